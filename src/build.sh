@@ -1,10 +1,12 @@
 #!/bin/sh
 
 rm -f test
+rm -f test_cpp
 rm -f memcacheclient.o
 rm -f libmemcacheclient.so.1.0.0
 rm -f libmemcacheclient.so
 gcc -c -g -fPIC -I./ memcacheclient.c
-gcc -shared -g -Wl,-soname,libmemcacheclient.so -o libmemcacheclient.so.1.0.0 memcacheclient.o
+gcc -shared -g -Wl,-soname,libmemcacheclient.so -o libmemcacheclient.so.1.0.0 memcacheclient.o -lpthread
 ln -s libmemcacheclient.so.1.0.0 libmemcacheclient.so
-gcc -g test.c -I./ -L./ -lmemcacheclient -o test
+gcc -g test.c -I./ -L./ -lmemcacheclient -lpthread -o test
+g++ -std=c++17 -g test.cpp -I./ -L./ -lmemcacheclient -lpthread -o test_cpp
@@ -1,6 +1,7 @@
 #!/bin/sh
 
 rm -f test
+rm -f test_cpp
 rm -f memcacheclient.o
 rm -f libmemcacheclient.so.1.0.0
 rm -f libmemcacheclient.so
@@ -4,27 +4,417 @@
  * @brief implements library functions defines in memcacheclient.h.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <limits.h>
 #include <resolv.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <sys/time.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#ifdef MCACHE_USDT
+#define _SDT_HAS_SEMAPHORES	1
+#include <sys/sdt.h>
+#endif
 
 #include "memcacheclient/memcacheclient.h"
 
 #define SELECT_TIMEOUT_SEC 0
 #define SELECT_TIMEOUT_USEC 50
 
-struct statInfo
+#define READER_BUFFER_SIZE	16 * 1024		///< initial size of response reader buffer
+#define READER_LINE_MAX		64 * 1024		///< longest response line accepted by reader
+#define SPLICE_CHUNK_SIZE	64 * 1024		///< bytes moved per splice(2) call
+#define RETRIEVAL_DROPPED	-1			///< retrievalFunc consumed value but could not keep it
+#define BATCH_DEPTH_MAX		16			///< upper bound of MemCacheServer.nBatchDepth
+#define BULK_HEADER_SIZE	MCACHE_KEY_MAX + 96	///< room for command line of one data in bulk commands
+#define POOL_CLASS_COUNT	12			///< size classes of MemCachePool, 32 bytes to 64KB
+#define POOL_CLASS_MIN		5			///< log2 of smallest size class of MemCachePool
+#define POOL_HEADER_SIZE	16			///< block header keeping size class, preserves 16 bytes alignment
+#define UPDATE_BACKOFF_USEC	1000			///< first backoff of MCACHE_DataUpdate retries
+#define UPDATE_BACKOFF_MAX_USEC	100 * 1000		///< upper bound of MCACHE_DataUpdate backoff
+#define COUNTER_SHARDS		16			///< shards of MemCacheCounter, picked by calling thread
+#define METER_SHARDS		8			///< shards of server metrics, picked by calling thread
+#define COUNTER_SLOTS_MIN	64			///< initial slots of a counter shard
+#define COUNTER_UNREAD		-1			///< status of delta whose reply was not read
+#define WRITER_BUCKETS_MIN	64			///< minimum hash buckets of MemCacheWriter
+#define HEDGE_MIN_SAMPLES	64			///< gets measured before hedge delay is derived from percentile
+#define HEDGE_HIST_DECAY	64 * 1024		///< latency histogram is halved once it holds this many samples
+#define HOTKEY_DECAY_USEC	1000 * 1000		///< counts of hot key tracker are halved once per this period
+#define NEGATIVE_WAYS		4			///< fingerprints per bucket of negative cache
+#define XXH_PRIME32_1		0x9E3779B1u
+#define XXH_PRIME32_2		0x85EBCA77u
+#define XXH_PRIME32_3		0xC2B2AE3Du
+#define XXH_PRIME64_1		0x9E3779B185EBCA87ull
+#define XXH_PRIME64_2		0xC2B2AE3D27D4EB4Full
+#define XXH_PRIME64_3		0x165667B19E3779F9ull
+#define XXH_PRIME64_4		0x85EBCA77C2B2AE63ull
+#define XXH_PRIME64_5		0x27D4EB2F165667C5ull
+#define XXH_PRIME_MX1		0x165667919E3779F9ull
+#define XXH_PRIME_MX2		0x9FB21C651E98DF25ull
+#define XXH_SECRET_SIZE		192			///< size of default secret of xxh3
+#define XXH_STRIPE_LEN		64
+
+/**
+ * find first of two delimiters in [pszBegin, pszEnd), NULL if none.
+ */
+typedef const char *(*scanFunc)(const char *pszBegin, const char *pszEnd, int nDelim1, int nDelim2);
+
+typedef uint32_t (*crcFunc)(uint32_t nCRC, const unsigned char *pData, size_t nDataLen);
+
+/**
+ * field of MemCacheStats filled from "STAT <name> <value>" line of "stats".
+ */
+struct statField
+{
+	const char *name;
+	size_t offset;
+	int type;		///< STAT_TYPE_*
+};
+
+enum
+{
+	STAT_TYPE_SIZE = 0,
+	STAT_TYPE_INT64,
+	STAT_TYPE_TIME,
+	STAT_TYPE_STRING
+};
+
+/**
+ * names and values of stats are gathered as "name\0value\0" in arena, then packed after array of MemCacheStatList.
+ */
+struct statArena
+{
+	char *buffer;
+	size_t size;
+	size_t len;
+	size_t count;
+};
+
+/**
+ * handler invoked by s_StatsRun for every "STAT <name> <value>" line, name and value are NUL terminated.
+ */
+typedef int (*statFunc)(const char *pszName, size_t nNameLen, const char *pszValue, size_t nValueLen, void *pArg);
+
+/**
+ * buffered reader over server socket. bytes in [begin, end) of buffer are received but not consumed yet.
+ */
+struct sockReader
+{
+	int fd;
+	int64_t deadline;	///< absolute time in microseconds
+	char *buffer;
+	size_t size;
+	size_t begin;
+	size_t end;
+	int owned;		///< buffer is allocated by reader
+	MemCacheServer *server;	///< server whose allocator owns buffer
+};
+
+struct fdTarget
+{
+	int fd;
+	int64_t deadline;
+};
+
+struct itemInfo
+{
+	MemCacheItemFunc hit;
+	void *arg;
+	int result;
+};
+
+struct updateInfo
+{
+	MemCacheItemFunc func;
+	void *arg;
+	MemCacheData *list;	///< working list, result of data i is stored into status[i]
+	int *status;
+};
+
+struct counterEntry
+{
+	char *key;		///< NULL for empty slot
+	uint32_t hash;
+	int64_t delta;
+};
+
+/**
+ * open addressing table of pending deltas, written by threads hashed to this shard.
+ */
+struct counterShard
+{
+	pthread_mutex_t lock;
+	struct counterEntry *slots;
+	size_t size;		///< power of 2
+	size_t count;
+};
+
+struct memCacheCounter
+{
+	MemCacheServer *server;
+	pthread_mutex_t flush_lock;	///< serializes flushes on server connection
+	size_t max_keys;
+	int64_t interval;		///< microseconds, 0 to disable
+	int64_t last_flush;
+	size_t pending;			///< keys in all shards
+	struct counterShard shards[COUNTER_SHARDS];
+};
+
+/**
+ * request metrics of a server, see MCACHE_ServerMetricsEnable. every thread updates counters of its own shard by
+ * relaxed atomics, shards are summed by MCACHE_ServerMetrics.
+ */
+struct meterShard
+{
+	MemCacheMetrics metrics;
+} __attribute__((aligned(64)));
+
+struct memCacheMeter
+{
+	struct meterShard shards[METER_SHARDS];
+};
+
+struct memCacheTracer
+{
+	MemCacheTraceFunc func;
+	void *context;
+};
+
+/**
+ * request of traced server in flight on calling thread, whose events carry its command and key.
+ */
+struct traceSpan
+{
+	MemCacheServer *server;	///< NULL if none
+	int op;
+	uint64_t hash;
+	size_t keys;
+	size_t received;	///< bytes of reply read so far
+};
+
+/**
+ * queued write of MemCacheWriter, key is stored right after the struct.
+ */
+struct writeItem
+{
+	struct writeItem *prev;
+	struct writeItem *next;
+	struct writeItem *hnext;	///< next item in hash bucket
+	uint32_t hash;
+	char *key;
+	void *value;
+	size_t len;
+	size_t flags;
+	size_t expiration;
+};
+
+struct memCacheWriter
+{
+	MemCacheServer *server;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		///< signaled to flusher for new items or stop
+	pthread_cond_t space;		///< signaled to writers once queue is taken by flusher
+	pthread_cond_t idle;		///< signaled once queue is empty and nothing is being sent
+	struct writeItem *head;		///< oldest item
+	struct writeItem *tail;
+	struct writeItem **buckets;
+	size_t mask;
+	size_t count;
+	size_t max_items;
+	int64_t linger;			///< microseconds to wait for more items before flushing
+	int flag;
+	int stop;
+	int busy;			///< flusher is sending items
+	int result;			///< first failure since last MCACHE_WriterFlush
+	size_t dropped;
+};
+
+/**
+ * synchronous call waiting in group of MemCacheServer, lives on stack of caller.
+ */
+struct groupCall
+{
+	MemCacheData *data;
+	int op;
+	uint64_t num;
+	int status;
+	int done;
+	struct groupCall *next;
+};
+
+/**
+ * group commit state of server, the first waiting caller becomes leader and sends calls of all others in one pipeline.
+ */
+struct memCacheGroup
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		///< signaled once calls are done or leader leaves
+	struct groupCall *head;
+	struct groupCall *tail;
+	size_t count;
+	int leader;			///< some caller is gathering or sending calls
+	int64_t window;			///< microseconds leader waits for more callers
+	size_t last_size;		///< calls sent by last leader, window is skipped after a lonely call
+};
+
+/**
+ * fingerprint of missing key and millisecond it was confirmed missing, 0 fingerprint for empty slot.
+ */
+struct negativeSlot
+{
+	uint32_t fp;
+	uint32_t stamp;
+};
+
+/**
+ * negative cache of server, a bucketed fingerprint table whose entries expire after ttl.
+ */
+struct memCacheNegative
+{
+	pthread_mutex_t lock;
+	struct negativeSlot *slots;	///< buckets * NEGATIVE_WAYS slots
+	size_t buckets;
+	uint32_t ttl;			///< milliseconds
+	int64_t base;			///< microseconds, origin of stamp
+	uint64_t epoch;			///< bumped by every invalidation
+};
+
+/**
+ * monitored key of Space-Saving sketch, count overestimates hits of key by at most error.
+ */
+struct hotCounter
+{
+	uint32_t hash;
+	uint64_t count;
+	uint64_t error;
+	char key[MCACHE_KEY_MAX + 1];
+};
+
+/**
+ * local copy of hot data, slot is picked by hash of key.
+ */
+struct hotPin
+{
+	char *key;		///< NULL for empty slot
+	void *value;
+	size_t len;
+	size_t flags;
+	int64_t expires;
+};
+
+struct memCacheHotKey
+{
+	pthread_mutex_t lock;
+	struct hotCounter *counters;
+	uint32_t *index;		///< position + 1 of counters by hash, 0 for empty slot
+	size_t mask;			///< index slots - 1, at least twice capacity
+	size_t capacity;
+	size_t used;
+	uint64_t threshold;
+	int64_t ttl;			///< microseconds
+	int64_t last_decay;
+	struct hotPin *pins;		///< capacity slots
+};
+
+/**
+ * free blocks of one size class of MemCachePool, linked through their headers.
+ */
+struct poolClass
+{
+	pthread_mutex_t lock;
+	void *free_list;
+	size_t cached;
+};
+
+struct memCachePool
+{
+	size_t max_cached;		///< free blocks kept per size class
+	struct poolClass classes[POOL_CLASS_COUNT];
+};
+
+struct streamInfo
+{
+	MemCacheStreamFunc func;
+	void *arg;
+	int fd;		///< splice into fd instead of calling func if not negative
+	int result;
+};
+
+/**
+ * hash index of keys of one retrieval command, offsets are relative to begin of command.
+ */
+struct keyIndex
+{
+	size_t mask;
+	uint32_t *slots;	///< 1 + offset of data, 0 for empty slot
+	uint32_t *hashes;	///< hash of key of each data
+	size_t *lens;		///< length of key of each data
+	const char **keys;	///< key of each data inside command line, caller may change its keys after prepare
+};
+
+/**
+ * one retrieval command covering data [begin, end) of list.
+ */
+struct retrievalBatch
+{
+	size_t begin;
+	size_t end;
+	char *cmd;
+	size_t cmd_len;
+	size_t sent;
+	struct keyIndex *index;	///< lookup of reply keys for prepared commands, NULL to search list
+};
+
+/**
+ * serialized retrieval commands of a key list, see MCACHE_DataPrepareGet.
+ */
+struct memCachePrepared
+{
+	int op;
+	size_t list_size;
+	size_t count;
+	struct retrievalBatch *batches;	///< commands and key indexes owned by prepared
+};
+
+/**
+ * handler invoked by s_DataRetrievalRun for every "VALUE" block, it must consume exactly pstMCData->nDataLen bytes from reader.
+ * RETRIEVAL_DROPPED tells value was consumed but could not be kept, see s_RetrievalParse.
+ */
+typedef int (*retrievalFunc)(struct sockReader *pstReader, MemCacheData *pstMCData, void *pArg);
+
+/**
+ * commands run by s_DataBulk, per data ops and nums take precedence over op and num if given.
+ */
+struct bulkRequest
 {
-	int idx;
-	char *value;
+	int op;
+	const int *ops;
+	uint64_t num;		///< delta of incr/decr, or time of delete
+	const uint64_t *nums;
+	uint64_t *results;	///< new values of incr/decr parsed without allocation if given, pDataValue is left as it is
+	int noreply;
+	retrievalFunc refetch;	///< if given, "gets" of key follows each command and value is handed to it for failed ones
+	void *refetch_arg;
+	char *refetched;	///< marked for data whose value was handed to refetch
 };
 
 enum
@@ -40,9 +430,22 @@ enum
 	MCACHE_OP_DELETE,
 	MCACHE_OP_INCREMENT,
 	MCACHE_OP_DECREMENT,
-	MCACHE_OP_STATS
+	MCACHE_OP_STATS,
+	MCACHE_OP_TOUCH,
+	MCACHE_OP_GAT,
+	MCACHE_OP_GATS
 };
 
+static int s_GroupRun(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nOpFlag, uint64_t nNum);
+static int s_RetrievalParse(struct sockReader *pstReader, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag,
+	const struct keyIndex *pstIndex, retrievalFunc pfnValue, void *pArg, char *pHit, size_t *pnFetched);
+static int s_RetrieveCopy(struct sockReader *pstReader, MemCacheData *pstMCData, void *pArg);
+static int s_BulkCommand(MemCacheData *pstMCData, int nOpFlag, uint64_t nNum, int nNoReply, char *pszBuffer,
+	size_t nBufferSize);
+static uint32_t s_CounterHash(const char *pKey, size_t nKeyLen);
+static size_t s_KeyLen(const MemCacheData *pstMCData);
+static uint64_t s_NegativeHash(const char *pKey, size_t nKeyLen);
+
 static int
 s_isSockReadable(int nSockFD, int nTimeoutSec, int nTimeoutUSec)
 {
@@ -366,976 +769,7233 @@ end:
 	return ret;
 }
 
-int
-s_ChkInput(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nOpFlag)
+static int64_t
+s_NowUSec(void)
 {
-	int ret = MCACHE_OK;
-
-	if (NULL == pstMCServer || NULL == pstMCData || 0 > pstMCServer->nSockFD ||
-		NULL == pstMCServer->pszServerAddr)
-		return MCACHE_ERR_INVAL;
+	struct timeval now;
 
-	switch (nOpFlag) {
-		case MCACHE_OP_SET:
-		case MCACHE_OP_ADD:
-		case MCACHE_OP_REPLACE:
-		case MCACHE_OP_APPEND:
-		case MCACHE_OP_PREPEND:
-			if (NULL == pstMCData->pszDataKey || NULL == pstMCData->pDataValue)
-				ret = MCACHE_ERR_INVAL;
-			
-			if (MCACHE_VALUE_MAX < pstMCData->nDataLen)
-				ret = MCACHE_ERR_INVAL;
-			break;
-		case MCACHE_OP_GET:
-		case MCACHE_OP_GETS:
-		case MCACHE_OP_INCREMENT:
-		case MCACHE_OP_DECREMENT:
-			if (NULL == pstMCData->pszDataKey)
-				ret = MCACHE_ERR_INVAL;
-			break;
-		default:
-			ret = MCACHE_ERR_INVAL;
-			break;
-	}
+	gettimeofday(&now, NULL);
 
-	return ret;
+	return (int64_t) now.tv_sec * 1000000 + now.tv_usec;
 }
 
-int
-s_DataManipulate(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nOpFlag)
+/**
+ * read at most nDataLen bytes from non-blocking socket, wait for readability until nDeadline if nothing is pending.
+ */
+static int
+s_SockReadSome(int nSockFD, void *pData, size_t nDataLen, size_t *pnReadNum, int64_t nDeadline)
 {
 	int ret = MCACHE_OK;
-	int buffer_size = MCACHE_VALUE_MAX + MCACHE_KEY_MAX * 2;
-	char buffer[MCACHE_VALUE_MAX + MCACHE_KEY_MAX * 2];
-	int timeout = 0;
-	int read_count = 0;
-	time_t check_time = 0;
+	ssize_t read_size = 0;
+	int64_t remain = 0;
 
-	switch (nOpFlag) {
-		case MCACHE_OP_SET:
-		case MCACHE_OP_ADD:
-		case MCACHE_OP_APPEND:
-		case MCACHE_OP_PREPEND:
-		case MCACHE_OP_REPLACE:
-		case MCACHE_OP_CAS:
-			ret = s_ChkInput(pstMCServer, pstMCData, nOpFlag);
-			break;
-		default:
-			ret = MCACHE_ERR_INVAL;
-			break;
-	}
+	while (1) {
+		read_size = read(nSockFD, pData, nDataLen);
 
-	if (MCACHE_OK != ret)
-		return ret;
+		if (0 < read_size) {
+			*pnReadNum = read_size;
+			return MCACHE_OK;
+		}
 
-	memset(buffer, 0, buffer_size);
-	if (MCACHE_OP_SET == nOpFlag) {
-		snprintf(buffer, buffer_size, "set %s %d %d %d\r\n", pstMCData->pszDataKey,
-			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen);
-	}
-	else if (MCACHE_OP_ADD == nOpFlag) {
-		snprintf(buffer, buffer_size, "add %s %d %d %d\r\n", pstMCData->pszDataKey,
-			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen);
-	}
-	else if (MCACHE_OP_APPEND == nOpFlag) {
-		snprintf(buffer, buffer_size, "append %s %d %d %d\r\n", pstMCData->pszDataKey,
-			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen);
-	}
-	else if (MCACHE_OP_PREPEND == nOpFlag) {
-		snprintf(buffer, buffer_size, "prepend %s %d %d %d\r\n", pstMCData->pszDataKey,
-			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen);
-	}
-	else if (MCACHE_OP_REPLACE == nOpFlag) {
-		snprintf(buffer, buffer_size, "replace %s %d %d %d\r\n", pstMCData->pszDataKey,
-			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen);
-	}
-	else if (MCACHE_OP_CAS == nOpFlag) {
-		snprintf(buffer, buffer_size, "cas %s %d %d %d %lld\r\n", pstMCData->pszDataKey,
-			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen, pstMCData->nCASUnique);
-	}
+		//peer closed connection
+		if (0 == read_size)
+			return MCACHE_ERR_NET;
 
-	timeout = pstMCServer->nTimeout;
-	check_time = time(NULL);
+		if (EINTR == errno)
+			continue;
 
-	if (MCACHE_OK == (ret = s_SockWrite(pstMCServer->nSockFD, buffer, strlen(buffer), timeout))) {
-		timeout -= time(NULL) - check_time;
-		memset(buffer, 0, buffer_size);
-
-		if (MCACHE_OK == (ret = s_SockWrite(pstMCServer->nSockFD, pstMCData->pDataValue, pstMCData->nDataLen, timeout)) &&
-			MCACHE_OK ==(ret = s_SockWrite(pstMCServer->nSockFD, "\r\n", 2, timeout))) {
-
-			if (MCACHE_OK == (ret = s_SockRead(pstMCServer->nSockFD, buffer, buffer_size, &read_count, timeout))) {
-				if (0 == strncmp(buffer, "STORED\r\n", 8))
-					ret = MCACHE_OK;
-				else if (0 == strncmp(buffer, "ERROR\r\n", 7) || buffer == strstr(buffer, "CLIENT_ERROR"))
-					ret = MCACHE_ERR_ERROR;
-				else if (0 == strncmp(buffer, "EXISTS\r\n", 8))
-					ret = MCACHE_ERR_EXISTS;
-				else if (0 == strncmp(buffer, "NOT_STORED\r\n", 12))
-					ret = MCACHE_ERR_NOT_STORED;
-				else
-					ret = MCACHE_ERR_DATA;
-			}
-		}
-		
-	}
+		if (EAGAIN != errno && EWOULDBLOCK != errno)
+			return MCACHE_ERR_NET;
 
-end:
+		if (0 >= (remain = nDeadline - s_NowUSec()))
+			return MCACHE_ERR_TIMEOUT;
 
-	return ret;
+		if (MCACHE_OK != (ret = s_isSockReadable(nSockFD, remain / 1000000, remain % 1000000)))
+			return ret;
+	}
 }
 
-static int
-s_DataCalculate(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum, int nOpFlag)
+/**
+ * scalar kernel of s_Scan, also used for tails of vector kernels.
+ */
+static const char *
+s_ScanScalar(const char *pszBegin, const char *pszEnd, int nDelim1, int nDelim2)
 {
-	int ret = MCACHE_OK;
-	int read_count = 0;
-	char buffer[MCACHE_VALUE_MAX];
-	size_t timeout = 0;
-	time_t check_time = 0;
-
-	switch (nOpFlag) {
-		case MCACHE_OP_INCREMENT:
-		case MCACHE_OP_DECREMENT:
-			ret = s_ChkInput(pstMCServer, pstMCData, nOpFlag);
-			break;
-		default:
-			ret = MCACHE_ERR_INVAL;
-			break;
+	for (; pszBegin < pszEnd; pszBegin++) {
+		if (nDelim1 == *pszBegin || nDelim2 == *pszBegin)
+			return pszBegin;
 	}
 
-	if (MCACHE_OK != ret)
-		return ret;
+	return NULL;
+}
 
-	memset(buffer, 0, MCACHE_VALUE_MAX);
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static const char *
+s_ScanSSE2(const char *pszBegin, const char *pszEnd, int nDelim1, int nDelim2)
+{
+	__m128i delim1 = _mm_set1_epi8((char) nDelim1);
+	__m128i delim2 = _mm_set1_epi8((char) nDelim2);
 
-	if (MCACHE_OP_INCREMENT == nOpFlag)
-		snprintf(buffer, MCACHE_VALUE_MAX - 1, "incr %s %d\r\n", pstMCData->pszDataKey, nNum);
-	else if (MCACHE_OP_DECREMENT == nOpFlag)
-		snprintf(buffer, MCACHE_VALUE_MAX - 1, "decr %s %d\r\n", pstMCData->pszDataKey, nNum);
+	for (; pszBegin + 16 <= pszEnd; pszBegin += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *) pszBegin);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, delim1), _mm_cmpeq_epi8(chunk, delim2)));
 
-	timeout = pstMCServer->nTimeout;
-	check_time = time(NULL);
+		if (0 != mask)
+			return pszBegin + __builtin_ctz(mask);
+	}
 
-	if (MCACHE_OK == (ret = s_SockWrite(pstMCServer->nSockFD, buffer, strlen(buffer), timeout))) {
-		timeout -= time(NULL) - check_time;
-		memset(buffer, 0, MCACHE_VALUE_MAX);
-
-		if (MCACHE_OK == (ret = s_SockRead(pstMCServer->nSockFD, buffer, MCACHE_VALUE_MAX - 1, &read_count, timeout))) {
-			char *tmp = NULL;
-			if (buffer == strstr(buffer, "CLIENT_ERROR"))
-				ret = MCACHE_ERR_ERROR;
-			else if (NULL == (tmp = strstr(buffer, "\r\n"))) {
-				ret = MCACHE_ERR_DATA;
-			}
-			else {
-				*tmp = '\0';
+	return s_ScanScalar(pszBegin, pszEnd, nDelim1, nDelim2);
+}
 
-				if (NULL == (tmp = strdup(buffer))) {
-					ret = MCACHE_ERR_NOMEM;
-					goto end;
-				}
-				
-				if (MCACHE_FLAG_FREE_VALUE == (pstMCServer->nFlag & MCACHE_FLAG_FREE_VALUE) && NULL != pstMCData->pDataValue) {
-					free(pstMCData->pDataValue);
-				}
+__attribute__((target("avx2")))
+static const char *
+s_ScanAVX2(const char *pszBegin, const char *pszEnd, int nDelim1, int nDelim2)
+{
+	__m256i delim1 = _mm256_set1_epi8((char) nDelim1);
+	__m256i delim2 = _mm256_set1_epi8((char) nDelim2);
 
-				pstMCData->pDataValue = (void *) tmp;
-				ret = MCACHE_OK;
-			}
-		}
-	}
+	for (; pszBegin + 32 <= pszEnd; pszBegin += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *) pszBegin);
+		unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, delim1),
+			_mm256_cmpeq_epi8(chunk, delim2)));
 
-end:
+		if (0 != mask)
+			return pszBegin + __builtin_ctz(mask);
+	}
 
-	return ret;
+	return s_ScanSSE2(pszBegin, pszEnd, nDelim1, nDelim2);
 }
+#endif
 
-static int
-s_GetDataByKey(MemCacheData *pstDataList, size_t nListSize, const char *pszKey)
-{
-	int i = 0;
-	int idx = -1;
+static const char *s_ScanInit(const char *pszBegin, const char *pszEnd, int nDelim1, int nDelim2);
 
-	if (NULL == pstDataList || 0 == nListSize || NULL == pszKey)
-		return -1;
+static scanFunc s_pfnScan = s_ScanInit;
 
-	for (i = 0; i < nListSize; i++) {
-		if (NULL == (pstDataList + i) || NULL == pstDataList[i].pszDataKey)
-			continue;
+/**
+ * pick widest kernel supported by running cpu on first call.
+ */
+static const char *
+s_ScanInit(const char *pszBegin, const char *pszEnd, int nDelim1, int nDelim2)
+{
+	scanFunc scan = s_ScanScalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		scan = s_ScanAVX2;
+	else if (__builtin_cpu_supports("sse2"))
+		scan = s_ScanSSE2;
+#endif
+
+	__atomic_store_n(&s_pfnScan, scan, __ATOMIC_RELAXED);
+
+	return scan(pszBegin, pszEnd, nDelim1, nDelim2);
+}
+
+/**
+ * find first of nDelim1 or nDelim2 (may be equal) in [pszBegin, pszEnd), NULL if none.
+ */
+static char *
+s_Scan(const char *pszBegin, const char *pszEnd, int nDelim1, int nDelim2)
+{
+	return (char *) __atomic_load_n(&s_pfnScan, __ATOMIC_RELAXED)(pszBegin, pszEnd, nDelim1, nDelim2);
+}
+
+/**
+ * well mixed id of calling thread, for picking shards.
+ */
+static uint64_t
+s_ThreadHash(void)
+{
+	uint64_t id = (uint64_t) (uintptr_t) pthread_self();
+
+	id ^= id >> 33;
+	id *= 0xff51afd7ed558ccdULL;
+	id ^= id >> 33;
+
+	return id;
+}
+
+static __thread struct traceSpan s_stTraceSpan;
+
+#ifdef MCACHE_USDT
+/**
+ * semaphore of each probe, raised by tracing tools while probe is attached.
+ */
+#define TRACE_SEMAPHORE(name)	unsigned short mcache_##name##_semaphore \
+	__attribute__((unused, section(".probes"), visibility("hidden")))
+
+TRACE_SEMAPHORE(enqueue);
+TRACE_SEMAPHORE(write__start);
+TRACE_SEMAPHORE(write__end);
+TRACE_SEMAPHORE(first__byte);
+TRACE_SEMAPHORE(parse__done);
+TRACE_SEMAPHORE(callback);
+
+#undef TRACE_SEMAPHORE
+#endif
+
+/**
+ * whether events of server are to be emitted, for its tracer or for USDT probes attached by now.
+ */
+static int
+s_TraceOn(const MemCacheServer *pstMCServer)
+{
+#ifdef MCACHE_USDT
+	if (0 != (mcache_enqueue_semaphore | mcache_write__start_semaphore | mcache_write__end_semaphore |
+		mcache_first__byte_semaphore | mcache_parse__done_semaphore | mcache_callback_semaphore))
+		return 1;
+#endif
+
+	return NULL != pstMCServer->pstTracer;
+}
+
+static uint64_t
+s_TraceHash(const MemCacheData *pstMCData)
+{
+	if (NULL == pstMCData || NULL == pstMCData->pszDataKey)
+		return 0;
+
+	return s_NegativeHash(pstMCData->pszDataKey, s_KeyLen(pstMCData));
+}
+
+/**
+ * fire USDT probe and trace callback of server for nEvent.
+ */
+static void
+s_TraceEmit(MemCacheServer *pstMCServer, int nEvent, int nOpFlag, uint64_t nHash, size_t nKeys, size_t nBytes,
+	int nResult)
+{
+	MemCacheTraceEvent event;
+	struct memCacheTracer *tracer = pstMCServer->pstTracer;
+
+#ifdef MCACHE_USDT
+#define TRACE_PROBE(name)	DTRACE_PROBE7(mcache, name, pstMCServer->pszServerAddr, pstMCServer->nPort, nOpFlag, \
+	nHash, nKeys, nBytes, nResult)
+
+	switch (nEvent) {
+		case MCACHE_TRACE_ENQUEUE:
+			TRACE_PROBE(enqueue);
+			break;
+		case MCACHE_TRACE_WRITE_START:
+			TRACE_PROBE(write__start);
+			break;
+		case MCACHE_TRACE_WRITE_END:
+			TRACE_PROBE(write__end);
+			break;
+		case MCACHE_TRACE_FIRST_BYTE:
+			TRACE_PROBE(first__byte);
+			break;
+		case MCACHE_TRACE_PARSE_DONE:
+			TRACE_PROBE(parse__done);
+			break;
+		case MCACHE_TRACE_CALLBACK:
+			TRACE_PROBE(callback);
+			break;
+	}
+
+#undef TRACE_PROBE
+#endif
+
+	if (NULL == tracer)
+		return;
+
+	event.nEvent = nEvent;
+	event.nOp = nOpFlag;
+	event.nResult = nResult;
+	event.nKeyHash = nHash;
+	event.nKeys = nKeys;
+	event.nBytes = nBytes;
+	event.nTime = s_NowUSec();
+
+	tracer->func(pstMCServer, &event, tracer->context);
+}
+
+/**
+ * emit write event of request in flight, nBytes is count of bytes written by request so far.
+ */
+static void
+s_TraceWrite(MemCacheServer *pstMCServer, int nEvent, size_t nBytes)
+{
+	struct traceSpan *span = &s_stTraceSpan;
+
+	if (s_TraceOn(pstMCServer) && pstMCServer == span->server)
+		s_TraceEmit(pstMCServer, nEvent, span->op, span->hash, span->keys, nBytes, MCACHE_OK);
+}
+
+/**
+ * emit event for fetched data about to be handed to callback of caller.
+ */
+static void
+s_TraceCallback(MemCacheServer *pstMCServer, const MemCacheData *pstMCData)
+{
+	struct traceSpan *span = &s_stTraceSpan;
+
+	if (s_TraceOn(pstMCServer) && pstMCServer == span->server)
+		s_TraceEmit(pstMCServer, MCACHE_TRACE_CALLBACK, span->op, s_TraceHash(pstMCData), 1, pstMCData->nDataLen,
+			MCACHE_OK);
+}
+
+/**
+ * count bytes received from server in its metrics, and trace first bytes of reply to request in flight.
+ */
+static void
+s_ServerReceived(MemCacheServer *pstMCServer, size_t nBytes)
+{
+	struct memCacheMeter *meter = pstMCServer->pstMeter;
+	struct traceSpan *span = &s_stTraceSpan;
+
+	if (NULL != meter)
+		__atomic_add_fetch(&meter->shards[s_ThreadHash() % METER_SHARDS].metrics.nBytesReceived, nBytes,
+			__ATOMIC_RELAXED);
+
+	if (s_TraceOn(pstMCServer) && pstMCServer == span->server && 0 < nBytes) {
+		if (0 == span->received)
+			s_TraceEmit(pstMCServer, MCACHE_TRACE_FIRST_BYTE, span->op, span->hash, span->keys, nBytes, MCACHE_OK);
+
+		span->received += nBytes;
+	}
+}
+
+/**
+ * allocate nSize bytes by allocator of server, values handed to caller and reply buffers are allocated so.
+ */
+static void *
+s_Alloc(MemCacheServer *pstMCServer, size_t nSize)
+{
+	if (NULL != pstMCServer->stAllocator.pfnAlloc)
+		return pstMCServer->stAllocator.pfnAlloc(nSize, pstMCServer->stAllocator.pContext);
+
+	return malloc(nSize);
+}
+
+static void
+s_Free(MemCacheServer *pstMCServer, void *pPtr)
+{
+	if (NULL != pstMCServer->stAllocator.pfnFree)
+		pstMCServer->stAllocator.pfnFree(pPtr, pstMCServer->stAllocator.pContext);
+	else
+		free(pPtr);
+}
+
+/**
+ * initialize reader on pBuffer (e.g. on stack for short replies), or on buffer allocated by server if pBuffer is
+ * NULL. pBuffer is replaced by an allocated one once more room is needed.
+ */
+static int
+s_ReaderInit(struct sockReader *pstReader, MemCacheServer *pstMCServer, int nTimeout, char *pBuffer,
+	size_t nBufferSize)
+{
+	memset(pstReader, 0, sizeof(struct sockReader));
+	pstReader->server = pstMCServer;
+
+	if (NULL == pBuffer) {
+		if (NULL == (pBuffer = (char *) s_Alloc(pstMCServer, READER_BUFFER_SIZE)))
+			return MCACHE_ERR_NOMEM;
+
+		nBufferSize = READER_BUFFER_SIZE;
+		pstReader->owned = 1;
+	}
+
+	pstReader->fd = pstMCServer->nSockFD;
+	pstReader->buffer = pBuffer;
+	pstReader->size = nBufferSize;
+	pstReader->deadline = s_NowUSec() + (int64_t) nTimeout * 1000000;
+
+	return MCACHE_OK;
+}
+
+static void
+s_ReaderFree(struct sockReader *pstReader)
+{
+	if (NULL != pstReader->buffer && pstReader->owned)
+		s_Free(pstReader->server, pstReader->buffer);
+
+	pstReader->buffer = NULL;
+}
+
+/**
+ * make room for nDataLen bytes counted from begin, buffer is compacted or enlarged as needed.
+ */
+static int
+s_ReaderReserve(struct sockReader *pstReader, size_t nDataLen)
+{
+	char *tmp = NULL;
+	size_t size = pstReader->size;
+
+	if (pstReader->begin == pstReader->end)
+		pstReader->begin = pstReader->end = 0;
+
+	if (pstReader->begin + nDataLen <= pstReader->size)
+		return MCACHE_OK;
+
+	if (0 < pstReader->begin) {
+		memmove(pstReader->buffer, pstReader->buffer + pstReader->begin, pstReader->end - pstReader->begin);
+		pstReader->end -= pstReader->begin;
+		pstReader->begin = 0;
+	}
+
+	if (nDataLen <= pstReader->size)
+		return MCACHE_OK;
+
+	while (size < nDataLen)
+		size *= 2;
+
+	//allocator has no realloc, buffer was compacted above so only end bytes are copied
+	if (NULL == (tmp = (char *) s_Alloc(pstReader->server, size)))
+		return MCACHE_ERR_NOMEM;
+
+	memcpy(tmp, pstReader->buffer, pstReader->end);
+
+	if (pstReader->owned)
+		s_Free(pstReader->server, pstReader->buffer);
+
+	pstReader->owned = 1;
+
+	pstReader->buffer = tmp;
+	pstReader->size = size;
+
+	return MCACHE_OK;
+}
+
+static int
+s_ReaderFill(struct sockReader *pstReader)
+{
+	int ret = MCACHE_OK;
+	size_t read_count = 0;
+
+	if (pstReader->end == pstReader->size &&
+		MCACHE_OK != (ret = s_ReaderReserve(pstReader, pstReader->end - pstReader->begin + 1)))
+		return ret;
+
+	ret = s_SockReadSome(pstReader->fd, pstReader->buffer + pstReader->end, pstReader->size - pstReader->end,
+		&read_count, pstReader->deadline);
+
+	if (MCACHE_OK == ret) {
+		pstReader->end += read_count;
+		s_ServerReceived(pstReader->server, read_count);
+	}
+
+	return ret;
+}
+
+/**
+ * fetch next line terminated by "\r\n", terminator is replaced by '\0' and excluded from *pnLen.
+ */
+static int
+s_ReaderLine(struct sockReader *pstReader, char **ppszLine, size_t *pnLen)
+{
+	int ret = MCACHE_OK;
+	size_t scanned = 0;
+	char *line = NULL;
+	char *eol = NULL;
+
+	while (1) {
+		line = pstReader->buffer + pstReader->begin;
+
+		if (NULL != (eol = s_Scan(line + scanned, pstReader->buffer + pstReader->end, '\n', '\n'))) {
+			if (eol == line || '\r' != *(eol - 1))
+				return MCACHE_ERR_DATA;
+
+			*(eol - 1) = '\0';
+			*ppszLine = line;
+			*pnLen = eol - 1 - line;
+			pstReader->begin = eol + 1 - pstReader->buffer;
+
+			return MCACHE_OK;
+		}
+
+		scanned = pstReader->end - pstReader->begin;
+
+		if (READER_LINE_MAX <= scanned)
+			return MCACHE_ERR_DATA;
+
+		if (MCACHE_OK != (ret = s_ReaderFill(pstReader)))
+			return ret;
+	}
+}
+
+/**
+ * make sure at least nDataLen bytes are buffered contiguously from begin.
+ */
+static int
+s_ReaderEnsure(struct sockReader *pstReader, size_t nDataLen)
+{
+	int ret = MCACHE_OK;
+
+	if (MCACHE_OK != (ret = s_ReaderReserve(pstReader, nDataLen)))
+		return ret;
+
+	while (pstReader->end - pstReader->begin < nDataLen) {
+		if (MCACHE_OK != (ret = s_ReaderFill(pstReader)))
+			return ret;
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * consume "\r\n" trailing each data block.
+ */
+static int
+s_ReaderEndOfData(struct sockReader *pstReader)
+{
+	int ret = MCACHE_OK;
+
+	if (MCACHE_OK != (ret = s_ReaderEnsure(pstReader, 2)))
+		return ret;
+
+	if ('\r' != pstReader->buffer[pstReader->begin] || '\n' != pstReader->buffer[pstReader->begin + 1])
+		return MCACHE_ERR_DATA;
+
+	pstReader->begin += 2;
+
+	return MCACHE_OK;
+}
+
+/**
+ * copy nDataLen bytes into pData, bytes not buffered yet are read from socket into pData directly.
+ */
+static int
+s_ReaderCopy(struct sockReader *pstReader, void *pData, size_t nDataLen)
+{
+	int ret = MCACHE_OK;
+	size_t copied = pstReader->end - pstReader->begin;
+	size_t read_count = 0;
+
+	if (copied > nDataLen)
+		copied = nDataLen;
+
+	memcpy(pData, pstReader->buffer + pstReader->begin, copied);
+	pstReader->begin += copied;
+
+	while (copied < nDataLen) {
+		if (MCACHE_OK != (ret = s_SockReadSome(pstReader->fd, (char *) pData + copied, nDataLen - copied,
+			&read_count, pstReader->deadline)))
+			return ret;
+
+		copied += read_count;
+		s_ServerReceived(pstReader->server, read_count);
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * deliver nDataLen bytes to pfnStream chunk by chunk as they arrive, NULL pfnStream discards them.
+ * once pfnStream fails its error is kept in *pnResult and remaining bytes are discarded to keep connection in sync.
+ */
+static int
+s_ReaderStream(struct sockReader *pstReader, MemCacheData *pstMCData, size_t nDataLen,
+	MemCacheStreamFunc pfnStream, void *pArg, int *pnResult)
+{
+	int ret = MCACHE_OK;
+	size_t offset = 0;
+	size_t chunk_size = 0;
+
+	while (offset < nDataLen) {
+		if (pstReader->begin == pstReader->end) {
+			pstReader->begin = pstReader->end = 0;
+
+			if (MCACHE_OK != (ret = s_ReaderFill(pstReader)))
+				return ret;
+		}
+
+		chunk_size = pstReader->end - pstReader->begin;
+		if (chunk_size > nDataLen - offset)
+			chunk_size = nDataLen - offset;
+
+		if (NULL != pfnStream && NULL != pnResult && MCACHE_OK == *pnResult)
+			*pnResult = pfnStream(pstMCData, offset, pstReader->buffer + pstReader->begin, chunk_size, pArg);
+
+		pstReader->begin += chunk_size;
+		offset += chunk_size;
+	}
+
+	return MCACHE_OK;
+}
+
+static int
+s_FDWrite(int nFD, const void *pData, size_t nDataLen, int64_t nDeadline)
+{
+	int ret = MCACHE_OK;
+	ssize_t sent_size = 0;
+	size_t sent_count = 0;
+	int64_t remain = 0;
+
+	while (sent_count < nDataLen) {
+		sent_size = write(nFD, (const char *) pData + sent_count, nDataLen - sent_count);
+
+		if (0 < sent_size) {
+			sent_count += sent_size;
+			continue;
+		}
+
+		if (0 > sent_size && EINTR == errno)
+			continue;
+
+		if (0 == sent_size || (EAGAIN != errno && EWOULDBLOCK != errno))
+			return MCACHE_ERR_IO;
+
+		if (0 >= (remain = nDeadline - s_NowUSec()))
+			return MCACHE_ERR_TIMEOUT;
+
+		if (MCACHE_OK != (ret = s_isSockWritable(nFD, remain / 1000000, remain % 1000000)))
+			return ret;
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * write as much as socket accepts without blocking, *pnSentNum could be 0.
+ */
+static int
+s_SockWriteSome(int nSockFD, const void *pData, size_t nDataLen, size_t *pnSentNum)
+{
+	ssize_t sent_size = 0;
+
+	*pnSentNum = 0;
+
+	while (*pnSentNum < nDataLen) {
+		sent_size = write(nSockFD, (const char *) pData + *pnSentNum, nDataLen - *pnSentNum);
+
+		if (0 < sent_size) {
+			*pnSentNum += sent_size;
+			continue;
+		}
+
+		if (0 > sent_size && EINTR == errno)
+			continue;
+
+		if (0 > sent_size && (EAGAIN == errno || EWOULDBLOCK == errno))
+			break;
+
+		return MCACHE_ERR_NET;
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * write all iovecs to socket, pstIOV is advanced in place over partial writes.
+ */
+static int
+s_SockWritev(int nSockFD, struct iovec *pstIOV, int nIOVCount, int nTimeout)
+{
+	int ret = MCACHE_OK;
+	ssize_t sent_size = 0;
+	int64_t deadline = s_NowUSec() + (int64_t) nTimeout * 1000000;
+	int64_t remain = 0;
+
+	while (0 < nIOVCount) {
+		sent_size = writev(nSockFD, pstIOV, IOV_MAX < nIOVCount ? IOV_MAX : nIOVCount);
+
+		if (0 > sent_size) {
+			if (EINTR == errno)
+				continue;
+
+			if (EAGAIN != errno && EWOULDBLOCK != errno)
+				return MCACHE_ERR_NET;
+
+			if (0 >= (remain = deadline - s_NowUSec()))
+				return MCACHE_ERR_TIMEOUT;
+
+			if (MCACHE_OK != (ret = s_isSockWritable(nSockFD, remain / 1000000, remain % 1000000)))
+				return ret;
+
+			continue;
+		}
+
+		while (0 < nIOVCount && (size_t) sent_size >= pstIOV->iov_len) {
+			sent_size -= pstIOV->iov_len;
+			pstIOV++;
+			nIOVCount--;
+		}
+
+		if (0 < nIOVCount) {
+			pstIOV->iov_base = (char *) pstIOV->iov_base + sent_size;
+			pstIOV->iov_len -= sent_size;
+		}
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * send nDataLen bytes of nFD starting at nOffset to socket by sendfile(2), or by copying if nFD does not support it.
+ */
+static int
+s_SockSendFile(int nSockFD, int nFD, off_t nOffset, size_t nDataLen, int64_t nDeadline)
+{
+	int ret = MCACHE_OK;
+	ssize_t sent_size = 0;
+	int64_t remain = 0;
+	char chunk[4096];
+
+	while (0 < nDataLen) {
+		sent_size = sendfile(nSockFD, nFD, &nOffset, nDataLen);
+
+		if (0 < sent_size) {
+			nDataLen -= sent_size;
+			continue;
+		}
+
+		//file is shorter than expected
+		if (0 == sent_size)
+			return MCACHE_ERR_IO;
+
+		if (EINTR == errno)
+			continue;
+
+		if (EAGAIN == errno || EWOULDBLOCK == errno) {
+			if (0 >= (remain = nDeadline - s_NowUSec()))
+				return MCACHE_ERR_TIMEOUT;
+
+			if (MCACHE_OK != (ret = s_isSockWritable(nSockFD, remain / 1000000, remain % 1000000)))
+				return ret;
+
+			continue;
+		}
+
+		if (EINVAL != errno && ENOSYS != errno && ESPIPE != errno)
+			return MCACHE_ERR_IO;
+
+		break;
+	}
+
+	while (0 < nDataLen) {
+		sent_size = pread(nFD, chunk, sizeof(chunk) < nDataLen ? sizeof(chunk) : nDataLen, nOffset);
+
+		//pipes and sockets are read from current position
+		if (0 > sent_size && ESPIPE == errno)
+			sent_size = read(nFD, chunk, sizeof(chunk) < nDataLen ? sizeof(chunk) : nDataLen);
+
+		if (0 > sent_size && EINTR == errno)
+			continue;
+
+		if (0 >= sent_size)
+			return MCACHE_ERR_IO;
+
+		if (MCACHE_OK != (ret = s_FDWrite(nSockFD, chunk, sent_size, nDeadline)))
+			return MCACHE_ERR_IO == ret ? MCACHE_ERR_NET : ret;
+
+		nOffset += sent_size;
+		nDataLen -= sent_size;
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * hold back partial frames on socket until uncorked, so that command pieces go out in the same segments.
+ */
+static void
+s_SockCork(int nSockFD, int nCork)
+{
+#ifdef TCP_CORK
+	setsockopt(nSockFD, IPPROTO_TCP, TCP_CORK, &nCork, sizeof(nCork));
+#endif
+}
+
+static int
+s_StreamToFD(MemCacheData *pstMCData, size_t nOffset, const void *pChunk, size_t nChunkLen, void *pArg)
+{
+	struct fdTarget *target = (struct fdTarget *) pArg;
+
+	(void) pstMCData;
+	(void) nOffset;
+
+	return s_FDWrite(target->fd, pChunk, nChunkLen, target->deadline);
+}
+
+#ifdef SPLICE_F_MOVE
+/**
+ * move up to *pnDataLen bytes from socket to nFD through a pipe, without copying into user space.
+ * *pnDataLen is decreased by bytes taken from socket. MCACHE_ERR_INVAL means nothing was moved since
+ * splice(2) is not supported by given descriptors.
+ */
+static int
+s_SockSplice(int nSockFD, int nFD, size_t *pnDataLen, int64_t nDeadline, int *pnResult)
+{
+	int ret = MCACHE_OK;
+	int pipe_fd[2];
+	ssize_t moved = 0;
+	size_t in_pipe = 0;
+	size_t total = 0;
+	int64_t remain = 0;
+
+	if (0 != pipe(pipe_fd))
+		return MCACHE_ERR_INVAL;
+
+	while (0 < *pnDataLen) {
+		moved = splice(nSockFD, NULL, pipe_fd[1], NULL,
+			*pnDataLen < SPLICE_CHUNK_SIZE ? *pnDataLen : SPLICE_CHUNK_SIZE,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+		if (0 == moved) {
+			ret = MCACHE_ERR_NET;
+			break;
+		}
+
+		if (0 > moved) {
+			if (EINTR == errno)
+				continue;
+
+			if (EAGAIN != errno && EWOULDBLOCK != errno) {
+				ret = (0 == total) ? MCACHE_ERR_INVAL : MCACHE_ERR_NET;
+				break;
+			}
+
+			if (0 >= (remain = nDeadline - s_NowUSec())) {
+				ret = MCACHE_ERR_TIMEOUT;
+				break;
+			}
+
+			if (MCACHE_OK != (ret = s_isSockReadable(nSockFD, remain / 1000000, remain % 1000000)))
+				break;
+
+			continue;
+		}
+
+		*pnDataLen -= moved;
+		in_pipe = moved;
+
+		while (0 < in_pipe && MCACHE_OK == *pnResult) {
+			moved = splice(pipe_fd[0], NULL, nFD, NULL, in_pipe, SPLICE_F_MOVE);
+
+			if (0 < moved) {
+				in_pipe -= moved;
+				total += moved;
+				continue;
+			}
+
+			if (0 > moved && EINTR == errno)
+				continue;
+
+			if (0 > moved && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+				remain = nDeadline - s_NowUSec();
+
+				if (0 < remain && MCACHE_OK == s_isSockWritable(nFD, remain / 1000000, remain % 1000000))
+					continue;
+
+				*pnResult = MCACHE_ERR_TIMEOUT;
+			}
+			else if (0 > moved && EINVAL == errno && 0 == total) {
+				//target does not support splice, bytes already in pipe are copied out by caller
+				*pnResult = MCACHE_ERR_INVAL;
+			}
+			else {
+				*pnResult = MCACHE_ERR_IO;
+			}
+		}
+
+		if (MCACHE_ERR_INVAL == *pnResult) {
+			char chunk[4096];
+			ssize_t read_size = 0;
+
+			*pnResult = MCACHE_OK;
+			while (0 < in_pipe && MCACHE_OK == *pnResult) {
+				if (0 >= (read_size = read(pipe_fd[0], chunk, sizeof(chunk) < in_pipe ? sizeof(chunk) : in_pipe))) {
+					*pnResult = MCACHE_ERR_IO;
+					break;
+				}
+
+				in_pipe -= read_size;
+				*pnResult = s_FDWrite(nFD, chunk, read_size, nDeadline);
+			}
+
+			ret = MCACHE_ERR_INVAL;
+			break;
+		}
+
+		//output failed, leave remaining bytes to be discarded by caller
+		if (MCACHE_OK != *pnResult)
+			break;
+	}
+
+	close(pipe_fd[0]);
+	close(pipe_fd[1]);
+
+	return ret;
+}
+#endif
+
+/**
+ * move nDataLen bytes from socket into nFD.
+ * buffered bytes are written directly, the rest is spliced without copying into user space if possible.
+ * failures of nFD are kept in *pnResult, and remaining bytes are discarded to keep connection in sync.
+ */
+static int
+s_ReaderSplice(struct sockReader *pstReader, MemCacheData *pstMCData, size_t nDataLen, int nFD, int *pnResult)
+{
+	int ret = MCACHE_OK;
+	size_t chunk_size = pstReader->end - pstReader->begin;
+	struct fdTarget target;
+
+	if (chunk_size > nDataLen)
+		chunk_size = nDataLen;
+
+	if (0 < chunk_size) {
+		*pnResult = s_FDWrite(nFD, pstReader->buffer + pstReader->begin, chunk_size, pstReader->deadline);
+		pstReader->begin += chunk_size;
+		nDataLen -= chunk_size;
+	}
+
+#ifdef SPLICE_F_MOVE
+	if (0 < nDataLen && MCACHE_OK == *pnResult) {
+		ret = s_SockSplice(pstReader->fd, nFD, &nDataLen, pstReader->deadline, pnResult);
+
+		if (MCACHE_OK != ret && MCACHE_ERR_INVAL != ret)
+			return ret;
+	}
+#endif
+
+	target.fd = nFD;
+	target.deadline = pstReader->deadline;
+
+	return s_ReaderStream(pstReader, pstMCData, nDataLen, MCACHE_OK == *pnResult ? s_StreamToFD : NULL, &target, pnResult);
+}
+
+/**
+ * histogram bucket of nLatency microseconds, every power of two is split into 4 buckets.
+ */
+static size_t
+s_MeterBucket(int64_t nLatency)
+{
+	int exp = 0;
+	size_t bucket = 0;
+
+	if (4 > nLatency)
+		return 0 > nLatency ? 0 : nLatency;
+
+	exp = 63 - __builtin_clzll((uint64_t) nLatency);
+	bucket = (exp - 1) * 4 + ((nLatency >> (exp - 2)) & 3);
+
+	return MCACHE_METRIC_BUCKETS > bucket ? bucket : MCACHE_METRIC_BUCKETS - 1;
+}
+
+/**
+ * mark start of a request of nOpFlag carrying nKeys data from pstMCData on server, see s_ServerLeave.
+ * request becomes the one traced on calling thread.
+ */
+static int64_t
+s_ServerEnter(MemCacheServer *pstMCServer, int nOpFlag, const MemCacheData *pstMCData, size_t nKeys)
+{
+	__atomic_add_fetch(&pstMCServer->nInflight, 1, __ATOMIC_RELAXED);
+
+	if (s_TraceOn(pstMCServer)) {
+		s_stTraceSpan.server = pstMCServer;
+		s_stTraceSpan.op = nOpFlag;
+		s_stTraceSpan.hash = s_TraceHash(pstMCData);
+		s_stTraceSpan.keys = nKeys;
+		s_stTraceSpan.received = 0;
+	}
+
+	return s_NowUSec();
+}
+
+/**
+ * mark end of a request of nOpFlag started at nBegin, and fold its latency into moving average of server (weight 1/8).
+ * request carrying nKeys data and nSent bytes is counted in metrics of server if enabled, with result nResult
+ * unless it is not a MCACHE_OK or MCACHE_ERR_* code (e.g. -1 for abandoned request). end of request is traced.
+ */
+static void
+s_ServerLeave(MemCacheServer *pstMCServer, int64_t nBegin, int nOpFlag, int nResult, size_t nKeys, size_t nSent)
+{
+	int64_t now = s_NowUSec();
+	int64_t latency = __atomic_load_n(&pstMCServer->nLatency, __ATOMIC_RELAXED);
+	struct memCacheMeter *meter = pstMCServer->pstMeter;
+	MemCacheOpMetrics *op = NULL;
+
+	latency = 0 < latency ? latency + (now - nBegin - latency) / 8 : now - nBegin;
+
+	__atomic_store_n(&pstMCServer->nLatency, latency, __ATOMIC_RELAXED);
+	__atomic_store_n(&pstMCServer->nLatencyTime, now, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&pstMCServer->nInflight, 1, __ATOMIC_RELAXED);
+
+	if (s_TraceOn(pstMCServer)) {
+		struct traceSpan *span = &s_stTraceSpan;
+		int traced = pstMCServer == span->server;
+
+		s_TraceEmit(pstMCServer, MCACHE_TRACE_PARSE_DONE, nOpFlag, traced ? span->hash : 0, nKeys,
+			traced ? span->received : 0, nResult);
+
+		if (traced)
+			span->server = NULL;
+	}
+
+	if (NULL == meter || 0 >= nOpFlag || MCACHE_METRIC_OPS <= nOpFlag)
+		return;
+
+	op = meter->shards[s_ThreadHash() % METER_SHARDS].metrics.astOps + nOpFlag;
+
+	__atomic_add_fetch(&op->nRequests, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&op->nKeys, nKeys, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&op->nBytesSent, nSent, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&op->nLatencySum, now - nBegin, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&op->anLatencyHist[s_MeterBucket(now - nBegin)], 1, __ATOMIC_RELAXED);
+
+	if (0 <= nResult && MCACHE_RESULT_COUNT > nResult)
+		__atomic_add_fetch(&op->anResults[nResult], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * expected cost of next request on server, latency is halved for every idle second so that a server once slow
+ * gets traffic again.
+ */
+static int64_t
+s_ServerLoad(MemCacheServer *pstMCServer, int64_t nNow)
+{
+	int64_t latency = __atomic_load_n(&pstMCServer->nLatency, __ATOMIC_RELAXED);
+	int64_t idle = (nNow - __atomic_load_n(&pstMCServer->nLatencyTime, __ATOMIC_RELAXED)) / 1000000;
+
+	if (0 < idle)
+		latency = 62 < idle ? 0 : latency >> idle;
+
+	return (latency + 1) * (__atomic_load_n(&pstMCServer->nInflight, __ATOMIC_RELAXED) + 1);
+}
+
+/**
+ * length of key of data, nKeyLen if given.
+ */
+static size_t
+s_KeyLen(const MemCacheData *pstMCData)
+{
+	return 0 < pstMCData->nKeyLen ? pstMCData->nKeyLen : strlen(pstMCData->pszDataKey);
+}
+
+/**
+ * compare NUL terminated pszStored with key of nKeyLen bytes.
+ */
+static int
+s_KeyEqual(const char *pszStored, const char *pKey, size_t nKeyLen)
+{
+	return 0 == strncmp(pszStored, pKey, nKeyLen) && '\0' == pszStored[nKeyLen];
+}
+
+/**
+ * validate key of data once, it must be 1 to MCACHE_KEY_MAX bytes without spaces or control characters.
+ * length of key is stored into pnKeyLen (optional).
+ */
+static int
+s_ChkKey(const MemCacheData *pstMCData, size_t *pnKeyLen)
+{
+	size_t i = 0;
+	size_t len = 0;
+	const unsigned char *key = (const unsigned char *) pstMCData->pszDataKey;
+
+	if (NULL == key)
+		return MCACHE_ERR_INVAL;
+
+	//one pass over key finds both its end and invalid characters
+	if (0 < pstMCData->nKeyLen) {
+		if (MCACHE_KEY_MAX < (len = pstMCData->nKeyLen))
+			return MCACHE_ERR_INVAL;
+
+		for (i = 0; i < len; i++) {
+			if (' ' >= key[i] || 0x7f == key[i])
+				return MCACHE_ERR_INVAL;
+		}
+	}
+	else {
+		for (len = 0; '\0' != key[len]; len++) {
+			if (MCACHE_KEY_MAX <= len || ' ' >= key[len] || 0x7f == key[len])
+				return MCACHE_ERR_INVAL;
+		}
+
+		if (0 == len)
+			return MCACHE_ERR_INVAL;
+	}
+
+	if (NULL != pnKeyLen)
+		*pnKeyLen = len;
+
+	return MCACHE_OK;
+}
+
+static uint64_t
+s_NegativeHash(const char *pKey, size_t nKeyLen)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (; 0 < nKeyLen; nKeyLen--, pKey++)
+		hash = (hash ^ (unsigned char) *pKey) * 1099511628211ull;
+
+	return hash;
+}
+
+/**
+ * locate slot of key in negative cache, or NULL. caller holds lock.
+ */
+static struct negativeSlot *
+s_NegativeFind(struct memCacheNegative *pstNegative, uint64_t nHash)
+{
+	size_t i = 0;
+	uint32_t fp = (uint32_t) (nHash >> 32) | 1;
+	struct negativeSlot *bucket = pstNegative->slots + (nHash % pstNegative->buckets) * NEGATIVE_WAYS;
+
+	for (i = 0; i < NEGATIVE_WAYS; i++) {
+		if (fp == bucket[i].fp)
+			return bucket + i;
+	}
+
+	return NULL;
+}
+
+/**
+ * record key as missing at nNow, taking an empty slot of its bucket or else the oldest one. caller holds lock.
+ */
+static void
+s_NegativeAdd(struct memCacheNegative *pstNegative, uint64_t nHash, uint32_t nNow)
+{
+	size_t i = 0;
+	struct negativeSlot *slot = NULL;
+	struct negativeSlot *bucket = pstNegative->slots + (nHash % pstNegative->buckets) * NEGATIVE_WAYS;
+
+	if (NULL == (slot = s_NegativeFind(pstNegative, nHash))) {
+		for (slot = bucket, i = 0; i < NEGATIVE_WAYS && 0 != slot->fp; i++) {
+			if (0 == bucket[i].fp || (uint32_t) (nNow - bucket[i].stamp) > (uint32_t) (nNow - slot->stamp))
+				slot = bucket + i;
+		}
+	}
+
+	slot->fp = (uint32_t) (nHash >> 32) | 1;
+	slot->stamp = nNow;
+}
+
+static uint32_t
+s_NegativeNow(struct memCacheNegative *pstNegative)
+{
+	return (uint32_t) ((s_NowUSec() - pstNegative->base) / 1000);
+}
+
+/**
+ * forget key stored by this client, so its next get goes to server.
+ */
+static void
+s_NegativeInvalidate(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	struct negativeSlot *slot = NULL;
+	struct memCacheNegative *negative = pstMCServer->pstNegative;
+
+	if (NULL == negative || NULL == pstMCData->pszDataKey)
+		return;
+
+	pthread_mutex_lock(&negative->lock);
+
+	if (NULL != (slot = s_NegativeFind(negative, s_NegativeHash(pstMCData->pszDataKey, s_KeyLen(pstMCData)))))
+		slot->fp = 0;
+
+	negative->epoch++;
+	pthread_mutex_unlock(&negative->lock);
+}
+
+int
+s_ChkInput(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nOpFlag)
+{
+	int ret = MCACHE_OK;
+
+	if (NULL == pstMCServer || NULL == pstMCData || 0 > pstMCServer->nSockFD ||
+		NULL == pstMCServer->pszServerAddr)
+		return MCACHE_ERR_INVAL;
+
+	switch (nOpFlag) {
+		case MCACHE_OP_SET:
+		case MCACHE_OP_ADD:
+		case MCACHE_OP_REPLACE:
+		case MCACHE_OP_APPEND:
+		case MCACHE_OP_PREPEND:
+		case MCACHE_OP_CAS:
+			if (MCACHE_OK != s_ChkKey(pstMCData, NULL) || NULL == pstMCData->pDataValue)
+				ret = MCACHE_ERR_INVAL;
+			
+			if (MCACHE_VALUE_MAX < pstMCData->nDataLen)
+				ret = MCACHE_ERR_INVAL;
+			break;
+		case MCACHE_OP_GET:
+		case MCACHE_OP_GETS:
+		case MCACHE_OP_GAT:
+		case MCACHE_OP_GATS:
+		case MCACHE_OP_TOUCH:
+		case MCACHE_OP_DELETE:
+		case MCACHE_OP_INCREMENT:
+		case MCACHE_OP_DECREMENT:
+			ret = s_ChkKey(pstMCData, NULL);
+			break;
+		default:
+			ret = MCACHE_ERR_INVAL;
+			break;
+	}
+
+	return ret;
+}
+
+/**
+ * decode unsigned decimal at *ppszCursor and skip following separator.
+ */
+static int
+s_ParseNumber(char **ppszCursor, const char *pszEnd, uint64_t *pnNum)
+{
+	char *cursor = *ppszCursor;
+	uint64_t num = 0;
+
+	if (cursor >= pszEnd || '0' > *cursor || '9' < *cursor)
+		return MCACHE_ERR_DATA;
+
+	while (cursor < pszEnd && '0' <= *cursor && '9' >= *cursor) {
+		num = num * 10 + (*cursor - '0');
+		cursor++;
+	}
+
+	if (cursor < pszEnd) {
+		if (' ' != *cursor)
+			return MCACHE_ERR_DATA;
+
+		cursor++;
+	}
+
+	*ppszCursor = cursor;
+	*pnNum = num;
+
+	return MCACHE_OK;
+}
+
+static int
+s_IsErrorLine(const char *pszLine)
+{
+	return 0 == strcmp(pszLine, "ERROR") || 0 == strncmp(pszLine, "CLIENT_ERROR", 12) ||
+		0 == strncmp(pszLine, "SERVER_ERROR", 12);
+}
+
+/**
+ * serialize command line of storage command into pszBuffer.
+ */
+static int
+s_StorageCommand(MemCacheData *pstMCData, int nOpFlag, int nNoReply, char *pszBuffer, size_t nBufferSize)
+{
+	int ret = 0;
+	int key_len = (int) s_KeyLen(pstMCData);
+	const char *noreply = nNoReply ? " noreply" : "";
+
+	if (MCACHE_OP_SET == nOpFlag) {
+		ret = snprintf(pszBuffer, nBufferSize, "set %.*s %zu %zu %zu%s\r\n", key_len, pstMCData->pszDataKey,
+			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen, noreply);
+	}
+	else if (MCACHE_OP_ADD == nOpFlag) {
+		ret = snprintf(pszBuffer, nBufferSize, "add %.*s %zu %zu %zu%s\r\n", key_len, pstMCData->pszDataKey,
+			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen, noreply);
+	}
+	else if (MCACHE_OP_APPEND == nOpFlag) {
+		ret = snprintf(pszBuffer, nBufferSize, "append %.*s %zu %zu %zu%s\r\n", key_len, pstMCData->pszDataKey,
+			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen, noreply);
+	}
+	else if (MCACHE_OP_PREPEND == nOpFlag) {
+		ret = snprintf(pszBuffer, nBufferSize, "prepend %.*s %zu %zu %zu%s\r\n", key_len, pstMCData->pszDataKey,
+			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen, noreply);
+	}
+	else if (MCACHE_OP_REPLACE == nOpFlag) {
+		ret = snprintf(pszBuffer, nBufferSize, "replace %.*s %zu %zu %zu%s\r\n", key_len, pstMCData->pszDataKey,
+			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen, noreply);
+	}
+	else if (MCACHE_OP_CAS == nOpFlag) {
+		ret = snprintf(pszBuffer, nBufferSize, "cas %.*s %zu %zu %zu %lld%s\r\n", key_len, pstMCData->pszDataKey,
+			pstMCData->nFlags, pstMCData->nExpiration, pstMCData->nDataLen, (long long) pstMCData->nCASUnique, noreply);
+	}
+
+	return ret;
+}
+
+/**
+ * translate reply line (without "\r\n") of storage, delete and touch commands.
+ */
+static int
+s_StorageResult(const char *pszReply)
+{
+	if (0 == strcmp(pszReply, "STORED") || 0 == strcmp(pszReply, "DELETED") || 0 == strcmp(pszReply, "TOUCHED"))
+		return MCACHE_OK;
+	else if (s_IsErrorLine(pszReply))
+		return MCACHE_ERR_ERROR;
+	else if (0 == strcmp(pszReply, "EXISTS"))
+		return MCACHE_ERR_EXISTS;
+	else if (0 == strcmp(pszReply, "NOT_STORED"))
+		return MCACHE_ERR_NOT_STORED;
+	else if (0 == strcmp(pszReply, "NOT_FOUND"))
+		return MCACHE_ERR_NOT_FOUND;
+
+	return MCACHE_ERR_DATA;
+}
+
+static int
+s_StorageReply(MemCacheServer *pstMCServer, int nTimeout)
+{
+	int ret = MCACHE_OK;
+	size_t line_len = 0;
+	char *line = NULL;
+	char buffer[MCACHE_KEY_MAX];
+	struct sockReader reader;
+
+	s_ReaderInit(&reader, pstMCServer, nTimeout, buffer, sizeof(buffer));
+
+	if (MCACHE_OK == (ret = s_ReaderLine(&reader, &line, &line_len)))
+		ret = s_StorageResult(line);
+
+	s_ReaderFree(&reader);
+
+	return ret;
+}
+
+int
+s_DataManipulate(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nOpFlag)
+{
+	int ret = MCACHE_OK;
+	char buffer[MCACHE_KEY_MAX * 2];
+	int timeout = 0;
+	time_t check_time = 0;
+	int64_t begin = 0;
+	size_t sent = 0;
+	struct iovec iov[3];
+
+	if (NULL != pstMCServer && NULL != pstMCData)
+		s_NegativeInvalidate(pstMCServer, pstMCData);
+
+	if (NULL != pstMCServer && NULL != pstMCServer->pstGroup)
+		return s_GroupRun(pstMCServer, pstMCData, nOpFlag, 0);
+
+	switch (nOpFlag) {
+		case MCACHE_OP_SET:
+		case MCACHE_OP_ADD:
+		case MCACHE_OP_APPEND:
+		case MCACHE_OP_PREPEND:
+		case MCACHE_OP_REPLACE:
+		case MCACHE_OP_CAS:
+			ret = s_ChkInput(pstMCServer, pstMCData, nOpFlag);
+			break;
+		default:
+			ret = MCACHE_ERR_INVAL;
+			break;
+	}
+
+	if (MCACHE_OK != ret)
+		return ret;
+
+	//header, value and trailing "\r\n" are flushed by one writev, value is never copied
+	iov[0].iov_base = buffer;
+	iov[0].iov_len = s_StorageCommand(pstMCData, nOpFlag, 0, buffer, sizeof(buffer));
+
+	if (0 == iov[0].iov_len || sizeof(buffer) <= iov[0].iov_len)
+		return MCACHE_ERR_INVAL;
+	iov[1].iov_base = pstMCData->pDataValue;
+	iov[1].iov_len = pstMCData->nDataLen;
+	iov[2].iov_base = "\r\n";
+	iov[2].iov_len = 2;
+
+	sent = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+	timeout = pstMCServer->nTimeout;
+	check_time = time(NULL);
+	begin = s_ServerEnter(pstMCServer, nOpFlag, pstMCData, 1);
+	s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_START, 0);
+
+	if (MCACHE_OK == (ret = s_SockWritev(pstMCServer->nSockFD, iov, 3, timeout))) {
+		s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_END, sent);
+		timeout -= time(NULL) - check_time;
+		ret = s_StorageReply(pstMCServer, timeout);
+	}
+
+	s_ServerLeave(pstMCServer, begin, nOpFlag, ret, 1, sent);
+
+	return ret;
+}
+
+static int
+s_DataCalculate(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum, int nOpFlag)
+{
+	int ret = MCACHE_OK;
+	int len = 0;
+	char buffer[BULK_HEADER_SIZE];
+	size_t line_len = 0;
+	char *line = NULL;
+	char *tmp = NULL;
+	int64_t begin = 0;
+	struct sockReader reader;
+
+	switch (nOpFlag) {
+		case MCACHE_OP_INCREMENT:
+		case MCACHE_OP_DECREMENT:
+			ret = s_ChkInput(pstMCServer, pstMCData, nOpFlag);
+			break;
+		default:
+			ret = MCACHE_ERR_INVAL;
+			break;
+	}
+
+	if (MCACHE_OK != ret)
+		return ret;
+
+	len = s_BulkCommand(pstMCData, nOpFlag, nNum, 0, buffer, sizeof(buffer));
+
+	if (0 >= len || sizeof(buffer) <= (size_t) len)
+		return MCACHE_ERR_INVAL;
+
+	begin = s_ServerEnter(pstMCServer, nOpFlag, pstMCData, 1);
+	s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_START, 0);
+
+	if (MCACHE_OK != (ret = s_SockWrite(pstMCServer->nSockFD, buffer, len, pstMCServer->nTimeout))) {
+		s_ServerLeave(pstMCServer, begin, nOpFlag, ret, 1, 0);
+		return ret;
+	}
+
+	s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_END, len);
+
+	s_ReaderInit(&reader, pstMCServer, pstMCServer->nTimeout, buffer, sizeof(buffer));
+
+	if (MCACHE_OK != (ret = s_ReaderLine(&reader, &line, &line_len)))
+		goto end;
+
+	if (0 == strncmp(line, "CLIENT_ERROR", 12)) {
+		ret = MCACHE_ERR_ERROR;
+		goto end;
+	}
+
+	if (NULL == (tmp = (char *) s_Alloc(pstMCServer, line_len + 1))) {
+		ret = MCACHE_ERR_NOMEM;
+		goto end;
+	}
+
+	memcpy(tmp, line, line_len + 1);
+
+	if (MCACHE_FLAG_FREE_VALUE == (pstMCServer->nFlag & MCACHE_FLAG_FREE_VALUE) && NULL != pstMCData->pDataValue)
+		s_Free(pstMCServer, pstMCData->pDataValue);
+
+	pstMCData->pDataValue = (void *) tmp;
+
+end:
+	s_ReaderFree(&reader);
+	s_ServerLeave(pstMCServer, begin, nOpFlag, ret, 1, len);
+
+	return ret;
+}
+
+/**
+ * serialize command line of one data for s_DataBulk.
+ */
+static int
+s_BulkCommand(MemCacheData *pstMCData, int nOpFlag, uint64_t nNum, int nNoReply, char *pszBuffer, size_t nBufferSize)
+{
+	int key_len = (int) s_KeyLen(pstMCData);
+	const char *noreply = nNoReply ? " noreply" : "";
+
+	switch (nOpFlag) {
+		case MCACHE_OP_DELETE:
+			if (0 != nNum)
+				return snprintf(pszBuffer, nBufferSize, "delete %.*s %llu%s\r\n", key_len, pstMCData->pszDataKey,
+					(unsigned long long) nNum, noreply);
+
+			return snprintf(pszBuffer, nBufferSize, "delete %.*s%s\r\n", key_len, pstMCData->pszDataKey, noreply);
+		case MCACHE_OP_GET:
+			return snprintf(pszBuffer, nBufferSize, "get %.*s\r\n", key_len, pstMCData->pszDataKey);
+		case MCACHE_OP_GETS:
+			return snprintf(pszBuffer, nBufferSize, "gets %.*s\r\n", key_len, pstMCData->pszDataKey);
+		case MCACHE_OP_TOUCH:
+			return snprintf(pszBuffer, nBufferSize, "touch %.*s %zu%s\r\n", key_len, pstMCData->pszDataKey,
+				pstMCData->nExpiration, noreply);
+		case MCACHE_OP_INCREMENT:
+			return snprintf(pszBuffer, nBufferSize, "incr %.*s %llu%s\r\n", key_len, pstMCData->pszDataKey,
+				(unsigned long long) nNum, noreply);
+		case MCACHE_OP_DECREMENT:
+			return snprintf(pszBuffer, nBufferSize, "decr %.*s %llu%s\r\n", key_len, pstMCData->pszDataKey,
+				(unsigned long long) nNum, noreply);
+		default:
+			return s_StorageCommand(pstMCData, nOpFlag, nNoReply, pszBuffer, nBufferSize);
+	}
+}
+
+/**
+ * translate reply line of one data for s_DataBulk, new value of incr/decr is parsed into *pnValue if given,
+ * otherwise it is stored into pDataValue.
+ */
+static int
+s_BulkResult(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nOpFlag, char *pszLine, size_t nLineLen,
+	uint64_t *pnValue)
+{
+	char *cursor = pszLine;
+	char *value = NULL;
+	uint64_t num = 0;
+
+	if (MCACHE_OP_INCREMENT != nOpFlag && MCACHE_OP_DECREMENT != nOpFlag)
+		return s_StorageResult(pszLine);
+
+	if (MCACHE_OK != s_ParseNumber(&cursor, pszLine + nLineLen, &num) || cursor != pszLine + nLineLen)
+		return s_StorageResult(pszLine);
+
+	if (NULL != pnValue) {
+		*pnValue = num;
+		return MCACHE_OK;
+	}
+
+	if (NULL == (value = (char *) s_Alloc(pstMCServer, nLineLen + 1)))
+		return MCACHE_ERR_NOMEM;
+
+	memcpy(value, pszLine, nLineLen + 1);
+
+	if (MCACHE_FLAG_FREE_VALUE == (pstMCServer->nFlag & MCACHE_FLAG_FREE_VALUE) && NULL != pstMCData->pDataValue)
+		s_Free(pstMCServer, pstMCData->pDataValue);
+
+	pstMCData->pDataValue = (void *) value;
+
+	return MCACHE_OK;
+}
+
+static int
+s_IsStorageOp(int nOpFlag)
+{
+	return MCACHE_OP_SET == nOpFlag || MCACHE_OP_ADD == nOpFlag || MCACHE_OP_APPEND == nOpFlag ||
+		MCACHE_OP_PREPEND == nOpFlag || MCACHE_OP_REPLACE == nOpFlag || MCACHE_OP_CAS == nOpFlag;
+}
+
+/**
+ * discard fetched value.
+ */
+static int
+s_RetrieveSkip(struct sockReader *pstReader, MemCacheData *pstMCData, void *pArg)
+{
+	(void) pArg;
+
+	return s_ReaderStream(pstReader, pstMCData, pstMCData->nDataLen, NULL, NULL, NULL);
+}
+
+/**
+ * parse reply of "gets" sent behind command of data whose result is nStatus. value is handed to refetch of
+ * request if command failed, and skipped otherwise without touching data.
+ */
+static int
+s_BulkRefetch(struct sockReader *pstReader, const struct bulkRequest *pstRequest, MemCacheData *pstMCData,
+	char *pHit, int nStatus)
+{
+	int ret = MCACHE_OK;
+	size_t fetched = 0;
+	MemCacheData scratch = *pstMCData;
+
+	if (MCACHE_OK != nStatus)
+		ret = s_RetrievalParse(pstReader, pstMCData, 1, MCACHE_OP_GETS, NULL, pstRequest->refetch,
+			pstRequest->refetch_arg, pHit, &fetched);
+	else
+		ret = s_RetrievalParse(pstReader, &scratch, 1, MCACHE_OP_GETS, NULL, s_RetrieveSkip, NULL, NULL, &fetched);
+
+	return RETRIEVAL_DROPPED == ret ? MCACHE_OK : ret;
+}
+
+/**
+ * run one command per data of list, commands of up to nBatchKeys data are serialized into one writev and
+ * their replies are parsed in one pass. result of each data is stored into pnStatus (optional).
+ * with refetch of request, "gets" of key follows each command in the same writev (see s_BulkRefetch).
+ *
+ * @return	MCACHE_OK if all data succeed, MCACHE_ERR_PARTIAL if some of them fail, failure of connection otherwise.
+ */
+static int
+s_DataBulk(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	struct bulkRequest *pstRequest, int *pnStatus)
+{
+	int ret = MCACHE_OK;
+	int status = MCACHE_OK;
+	int op = 0;
+	size_t i = 0;
+	size_t k = 0;
+	size_t begin = 0;
+	size_t count = 0;
+	size_t iov_count = 0;
+	size_t failed = 0;
+	size_t line_len = 0;
+	size_t max_keys = 0;
+	size_t written = 0;
+	int64_t started = 0;
+	size_t *idx = NULL;
+	char *line = NULL;
+	char *header = NULL;
+	struct iovec *iov = NULL;
+	struct sockReader reader;
+	int fetch = 0;
+
+	if (NULL == pstMCServer || NULL == pstMCDataList || 0 > pstMCServer->nSockFD || NULL == pstRequest)
+		return MCACHE_ERR_INVAL;
+
+	fetch = NULL != pstRequest->refetch && !pstRequest->noreply;
+
+	max_keys = 0 < pstMCServer->nBatchKeys ? pstMCServer->nBatchKeys : MCACHE_MULTIGET_MAX;
+
+	if (max_keys > nListSize)
+		max_keys = nListSize;
+
+	if (0 == max_keys)
+		return MCACHE_OK;
+
+	//command lines are followed by "gets" lines if refetched
+	idx = (size_t *) malloc(max_keys * sizeof(size_t));
+	iov = (struct iovec *) malloc(max_keys * (3 + fetch) * sizeof(struct iovec));
+	header = (char *) malloc(max_keys * (1 + fetch) * BULK_HEADER_SIZE);
+
+	if (NULL == idx || NULL == iov || NULL == header ||
+		MCACHE_OK != s_ReaderInit(&reader, pstMCServer, pstMCServer->nTimeout, NULL, 0)) {
+		ret = MCACHE_ERR_NOMEM;
+		reader.buffer = NULL;
+		goto end;
+	}
+
+	started = s_ServerEnter(pstMCServer, NULL != pstRequest->ops ? pstRequest->ops[0] : pstRequest->op, pstMCDataList,
+		nListSize);
+
+	for (begin = 0, i = 0; i < nListSize; begin = i) {
+		iov_count = 0;
+		count = 0;
+
+		for (i = begin; i < nListSize && count < max_keys; i++) {
+			int len = 0;
+			char *cmd = header + count * BULK_HEADER_SIZE;
+
+			op = (NULL != pstRequest->ops) ? pstRequest->ops[i] : pstRequest->op;
+
+			if (MCACHE_OK == (status = s_ChkInput(pstMCServer, pstMCDataList + i, op))) {
+				len = s_BulkCommand(pstMCDataList + i, op, NULL != pstRequest->nums ? pstRequest->nums[i] : pstRequest->num,
+					pstRequest->noreply, cmd, BULK_HEADER_SIZE);
+
+				if (0 >= len || BULK_HEADER_SIZE <= len)
+					status = MCACHE_ERR_INVAL;
+			}
+
+			if (MCACHE_OK != status) {
+				if (NULL != pnStatus)
+					pnStatus[i] = status;
+
+				failed++;
+				continue;
+			}
+
+			if (s_IsStorageOp(op))
+				s_NegativeInvalidate(pstMCServer, pstMCDataList + i);
+
+			iov[iov_count].iov_base = cmd;
+			iov[iov_count].iov_len = len;
+			iov_count++;
+
+			if (s_IsStorageOp(op)) {
+				iov[iov_count].iov_base = pstMCDataList[i].pDataValue;
+				iov[iov_count].iov_len = pstMCDataList[i].nDataLen;
+				iov_count++;
+				iov[iov_count].iov_base = "\r\n";
+				iov[iov_count].iov_len = 2;
+				iov_count++;
+			}
+
+			if (fetch) {
+				char *gets = header + (max_keys + count) * BULK_HEADER_SIZE;
+				size_t key_len = s_KeyLen(pstMCDataList + i);
+
+				memcpy(gets, "gets ", 5);
+				memcpy(gets + 5, pstMCDataList[i].pszDataKey, key_len);
+				memcpy(gets + 5 + key_len, "\r\n", 2);
+				iov[iov_count].iov_base = gets;
+				iov[iov_count].iov_len = key_len + 7;
+				iov_count++;
+			}
+
+			idx[count] = i;
+			count++;
+		}
+
+		if (0 == count)
+			continue;
+
+		s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_START, written);
+
+		if (MCACHE_OK != (ret = s_SockWritev(pstMCServer->nSockFD, iov, iov_count, pstMCServer->nTimeout))) {
+			k = 0;
+			break;
+		}
+
+		for (k = 0; k < iov_count; k++)
+			written += iov[k].iov_len;
+
+		s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_END, written);
+
+		reader.deadline = s_NowUSec() + (int64_t) pstMCServer->nTimeout * 1000000;
+
+		for (k = 0; k < count; k++) {
+			op = (NULL != pstRequest->ops) ? pstRequest->ops[idx[k]] : pstRequest->op;
+
+			if (pstRequest->noreply) {
+				status = MCACHE_OK;
+			}
+			else if (MCACHE_OP_GET == op || MCACHE_OP_GETS == op) {
+				size_t fetched = 0;
+
+				status = s_RetrievalParse(&reader, pstMCDataList + idx[k], 1, op, NULL, s_RetrieveCopy, pstMCServer, NULL, &fetched);
+				if (RETRIEVAL_DROPPED == status)
+					status = MCACHE_ERR_NOMEM;
+
+				//anything but error reply of server or dropped value leaves stream out of sync
+				else if (MCACHE_OK != status && MCACHE_ERR_ERROR != status) {
+					ret = status;
+					break;
+				}
+
+				if (MCACHE_OK == status && 0 == fetched)
+					status = MCACHE_ERR_PARTIAL;
+			}
+			else {
+				if (MCACHE_OK != (ret = s_ReaderLine(&reader, &line, &line_len)))
+					break;
+
+				status = s_BulkResult(pstMCServer, pstMCDataList + idx[k], op, line, line_len,
+					NULL != pstRequest->results ? pstRequest->results + idx[k] : NULL);
+
+				if (fetch && MCACHE_OK != (ret = s_BulkRefetch(&reader, pstRequest, pstMCDataList + idx[k],
+					NULL != pstRequest->refetched ? pstRequest->refetched + idx[k] : NULL, status)))
+					break;
+			}
+
+			if (MCACHE_OK != status)
+				failed++;
+
+			if (NULL != pnStatus)
+				pnStatus[idx[k]] = status;
+		}
+
+		if (MCACHE_OK != ret)
+			break;
+	}
+
+	//data not processed for failure of connection
+	if (MCACHE_OK != ret && NULL != pnStatus) {
+		for (; k < count; k++)
+			pnStatus[idx[k]] = ret;
+
+		for (; i < nListSize; i++)
+			pnStatus[i] = ret;
+	}
+
+end:
+
+	if (MCACHE_OK == ret && 0 < failed)
+		ret = MCACHE_ERR_PARTIAL;
+
+	//mixed commands are counted as command of first data
+	if (NULL != reader.buffer) {
+		s_ReaderFree(&reader);
+		s_ServerLeave(pstMCServer, started, NULL != pstRequest->ops ? pstRequest->ops[0] : pstRequest->op, ret,
+			nListSize, written);
+	}
+
+	if (NULL != idx)
+		free(idx);
+
+	if (NULL != iov)
+		free(iov);
+
+	if (NULL != header)
+		free(header);
+
+	return ret;
+}
+
+/**
+ * find data in list by key of nKeyLen bytes, search starts from nHint and wraps around since server replies in
+ * request order.
+ */
+static int
+s_GetDataByKey(MemCacheData *pstDataList, size_t nListSize, const char *pKey, size_t nKeyLen, size_t nHint)
+{
+	int i = 0;
+	int idx = -1;
+	size_t count = 0;
+	const char *key = NULL;
+
+	if (NULL == pstDataList || 0 == nListSize || NULL == pKey)
+		return -1;
+
+	for (count = 0, i = nHint % nListSize; count < nListSize; count++, i = (i + 1) % nListSize) {
+		if (NULL == (key = pstDataList[i].pszDataKey))
+			continue;
+
+		//NUL terminated keys are compared without measuring them first
+		if (0 < pstDataList[i].nKeyLen ? nKeyLen == pstDataList[i].nKeyLen && 0 == memcmp(key, pKey, nKeyLen) :
+			0 == strncmp(key, pKey, nKeyLen) && '\0' == key[nKeyLen]) {
+			idx = i;
+			break;
+		}
+	}
+
+	return idx;
+}
+
+/**
+ * serialize "get"/"gets"/"gat"/"gats" command line for valid keys in list starting from pstBatch->begin into
+ * malloced pstBatch->cmd. command is cut once it holds nBatchKeys keys or would exceed nBatchBytes,
+ * pstBatch->cmd is NULL if no valid key was found. nExpiration is used by "gat" and "gats" only.
+ */
+static int
+s_RetrievalCommand(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag,
+	size_t nExpiration, struct retrievalBatch *pstBatch)
+{
+	size_t i = 0;
+	int prefix_size = 0;
+	size_t key_len = 0;
+	size_t buffer_size = 0;
+	size_t key_count = 0;
+	char prefix[32];
+	size_t max_keys = 0 < pstMCServer->nBatchKeys ? pstMCServer->nBatchKeys : MCACHE_MULTIGET_MAX;
+	size_t max_bytes = 0 < pstMCServer->nBatchBytes ? pstMCServer->nBatchBytes : MCACHE_BATCH_BYTES;
+	char *buffer = NULL;
+	char *cursor = NULL;
+
+	pstBatch->cmd = NULL;
+	pstBatch->cmd_len = 0;
+	pstBatch->sent = 0;
+
+	if (MCACHE_OP_GET == nOpFlag)
+		prefix_size = snprintf(prefix, sizeof(prefix), "get");
+	else if (MCACHE_OP_GETS == nOpFlag)
+		prefix_size = snprintf(prefix, sizeof(prefix), "gets");
+	else if (MCACHE_OP_GAT == nOpFlag)
+		prefix_size = snprintf(prefix, sizeof(prefix), "gat %zu", nExpiration);
+	else
+		prefix_size = snprintf(prefix, sizeof(prefix), "gats %zu", nExpiration);
+
+	//room for first key even if it exceeds max_bytes, keys are validated and copied in one pass
+	buffer_size = prefix_size + 2 + MCACHE_KEY_MAX + 1; // prefix + \r\n + first key
+
+	if (max_keys > nListSize - pstBatch->begin)
+		max_keys = nListSize - pstBatch->begin;
+
+	if (max_bytes > (MCACHE_KEY_MAX + 1) * max_keys)
+		max_bytes = (MCACHE_KEY_MAX + 1) * max_keys;
+
+	if (NULL == (buffer = (char *) malloc(buffer_size + max_bytes)))
+		return MCACHE_ERR_NOMEM;
+
+	memcpy(buffer, prefix, prefix_size);
+	cursor = buffer + prefix_size;
+
+	for (i = pstBatch->begin; i < nListSize && key_count < max_keys; i++) {
+		if (MCACHE_OK != s_ChkKey(pstMCDataList + i, &key_len))
+			continue;
+
+		if (0 < key_count && max_bytes < cursor - buffer + key_len + 3)
+			break;
+
+		*cursor = ' ';
+		cursor++;
+		memcpy(cursor, pstMCDataList[i].pszDataKey, key_len);
+		cursor += key_len;
+		key_count++;
+	}
+
+	pstBatch->end = i;
+
+	if (0 == key_count) {
+		free(buffer);
+		return MCACHE_OK;
+	}
+
+	*cursor = '\r';
+	cursor++;
+	*cursor = '\n';
+	cursor++;
+
+	pstBatch->cmd = buffer;
+	pstBatch->cmd_len = cursor - buffer;
+
+	return MCACHE_OK;
+}
+
+/**
+ * parse "VALUE <key> <flags> <bytes> [<cas unique>]" in a single forward pass, key is terminated in place and
+ * also stored with its length into pstMCData.
+ */
+static int
+s_ParseValueLine(char *pszLine, size_t nLen, int nOpFlag, char **ppszKey, MemCacheData *pstMCData)
+{
+	char *cursor = pszLine + 6;
+	char *end = pszLine + nLen;
+	uint64_t num = 0;
+
+	*ppszKey = cursor;
+
+	if (NULL == (cursor = s_Scan(cursor, end, ' ', ' ')) || cursor == *ppszKey)
+		return MCACHE_ERR_DATA;
+
+	*cursor = '\0';
+	pstMCData->pszDataKey = *ppszKey;
+	pstMCData->nKeyLen = cursor - *ppszKey;
+	cursor++;
+
+	if (MCACHE_OK != s_ParseNumber(&cursor, end, &num))
+		return MCACHE_ERR_DATA;
+
+	pstMCData->nFlags = num;
+
+	if (MCACHE_OK != s_ParseNumber(&cursor, end, &num))
+		return MCACHE_ERR_DATA;
+
+	pstMCData->nDataLen = num;
+
+	if (MCACHE_OP_GETS == nOpFlag || MCACHE_OP_GATS == nOpFlag) {
+		if (MCACHE_OK != s_ParseNumber(&cursor, end, &num))
+			return MCACHE_ERR_DATA;
+
+		pstMCData->nCASUnique = num;
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * find data of key of nKeyLen bytes through index of prepared command.
+ */
+static int
+s_IndexFind(const struct keyIndex *pstIndex, size_t nListSize, const char *pKey, size_t nKeyLen)
+{
+	size_t pos = 0;
+	uint32_t idx = 0;
+	uint32_t hash = s_CounterHash(pKey, nKeyLen);
+
+	for (pos = hash & pstIndex->mask; 0 != (idx = pstIndex->slots[pos]); pos = (pos + 1) & pstIndex->mask) {
+		idx--;
+
+		if (hash == pstIndex->hashes[idx] && nKeyLen == pstIndex->lens[idx] && idx < nListSize &&
+			0 == memcmp(pstIndex->keys[idx], pKey, nKeyLen))
+			return idx;
+	}
+
+	return -1;
+}
+
+/**
+ * parse response of one retrieval command up to "END", pfnValue is invoked as each "VALUE" header is parsed
+ * and must consume its data block from reader. pHit (optional) is marked for every fetched data.
+ * reply keys are looked up through pstIndex if given, otherwise list is searched. values dropped by pfnValue are
+ * not fetched, and RETRIEVAL_DROPPED is returned once whole reply is parsed, so that callers can tell it from errors
+ * leaving stream out of sync.
+ */
+static int
+s_RetrievalParse(struct sockReader *pstReader, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag,
+	const struct keyIndex *pstIndex, retrievalFunc pfnValue, void *pArg, char *pHit, size_t *pnFetched)
+{
+	int ret = MCACHE_OK;
+	int dropped = 0;
+	int idx = -1;
+	size_t line_len = 0;
+	char *line = NULL;
+	char *key = NULL;
+	MemCacheData header;
+
+	while (1) {
+		if (MCACHE_OK != (ret = s_ReaderLine(pstReader, &line, &line_len)))
+			break;
+
+		if (0 == strcmp(line, "END"))
+			break;
+
+		if (0 != strncmp(line, "VALUE ", 6)) {
+			ret = s_IsErrorLine(line) ? MCACHE_ERR_ERROR : MCACHE_ERR_DATA;
+			break;
+		}
+
+		if (MCACHE_OK != (ret = s_ParseValueLine(line, line_len, nOpFlag, &key, &header)))
+			break;
+
+		if (NULL != pstIndex)
+			idx = s_IndexFind(pstIndex, nListSize, key, header.nKeyLen);
+		else
+			idx = s_GetDataByKey(pstMCDataList, nListSize, key, header.nKeyLen, idx + 1);
+
+		if (-1 == idx) {
+			ret = MCACHE_ERR_DATA;
+			break;
+		}
+
+		pstMCDataList[idx].nFlags = header.nFlags;
+		pstMCDataList[idx].nDataLen = header.nDataLen;
+
+		if (MCACHE_OP_GETS == nOpFlag || MCACHE_OP_GATS == nOpFlag)
+			pstMCDataList[idx].nCASUnique = header.nCASUnique;
+
+		//dropped value is neither a hit nor fetched, reply is still parsed up to "END"
+		if (RETRIEVAL_DROPPED == (ret = pfnValue(pstReader, pstMCDataList + idx, pArg))) {
+			dropped = 1;
+
+			if (MCACHE_OK != (ret = s_ReaderEndOfData(pstReader)))
+				break;
+
+			continue;
+		}
+
+		if (MCACHE_OK != ret || MCACHE_OK != (ret = s_ReaderEndOfData(pstReader)))
+			break;
+
+		if (NULL != pHit)
+			pHit[idx] = 1;
+
+		(*pnFetched)++;
+	}
+
+	if (MCACHE_OK == ret && dropped)
+		ret = RETRIEVAL_DROPPED;
+
+	return ret;
+}
+
+/**
+ * send retrieval commands and parse responses incrementally, see s_RetrievalParse.
+ * list of any size is split into commands by s_RetrievalCommand, or commands of pstPrepared are used as they are.
+ * up to nBatchDepth of them are kept in flight on connection. only the oldest command is sent blocking, later ones
+ * are pushed as far as socket accepts without blocking, so that server is never stalled by responses which are not
+ * read yet. connection is closed if it stops with replies left unread, those could not be told from later ones.
+ */
+static int
+s_RetrievalPipeline(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag,
+	size_t nExpiration, const struct memCachePrepared *pstPrepared, retrievalFunc pfnValue, void *pArg, char *pHit)
+{
+	int ret = MCACHE_OK;
+	size_t i = 0;
+	size_t taken = 0;
+	size_t sent = 0;
+	size_t written = 0;
+	size_t next = 0;
+	size_t head = 0;
+	size_t inflight = 0;
+	size_t depth = 0;
+	size_t fetched_count = 0;
+	int dropped = 0;
+	int synced = 1;
+	int64_t begin = 0;
+	struct retrievalBatch batch[BATCH_DEPTH_MAX];
+	struct retrievalBatch *cur = NULL;
+	struct sockReader reader;
+
+	if (NULL == pstMCServer || NULL == pstMCDataList || 0 > pstMCServer->nSockFD || NULL == pfnValue)
+		return MCACHE_ERR_INVAL;
+
+	depth = 0 < pstMCServer->nBatchDepth ? pstMCServer->nBatchDepth : MCACHE_BATCH_DEPTH;
+	if (BATCH_DEPTH_MAX < depth)
+		depth = BATCH_DEPTH_MAX;
+
+	if (MCACHE_OK != (ret = s_ReaderInit(&reader, pstMCServer, pstMCServer->nTimeout, NULL, 0)))
+		return ret;
+
+	begin = s_ServerEnter(pstMCServer, nOpFlag, pstMCDataList, nListSize);
+
+	if (NULL != pstPrepared && 0 == pstPrepared->count)
+		next = nListSize;
+
+	while (next < nListSize || 0 < inflight) {
+		while (inflight < depth && next < nListSize) {
+			cur = batch + (head + inflight) % depth;
+
+			if (NULL != pstPrepared) {
+				*cur = pstPrepared->batches[taken++];
+				next = taken < pstPrepared->count ? cur->end : nListSize;
+				inflight++;
+				continue;
+			}
+
+			cur->begin = next;
+			cur->index = NULL;
+
+			if (MCACHE_OK != (ret = s_RetrievalCommand(pstMCServer, pstMCDataList, nListSize, nOpFlag, nExpiration, cur)))
+				break;
+
+			next = cur->end;
+
+			if (NULL != cur->cmd)
+				inflight++;
+		}
+
+		if (MCACHE_OK != ret || 0 == inflight)
+			break;
+
+		cur = batch + head;
+		synced = 0;
+
+		if (cur->sent < cur->cmd_len) {
+			s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_START, written);
+
+			if (MCACHE_OK != (ret = s_SockWrite(pstMCServer->nSockFD, cur->cmd + cur->sent, cur->cmd_len - cur->sent,
+				pstMCServer->nTimeout)))
+				break;
+
+			s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_END, written + cur->cmd_len);
+		}
+
+		cur->sent = cur->cmd_len;
+		written += cur->cmd_len;
+
+		for (i = 1; i < inflight; i++) {
+			struct retrievalBatch *later = batch + (head + i) % depth;
+
+			if (later->sent == later->cmd_len)
+				continue;
+
+			if (MCACHE_OK != (ret = s_SockWriteSome(pstMCServer->nSockFD, later->cmd + later->sent,
+				later->cmd_len - later->sent, &sent)))
+				break;
+
+			later->sent += sent;
+
+			if (later->sent < later->cmd_len)
+				break;
+		}
+
+		if (MCACHE_OK != ret)
+			break;
+
+		reader.deadline = s_NowUSec() + (int64_t) pstMCServer->nTimeout * 1000000;
+
+		ret = s_RetrievalParse(&reader, pstMCDataList + cur->begin, cur->end - cur->begin, nOpFlag, cur->index,
+			pfnValue, pArg, NULL != pHit ? pHit + cur->begin : NULL, &fetched_count);
+
+		if (NULL == pstPrepared)
+			free(cur->cmd);
+
+		cur->cmd = NULL;
+		head = (head + 1) % depth;
+		inflight--;
+
+		//reply parsed up to its end keeps stream in sync, values dropped on it are reported once list is done
+		if (RETRIEVAL_DROPPED == ret) {
+			dropped = 1;
+			ret = MCACHE_OK;
+		}
+
+		synced = MCACHE_OK == ret || MCACHE_ERR_ERROR == ret;
+
+		if (MCACHE_OK != ret)
+			break;
+	}
+
+	for (i = 0; i < inflight; i++) {
+		cur = batch + (head + i) % depth;
+
+		if (0 < cur->sent)
+			synced = 0;
+
+		if (NULL == pstPrepared)
+			free(cur->cmd);
+	}
+
+	//replies in flight, or rest of one partly parsed, would be taken for replies of next command
+	if (!synced)
+		MCACHE_ServerDisconnect(pstMCServer);
+
+	if (MCACHE_OK == ret && dropped)
+		ret = MCACHE_ERR_NOMEM;
+
+	if (MCACHE_OK == ret && nListSize != fetched_count)
+		ret = MCACHE_ERR_PARTIAL;
+
+	s_ReaderFree(&reader);
+	s_ServerLeave(pstMCServer, begin, nOpFlag, ret, nListSize, written);
+
+	return ret;
+}
+
+static int
+s_DataRetrievalRun(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag,
+	size_t nExpiration, retrievalFunc pfnValue, void *pArg, char *pHit)
+{
+	return s_RetrievalPipeline(pstMCServer, pstMCDataList, nListSize, nOpFlag, nExpiration, NULL, pfnValue, pArg, pHit);
+}
+
+static void
+s_PreparedFree(struct memCachePrepared *pstPrepared)
+{
+	size_t i = 0;
+
+	for (i = 0; NULL != pstPrepared->batches && i < pstPrepared->count; i++) {
+		struct keyIndex *index = pstPrepared->batches[i].index;
+
+		free(pstPrepared->batches[i].cmd);
+
+		if (NULL != index) {
+			free(index->slots);
+			free(index->hashes);
+			free(index->lens);
+			free(index->keys);
+			free(index);
+		}
+	}
+
+	free(pstPrepared->batches);
+	free(pstPrepared);
+}
+
+/**
+ * build hash index of valid keys of data [begin, end) of list for pstBatch, keys are taken from its command line
+ * in which they follow command name, and expiration for "gat" and "gats".
+ */
+static int
+s_PreparedIndex(MemCacheData *pstMCDataList, int nOpFlag, struct retrievalBatch *pstBatch)
+{
+	size_t i = 0;
+	size_t pos = 0;
+	size_t size = 16;
+	size_t count = pstBatch->end - pstBatch->begin;
+	const char *cursor = strchr(pstBatch->cmd, ' ');
+	struct keyIndex *index = NULL;
+
+	if (MCACHE_OP_GAT == nOpFlag || MCACHE_OP_GATS == nOpFlag)
+		cursor = strchr(cursor + 1, ' ');
+
+	while (size < count * 2)
+		size *= 2;
+
+	if (NULL == (index = (struct keyIndex *) calloc(1, sizeof(struct keyIndex))))
+		return MCACHE_ERR_NOMEM;
+
+	pstBatch->index = index;
+	index->mask = size - 1;
+	index->slots = (uint32_t *) calloc(size, sizeof(uint32_t));
+	index->hashes = (uint32_t *) calloc(count, sizeof(uint32_t));
+	index->lens = (size_t *) calloc(count, sizeof(size_t));
+	index->keys = (const char **) calloc(count, sizeof(char *));
+
+	if (NULL == index->slots || NULL == index->hashes || NULL == index->lens || NULL == index->keys)
+		return MCACHE_ERR_NOMEM;
+
+	for (i = 0; i < count; i++) {
+		MemCacheData *data = pstMCDataList + pstBatch->begin + i;
+
+		//invalid keys were left out of command, and can not be in reply
+		if (MCACHE_OK != s_ChkKey(data, index->lens + i))
+			continue;
+
+		index->keys[i] = cursor + 1;
+		index->hashes[i] = s_CounterHash(index->keys[i], index->lens[i]);
+		cursor += 1 + index->lens[i];
+
+		for (pos = index->hashes[i] & index->mask; 0 != index->slots[pos]; pos = (pos + 1) & index->mask)
+			;
+
+		index->slots[pos] = i + 1;
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * validate and serialize retrieval commands of list once, see MCACHE_DataPrepareGet.
+ */
+static int
+s_DataPrepare(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList,
+	size_t nListSize, int nOpFlag)
+{
+	int ret = MCACHE_OK;
+	size_t next = 0;
+	struct retrievalBatch batch;
+	MemCachePrepared *prepared = NULL;
+
+	if (NULL == ppstPrepared || NULL == pstMCServer || NULL == pstMCDataList || 0 == nListSize)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL == (prepared = (MemCachePrepared *) calloc(1, sizeof(MemCachePrepared))))
+		return MCACHE_ERR_NOMEM;
+
+	prepared->op = nOpFlag;
+	prepared->list_size = nListSize;
+
+	//at most one command per key
+	if (NULL == (prepared->batches = (struct retrievalBatch *) calloc(nListSize, sizeof(struct retrievalBatch)))) {
+		free(prepared);
+		return MCACHE_ERR_NOMEM;
+	}
+
+	while (next < nListSize) {
+		batch.begin = next;
+		batch.index = NULL;
+
+		if (MCACHE_OK != (ret = s_RetrievalCommand(pstMCServer, pstMCDataList, nListSize, nOpFlag, 0, &batch)))
+			break;
+
+		next = batch.end;
+
+		if (NULL == batch.cmd)
+			continue;
+
+		prepared->batches[prepared->count++] = batch;
+
+		if (MCACHE_OK != (ret = s_PreparedIndex(pstMCDataList, nOpFlag, prepared->batches + prepared->count - 1)))
+			break;
+	}
+
+	if (MCACHE_OK != ret) {
+		s_PreparedFree(prepared);
+		return ret;
+	}
+
+	*ppstPrepared = prepared;
+
+	return MCACHE_OK;
+}
+
+static int
+s_RetrieveStream(struct sockReader *pstReader, MemCacheData *pstMCData, void *pArg)
+{
+	struct streamInfo *info = (struct streamInfo *) pArg;
+
+	s_TraceCallback(pstReader->server, pstMCData);
+
+	if (0 <= info->fd)
+		return s_ReaderSplice(pstReader, pstMCData, pstMCData->nDataLen, info->fd, &info->result);
+
+	return s_ReaderStream(pstReader, pstMCData, pstMCData->nDataLen, info->func, info->arg, &info->result);
+}
+
+/**
+ * malloc value and read data block into it, buffered bytes are copied and the rest is read from socket directly.
+ * value is terminated by an extra '\0' not counted in nDataLen.
+ */
+static int
+s_RetrieveCopy(struct sockReader *pstReader, MemCacheData *pstMCData, void *pArg)
+{
+	int ret = MCACHE_OK;
+	MemCacheServer *server = (MemCacheServer *) pArg;
+
+	if (MCACHE_FLAG_FREE_VALUE == (server->nFlag & MCACHE_FLAG_FREE_VALUE) && NULL != pstMCData->pDataValue)
+		s_Free(server, pstMCData->pDataValue);
+
+	//value is drained to keep connection in sync, and data is not counted as fetched
+	if (NULL == (pstMCData->pDataValue = s_Alloc(server, pstMCData->nDataLen + 1))) {
+		if (MCACHE_OK == (ret = s_ReaderStream(pstReader, pstMCData, pstMCData->nDataLen, NULL, NULL, NULL)))
+			ret = RETRIEVAL_DROPPED;
+
+		return ret;
+	}
+
+	if (MCACHE_OK == (ret = s_ReaderCopy(pstReader, pstMCData->pDataValue, pstMCData->nDataLen)))
+		((char *) pstMCData->pDataValue)[pstMCData->nDataLen] = '\0';
+
+	return ret;
+}
+
+static int
+s_RetrieveView(struct sockReader *pstReader, MemCacheData *pstMCData, void *pArg)
+{
+	int ret = MCACHE_OK;
+	size_t len = pstMCData->nDataLen;
+	struct itemInfo *info = (struct itemInfo *) pArg;
+
+	if (MCACHE_OK != info->result)
+		return s_ReaderStream(pstReader, pstMCData, len, NULL, NULL, NULL);
+
+	if (MCACHE_OK != (ret = s_ReaderEnsure(pstReader, len)))
+		return ret;
+
+	s_TraceCallback(pstReader->server, pstMCData);
+	info->result = info->hit(pstMCData, pstReader->buffer + pstReader->begin, info->arg);
+	pstReader->begin += len;
+
+	return MCACHE_OK;
+}
+
+/**
+ * hand fetched value to update callback of MCACHE_DataUpdate, which replaces pDataValue with new value.
+ */
+static int
+s_RetrieveUpdate(struct sockReader *pstReader, MemCacheData *pstMCData, void *pArg)
+{
+	int ret = MCACHE_OK;
+	size_t len = pstMCData->nDataLen;
+	struct updateInfo *info = (struct updateInfo *) pArg;
+
+	if (MCACHE_OK != (ret = s_ReaderEnsure(pstReader, len)))
+		return ret;
+
+	s_TraceCallback(pstReader->server, pstMCData);
+	info->status[pstMCData - info->list] = info->func(pstMCData, pstReader->buffer + pstReader->begin, info->arg);
+	pstReader->begin += len;
+
+	return MCACHE_OK;
+}
+
+/**
+ * get or gets through negative cache of server, keys recently confirmed missing are answered as misses locally.
+ * misses are recorded unless some key was stored by this client meanwhile.
+ */
+static int
+s_NegativeRetrieval(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag)
+{
+	int ret = MCACHE_OK;
+	size_t i = 0;
+	size_t count = 0;
+	size_t skipped = 0;
+	uint64_t epoch = 0;
+	uint32_t now = 0;
+	size_t *map = NULL;
+	char *hit = NULL;
+	uint64_t *hash = NULL;
+	MemCacheData *list = NULL;
+	struct negativeSlot *slot = NULL;
+	struct memCacheNegative *negative = pstMCServer->pstNegative;
+
+	if (NULL == pstMCDataList || 0 == nListSize)
+		return MCACHE_ERR_INVAL;
+
+	map = (size_t *) malloc(nListSize * sizeof(size_t));
+	hit = (char *) calloc(nListSize, 1);
+	hash = (uint64_t *) malloc(nListSize * sizeof(uint64_t));
+	list = (MemCacheData *) malloc(nListSize * sizeof(MemCacheData));
+
+	if (NULL == map || NULL == hit || NULL == hash || NULL == list) {
+		ret = MCACHE_ERR_NOMEM;
+		goto end;
+	}
+
+	pthread_mutex_lock(&negative->lock);
+	epoch = negative->epoch;
+	now = s_NegativeNow(negative);
+
+	for (i = 0; i < nListSize; i++) {
+		hash[count] = 0;
+
+		if (NULL != pstMCDataList[i].pszDataKey) {
+			hash[count] = s_NegativeHash(pstMCDataList[i].pszDataKey, s_KeyLen(pstMCDataList + i));
+
+			if (NULL != (slot = s_NegativeFind(negative, hash[count]))) {
+				if ((uint32_t) (now - slot->stamp) < negative->ttl) {
+					skipped++;
+					continue;
+				}
+
+				slot->fp = 0;
+			}
+		}
+
+		map[count] = i;
+		list[count++] = pstMCDataList[i];
+	}
+
+	pthread_mutex_unlock(&negative->lock);
+
+	if (0 == count) {
+		ret = MCACHE_ERR_PARTIAL;
+		goto end;
+	}
+
+	if (NULL != pstMCServer->pstGroup && 1 == count) {
+		ret = s_GroupRun(pstMCServer, list, nOpFlag, 0);
+		hit[0] = MCACHE_OK == ret;
+	}
+	else
+		ret = s_DataRetrievalRun(pstMCServer, list, count, nOpFlag, 0, s_RetrieveCopy, pstMCServer, hit);
+
+	for (i = 0; i < count; i++)
+		pstMCDataList[map[i]] = list[i];
+
+	if (MCACHE_OK != ret && MCACHE_ERR_PARTIAL != ret)
+		goto end;
+
+	pthread_mutex_lock(&negative->lock);
+
+	for (i = 0; epoch == negative->epoch && i < count; i++) {
+		if (0 == hit[i])
+			s_NegativeAdd(negative, hash[i], s_NegativeNow(negative));
+	}
+
+	pthread_mutex_unlock(&negative->lock);
+
+	if (0 < skipped)
+		ret = MCACHE_ERR_PARTIAL;
+
+end:
+
+	if (NULL != map)
+		free(map);
+
+	if (NULL != hit)
+		free(hit);
+
+	if (NULL != hash)
+		free(hash);
+
+	if (NULL != list)
+		free(list);
+
+	return ret;
+}
+
+static int
+s_DataRetrieval(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag, size_t nExpiration)
+{
+	if (NULL != pstMCServer && NULL != pstMCServer->pstNegative && (MCACHE_OP_GET == nOpFlag || MCACHE_OP_GETS == nOpFlag))
+		return s_NegativeRetrieval(pstMCServer, pstMCDataList, nListSize, nOpFlag);
+
+	if (NULL != pstMCServer && NULL != pstMCServer->pstGroup && 1 == nListSize &&
+		(MCACHE_OP_GET == nOpFlag || MCACHE_OP_GETS == nOpFlag))
+		return s_GroupRun(pstMCServer, pstMCDataList, nOpFlag, 0);
+
+	return s_DataRetrievalRun(pstMCServer, pstMCDataList, nListSize, nOpFlag, nExpiration, s_RetrieveCopy, pstMCServer, NULL);
+}
+
+static int
+s_DataRetrievalEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag,
+	MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg)
+{
+	size_t i = 0;
+	int ret = MCACHE_OK;
+	char *hit = NULL;
+	struct itemInfo info;
+
+	if (NULL == pfnHit || NULL == pstMCDataList)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL != pfnMiss && NULL == (hit = (char *) calloc(nListSize + 1, 1)))
+		return MCACHE_ERR_NOMEM;
+
+	info.hit = pfnHit;
+	info.arg = pArg;
+	info.result = MCACHE_OK;
+
+	ret = s_DataRetrievalRun(pstMCServer, pstMCDataList, nListSize, nOpFlag, 0, s_RetrieveView, &info, hit);
+
+	if (MCACHE_OK == ret || MCACHE_ERR_PARTIAL == ret) {
+		for (i = 0; NULL != pfnMiss && i < nListSize && MCACHE_OK == info.result; i++) {
+			if (0 == hit[i])
+				info.result = pfnMiss(pstMCDataList + i, NULL, pArg);
+		}
+
+		if (MCACHE_OK != info.result)
+			ret = info.result;
+	}
+
+	if (NULL != hit)
+		free(hit);
+
+	return ret;
+}
+
+/**
+ * sleep for a random period in [nDelay / 2, nDelay] microseconds, so that contending clients do not retry in lockstep.
+ */
+static void
+s_Backoff(int64_t nDelay, unsigned int *pnSeed)
+{
+	struct timespec ts;
+
+	nDelay = nDelay / 2 + rand_r(pnSeed) % (nDelay / 2 + 1);
+	ts.tv_sec = nDelay / 1000000;
+	ts.tv_nsec = (nDelay % 1000000) * 1000;
+
+	while (0 != nanosleep(&ts, &ts) && EINTR == errno)
+		;
+}
+
+/**
+ * read-modify-write data of list with "gets" and "cas" ("add" for data not found), data are fetched in one pipeline
+ * and stored in one bulk per round, data losing a race are retried up to nRetry times with jittered backoff.
+ * "gets" rides behind every "cas"/"add", so losers get current value and CAS with their failure and retries cost no
+ * extra round trip. value computed by pfnUpdate is kept in data of list once callback has run, and handed back to
+ * it on retry.
+ */
+static int
+s_DataUpdate(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheItemFunc pfnUpdate, void *pArg, int nRetry, int *pnStatus)
+{
+	int ret = MCACHE_OK;
+	int attempt = 0;
+	int *ops = NULL;
+	int *status = NULL;
+	int *result = NULL;
+	size_t i = 0;
+	size_t k = 0;
+	size_t count = 0;
+	size_t pending = 0;
+	size_t failed = 0;
+	size_t *map = NULL;
+	char *hit = NULL;
+	unsigned int seed = 0;
+	int64_t delay = UPDATE_BACKOFF_USEC;
+	MemCacheData *work = NULL;
+	struct bulkRequest request;
+	struct updateInfo info;
+
+	if (NULL == pstMCServer || NULL == pstMCDataList || NULL == pfnUpdate || 0 > pstMCServer->nSockFD)
+		return MCACHE_ERR_INVAL;
+
+	if (0 == nListSize)
+		return MCACHE_OK;
+
+	work = (MemCacheData *) malloc(nListSize * sizeof(MemCacheData));
+	map = (size_t *) malloc(nListSize * sizeof(size_t));
+	ops = (int *) malloc(nListSize * sizeof(int));
+	status = (int *) malloc(nListSize * sizeof(int));
+	result = (int *) malloc(nListSize * sizeof(int));
+	hit = (char *) malloc(nListSize);
+
+	if (NULL == work || NULL == map || NULL == ops || NULL == status || NULL == result || NULL == hit) {
+		ret = MCACHE_ERR_NOMEM;
+		goto end;
+	}
+
+	for (i = 0; i < nListSize; i++) {
+		if (NULL == pstMCDataList[i].pszDataKey) {
+			if (NULL != pnStatus)
+				pnStatus[i] = MCACHE_ERR_INVAL;
+
+			failed++;
+			continue;
+		}
+
+		map[pending++] = i;
+	}
+
+	seed = (unsigned int) (s_NowUSec() ^ (int64_t) getpid());
+	info.func = pfnUpdate;
+	info.arg = pArg;
+	info.list = work;
+	info.status = result;
+
+	memset(&request, 0, sizeof(request));
+	request.ops = ops;
+	request.refetch_arg = &info;
+	request.refetched = hit;
+
+	for (k = 0; k < pending; k++) {
+		work[k] = pstMCDataList[map[k]];
+		work[k].pDataValue = NULL;
+		work[k].nDataLen = 0;
+		work[k].nCASUnique = 0;
+		result[k] = MCACHE_OK;
+	}
+
+	memset(hit, 0, pending);
+
+	//only first round fetches, later ones use values fetched along with failures
+	ret = s_DataRetrievalRun(pstMCServer, work, pending, MCACHE_OP_GETS, 0, s_RetrieveUpdate, &info, hit);
+
+	if (MCACHE_OK != ret && MCACHE_ERR_PARTIAL != ret) {
+		for (k = 0; k < pending; k++) {
+			if (hit[k])
+				pstMCDataList[map[k]].pDataValue = work[k].pDataValue;
+		}
+
+		pending = 0;
+	}
+
+	for (attempt = 0; 0 < pending; attempt++) {
+		if (0 < attempt) {
+			s_Backoff(delay, &seed);
+
+			if (UPDATE_BACKOFF_MAX_USEC < (delay *= 2))
+				delay = UPDATE_BACKOFF_MAX_USEC;
+		}
+
+		ret = MCACHE_OK;
+
+		//data not found is created by "add", data whose callback fails is dropped
+		for (k = 0, count = 0; k < pending; k++) {
+			if (0 == hit[k]) {
+				work[k].nDataLen = 0;
+				work[k].nCASUnique = 0;
+				result[k] = pfnUpdate(work + k, NULL, pArg);
+			}
+
+			if (MCACHE_OK != result[k]) {
+				pstMCDataList[map[k]].pDataValue = work[k].pDataValue;
+				pstMCDataList[map[k]].nDataLen = work[k].nDataLen;
+
+				if (NULL != pnStatus)
+					pnStatus[map[k]] = result[k];
+
+				failed++;
+				continue;
+			}
+
+			ops[count] = hit[k] ? MCACHE_OP_CAS : MCACHE_OP_ADD;
+			work[count] = work[k];
+			map[count] = map[k];
+			result[count] = MCACHE_OK;
+			hit[count] = 0;
+			count++;
+		}
+
+		if (0 == count)
+			break;
+
+		//last round has no use for current values
+		request.refetch = attempt < nRetry ? s_RetrieveUpdate : NULL;
+		ret = s_DataBulk(pstMCServer, work, count, &request, status);
+
+		if (MCACHE_OK != ret && MCACHE_ERR_PARTIAL != ret) {
+			for (k = 0; k < count; k++) {
+				pstMCDataList[map[k]].pDataValue = work[k].pDataValue;
+				pstMCDataList[map[k]].nDataLen = work[k].nDataLen;
+
+				if (NULL != pnStatus)
+					pnStatus[map[k]] = status[k];
+			}
+
+			break;
+		}
+
+		ret = MCACHE_OK;
+
+		//data modified, deleted or created by others since fetched are retried with value fetched along
+		for (k = 0, pending = 0; k < count; k++) {
+			pstMCDataList[map[k]].pDataValue = work[k].pDataValue;
+			pstMCDataList[map[k]].nDataLen = work[k].nDataLen;
+
+			if (MCACHE_OK == status[k]) {
+				pstMCDataList[map[k]].nFlags = work[k].nFlags;
+			}
+			else if (attempt < nRetry && (MCACHE_ERR_EXISTS == status[k] || MCACHE_ERR_NOT_FOUND == status[k] ||
+				MCACHE_ERR_NOT_STORED == status[k])) {
+				work[pending] = work[k];
+				result[pending] = result[k];
+				hit[pending] = hit[k];
+				map[pending++] = map[k];
+				continue;
+			}
+			else {
+				failed++;
+			}
+
+			if (NULL != pnStatus)
+				pnStatus[map[k]] = status[k];
+		}
+	}
+
+end:
+
+	if (NULL != work)
+		free(work);
+
+	if (NULL != map)
+		free(map);
+
+	if (NULL != ops)
+		free(ops);
+
+	if (NULL != status)
+		free(status);
+
+	if (NULL != result)
+		free(result);
+
+	if (NULL != hit)
+		free(hit);
+
+	if (MCACHE_OK == ret && 0 < failed)
+		ret = MCACHE_ERR_PARTIAL;
+
+	return ret;
+}
+
+/**
+ * incr/decr without allocation, new value is parsed into *pnValue (optional).
+ */
+static int
+s_DataCount(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, int nOpFlag, uint64_t *pnValue)
+{
+	int ret = MCACHE_OK;
+	int len = 0;
+	size_t line_len = 0;
+	uint64_t value = 0;
+	char *line = NULL;
+	char *cursor = NULL;
+	int64_t begin = 0;
+	char buffer[BULK_HEADER_SIZE];
+	struct sockReader reader;
+
+	if (MCACHE_OK != (ret = s_ChkInput(pstMCServer, pstMCData, nOpFlag)))
+		return ret;
+
+	len = s_BulkCommand(pstMCData, nOpFlag, nNum, 0, buffer, sizeof(buffer));
+
+	if (0 >= len || sizeof(buffer) <= (size_t) len)
+		return MCACHE_ERR_INVAL;
+
+	begin = s_ServerEnter(pstMCServer, nOpFlag, pstMCData, 1);
+	s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_START, 0);
+
+	if (MCACHE_OK != (ret = s_SockWrite(pstMCServer->nSockFD, buffer, len, pstMCServer->nTimeout))) {
+		s_ServerLeave(pstMCServer, begin, nOpFlag, ret, 1, 0);
+		return ret;
+	}
+
+	s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_END, len);
+
+	s_ReaderInit(&reader, pstMCServer, pstMCServer->nTimeout, buffer, sizeof(buffer));
+
+	if (MCACHE_OK == (ret = s_ReaderLine(&reader, &line, &line_len))) {
+		cursor = line;
+
+		if (MCACHE_OK == s_ParseNumber(&cursor, line + line_len, &value) && cursor == line + line_len) {
+			if (NULL != pnValue)
+				*pnValue = value;
+		}
+		else {
+			ret = s_StorageResult(line);
+		}
+	}
+
+	s_ReaderFree(&reader);
+	s_ServerLeave(pstMCServer, begin, nOpFlag, ret, 1, len);
+
+	return ret;
+}
+
+static uint32_t
+s_CounterHash(const char *pKey, size_t nKeyLen)
+{
+	uint32_t hash = 2166136261u;
+
+	for (; 0 < nKeyLen; nKeyLen--, pKey++)
+		hash = (hash ^ (unsigned char) *pKey) * 16777619u;
+
+	return hash;
+}
+
+/**
+ * shard of calling thread, so threads counting the same key rarely share a lock.
+ */
+static struct counterShard *
+s_CounterShard(MemCacheCounter *pstCounter)
+{
+	return pstCounter->shards + (s_ThreadHash() % COUNTER_SHARDS);
+}
+
+/**
+ * add nDelta to entry of key in shard, key is copied if entry does not exist (*pnNew is set then).
+ * caller holds shard lock.
+ */
+static int
+s_CounterMerge(struct counterShard *pstShard, const char *pszKey, uint32_t nHash, int64_t nDelta, int *pnNew)
+{
+	size_t i = 0;
+	size_t mask = 0;
+	struct counterEntry *slots = NULL;
+
+	if (pstShard->count * 2 >= pstShard->size) {
+		size_t size = 0 < pstShard->size ? pstShard->size * 2 : COUNTER_SLOTS_MIN;
+
+		if (NULL == (slots = (struct counterEntry *) calloc(size, sizeof(struct counterEntry))))
+			return MCACHE_ERR_NOMEM;
+
+		for (i = 0; i < pstShard->size; i++) {
+			size_t k = pstShard->slots[i].hash & (size - 1);
+
+			if (NULL == pstShard->slots[i].key)
+				continue;
+
+			while (NULL != slots[k].key)
+				k = (k + 1) & (size - 1);
+
+			slots[k] = pstShard->slots[i];
+		}
+
+		free(pstShard->slots);
+		pstShard->slots = slots;
+		pstShard->size = size;
+	}
+
+	mask = pstShard->size - 1;
+
+	for (i = nHash & mask; NULL != pstShard->slots[i].key; i = (i + 1) & mask) {
+		if (nHash == pstShard->slots[i].hash && 0 == strcmp(pstShard->slots[i].key, pszKey)) {
+			pstShard->slots[i].delta += nDelta;
+			*pnNew = 0;
+			return MCACHE_OK;
+		}
+	}
+
+	if (NULL == (pstShard->slots[i].key = strdup(pszKey)))
+		return MCACHE_ERR_NOMEM;
+
+	pstShard->slots[i].hash = nHash;
+	pstShard->slots[i].delta = nDelta;
+	pstShard->count++;
+	*pnNew = 1;
+
+	return MCACHE_OK;
+}
+
+static int
+s_CounterAdd(MemCacheCounter *pstCounter, const char *pszKey, int64_t nDelta)
+{
+	int ret = MCACHE_OK;
+	int created = 0;
+	struct counterShard *shard = s_CounterShard(pstCounter);
+
+	pthread_mutex_lock(&shard->lock);
+	ret = s_CounterMerge(shard, pszKey, s_CounterHash(pszKey, strlen(pszKey)), nDelta, &created);
+	pthread_mutex_unlock(&shard->lock);
+
+	if (MCACHE_OK == ret && created)
+		__atomic_add_fetch(&pstCounter->pending, 1, __ATOMIC_RELAXED);
+
+	return ret;
+}
+
+/**
+ * send deltas in one bulk of incr/decr, keys not found are created by "add" and raced "add" falls back to "incr".
+ * deltas not applied for connection failure (or for lack of memory) are merged back to be sent by next flush,
+ * deltas already acknowledged by server are never sent again.
+ */
+static int
+s_CounterSend(MemCacheCounter *pstCounter, MemCacheData *pstMCDataList, int64_t *pnDeltas, size_t nListSize)
+{
+	int ret = MCACHE_OK;
+	int round = 0;
+	int *ops = NULL;
+	int *status = NULL;
+	uint64_t *nums = NULL;
+	uint64_t *results = NULL;
+	char (*values)[24] = NULL;
+	size_t i = 0;
+	size_t count = nListSize;
+	struct bulkRequest request;
+
+	//one block for all arrays, 64-bit ones first to keep them aligned. new values of incr/decr are parsed into
+	//results so that replies allocate nothing
+	if (NULL == (nums = (uint64_t *) malloc(nListSize * (2 * sizeof(uint64_t) + 2 * sizeof(int) + sizeof(*values))))) {
+		ret = MCACHE_ERR_NOMEM;
+		goto end;
+	}
+
+	results = nums + nListSize;
+	ops = (int *) (results + nListSize);
+	status = ops + nListSize;
+	values = (char (*)[24]) (status + nListSize);
+
+	memset(&request, 0, sizeof(request));
+	request.ops = ops;
+	request.nums = nums;
+	request.results = results;
+
+	for (i = 0; i < count; i++) {
+		ops[i] = 0 <= pnDeltas[i] ? MCACHE_OP_INCREMENT : MCACHE_OP_DECREMENT;
+		nums[i] = 0 <= pnDeltas[i] ? (uint64_t) pnDeltas[i] : (uint64_t) -pnDeltas[i];
+	}
+
+	//incr/decr, then add for data not found, then incr again for data added by others in between
+	for (round = 0; 0 < count && 3 > round; round++) {
+		size_t k = 0;
+
+		for (i = 0; i < count; i++)
+			status[i] = COUNTER_UNREAD;
+
+		ret = s_DataBulk(pstCounter->server, pstMCDataList, count, &request, status);
+
+		if (MCACHE_OK != ret && MCACHE_ERR_PARTIAL != ret)
+			break;
+
+		ret = MCACHE_OK;
+
+		for (i = 0, k = 0; i < count; i++) {
+			if (0 == round && MCACHE_ERR_NOT_FOUND == status[i]) {
+				ops[k] = MCACHE_OP_ADD;
+				snprintf(values[k], sizeof(values[k]), "%llu", (unsigned long long) (0 <= pnDeltas[i] ? nums[i] : 0));
+				pstMCDataList[i].pDataValue = values[k];
+				pstMCDataList[i].nDataLen = strlen(values[k]);
+			}
+			else if (1 == round && MCACHE_ERR_NOT_STORED == status[i]) {
+				ops[k] = 0 <= pnDeltas[i] ? MCACHE_OP_INCREMENT : MCACHE_OP_DECREMENT;
+			}
+			else {
+				continue;
+			}
+
+			nums[k] = nums[i];
+			pnDeltas[k] = pnDeltas[i];
+			pstMCDataList[k] = pstMCDataList[i];
+			k++;
+		}
+
+		count = k;
+	}
+
+end:
+
+	//deltas never sent or whose reply was not read are merged back, as are those not found or not stored
+	if (MCACHE_OK != ret) {
+		for (i = 0; i < count; i++) {
+			if (NULL == status || (MCACHE_OK != status[i] && MCACHE_ERR_ERROR != status[i] &&
+				MCACHE_ERR_DATA != status[i] && MCACHE_ERR_INVAL != status[i]))
+				s_CounterAdd(pstCounter, pstMCDataList[i].pszDataKey, pnDeltas[i]);
+		}
+	}
+
+	if (NULL != nums)
+		free(nums);
+
+	return ret;
+}
+
+/**
+ * take pending deltas out of every shard and send them.
+ */
+static int
+s_CounterFlush(MemCacheCounter *pstCounter)
+{
+	int ret = MCACHE_OK;
+	size_t i = 0;
+	size_t k = 0;
+	size_t count = 0;
+	size_t total = 0;
+	int64_t *deltas = NULL;
+	char **keys = NULL;
+	MemCacheData *list = NULL;
+	struct counterShard taken[COUNTER_SHARDS];
+
+	__atomic_store_n(&pstCounter->last_flush, s_NowUSec(), __ATOMIC_RELAXED);
+
+	for (i = 0; i < COUNTER_SHARDS; i++) {
+		struct counterShard *shard = pstCounter->shards + i;
+
+		pthread_mutex_lock(&shard->lock);
+		taken[i] = *shard;
+		shard->slots = NULL;
+		shard->size = 0;
+		shard->count = 0;
+		pthread_mutex_unlock(&shard->lock);
+
+		total += taken[i].count;
+	}
+
+	__atomic_sub_fetch(&pstCounter->pending, total, __ATOMIC_RELAXED);
+
+	if (0 < total) {
+		list = (MemCacheData *) calloc(total, sizeof(MemCacheData));
+		deltas = (int64_t *) malloc(total * sizeof(int64_t));
+		keys = (char **) malloc(total * sizeof(char *));
+	}
+
+	for (i = 0; i < COUNTER_SHARDS; i++) {
+		for (k = 0; k < taken[i].size; k++) {
+			if (NULL == taken[i].slots[k].key)
+				continue;
+
+			if (0 != taken[i].slots[k].delta && NULL != list && NULL != deltas && NULL != keys) {
+				keys[count] = taken[i].slots[k].key;
+				list[count].pszDataKey = keys[count];
+				deltas[count] = taken[i].slots[k].delta;
+				count++;
+			}
+			else {
+				free(taken[i].slots[k].key);
+			}
+		}
+
+		if (NULL != taken[i].slots)
+			free(taken[i].slots);
+	}
+
+	if (0 < total && (NULL == list || NULL == deltas || NULL == keys))
+		ret = MCACHE_ERR_NOMEM;
+	else if (0 < count)
+		ret = s_CounterSend(pstCounter, list, deltas, count);
+
+	//s_CounterSend compacts list, keys are freed in original order
+	for (i = 0; i < count; i++)
+		free(keys[i]);
+
+	if (NULL != keys)
+		free(keys);
+
+	if (NULL != list)
+		free(list);
+
+	if (NULL != deltas)
+		free(deltas);
+
+	return ret;
+}
+
+static void
+s_WriterUnlink(MemCacheWriter *pstWriter, struct writeItem *pstItem)
+{
+	struct writeItem **link = pstWriter->buckets + (pstItem->hash & pstWriter->mask);
+
+	while (*link != pstItem)
+		link = &(*link)->hnext;
+
+	*link = pstItem->hnext;
+
+	if (NULL != pstItem->prev)
+		pstItem->prev->next = pstItem->next;
+	else
+		pstWriter->head = pstItem->next;
+
+	if (NULL != pstItem->next)
+		pstItem->next->prev = pstItem->prev;
+	else
+		pstWriter->tail = pstItem->prev;
+
+	pstWriter->count--;
+}
+
+static void
+s_WriterDrop(MemCacheWriter *pstWriter, struct writeItem *pstItem)
+{
+	s_WriterUnlink(pstWriter, pstItem);
+	free(pstItem->value);
+	free(pstItem);
+}
+
+static void
+s_WriterFreeItems(struct writeItem *pstItem)
+{
+	struct writeItem *next = NULL;
+
+	for (; NULL != pstItem; pstItem = next) {
+		next = pstItem->next;
+		free(pstItem->value);
+		free(pstItem);
+	}
+}
+
+/**
+ * send items in one bulk of sets, replies are skipped if MCACHE_WRITER_NOREPLY is given.
+ */
+static int
+s_WriterSend(MemCacheWriter *pstWriter, struct writeItem *pstItems, size_t nCount)
+{
+	int ret = MCACHE_OK;
+	size_t i = 0;
+	MemCacheData *list = NULL;
+	struct bulkRequest request;
+
+	if (NULL == (list = (MemCacheData *) calloc(nCount, sizeof(MemCacheData))))
+		return MCACHE_ERR_NOMEM;
+
+	for (i = 0; i < nCount && NULL != pstItems; i++, pstItems = pstItems->next) {
+		list[i].pszDataKey = pstItems->key;
+		list[i].pDataValue = pstItems->value;
+		list[i].nDataLen = pstItems->len;
+		list[i].nFlags = pstItems->flags;
+		list[i].nExpiration = pstItems->expiration;
+	}
+
+	memset(&request, 0, sizeof(request));
+	request.op = MCACHE_OP_SET;
+	request.noreply = MCACHE_WRITER_NOREPLY == (pstWriter->flag & MCACHE_WRITER_NOREPLY);
+
+	ret = s_DataBulk(pstWriter->server, list, i, &request, NULL);
+	free(list);
+
+	return ret;
+}
+
+/**
+ * flusher thread of MemCacheWriter, takes whole queue at once so writers are blocked only while unlinking.
+ */
+static void *
+s_WriterThread(void *pArg)
+{
+	int ret = MCACHE_OK;
+	size_t count = 0;
+	struct writeItem *items = NULL;
+	struct writeItem *item = NULL;
+	struct timespec ts;
+	MemCacheWriter *writer = (MemCacheWriter *) pArg;
+
+	pthread_mutex_lock(&writer->lock);
+
+	for (;;) {
+		while (!writer->stop && 0 == writer->count)
+			pthread_cond_wait(&writer->wake, &writer->lock);
+
+		if (0 == writer->count)
+			break;
+
+		//wait a little for more items unless queue is already half full
+		if (!writer->stop && 0 < writer->linger && writer->count * 2 < writer->max_items) {
+			int64_t deadline = 0;
+
+			clock_gettime(CLOCK_REALTIME, &ts);
+			deadline = (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + writer->linger;
+			ts.tv_sec = deadline / 1000000;
+			ts.tv_nsec = (deadline % 1000000) * 1000;
+
+			while (!writer->stop && writer->count * 2 < writer->max_items &&
+				ETIMEDOUT != pthread_cond_timedwait(&writer->wake, &writer->lock, &ts))
+				;
+		}
+
+		items = writer->head;
+		count = writer->count;
+
+		for (item = items; NULL != item; item = item->next)
+			writer->buckets[item->hash & writer->mask] = NULL;
+
+		writer->head = NULL;
+		writer->tail = NULL;
+		writer->count = 0;
+		writer->busy = 1;
+		pthread_cond_broadcast(&writer->space);
+		pthread_mutex_unlock(&writer->lock);
+
+		ret = s_WriterSend(writer, items, count);
+		s_WriterFreeItems(items);
+
+		pthread_mutex_lock(&writer->lock);
+		writer->busy = 0;
+
+		if (MCACHE_OK == writer->result)
+			writer->result = ret;
+
+		if (0 == writer->count)
+			pthread_cond_broadcast(&writer->idle);
+	}
+
+	writer->busy = 0;
+	pthread_cond_broadcast(&writer->idle);
+	pthread_mutex_unlock(&writer->lock);
+
+	return NULL;
+}
+
+/**
+ * run one synchronous call through group commit of server. callers arriving while a leader gathers or sends calls
+ * wait in queue, the next leader sends all of them by one s_DataBulk and hands results back.
+ */
+static int
+s_GroupRun(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nOpFlag, uint64_t nNum)
+{
+	int ret = MCACHE_OK;
+	struct groupCall call;
+	struct memCacheGroup *group = pstMCServer->pstGroup;
+
+	if (MCACHE_OK != (ret = s_ChkInput(pstMCServer, pstMCData, nOpFlag)))
+		return ret;
+
+	if (s_TraceOn(pstMCServer))
+		s_TraceEmit(pstMCServer, MCACHE_TRACE_ENQUEUE, nOpFlag, s_TraceHash(pstMCData), 1,
+			s_IsStorageOp(nOpFlag) ? pstMCData->nDataLen : 0, MCACHE_OK);
+
+	memset(&call, 0, sizeof(call));
+	call.data = pstMCData;
+	call.op = nOpFlag;
+	call.num = nNum;
+
+	pthread_mutex_lock(&group->lock);
+
+	if (NULL != group->tail)
+		group->tail->next = &call;
+	else
+		group->head = &call;
+
+	group->tail = &call;
+
+	//let a gathering leader go at once
+	if (++group->count >= (0 < pstMCServer->nBatchKeys ? pstMCServer->nBatchKeys : MCACHE_MULTIGET_MAX))
+		pthread_cond_broadcast(&group->cond);
+
+	while (!call.done) {
+		size_t i = 0;
+		size_t count = 0;
+		size_t max_keys = 0 < pstMCServer->nBatchKeys ? pstMCServer->nBatchKeys : MCACHE_MULTIGET_MAX;
+		int *ops = NULL;
+		int *status = NULL;
+		uint64_t *nums = NULL;
+		MemCacheData *list = NULL;
+		struct groupCall *calls = NULL;
+		struct groupCall *cur = NULL;
+		struct bulkRequest request;
+		struct timespec ts;
+
+		if (group->leader) {
+			pthread_cond_wait(&group->cond, &group->lock);
+			continue;
+		}
+
+		group->leader = 1;
+
+		if (0 < group->window && 1 < group->last_size) {
+			int64_t deadline = 0;
+
+			clock_gettime(CLOCK_REALTIME, &ts);
+			deadline = (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + group->window;
+			ts.tv_sec = deadline / 1000000;
+			ts.tv_nsec = (deadline % 1000000) * 1000;
+
+			while (group->count < max_keys &&
+				ETIMEDOUT != pthread_cond_timedwait(&group->cond, &group->lock, &ts))
+				;
+		}
+
+		calls = group->head;
+		count = group->count;
+		group->head = NULL;
+		group->tail = NULL;
+		group->count = 0;
+		pthread_mutex_unlock(&group->lock);
+
+		list = (MemCacheData *) malloc(count * sizeof(MemCacheData));
+		ops = (int *) malloc(count * sizeof(int));
+		nums = (uint64_t *) malloc(count * sizeof(uint64_t));
+		status = (int *) malloc(count * sizeof(int));
+
+		if (NULL == list || NULL == ops || NULL == nums || NULL == status) {
+			ret = MCACHE_ERR_NOMEM;
+			count = 0;
+		}
+		else {
+			for (i = 0, cur = calls; i < count; i++, cur = cur->next) {
+				list[i] = *cur->data;
+				ops[i] = cur->op;
+				nums[i] = cur->num;
+			}
+
+			memset(&request, 0, sizeof(request));
+			request.ops = ops;
+			request.nums = nums;
+
+			ret = s_DataBulk(pstMCServer, list, count, &request, status);
+		}
+
+		pthread_mutex_lock(&group->lock);
+
+		for (i = 0, cur = calls; NULL != cur; i++, cur = cur->next) {
+			if (i < count) {
+				*cur->data = list[i];
+				cur->status = status[i];
+			}
+			else {
+				cur->status = ret;
+			}
+
+			cur->done = 1;
+		}
+
+		group->last_size = i;
+		group->leader = 0;
+		pthread_cond_broadcast(&group->cond);
+
+		if (NULL != list)
+			free(list);
+
+		if (NULL != ops)
+			free(ops);
+
+		if (NULL != nums)
+			free(nums);
+
+		if (NULL != status)
+			free(status);
+	}
+
+	pthread_mutex_unlock(&group->lock);
+
+	return call.status;
+}
+
+/**
+ * failures after which state of connection is unknown, so it can not be used any more.
+ */
+static int
+s_IsConnError(int nRet)
+{
+	return MCACHE_ERR_NET == nRet || MCACHE_ERR_IO == nRet || MCACHE_ERR_TIMEOUT == nRet || MCACHE_ERR_DATA == nRet;
+}
+
+static int
+s_ServerReconnect(MemCacheServer *pstMCServer)
+{
+	if (0 <= pstMCServer->nSockFD)
+		close(pstMCServer->nSockFD);
+
+	pstMCServer->nDiscard = 0;
+
+	pstMCServer->nSockFD = s_ConnectTCP(pstMCServer->pszServerAddr, pstMCServer->nPort, pstMCServer->nTimeout,
+		pstMCServer->nFlag);
+
+	return 0 > pstMCServer->nSockFD ? MCACHE_ERR_NET : MCACHE_OK;
+}
+
+static void
+s_ReplicaFail(MemCacheReplicaSet *pstReplicaSet, size_t nIndex)
+{
+	MemCacheServer *server = pstReplicaSet->apstServers[nIndex];
+
+	if (0 <= server->nSockFD) {
+		close(server->nSockFD);
+		server->nSockFD = -1;
+	}
+
+	//responses pending on old connection are gone
+	server->nDiscard = 0;
+	pstReplicaSet->anDownUntil[nIndex] = s_NowUSec() + (int64_t) MCACHE_REPLICA_RETRY * 1000000;
+}
+
+/**
+ * skip retrieval responses left on connection by hedged gets which lost, waiting for them at most nWait
+ * microseconds. MCACHE_ERR_TIMEOUT leaves connection usable but busy.
+ */
+static int
+s_ServerDrain(MemCacheServer *pstMCServer, int64_t nWait)
+{
+	int ret = MCACHE_OK;
+	size_t line_len = 0;
+	char *line = NULL;
+	char *key = NULL;
+	MemCacheData header;
+	struct pollfd pfd;
+	struct sockReader reader;
+
+	while (0 < pstMCServer->nDiscard) {
+		pfd.fd = pstMCServer->nSockFD;
+		pfd.events = POLLIN;
+
+		if (1 != poll(&pfd, 1, (int) (nWait / 1000)))
+			return MCACHE_ERR_TIMEOUT;
+
+		if (MCACHE_OK != (ret = s_ReaderInit(&reader, pstMCServer, pstMCServer->nTimeout, NULL, 0)))
+			return ret;
+
+		while (MCACHE_OK == (ret = s_ReaderLine(&reader, &line, &line_len)) && 0 != strcmp(line, "END")) {
+			if (MCACHE_OK != (ret = s_ParseValueLine(line, line_len, MCACHE_OP_GET, &key, &header)) ||
+				MCACHE_OK != (ret = s_ReaderStream(&reader, &header, header.nDataLen, NULL, NULL, NULL)) ||
+				MCACHE_OK != (ret = s_ReaderEndOfData(&reader)))
+				break;
+		}
+
+		s_ReaderFree(&reader);
+
+		if (MCACHE_OK != ret)
+			return ret;
+
+		pstMCServer->nDiscard--;
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * store indexes of usable replicas into pnOrder, the one to try first is chosen by nSelect of replica set and the
+ * rest follow by load (see s_ServerLoad) for failover. replicas marked down are reconnected once their retry time
+ * has come. replicas still receiving responses of lost hedges are put last for reads, but writes (nWrite) must
+ * reach them, so their responses are drained for up to nTimeout first.
+ */
+static size_t
+s_ReplicaOrder(MemCacheReplicaSet *pstReplicaSet, size_t *pnOrder, int nWrite)
+{
+	int ret = MCACHE_OK;
+	int pass = 0;
+	size_t i = 0;
+	size_t k = 0;
+	size_t count = 0;
+	size_t busy = 0;
+	int64_t now = s_NowUSec();
+	int64_t load[MCACHE_REPLICA_MAX];
+
+	//replicas still receiving responses of lost hedges are used only if no other one is usable
+	for (pass = 0; 0 == pass || (1 == pass && 0 == count && 0 < busy); pass++) {
+		for (i = 0; i < pstReplicaSet->nServerCount; i++) {
+			MemCacheServer *server = pstReplicaSet->apstServers[i];
+
+			if (0 > server->nSockFD) {
+				if (0 < pass || now < pstReplicaSet->anDownUntil[i])
+					continue;
+
+				if (MCACHE_OK != s_ServerReconnect(server)) {
+					s_ReplicaFail(pstReplicaSet, i);
+					continue;
+				}
+			}
+
+			if (0 < server->nDiscard) {
+				ret = s_ServerDrain(server, 0 == pass && !nWrite ? 0 : (int64_t) server->nTimeout * 1000000);
+
+				if (MCACHE_ERR_TIMEOUT == ret && 0 == pass) {
+					busy++;
+					continue;
+				}
+
+				if (MCACHE_OK != ret) {
+					s_ReplicaFail(pstReplicaSet, i);
+					continue;
+				}
+			}
+			else if (0 < pass) {
+				continue;
+			}
+
+			load[i] = s_ServerLoad(server, now);
+
+			//insertion sort, there are only a few replicas
+			for (k = count; 0 < k && load[pnOrder[k - 1]] > load[i]; k--)
+				pnOrder[k] = pnOrder[k - 1];
+
+			pnOrder[k] = i;
+			count++;
+		}
+	}
+
+	//power of two choices: the better of two random replicas goes first
+	if (MCACHE_SELECT_P2C == pstReplicaSet->nSelect && 2 < count) {
+		uint64_t r = (uint64_t) now * 0x9e3779b97f4a7c15ULL;
+		size_t a = (r >> 32) % count;
+		size_t b = (a + 1 + (r >> 16) % (count - 1)) % count;
+		size_t first = a < b ? a : b;
+
+		//order is sorted, so the smaller position is the less loaded one
+		for (k = pnOrder[first]; 0 < first; first--)
+			pnOrder[first] = pnOrder[first - 1];
+
+		pnOrder[0] = k;
+	}
+
+	return count;
+}
+
+/**
+ * send storage or delete command to replicas, all commands are written before any reply is read so replicas work
+ * in parallel. with MCACHE_ACK_ONE only the least loaded replica replies and others get "noreply" commands, the
+ * next replica is asked for a reply if it fails.
+ */
+static int
+s_ReplicaWrite(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData, int nOpFlag, uint64_t nNum)
+{
+	int ret = MCACHE_OK;
+	int result = MCACHE_ERR_NET;
+	int len = 0;
+	int noreply_len = 0;
+	size_t i = 0;
+	size_t k = 0;
+	size_t count = 0;
+	size_t acked = 0;
+	size_t order[MCACHE_REPLICA_MAX];
+	int status[MCACHE_REPLICA_MAX];
+	char header[BULK_HEADER_SIZE];
+	char noreply[BULK_HEADER_SIZE];
+	struct iovec iov[3];
+	int all = MCACHE_ACK_ALL == pstReplicaSet->nAck;
+
+	count = s_ReplicaOrder(pstReplicaSet, order, 1);
+
+	for (k = 0; k < count; k++) {
+		if (MCACHE_OK != (ret = s_ChkInput(pstReplicaSet->apstServers[order[k]], pstMCData, nOpFlag)))
+			return ret;
+
+		if (s_IsStorageOp(nOpFlag))
+			s_NegativeInvalidate(pstReplicaSet->apstServers[order[k]], pstMCData);
+	}
+
+	len = s_BulkCommand(pstMCData, nOpFlag, nNum, 0, header, sizeof(header));
+	noreply_len = s_BulkCommand(pstMCData, nOpFlag, nNum, 1, noreply, sizeof(noreply));
+
+	if (0 >= len || sizeof(header) <= (size_t) len || 0 >= noreply_len || sizeof(noreply) <= (size_t) noreply_len)
+		return MCACHE_ERR_INVAL;
+
+	for (i = 0; i < count; i++) {
+		//replica answering in MCACHE_ACK_ONE mode, advanced on failure
+		int reply = all || i == acked;
+		MemCacheServer *server = pstReplicaSet->apstServers[order[i]];
+
+		iov[0].iov_base = reply ? header : noreply;
+		iov[0].iov_len = reply ? len : noreply_len;
+		iov[1].iov_base = pstMCData->pDataValue;
+		iov[1].iov_len = pstMCData->nDataLen;
+		iov[2].iov_base = "\r\n";
+		iov[2].iov_len = 2;
+
+		status[i] = s_SockWritev(server->nSockFD, iov, s_IsStorageOp(nOpFlag) ? 3 : 1, server->nTimeout);
+
+		if (MCACHE_OK != status[i]) {
+			s_ReplicaFail(pstReplicaSet, order[i]);
+
+			if (i == acked)
+				acked++;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		MemCacheServer *server = pstReplicaSet->apstServers[order[i]];
+
+		if (!all && i != acked)
+			continue;
+
+		if (MCACHE_OK == status[i])
+			status[i] = s_StorageReply(server, server->nTimeout);
+
+		if (s_IsConnError(status[i]))
+			s_ReplicaFail(pstReplicaSet, order[i]);
+
+		if (all) {
+			if (MCACHE_OK != status[i] && MCACHE_OK == ret)
+				ret = status[i];
+
+			continue;
+		}
+
+		result = status[i];
+
+		if (!s_IsConnError(result))
+			break;
+
+		//ask next usable replica for a reply, it has got a "noreply" command already
+		for (acked = i + 1; acked < count && 0 > pstReplicaSet->apstServers[order[acked]]->nSockFD; acked++)
+			;
+
+		if (acked < count) {
+			server = pstReplicaSet->apstServers[order[acked]];
+			iov[0].iov_base = header;
+			iov[0].iov_len = len;
+			iov[1].iov_base = pstMCData->pDataValue;
+			iov[1].iov_len = pstMCData->nDataLen;
+			iov[2].iov_base = "\r\n";
+			iov[2].iov_len = 2;
+
+			if (MCACHE_OK != (status[acked] = s_SockWritev(server->nSockFD, iov, s_IsStorageOp(nOpFlag) ? 3 : 1,
+				server->nTimeout)))
+				s_ReplicaFail(pstReplicaSet, order[acked]);
+		}
+
+		i = acked - 1;
+	}
+
+	if (all)
+		return count < pstReplicaSet->nServerCount && MCACHE_OK == ret ? MCACHE_ERR_NET : ret;
+
+	return result;
+}
+
+/**
+ * record latency of a get served by replica set into its histogram.
+ */
+static void
+s_HedgeRecord(MemCacheReplicaSet *pstReplicaSet, int64_t nLatency)
+{
+	int i = 0;
+	int bucket = 0;
+	uint64_t total = 0;
+
+	while (bucket < MCACHE_LATENCY_BUCKETS - 1 && ((int64_t) 2 << bucket) <= nLatency)
+		bucket++;
+
+	pstReplicaSet->anLatencyHist[bucket]++;
+
+	for (i = 0; i < MCACHE_LATENCY_BUCKETS; i++)
+		total += pstReplicaSet->anLatencyHist[i];
+
+	//old samples fade out, so percentile follows current behavior of replicas
+	if (HEDGE_HIST_DECAY <= total) {
+		for (i = 0; i < MCACHE_LATENCY_BUCKETS; i++)
+			pstReplicaSet->anLatencyHist[i] /= 2;
+	}
+}
+
+/**
+ * delay before a get is hedged, 0 for no hedging.
+ */
+static int64_t
+s_HedgeDelay(MemCacheReplicaSet *pstReplicaSet)
+{
+	int i = 0;
+	uint64_t total = 0;
+	uint64_t sum = 0;
+
+	if (0 < pstReplicaSet->nHedgeDelay)
+		return pstReplicaSet->nHedgeDelay;
+
+	if (0 >= pstReplicaSet->nHedgePercentile || 100 <= pstReplicaSet->nHedgePercentile)
+		return 0;
+
+	for (i = 0; i < MCACHE_LATENCY_BUCKETS; i++)
+		total += pstReplicaSet->anLatencyHist[i];
+
+	if (HEDGE_MIN_SAMPLES > total)
+		return 0;
+
+	//upper bound of bucket holding the percentile
+	for (i = 0; i < MCACHE_LATENCY_BUCKETS - 1; i++) {
+		sum += pstReplicaSet->anLatencyHist[i];
+
+		if (sum * 100 >= total * pstReplicaSet->nHedgePercentile)
+			break;
+	}
+
+	return (int64_t) 2 << i;
+}
+
+/**
+ * send get to replica pnOrder[0], and to replica pnOrder[1] as well if no reply arrives within nDelay microseconds.
+ * response arriving first is parsed, the other one is left to s_ServerDrain. lists not fitting in one command are
+ * not hedged.
+ */
+static int
+s_HedgeGet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCDataList, size_t nListSize, size_t *pnOrder,
+	size_t nCount, int64_t nDelay)
+{
+	int ret = MCACHE_OK;
+	int nfds = 1;
+	size_t fetched = 0;
+	int64_t begin[2];
+	struct pollfd pfd[2];
+	struct timespec ts;
+	struct retrievalBatch batch;
+	struct sockReader reader;
+	MemCacheServer *server[2];
+	int winner = 0;
+
+	server[0] = pstReplicaSet->apstServers[pnOrder[0]];
+	server[1] = 1 < nCount ? pstReplicaSet->apstServers[pnOrder[1]] : NULL;
+
+	memset(&batch, 0, sizeof(batch));
+
+	if (MCACHE_OK != (ret = s_RetrievalCommand(server[0], pstMCDataList, nListSize, MCACHE_OP_GET, 0, &batch)))
+		return ret;
+
+	if (NULL == batch.cmd || batch.end < nListSize) {
+		free(batch.cmd);
+		return s_DataRetrieval(server[0], pstMCDataList, nListSize, MCACHE_OP_GET, 0);
+	}
+
+	begin[0] = s_ServerEnter(server[0], MCACHE_OP_GET, pstMCDataList, nListSize);
+	s_TraceWrite(server[0], MCACHE_TRACE_WRITE_START, 0);
+
+	if (MCACHE_OK != (ret = s_SockWrite(server[0]->nSockFD, batch.cmd, batch.cmd_len, server[0]->nTimeout))) {
+		s_ServerLeave(server[0], begin[0], MCACHE_OP_GET, ret, nListSize, 0);
+		s_ReplicaFail(pstReplicaSet, pnOrder[0]);
+		free(batch.cmd);
+		return ret;
+	}
+
+	s_TraceWrite(server[0], MCACHE_TRACE_WRITE_END, batch.cmd_len);
+
+	pfd[0].fd = server[0]->nSockFD;
+	pfd[0].events = POLLIN;
+	pfd[1].events = POLLIN;
+	ts.tv_sec = nDelay / 1000000;
+	ts.tv_nsec = (nDelay % 1000000) * 1000;
+
+	if (NULL != server[1] && 0 == ppoll(pfd, 1, &ts, NULL)) {
+		//reply of hedged request is the one traced on thread
+		begin[1] = s_ServerEnter(server[1], MCACHE_OP_GET, pstMCDataList, nListSize);
+		s_TraceWrite(server[1], MCACHE_TRACE_WRITE_START, 0);
+
+		if (MCACHE_OK == s_SockWrite(server[1]->nSockFD, batch.cmd, batch.cmd_len, server[1]->nTimeout)) {
+			s_TraceWrite(server[1], MCACHE_TRACE_WRITE_END, batch.cmd_len);
+			pfd[1].fd = server[1]->nSockFD;
+			nfds = 2;
+			pstReplicaSet->nHedges++;
+		}
+		else {
+			s_ServerLeave(server[1], begin[1], MCACHE_OP_GET, MCACHE_ERR_NET, nListSize, 0);
+			s_ReplicaFail(pstReplicaSet, pnOrder[1]);
+		}
+
+		ts.tv_sec = server[0]->nTimeout;
+		ts.tv_nsec = 0;
+
+		if (0 < ppoll(pfd, nfds, &ts, NULL) && 2 == nfds && 0 == pfd[0].revents && 0 != pfd[1].revents)
+			winner = 1;
+	}
+
+	free(batch.cmd);
+
+	//parse reply of winner, even on timeout of poll reader fails cleanly by its own deadline
+	if (MCACHE_OK == (ret = s_ReaderInit(&reader, server[winner], server[winner]->nTimeout, NULL, 0))) {
+		ret = s_RetrievalParse(&reader, pstMCDataList, nListSize, MCACHE_OP_GET, NULL, s_RetrieveCopy, server[winner],
+			NULL, &fetched);
+		s_ReaderFree(&reader);
+
+		if (RETRIEVAL_DROPPED == ret)
+			ret = MCACHE_ERR_NOMEM;
+	}
+
+	if (MCACHE_OK == ret && nListSize != fetched)
+		ret = MCACHE_ERR_PARTIAL;
+
+	s_ServerLeave(server[winner], begin[winner], MCACHE_OP_GET, ret, nListSize, batch.cmd_len);
+
+	//abandoned request has no result
+	if (2 == nfds) {
+		s_ServerLeave(server[1 - winner], begin[1 - winner], MCACHE_OP_GET, -1, nListSize, batch.cmd_len);
+		server[1 - winner]->nDiscard++;
+
+		if (1 == winner)
+			pstReplicaSet->nHedgeWins++;
+	}
+
+	if (s_IsConnError(ret))
+		s_ReplicaFail(pstReplicaSet, pnOrder[winner]);
+
+	return ret;
+}
+
+/**
+ * slot of index holding counter of key, or empty slot ending its probe run. caller holds lock.
+ */
+static size_t
+s_HotKeySlot(const MemCacheHotKey *pstHotKey, const char *pKey, size_t nKeyLen, uint32_t nHash)
+{
+	size_t pos = nHash & pstHotKey->mask;
+	uint32_t slot = 0;
+
+	while (0 != (slot = pstHotKey->index[pos])) {
+		const struct hotCounter *counter = pstHotKey->counters + slot - 1;
+
+		if (nHash == counter->hash && s_KeyEqual(counter->key, pKey, nKeyLen))
+			break;
+
+		pos = (pos + 1) & pstHotKey->mask;
+	}
+
+	return pos;
+}
+
+/**
+ * empty slot of index, later slots of its probe run are shifted back so no lookup stops early.
+ */
+static void
+s_HotKeyUnindex(MemCacheHotKey *pstHotKey, size_t nPos)
+{
+	size_t next = nPos;
+	size_t home = 0;
+
+	for (;;) {
+		pstHotKey->index[nPos] = 0;
+
+		//find counter of run which may fill the hole, i.e., its home slot is not after hole
+		do {
+			next = (next + 1) & pstHotKey->mask;
+
+			if (0 == pstHotKey->index[next])
+				return;
+
+			home = pstHotKey->counters[pstHotKey->index[next] - 1].hash & pstHotKey->mask;
+		} while (((next - home) & pstHotKey->mask) < ((next - nPos) & pstHotKey->mask));
+
+		pstHotKey->index[nPos] = pstHotKey->index[next];
+		nPos = next;
+	}
+}
+
+/**
+ * count one hit of key in Space-Saving sketch, the least counted key is evicted for an untracked one.
+ * returns 1 if key is hot. caller holds lock.
+ * tracked keys are found through index, only eviction and decay once per period scan all counters.
+ */
+static int
+s_HotKeyObserve(MemCacheHotKey *pstHotKey, const char *pKey, size_t nKeyLen, uint32_t nHash)
+{
+	size_t i = 0;
+	size_t min = 0;
+	size_t pos = 0;
+	int64_t now = s_NowUSec();
+	struct hotCounter *counter = NULL;
+
+	//halve counts once per period, so count of a key follows its recent rate
+	if (now - pstHotKey->last_decay >= HOTKEY_DECAY_USEC) {
+		int shift = (now - pstHotKey->last_decay) / HOTKEY_DECAY_USEC;
+
+		for (i = 0; i < pstHotKey->used; i++) {
+			pstHotKey->counters[i].count = 63 < shift ? 0 : pstHotKey->counters[i].count >> shift;
+			pstHotKey->counters[i].error = 63 < shift ? 0 : pstHotKey->counters[i].error >> shift;
+		}
+
+		pstHotKey->last_decay = now;
+	}
+
+	pos = s_HotKeySlot(pstHotKey, pKey, nKeyLen, nHash);
+
+	if (0 != pstHotKey->index[pos]) {
+		counter = pstHotKey->counters + pstHotKey->index[pos] - 1;
+		counter->count++;
+		return counter->count - counter->error >= pstHotKey->threshold;
+	}
+
+	if (pstHotKey->used < pstHotKey->capacity) {
+		counter = pstHotKey->counters + pstHotKey->used++;
+		counter->count = 1;
+		counter->error = 0;
+	}
+	else {
+		for (i = 1; i < pstHotKey->used; i++) {
+			if (pstHotKey->counters[i].count < pstHotKey->counters[min].count)
+				min = i;
+		}
+
+		counter = pstHotKey->counters + min;
+		s_HotKeyUnindex(pstHotKey, s_HotKeySlot(pstHotKey, counter->key, strlen(counter->key), counter->hash));
+		counter->error = counter->count;
+		counter->count++;
+
+		//shifting back may have moved empty slot of key
+		pos = s_HotKeySlot(pstHotKey, pKey, nKeyLen, nHash);
+	}
+
+	counter->hash = nHash;
+	memcpy(counter->key, pKey, nKeyLen);
+	counter->key[nKeyLen] = '\0';
+	pstHotKey->index[pos] = counter - pstHotKey->counters + 1;
+
+	return counter->count - counter->error >= pstHotKey->threshold;
+}
+
+static struct hotPin *
+s_HotKeyPin(MemCacheHotKey *pstHotKey, const char *pKey, size_t nKeyLen, uint32_t nHash)
+{
+	struct hotPin *pin = pstHotKey->pins + nHash % pstHotKey->capacity;
+
+	if (NULL == pin->key || !s_KeyEqual(pin->key, pKey, nKeyLen))
+		return NULL;
+
+	if (pin->expires <= s_NowUSec()) {
+		free(pin->key);
+		free(pin->value);
+		pin->key = NULL;
+		pin->value = NULL;
+		return NULL;
+	}
+
+	return pin;
+}
+
+/**
+ * keep a copy of fetched data for ttl of tracker, replacing whatever occupies its slot. caller holds lock.
+ */
+static void
+s_HotKeyStore(MemCacheHotKey *pstHotKey, MemCacheData *pstMCData, uint32_t nHash)
+{
+	char *key = NULL;
+	void *value = NULL;
+	struct hotPin *pin = pstHotKey->pins + nHash % pstHotKey->capacity;
+
+	if (NULL == (key = strndup(pstMCData->pszDataKey, s_KeyLen(pstMCData))))
+		return;
+
+	if (NULL == (value = malloc(pstMCData->nDataLen + 1))) {
+		free(key);
+		return;
+	}
+
+	memcpy(value, pstMCData->pDataValue, pstMCData->nDataLen + 1);
+
+	if (NULL != pin->key) {
+		free(pin->key);
+		free(pin->value);
+	}
+
+	pin->key = key;
+	pin->value = value;
+	pin->len = pstMCData->nDataLen;
+	pin->flags = pstMCData->nFlags;
+	pin->expires = s_NowUSec() + pstHotKey->ttl;
+}
+
+/**
+ * default secret of xxh3, results match XXH3_64bits() of reference implementation.
+ */
+static const unsigned char s_aXXHSecret[XXH_SECRET_SIZE] = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e
+};
+
+static uint32_t s_aCRCTable[256];
+
+static pthread_once_t s_stCRCOnce = PTHREAD_ONCE_INIT;
+
+static void
+s_CRCTableInit(void)
+{
+	uint32_t i = 0;
+	uint32_t k = 0;
+	uint32_t crc = 0;
+
+	for (i = 0; i < 256; i++) {
+		for (crc = i, k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0x82F63B78u & (0 - (crc & 1)));
+
+		s_aCRCTable[i] = crc;
+	}
+}
+
+/**
+ * table driven CRC32C (Castagnoli), for cpus without crc32 instruction.
+ */
+static uint32_t
+s_CRCSoft(uint32_t nCRC, const unsigned char *pData, size_t nDataLen)
+{
+	pthread_once(&s_stCRCOnce, s_CRCTableInit);
+
+	for (; 0 < nDataLen; nDataLen--, pData++)
+		nCRC = s_aCRCTable[(nCRC ^ *pData) & 0xff] ^ (nCRC >> 8);
+
+	return nCRC;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t
+s_CRCHard(uint32_t nCRC, const unsigned char *pData, size_t nDataLen)
+{
+	uint64_t crc = nCRC;
+	uint64_t word = 0;
+
+	for (; 8 <= nDataLen; nDataLen -= 8, pData += 8) {
+		memcpy(&word, pData, 8);
+		crc = _mm_crc32_u64(crc, word);
+	}
+
+	for (; 0 < nDataLen; nDataLen--, pData++)
+		crc = _mm_crc32_u8((uint32_t) crc, *pData);
+
+	return (uint32_t) crc;
+}
+#endif
+
+static uint32_t s_CRCInit(uint32_t nCRC, const unsigned char *pData, size_t nDataLen);
+
+static crcFunc s_pfnCRC = s_CRCInit;
+
+/**
+ * pick crc32 instruction if running cpu has it on first call.
+ */
+static uint32_t
+s_CRCInit(uint32_t nCRC, const unsigned char *pData, size_t nDataLen)
+{
+	crcFunc crc = s_CRCSoft;
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("sse4.2"))
+		crc = s_CRCHard;
+#endif
+
+	__atomic_store_n(&s_pfnCRC, crc, __ATOMIC_RELAXED);
+
+	return crc(nCRC, pData, nDataLen);
+}
+
+static uint64_t
+s_XXHRead64(const unsigned char *pData)
+{
+	uint64_t val = 0;
+
+	memcpy(&val, pData, 8);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	val = __builtin_bswap64(val);
+#endif
+
+	return val;
+}
+
+static uint32_t
+s_XXHRead32(const unsigned char *pData)
+{
+	uint32_t val = 0;
+
+	memcpy(&val, pData, 4);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	val = __builtin_bswap32(val);
+#endif
+
+	return val;
+}
+
+static uint64_t
+s_XXHMulFold(uint64_t nLhs, uint64_t nRhs)
+{
+	unsigned __int128 product = (unsigned __int128) nLhs * nRhs;
+
+	return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+static uint64_t
+s_XXH64Avalanche(uint64_t nHash)
+{
+	nHash ^= nHash >> 33;
+	nHash *= XXH_PRIME64_2;
+	nHash ^= nHash >> 29;
+	nHash *= XXH_PRIME64_3;
+	nHash ^= nHash >> 32;
+
+	return nHash;
+}
+
+static uint64_t
+s_XXH3Avalanche(uint64_t nHash)
+{
+	nHash ^= nHash >> 37;
+	nHash *= XXH_PRIME_MX1;
+	nHash ^= nHash >> 32;
+
+	return nHash;
+}
+
+static uint64_t
+s_XXHMix16(const unsigned char *pData, const unsigned char *pSecret)
+{
+	return s_XXHMulFold(s_XXHRead64(pData) ^ s_XXHRead64(pSecret), s_XXHRead64(pData + 8) ^ s_XXHRead64(pSecret + 8));
+}
+
+static void
+s_XXHAccumulate(uint64_t *pnAcc, const unsigned char *pData, const unsigned char *pSecret)
+{
+	size_t i = 0;
+
+	for (i = 0; i < 8; i++) {
+		uint64_t val = s_XXHRead64(pData + 8 * i);
+		uint64_t key = val ^ s_XXHRead64(pSecret + 8 * i);
+
+		pnAcc[i ^ 1] += val;
+		pnAcc[i] += (key & 0xffffffff) * (key >> 32);
+	}
+}
+
+/**
+ * xxh3 of inputs longer than 240 bytes, stripes of 64 bytes are folded into 8 accumulators.
+ */
+static uint64_t
+s_XXHLong(const unsigned char *pData, size_t nDataLen)
+{
+	size_t i = 0;
+	size_t n = 0;
+	size_t stripes = (XXH_SECRET_SIZE - XXH_STRIPE_LEN) / 8;
+	size_t block_len = XXH_STRIPE_LEN * stripes;
+	size_t blocks = (nDataLen - 1) / block_len;
+	uint64_t result = nDataLen * XXH_PRIME64_1;
+	uint64_t acc[8] = {XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+		XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1};
+	const unsigned char *secret = s_aXXHSecret;
+
+	for (n = 0; n < blocks; n++) {
+		for (i = 0; i < stripes; i++)
+			s_XXHAccumulate(acc, pData + n * block_len + i * XXH_STRIPE_LEN, secret + i * 8);
+
+		//scramble
+		for (i = 0; i < 8; i++) {
+			acc[i] ^= acc[i] >> 47;
+			acc[i] ^= s_XXHRead64(secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN + 8 * i);
+			acc[i] *= XXH_PRIME32_1;
+		}
+	}
+
+	stripes = ((nDataLen - 1) - block_len * blocks) / XXH_STRIPE_LEN;
+
+	for (i = 0; i < stripes; i++)
+		s_XXHAccumulate(acc, pData + blocks * block_len + i * XXH_STRIPE_LEN, secret + i * 8);
+
+	s_XXHAccumulate(acc, pData + nDataLen - XXH_STRIPE_LEN, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - 7);
+
+	for (i = 0; i < 4; i++)
+		result += s_XXHMulFold(acc[2 * i] ^ s_XXHRead64(secret + 11 + 16 * i), acc[2 * i + 1] ^ s_XXHRead64(secret + 19 + 16 * i));
+
+	return s_XXH3Avalanche(result);
+}
+
+/**
+ * xxh3 64-bit hash with seed 0.
+ */
+static uint64_t
+s_XXH3(const unsigned char *pData, size_t nDataLen)
+{
+	size_t i = 0;
+	uint64_t acc = 0;
+	const unsigned char *secret = s_aXXHSecret;
+
+	if (16 >= nDataLen) {
+		if (8 < nDataLen) {
+			uint64_t lo = s_XXHRead64(pData) ^ (s_XXHRead64(secret + 24) ^ s_XXHRead64(secret + 32));
+			uint64_t hi = s_XXHRead64(pData + nDataLen - 8) ^ (s_XXHRead64(secret + 40) ^ s_XXHRead64(secret + 48));
+
+			return s_XXH3Avalanche(nDataLen + __builtin_bswap64(lo) + hi + s_XXHMulFold(lo, hi));
+		}
+
+		if (4 <= nDataLen) {
+			uint64_t input = s_XXHRead32(pData + nDataLen - 4) + ((uint64_t) s_XXHRead32(pData) << 32);
+
+			acc = input ^ (s_XXHRead64(secret + 8) ^ s_XXHRead64(secret + 16));
+			acc ^= ((acc << 49) | (acc >> 15)) ^ ((acc << 24) | (acc >> 40));
+			acc *= XXH_PRIME_MX2;
+			acc ^= (acc >> 35) + nDataLen;
+			acc *= XXH_PRIME_MX2;
+
+			return acc ^ (acc >> 28);
+		}
+
+		if (0 < nDataLen) {
+			uint32_t combined = ((uint32_t) pData[0] << 16) | ((uint32_t) pData[nDataLen >> 1] << 24) |
+				(uint32_t) pData[nDataLen - 1] | ((uint32_t) nDataLen << 8);
+
+			return s_XXH64Avalanche(combined ^ (uint64_t) (s_XXHRead32(secret) ^ s_XXHRead32(secret + 4)));
+		}
+
+		return s_XXH64Avalanche(s_XXHRead64(secret + 56) ^ s_XXHRead64(secret + 64));
+	}
+
+	acc = nDataLen * XXH_PRIME64_1;
+
+	if (128 >= nDataLen) {
+		if (32 < nDataLen) {
+			if (64 < nDataLen) {
+				if (96 < nDataLen) {
+					acc += s_XXHMix16(pData + 48, secret + 96);
+					acc += s_XXHMix16(pData + nDataLen - 64, secret + 112);
+				}
+
+				acc += s_XXHMix16(pData + 32, secret + 64);
+				acc += s_XXHMix16(pData + nDataLen - 48, secret + 80);
+			}
+
+			acc += s_XXHMix16(pData + 16, secret + 32);
+			acc += s_XXHMix16(pData + nDataLen - 32, secret + 48);
+		}
+
+		acc += s_XXHMix16(pData, secret);
+		acc += s_XXHMix16(pData + nDataLen - 16, secret + 16);
+
+		return s_XXH3Avalanche(acc);
+	}
+
+	if (240 >= nDataLen) {
+		for (i = 0; i < 8; i++)
+			acc += s_XXHMix16(pData + 16 * i, secret + 16 * i);
+
+		acc = s_XXH3Avalanche(acc);
+
+		for (i = 8; i < nDataLen / 16; i++)
+			acc += s_XXHMix16(pData + 16 * i, secret + 16 * (i - 8) + 3);
+
+		acc += s_XXHMix16(pData + nDataLen - 16, secret + 136 - 17);
+
+		return s_XXH3Avalanche(acc);
+	}
+
+	return s_XXHLong(pData, nDataLen);
+}
+
+/**
+ * MD5 digest (RFC 1321) of pData into pDigest.
+ */
+static void
+s_MD5(const unsigned char *pData, size_t nDataLen, unsigned char *pDigest)
+{
+	static const uint32_t shift[64] = {
+		7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+		5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+		4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+		6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+	};
+	static const uint32_t table[64] = {
+		0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+		0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+		0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+		0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+		0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+		0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+		0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+		0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+	};
+	uint32_t state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+	unsigned char block[64];
+	size_t offset = 0;
+	size_t i = 0;
+	int last = 0;
+
+	//blocks of input, then one or two blocks of padding and bit length
+	while (!last) {
+		uint32_t word[16];
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+		if (offset + 64 <= nDataLen)
+			memcpy(block, pData + offset, 64);
+		else {
+			size_t remain = offset <= nDataLen ? nDataLen - offset : 0;
+
+			memset(block, 0, 64);
+			memcpy(block, pData + offset, remain);
+
+			if (offset <= nDataLen)
+				block[remain] = 0x80;
+
+			if (56 > remain || offset > nDataLen) {
+				uint64_t bits = (uint64_t) nDataLen * 8;
+
+				for (i = 0; i < 8; i++)
+					block[56 + i] = (unsigned char) (bits >> (8 * i));
+
+				last = 1;
+			}
+		}
+
+		offset += 64;
+
+		for (i = 0; i < 16; i++)
+			word[i] = (uint32_t) block[i * 4] | ((uint32_t) block[i * 4 + 1] << 8) |
+				((uint32_t) block[i * 4 + 2] << 16) | ((uint32_t) block[i * 4 + 3] << 24);
+
+		for (i = 0; i < 64; i++) {
+			uint32_t f = 0;
+			uint32_t g = 0;
+
+			if (16 > i) {
+				f = (b & c) | (~b & d);
+				g = i;
+			}
+			else if (32 > i) {
+				f = (d & b) | (~d & c);
+				g = (5 * i + 1) % 16;
+			}
+			else if (48 > i) {
+				f = b ^ c ^ d;
+				g = (3 * i + 5) % 16;
+			}
+			else {
+				f = c ^ (b | ~d);
+				g = (7 * i) % 16;
+			}
+
+			f += a + table[i] + word[g];
+			a = d;
+			d = c;
+			c = b;
+			b += (f << shift[i]) | (f >> (32 - shift[i]));
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+	}
+
+	for (i = 0; i < 16; i++)
+		pDigest[i] = (unsigned char) (state[i / 4] >> (8 * (i % 4)));
+}
+
+// Context Functions
+/**
+ * @fn 		int MCACHE_ServerInit(MemCacheServer *pstMCServer, const char *pszHost, int nPort, int nTimeout)
+ *
+ * @param 	pszMCServer 	pointer of server for intialization.
+ * @param 	pszHost 	the hostname/address of server running memcached.
+ * @param 	nPort		the port which memcached server serving.
+ * @param 	nTimeout	maximum timeout in seconds while communicating with memcached server.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	initialize MemCacheServer with given host, port and timeout.
+ *
+ * @note	upon success. socket descriptor will be available. pszServerAddr must be freed by MCACHE_ServerDestroy.
+ *
+ * @see		MCACHE_ServerDisconnect, MCACHE_ServerDestroy
+ */
+int
+MCACHE_ServerInit(MemCacheServer *pstMCServer, const char *pszHost, int nPort, int nTimeout, int nFlag)
+{
+	if (NULL == pstMCServer || NULL == pszHost || 0 >= nPort || 65535 < nPort ||
+		0 >= nTimeout || MCACHE_TIMEOUT_MAX < nTimeout)
+		return MCACHE_ERR_INVAL;
+
+	memset(pstMCServer, 0, sizeof(MemCacheServer));
+
+	if (0 > (pstMCServer->nSockFD = s_ConnectTCP(pszHost, nPort, nTimeout, nFlag)))
+		return MCACHE_ERR_NET;
+
+	if (NULL == (pstMCServer->pszServerAddr = strdup(pszHost))) {
+		return MCACHE_ERR_NOMEM;
+	}
+
+	pstMCServer->nPort = nPort;
+	pstMCServer->nTimeout = nTimeout;
+	pstMCServer->nFlag = nFlag;
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_ServerDisconnect(MemCacheServer *pstMCServer)
+ *
+ * @param	pstMCServer	pointer of server for socket disconnection.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	disconnect socket connection between client and server.
+ *
+ * @note	upon success. socket descriptor will be unavailable, and socket descriptor will be reset to -1.
+ *
+ * @see		MCACHE_ServerInit
+ */
+int
+MCACHE_ServerDisconnect(MemCacheServer *pstMCServer)
+{
+	if (NULL == pstMCServer || 0 > pstMCServer->nSockFD)
+		return MCACHE_ERR_INVAL;
+
+	close(pstMCServer->nSockFD);
+	pstMCServer->nSockFD = -1;
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_ServerDestroy(MemCacheServer *pstMCServer)
+ *
+ * @param	pstMCServer	pointer of server for destroy.
+ *
+ * @return	MCACHE_OK for success, failure othwise.
+ */
+int
+MCACHE_ServerDestroy(MemCacheServer *pstMCServer)
+{
+	if (NULL == pstMCServer)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL != pstMCServer->pszServerAddr) {
+		free(pstMCServer->pszServerAddr);
+		pstMCServer->pszServerAddr = NULL;
+	}
+
+	if (NULL != pstMCServer->pstGroup) {
+		pthread_mutex_destroy(&pstMCServer->pstGroup->lock);
+		pthread_cond_destroy(&pstMCServer->pstGroup->cond);
+		free(pstMCServer->pstGroup);
+		pstMCServer->pstGroup = NULL;
+	}
+
+	if (NULL != pstMCServer->pstNegative) {
+		pthread_mutex_destroy(&pstMCServer->pstNegative->lock);
+		free(pstMCServer->pstNegative->slots);
+		free(pstMCServer->pstNegative);
+		pstMCServer->pstNegative = NULL;
+	}
+
+	if (NULL != pstMCServer->pstMeter) {
+		free(pstMCServer->pstMeter);
+		pstMCServer->pstMeter = NULL;
+	}
+
+	if (NULL != pstMCServer->pstTracer) {
+		free(pstMCServer->pstTracer);
+		pstMCServer->pstTracer = NULL;
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_ServerGroupEnable(MemCacheServer *pstMCServer, int nWindow)
+ *
+ * @param	pstMCServer	pointer of server.
+ * @param	nWindow		microseconds a caller waits for other callers before sending, 0 to gather only callers
+ *        			arriving while previous calls are being sent.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	let concurrent synchronous calls on server share one pipelined write (group commit).
+ *
+ * @note	once enabled, storage commands, MCACHE_DataDelete, MCACHE_DataTouch and single-key MCACHE_DataGet and
+ *       	MCACHE_DataGets are thread safe on server, callers block until their own reply is parsed.
+ *       	the window is skipped while calls arrive alone, so latency of a lonely caller is unchanged.
+ *       	other commands must not run concurrently with them. group is released by MCACHE_ServerDestroy.
+ */
+int
+MCACHE_ServerGroupEnable(MemCacheServer *pstMCServer, int nWindow)
+{
+	struct memCacheGroup *group = NULL;
+
+	if (NULL == pstMCServer || 0 > nWindow)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL != pstMCServer->pstGroup) {
+		pthread_mutex_lock(&pstMCServer->pstGroup->lock);
+		pstMCServer->pstGroup->window = nWindow;
+		pthread_mutex_unlock(&pstMCServer->pstGroup->lock);
+
+		return MCACHE_OK;
+	}
+
+	if (NULL == (group = (struct memCacheGroup *) calloc(1, sizeof(struct memCacheGroup))))
+		return MCACHE_ERR_NOMEM;
+
+	pthread_mutex_init(&group->lock, NULL);
+	pthread_cond_init(&group->cond, NULL);
+	group->window = nWindow;
+	pstMCServer->pstGroup = group;
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_ServerNegativeEnable(MemCacheServer *pstMCServer, size_t nMaxKeys, int nTTL)
+ *
+ * @param	pstMCServer	pointer of server.
+ * @param	nMaxKeys	number of missing keys remembered.
+ * @param	nTTL		milliseconds a missing key is answered locally.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	remember keys MCACHE_DataGet and MCACHE_DataGets found missing, so repeated gets of them are answered as
+ *       	misses without a round trip for nTTL.
+ *
+ * @note	keys are kept as 32-bit fingerprints (8 bytes each), a false hit is possible but very unlikely.
+ *       	storage commands of this client forget the key stored, other clients storing it are seen after nTTL.
+ *       	calling again clears cache and changes nTTL. cache is released by MCACHE_ServerDestroy.
+ */
+int
+MCACHE_ServerNegativeEnable(MemCacheServer *pstMCServer, size_t nMaxKeys, int nTTL)
+{
+	struct memCacheNegative *negative = NULL;
+
+	if (NULL == pstMCServer || 0 == nMaxKeys || 0 >= nTTL)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL != (negative = pstMCServer->pstNegative)) {
+		pthread_mutex_lock(&negative->lock);
+		memset(negative->slots, 0, negative->buckets * NEGATIVE_WAYS * sizeof(struct negativeSlot));
+		negative->ttl = nTTL;
+		negative->epoch++;
+		pthread_mutex_unlock(&negative->lock);
+
+		return MCACHE_OK;
+	}
+
+	if (NULL == (negative = (struct memCacheNegative *) calloc(1, sizeof(struct memCacheNegative))))
+		return MCACHE_ERR_NOMEM;
+
+	negative->buckets = (nMaxKeys + NEGATIVE_WAYS - 1) / NEGATIVE_WAYS;
+
+	if (NULL == (negative->slots = (struct negativeSlot *) calloc(negative->buckets * NEGATIVE_WAYS, sizeof(struct negativeSlot)))) {
+		free(negative);
+		return MCACHE_ERR_NOMEM;
+	}
+
+	pthread_mutex_init(&negative->lock, NULL);
+	negative->ttl = nTTL;
+	negative->base = s_NowUSec();
+	pstMCServer->pstNegative = negative;
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_ServerMetricsEnable(MemCacheServer *pstMCServer)
+ *
+ * @param	pstMCServer	pointer of server.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	count requests, keys, bytes, results and latency of every command sent to server, see MCACHE_ServerMetrics.
+ *
+ * @note	counters are sharded by calling thread and updated by relaxed atomics, no lock is taken on request path.
+ *       	metrics take about 128KB, and are released by MCACHE_ServerDestroy. calling again keeps current counters.
+ */
+int
+MCACHE_ServerMetricsEnable(MemCacheServer *pstMCServer)
+{
+	struct memCacheMeter *meter = NULL;
+
+	if (NULL == pstMCServer)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL != pstMCServer->pstMeter)
+		return MCACHE_OK;
+
+	if (0 != posix_memalign((void **) &meter, 64, sizeof(struct memCacheMeter)))
+		return MCACHE_ERR_NOMEM;
+
+	memset(meter, 0, sizeof(struct memCacheMeter));
+	__atomic_store_n(&pstMCServer->pstMeter, meter, __ATOMIC_RELEASE);
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_ServerTraceEnable(MemCacheServer *pstMCServer, MemCacheTraceFunc pfnTrace, void *pContext)
+ *
+ * @param	pstMCServer	pointer of server.
+ * @param	pfnTrace	callback receiving events of requests on server, NULL to stop tracing.
+ * @param	pContext	argument passed to pfnTrace.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	report lifecycle points of requests on server (see MCACHE_TRACE_*) to pfnTrace.
+ *
+ * @note	must not be called while server is in use. an untraced server pays one pointer test per event, if
+ *       	library is built with -DMCACHE_USDT events also fire USDT probes while any of them is attached.
+ *       	tracer is released by MCACHE_ServerDestroy.
+ */
+int
+MCACHE_ServerTraceEnable(MemCacheServer *pstMCServer, MemCacheTraceFunc pfnTrace, void *pContext)
+{
+	struct memCacheTracer *tracer = NULL;
+
+	if (NULL == pstMCServer)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL == pfnTrace) {
+		free(pstMCServer->pstTracer);
+		pstMCServer->pstTracer = NULL;
+		return MCACHE_OK;
+	}
+
+	if (NULL == (tracer = pstMCServer->pstTracer) &&
+		NULL == (tracer = (struct memCacheTracer *) malloc(sizeof(struct memCacheTracer))))
+		return MCACHE_ERR_NOMEM;
+
+	tracer->func = pfnTrace;
+	tracer->context = pContext;
+	pstMCServer->pstTracer = tracer;
+
+	return MCACHE_OK;
+}
+
+// Storage Commands
+/**
+ * @fn		int MCACHE_DataSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for setting data.
+ * @param	pstMCData	pointer of data to set.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	set (add if key not exists, update if key exists)  given value with key on specified cache server.
+ *
+ */
+int
+MCACHE_DataSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_SET);
+}
+
+
+/**
+ * @fn		int MCACHE_DataAdd(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for adding data.
+ * @param	pstMCData	pointer of data to add.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	add given value associated with key on specified cache server.
+ *
+ */
+int
+MCACHE_DataAdd(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_ADD);
+}
+
+/**
+ * @fn		int MCACHE_DataReplace(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for replacing data.
+ * @param	pstMCData	pointer of data to replace.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	replace value associated with given key on server by given value.
+ *
+ */
+int
+MCACHE_DataReplace(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_REPLACE);
+}
+
+/**
+ * @fn		int MCACHE_DataAppend(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for append data.
+ * @param	pstMCData	pointer of data to append.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	add given value to an existing key after existing value
+ *
+ */
+int
+MCACHE_DataAppend(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_APPEND);
+}
+
+/**
+ * @fn		int MCACHE_DataPrepend(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for prepend data.
+ * @param	pstMCData	pointer of data to prepend.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	add given value to an existing key before existing data
+ * 
+ */
+int
+MCACHE_DataPrepend(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_PREPEND);
+}
+
+/**
+ * @fn		int MCACHE_DataCheckAndSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for setting data.
+ * @param	pstMCData	pointer of data to check and set.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	store given value but only if no one else has updated since last fetched it (by checking pstMCData->nCASUnique).
+ */
+int
+MCACHE_DataCheckAndSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_CAS);
+}
+
+/**
+ * @fn		int MCACHE_DataSetMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for setting data.
+ * @param	pstMCDataList	pointer of data list to set.
+ * @param	nListSize	number of data in data list.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are stored, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	set all data of list, commands are sent in one write and replies are parsed in one pass.
+ *
+ * @note	commands are sent nBatchKeys data at a time, values are never copied.
+ */
+int
+MCACHE_DataSetMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+{
+	struct bulkRequest request;
+
+	memset(&request, 0, sizeof(request));
+	request.op = MCACHE_OP_SET;
+
+	return s_DataBulk(pstMCServer, pstMCDataList, nListSize, &request, pnStatus);
+}
+
+/**
+ * @fn		int MCACHE_DataSetFromFD(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nFD, int64_t nOffset)
+ *
+ * @param	pstMCServer	pointer of server for setting data.
+ * @param	pstMCData	pointer of data to set, pDataValue is ignored and nDataLen bytes are taken from nFD.
+ * @param	nFD		descriptor to read value from.
+ * @param	nOffset		offset of value within nFD.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_IO for failure of nFD, failure otherwise.
+ *
+ * @brief	set given key with value stored in nFD.
+ *
+ * @note	value is sent by sendfile(2) without copying into user space, and command line, value and trailing
+ *       	"\r\n" are flushed together. for memory mapped regions, pass mapped address as pDataValue to MCACHE_DataSet.
+ *       	connection is closed if command could not be sent completely (e.g. nDataLen bytes could not be read from
+ *       	nFD), since it is left out of sync.
+ */
+int
+MCACHE_DataSetFromFD(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nFD, int64_t nOffset)
+{
+	int ret = MCACHE_OK;
+	size_t cmd_len = 0;
+	char buffer[MCACHE_KEY_MAX * 2];
+	int64_t deadline = 0;
+	int64_t begin = 0;
+	size_t sent = 0;
+	int timeout = 0;
+	time_t check_time = 0;
+
+	if (NULL == pstMCServer || NULL == pstMCData || 0 > pstMCServer->nSockFD || MCACHE_OK != s_ChkKey(pstMCData, NULL) ||
+		MCACHE_VALUE_MAX < pstMCData->nDataLen || 0 > nFD || 0 > nOffset)
+		return MCACHE_ERR_INVAL;
+
+	cmd_len = s_StorageCommand(pstMCData, MCACHE_OP_SET, 0, buffer, sizeof(buffer));
+
+	if (0 == cmd_len || sizeof(buffer) <= cmd_len)
+		return MCACHE_ERR_INVAL;
+
+	s_NegativeInvalidate(pstMCServer, pstMCData);
+
+	timeout = pstMCServer->nTimeout;
+	check_time = time(NULL);
+	begin = s_ServerEnter(pstMCServer, MCACHE_OP_SET, pstMCData, 1);
+	deadline = begin + (int64_t) timeout * 1000000;
+
+	s_SockCork(pstMCServer->nSockFD, 1);
+	s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_START, 0);
+
+	if (MCACHE_OK == (ret = s_FDWrite(pstMCServer->nSockFD, buffer, cmd_len, deadline)) &&
+		MCACHE_OK == (ret = s_SockSendFile(pstMCServer->nSockFD, nFD, nOffset, pstMCData->nDataLen, deadline)))
+		ret = s_FDWrite(pstMCServer->nSockFD, "\r\n", 2, deadline);
+
+	s_SockCork(pstMCServer->nSockFD, 0);
+
+	if (MCACHE_OK == ret) {
+		sent = cmd_len + pstMCData->nDataLen + 2;
+		s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_END, sent);
+		timeout -= time(NULL) - check_time;
+		ret = s_StorageReply(pstMCServer, timeout);
+	}
+
+	s_ServerLeave(pstMCServer, begin, MCACHE_OP_SET, ret, 1, sent);
+
+	//command may be cut anywhere (timeout, failure of socket or nFD), connection is out of sync
+	if (0 == sent)
+		MCACHE_ServerDisconnect(pstMCServer);
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_DataFree(MemCacheData *pstMCData)
+ *
+ * @param	pstMCData	pointer of data to free.
+ *
+ * @brief	free pstMCData.pszDataValue if it's not NULL.
+ *
+ * @note	MCACHE_DataFree will be used for those data fetched by MCACHE_DataGet.
+ *       	data fetched by server with stAllocator set is freed by MCACHE_ServerDataFree instead.
+ *
+ */
+int
+MCACHE_DataFree(MemCacheData *pstMCData)
+{
+	if (NULL == pstMCData || NULL == pstMCData->pDataValue)
+		return MCACHE_ERR_INVAL;
+
+	free(pstMCData->pDataValue);
+	pstMCData->pDataValue = NULL;
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_ServerDataFree(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server which fetched data.
+ * @param	pstMCData	pointer of data to free.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataFree, but value is released by allocator of pstMCServer.
+ */
+int
+MCACHE_ServerDataFree(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	if (NULL == pstMCServer || NULL == pstMCData || NULL == pstMCData->pDataValue)
+		return MCACHE_ERR_INVAL;
+
+	s_Free(pstMCServer, pstMCData->pDataValue);
+	pstMCData->pDataValue = NULL;
+
+	return MCACHE_OK;
+}
+
+// Retrival commands
+/**
+ * @fn		int MCACHE_DataGet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched correctly, failure otherwise.
+ *
+ * @brief	fetch data associted with given key and store pstMCData.
+ *       	fetched value will be stored in malloced memory, and caller must invoked MCACHE_DataFree to free it.
+ *
+ * @note	list of any size is accepted, it is split into commands of nBatchKeys keys (or nBatchBytes bytes) and
+ *       	up to nBatchDepth of them are pipelined on connection.
+ */
+int
+MCACHE_DataGet(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+{
+	return s_DataRetrieval(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GET, 0);
+}
+
+/**
+ * @fn		int MCACHE_DataGets(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCData	pointer of data to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched correctly, failure otherwise.
+ *
+ * @brief	fetched data associted with given key to pst
+ *
+ */
+int
+MCACHE_DataGets(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+{
+	return s_DataRetrieval(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GETS, 0);
+}
+
+/**
+ * @fn		int MCACHE_DataGetAndTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nExpiration)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ * @param	nExpiration	new expiration time of fetched data.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched correctly, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataGet, and expiration time of fetched data is updated in the same round trip ("gat").
+ */
+int
+MCACHE_DataGetAndTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nExpiration)
+{
+	return s_DataRetrieval(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GAT, nExpiration);
+}
+
+/**
+ * @fn		int MCACHE_DataGetsAndTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nExpiration)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ * @param	nExpiration	new expiration time of fetched data.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched correctly, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataGets, and expiration time of fetched data is updated in the same round trip ("gats").
+ */
+int
+MCACHE_DataGetsAndTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nExpiration)
+{
+	return s_DataRetrieval(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GATS, nExpiration);
+}
+
+/**
+ * @fn		int MCACHE_DataGetEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key, fetched flags and length.
+ * @param	nListSize	number of data in data list.
+ * @param	pfnHit		callback invoked for each fetched data as soon as its value is received.
+ * @param	pfnMiss		callback invoked for each data not found after whole response is received, could be NULL.
+ * @param	pArg		argument passed to pfnHit and pfnMiss.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched, error returned by callbacks, failure otherwise.
+ *
+ * @brief	fetch data associated with given keys and hand each of them to pfnHit while response is still being parsed.
+ *
+ * @note	value passed to pfnHit points into receive buffer and is valid until callback returns, pDataValue is left untouched.
+ *       	once a callback fails, no more callbacks are invoked.
+ */
+int
+MCACHE_DataGetEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg)
+{
+	return s_DataRetrievalEach(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GET, pfnHit, pfnMiss, pArg);
+}
+
+/**
+ * @fn		int MCACHE_DataGetsEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key, fetched flags, length and cas unique.
+ * @param	nListSize	number of data in data list.
+ * @param	pfnHit		callback invoked for each fetched data as soon as its value is received.
+ * @param	pfnMiss		callback invoked for each data not found after whole response is received, could be NULL.
+ * @param	pArg		argument passed to pfnHit and pfnMiss.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched, error returned by callbacks, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataGetEach, but nCASUnique is fetched as well.
+ */
+int
+MCACHE_DataGetsEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg)
+{
+	return s_DataRetrievalEach(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GETS, pfnHit, pfnMiss, pArg);
+}
+
+/**
+ * @fn		int MCACHE_DataGetStream(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, MemCacheStreamFunc pfnStream, void *pArg)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key, fetched flags and length.
+ * @param	nListSize	number of data in data list.
+ * @param	pfnStream	callback receiving value chunks.
+ * @param	pArg		argument passed to pfnStream.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched, error returned by pfnStream, failure otherwise.
+ *
+ * @brief	fetch data associated with given keys and deliver values to pfnStream in chunks as they are received.
+ *
+ * @note	pDataValue is left untouched, values are never buffered as a whole.
+ */
+int
+MCACHE_DataGetStream(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheStreamFunc pfnStream, void *pArg)
+{
+	int ret = MCACHE_OK;
+	struct streamInfo info;
+
+	if (NULL == pfnStream)
+		return MCACHE_ERR_INVAL;
+
+	info.func = pfnStream;
+	info.arg = pArg;
+	info.fd = -1;
+	info.result = MCACHE_OK;
+
+	ret = s_DataRetrievalRun(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GET, 0, s_RetrieveStream, &info, NULL);
+
+	if ((MCACHE_OK == ret || MCACHE_ERR_PARTIAL == ret) && MCACHE_OK != info.result)
+		ret = info.result;
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_DataGetToFD(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nFD)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCData	pointer of data to hold key, fetched flags and length.
+ * @param	nFD		descriptor to write value into.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for data not found, MCACHE_ERR_IO for failure of nFD, failure otherwise.
+ *
+ * @brief	fetch data associated with given key and write value into nFD.
+ *
+ * @note	value is spliced from socket into nFD without copying into user space where splice(2) is supported.
+ */
+int
+MCACHE_DataGetToFD(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nFD)
+{
+	int ret = MCACHE_OK;
+	struct streamInfo info;
+
+	if (0 > nFD)
+		return MCACHE_ERR_INVAL;
+
+	info.func = NULL;
+	info.arg = NULL;
+	info.fd = nFD;
+	info.result = MCACHE_OK;
+
+	ret = s_DataRetrievalRun(pstMCServer, pstMCData, 1, MCACHE_OP_GET, 0, s_RetrieveStream, &info, NULL);
+
+	if (MCACHE_OK == ret && MCACHE_OK != info.result)
+		ret = info.result;
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_DataPrepareGet(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	ppstPrepared	pointer to hold prepared commands.
+ * @param	pstMCServer	pointer of server whose batch settings split commands.
+ * @param	pstMCDataList	pointer of data list holding keys.
+ * @param	nListSize	number of data in data list.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	validate keys of data list and serialize its "get" commands once, for lists fetched again and again.
+ *
+ * @note	invalid keys are left out and reported as not fetched by MCACHE_DataGetPrepared. prepared commands
+ *       	must be freed by MCACHE_PreparedFree.
+ */
+int
+MCACHE_DataPrepareGet(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList,
+	size_t nListSize)
+{
+	return s_DataPrepare(ppstPrepared, pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GET);
+}
+
+/**
+ * @fn		int MCACHE_DataPrepareGets(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	ppstPrepared	pointer to hold prepared commands.
+ * @param	pstMCServer	pointer of server whose batch settings split commands.
+ * @param	pstMCDataList	pointer of data list holding keys.
+ * @param	nListSize	number of data in data list.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataPrepareGet, but prepare "gets" commands fetching CAS unique too.
+ */
+int
+MCACHE_DataPrepareGets(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList,
+	size_t nListSize)
+{
+	return s_DataPrepare(ppstPrepared, pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GETS);
+}
+
+/**
+ * @fn		int MCACHE_DataGetPrepared(MemCacheServer *pstMCServer, MemCachePrepared *pstPrepared, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstPrepared	pointer of prepared commands.
+ * @param	pstMCDataList	pointer of data list to store fetched value, keys must be those given to prepare, in same order.
+ * @param	nListSize	number of data in data list, same as given to prepare.
+ *
+ * @return	same as MCACHE_DataGet.
+ *
+ * @brief	send prepared commands and parse replies, keys are neither validated nor serialized again and reply keys
+ *       	are found through precomputed hash index.
+ *
+ * @note	negative cache and group commit of server are bypassed. reply keys are matched against keys kept in
+ *       	prepared commands, so keys of list changed after prepare are not read.
+ */
+int
+MCACHE_DataGetPrepared(MemCacheServer *pstMCServer, MemCachePrepared *pstPrepared, MemCacheData *pstMCDataList,
+	size_t nListSize)
+{
+	if (NULL == pstPrepared || pstPrepared->list_size != nListSize)
+		return MCACHE_ERR_INVAL;
+
+	return s_RetrievalPipeline(pstMCServer, pstMCDataList, nListSize, pstPrepared->op, 0, pstPrepared,
+		s_RetrieveCopy, pstMCServer, NULL);
+}
+
+/**
+ * @fn		int MCACHE_PreparedFree(MemCachePrepared *pstPrepared)
+ *
+ * @param	pstPrepared	pointer of prepared commands.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ */
+int
+MCACHE_PreparedFree(MemCachePrepared *pstPrepared)
+{
+	if (NULL == pstPrepared)
+		return MCACHE_ERR_INVAL;
+
+	s_PreparedFree(pstPrepared);
+
+	return MCACHE_OK;
+}
+
+// Update commands
+/**
+ * @fn		int MCACHE_DataUpdate(MemCacheServer *pstMCServer, MemCacheData *pstMCData, MemCacheItemFunc pfnUpdate, void *pArg, int nRetry)
+ *
+ * @param	pstMCServer	pointer of server for updating data.
+ * @param	pstMCData	pointer of data holding key, expiration time, and new value after success.
+ * @param	pfnUpdate	callback computing new value from current one.
+ * @param	pArg		argument passed to pfnUpdate.
+ * @param	nRetry		maximum number of retries after losing a race with other clients.
+ *
+ * @return	MCACHE_OK for success, error returned by pfnUpdate, failure otherwise. once retries are exhausted the last
+ *       	race lost is returned: MCACHE_ERR_EXISTS if data was modified, MCACHE_ERR_NOT_FOUND if it was deleted, or
+ *       	MCACHE_ERR_NOT_STORED if it was created by others.
+ *
+ * @brief	atomically replace value of data with the one computed by pfnUpdate, by running "gets" and "cas" until
+ *       	no one else updates data in between. "gets" is pipelined behind every "cas", so a retry costs no extra
+ *       	round trip.
+ *
+ * @note	pfnUpdate receives current value (NULL if data does not exist, then it is created by "add") and must store
+ *       	new value into pDataValue and nDataLen (nFlags and nExpiration could be changed too), returning other than
+ *       	MCACHE_OK gives up the update. pfnUpdate may be invoked once per attempt, on retry pDataValue holds value
+ *       	it computed on previous attempt, which it may reuse or release before storing new one. values are owned
+ *       	by caller and never freed by library, once pfnUpdate has run pDataValue is left holding the last value it
+ *       	computed whether stored or not.
+ */
+int
+MCACHE_DataUpdate(MemCacheServer *pstMCServer, MemCacheData *pstMCData, MemCacheItemFunc pfnUpdate, void *pArg, int nRetry)
+{
+	int ret = MCACHE_OK;
+	int status = MCACHE_OK;
+
+	if (MCACHE_ERR_PARTIAL == (ret = s_DataUpdate(pstMCServer, pstMCData, 1, pfnUpdate, pArg, nRetry, &status)))
+		ret = status;
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_DataUpdateMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, MemCacheItemFunc pfnUpdate, void *pArg, int nRetry, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for updating data.
+ * @param	pstMCDataList	pointer of data list holding keys, expiration time, and new values after success.
+ * @param	nListSize	number of data in data list.
+ * @param	pfnUpdate	callback computing new value from current one.
+ * @param	pArg		argument passed to pfnUpdate.
+ * @param	nRetry		maximum number of retries after losing a race with other clients.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are updated, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataUpdate for each data, pending data are fetched and stored in one pipeline per attempt,
+ *       	so only data losing a race cost extra round trips.
+ */
+int
+MCACHE_DataUpdateMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheItemFunc pfnUpdate, void *pArg, int nRetry, int *pnStatus)
+{
+	return s_DataUpdate(pstMCServer, pstMCDataList, nListSize, pfnUpdate, pArg, nRetry, pnStatus);
+}
+
+// Delete commands
+/**
+ * @fn		int MCACHE_DataDelete(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nTime)
+ *
+ * @param	pstMCServer	pointer of server for deleting data.
+ * @param	pstMCData	pointer of data to hold key and stored fetched value.
+ * @param	nTime		seconds for server to refuse "add" and "replace" commands with this key.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	delete data on cache server associated with given key.
+ */
+int
+MCACHE_DataDelete(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nTime)
+{
+	int ret = MCACHE_OK;
+	int status = MCACHE_OK;
+	struct bulkRequest request;
+
+	if (NULL != pstMCServer && NULL != pstMCServer->pstGroup)
+		return s_GroupRun(pstMCServer, pstMCData, MCACHE_OP_DELETE, nTime);
+
+	memset(&request, 0, sizeof(request));
+	request.op = MCACHE_OP_DELETE;
+	request.num = nTime;
+
+	if (MCACHE_ERR_PARTIAL == (ret = s_DataBulk(pstMCServer, pstMCData, 1, &request, &status)))
+		ret = status;
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_DataDeleteMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for deleting data.
+ * @param	pstMCDataList	pointer of data list holding keys to delete.
+ * @param	nListSize	number of data in data list.
+ * @param	pnStatus	array of nListSize to hold result of each data (e.g., MCACHE_ERR_NOT_FOUND), could be NULL.
+ *
+ * @return	MCACHE_OK if all data are deleted, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	delete data associated with given keys, commands are sent in one write and replies are parsed in one pass.
+ */
+int
+MCACHE_DataDeleteMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+{
+	struct bulkRequest request;
+
+	memset(&request, 0, sizeof(request));
+	request.op = MCACHE_OP_DELETE;
+
+	return s_DataBulk(pstMCServer, pstMCDataList, nListSize, &request, pnStatus);
+}
+
+// Touch commands
+/**
+ * @fn		int MCACHE_DataTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for touching data.
+ * @param	pstMCData	pointer of data holding key and new expiration time (nExpiration).
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND for data not found, failure otherwise.
+ *
+ * @brief	update expiration time of data associated with given key without transferring its value.
+ */
+int
+MCACHE_DataTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+{
+	int ret = MCACHE_OK;
+	int status = MCACHE_OK;
+	struct bulkRequest request;
+
+	if (NULL != pstMCServer && NULL != pstMCServer->pstGroup)
+		return s_GroupRun(pstMCServer, pstMCData, MCACHE_OP_TOUCH, 0);
+
+	memset(&request, 0, sizeof(request));
+	request.op = MCACHE_OP_TOUCH;
+
+	if (MCACHE_ERR_PARTIAL == (ret = s_DataBulk(pstMCServer, pstMCData, 1, &request, &status)))
+		ret = status;
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_DataTouchMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for touching data.
+ * @param	pstMCDataList	pointer of data list holding keys and new expiration time (nExpiration).
+ * @param	nListSize	number of data in data list.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are touched, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataTouch for each data, commands are sent in one write and replies are parsed in one pass.
+ */
+int
+MCACHE_DataTouchMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+{
+	struct bulkRequest request;
+
+	memset(&request, 0, sizeof(request));
+	request.op = MCACHE_OP_TOUCH;
+
+	return s_DataBulk(pstMCServer, pstMCDataList, nListSize, &request, pnStatus);
+}
+
+// Increment/Decrement commands
+/**
+ * @fn		int MCACHE_DataIncrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for addition.
+ * @param	pstMCData	pointer of data to add.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	take the data associated with given key on server as 64-bit unsigned integer, and add given data and original data together on server.
+ *
+ */
+int
+MCACHE_DataIncrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum)
+{
+	return s_DataCalculate(pstMCServer, pstMCData, nNum, MCACHE_OP_INCREMENT);
+}
+
+/**
+ * @fn		int MCACHE_DataDecrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for substraction.
+ * @param	pstMCData	pointer of data to substract.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	take the data associated with given key on server as 64-bit unsigned integer, and substract given dat from original data on server.
+ */
+int
+MCACHE_DataDecrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum)
+{
+	return s_DataCalculate(pstMCServer, pstMCData, nNum, MCACHE_OP_DECREMENT);
+}
+
+/**
+ * @fn		int MCACHE_DataIncrementMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nNum, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for addition.
+ * @param	pstMCDataList	pointer of data list holding keys to add.
+ * @param	nListSize	number of data in data list.
+ * @param	nNum		number to add to each data.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are incremented, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataIncrement for each data, commands are sent in one write and replies are parsed in one pass.
+ */
+int
+MCACHE_DataIncrementMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nNum, int *pnStatus)
+{
+	struct bulkRequest request;
+
+	memset(&request, 0, sizeof(request));
+	request.op = MCACHE_OP_INCREMENT;
+	request.num = nNum;
+
+	return s_DataBulk(pstMCServer, pstMCDataList, nListSize, &request, pnStatus);
+}
+
+/**
+ * @fn		int MCACHE_DataDecrementMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nNum, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for substraction.
+ * @param	pstMCDataList	pointer of data list holding keys to substract.
+ * @param	nListSize	number of data in data list.
+ * @param	nNum		number to substract from each data.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are decremented, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataDecrement for each data, commands are sent in one write and replies are parsed in one pass.
+ */
+int
+MCACHE_DataDecrementMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nNum, int *pnStatus)
+{
+	struct bulkRequest request;
+
+	memset(&request, 0, sizeof(request));
+	request.op = MCACHE_OP_DECREMENT;
+	request.num = nNum;
+
+	return s_DataBulk(pstMCServer, pstMCDataList, nListSize, &request, pnStatus);
+}
+
+// Counter commands
+/**
+ * @fn		int MCACHE_DataIncrementNum(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, uint64_t *pnValue)
+ *
+ * @param	pstMCServer	pointer of server for addition.
+ * @param	pstMCData	pointer of data holding key.
+ * @param	nNum		number to add.
+ * @param	pnValue		pointer to hold new value, could be NULL.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND for data not found, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataIncrement, but new value is returned as integer and pDataValue is left untouched.
+ *
+ * @note	no memory is allocated.
+ */
+int
+MCACHE_DataIncrementNum(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, uint64_t *pnValue)
+{
+	return s_DataCount(pstMCServer, pstMCData, nNum, MCACHE_OP_INCREMENT, pnValue);
+}
+
+/**
+ * @fn		int MCACHE_DataDecrementNum(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, uint64_t *pnValue)
+ *
+ * @param	pstMCServer	pointer of server for substraction.
+ * @param	pstMCData	pointer of data holding key.
+ * @param	nNum		number to substract.
+ * @param	pnValue		pointer to hold new value, could be NULL.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND for data not found, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataDecrement, but new value is returned as integer and pDataValue is left untouched.
+ *
+ * @note	no memory is allocated.
+ */
+int
+MCACHE_DataDecrementNum(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, uint64_t *pnValue)
+{
+	return s_DataCount(pstMCServer, pstMCData, nNum, MCACHE_OP_DECREMENT, pnValue);
+}
+
+/**
+ * @fn		int MCACHE_CounterCreate(MemCacheCounter **ppstCounter, MemCacheServer *pstMCServer, size_t nMaxKeys, int nInterval)
+ *
+ * @param	ppstCounter	pointer to hold created counter.
+ * @param	pstMCServer	pointer of server receiving aggregated deltas.
+ * @param	nMaxKeys	pending keys triggering a flush, 0 for no limit.
+ * @param	nInterval	milliseconds after last flush triggering a flush, 0 for no limit.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	create counter aggregating deltas of incr/decr on client side.
+ *
+ * @note	deltas added by MCACHE_CounterAdd are kept in tables sharded by thread and sent by one bulk of incr/decr
+ *       	when a trigger fires (checked by MCACHE_CounterAdd) or MCACHE_CounterFlush is invoked.
+ *       	counters not existing on server are created by "add".
+ *       	pstMCServer must not be used by other threads while counter is alive, counter must be destroyed by
+ *       	MCACHE_CounterDestroy.
+ */
+int
+MCACHE_CounterCreate(MemCacheCounter **ppstCounter, MemCacheServer *pstMCServer, size_t nMaxKeys, int nInterval)
+{
+	int i = 0;
+	MemCacheCounter *counter = NULL;
+
+	if (NULL == ppstCounter || NULL == pstMCServer || 0 > nInterval)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL == (counter = (MemCacheCounter *) calloc(1, sizeof(MemCacheCounter))))
+		return MCACHE_ERR_NOMEM;
+
+	counter->server = pstMCServer;
+	counter->max_keys = nMaxKeys;
+	counter->interval = (int64_t) nInterval * 1000;
+	counter->last_flush = s_NowUSec();
+	pthread_mutex_init(&counter->flush_lock, NULL);
+
+	for (i = 0; i < COUNTER_SHARDS; i++)
+		pthread_mutex_init(&counter->shards[i].lock, NULL);
+
+	*ppstCounter = counter;
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_CounterAdd(MemCacheCounter *pstCounter, const char *pszKey, int64_t nDelta)
+ *
+ * @param	pstCounter	pointer of counter.
+ * @param	pszKey		key of counter on server.
+ * @param	nDelta		number to add, negative for substraction.
+ *
+ * @return	MCACHE_OK for success, result of flush if it is triggered, failure otherwise.
+ *
+ * @brief	aggregate delta of key on client side, thread safe.
+ *
+ * @note	deltas of a key are summed before sent, so decrements saturating at 0 on server may differ from
+ *       	sending them one by one.
+ */
+int
+MCACHE_CounterAdd(MemCacheCounter *pstCounter, const char *pszKey, int64_t nDelta)
+{
+	int ret = MCACHE_OK;
+	int64_t last = 0;
+
+	if (NULL == pstCounter || NULL == pszKey || MCACHE_KEY_MAX < strlen(pszKey))
+		return MCACHE_ERR_INVAL;
+
+	if (MCACHE_OK != (ret = s_CounterAdd(pstCounter, pszKey, nDelta)))
+		return ret;
+
+	last = __atomic_load_n(&pstCounter->last_flush, __ATOMIC_RELAXED);
+
+	if ((0 < pstCounter->max_keys && pstCounter->max_keys <= __atomic_load_n(&pstCounter->pending, __ATOMIC_RELAXED)) ||
+		(0 < pstCounter->interval && last + pstCounter->interval <= s_NowUSec())) {
+		//leave it to the thread already flushing
+		if (0 == pthread_mutex_trylock(&pstCounter->flush_lock)) {
+			ret = s_CounterFlush(pstCounter);
+			pthread_mutex_unlock(&pstCounter->flush_lock);
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_CounterFlush(MemCacheCounter *pstCounter)
+ *
+ * @param	pstCounter	pointer of counter.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	send all pending deltas in one bulk of incr/decr.
+ *
+ * @note	deltas failed for connection are kept and sent by next flush.
+ */
+int
+MCACHE_CounterFlush(MemCacheCounter *pstCounter)
+{
+	int ret = MCACHE_OK;
+
+	if (NULL == pstCounter)
+		return MCACHE_ERR_INVAL;
+
+	pthread_mutex_lock(&pstCounter->flush_lock);
+	ret = s_CounterFlush(pstCounter);
+	pthread_mutex_unlock(&pstCounter->flush_lock);
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_CounterDestroy(MemCacheCounter *pstCounter)
+ *
+ * @param	pstCounter	pointer of counter.
+ *
+ * @return	result of final flush.
+ *
+ * @brief	flush pending deltas and free counter, deltas failed to be sent are dropped.
+ */
+int
+MCACHE_CounterDestroy(MemCacheCounter *pstCounter)
+{
+	int i = 0;
+	int ret = MCACHE_OK;
+	size_t k = 0;
+
+	if (NULL == pstCounter)
+		return MCACHE_ERR_INVAL;
+
+	ret = MCACHE_CounterFlush(pstCounter);
+
+	for (i = 0; i < COUNTER_SHARDS; i++) {
+		for (k = 0; k < pstCounter->shards[i].size; k++) {
+			if (NULL != pstCounter->shards[i].slots[k].key)
+				free(pstCounter->shards[i].slots[k].key);
+		}
+
+		if (NULL != pstCounter->shards[i].slots)
+			free(pstCounter->shards[i].slots);
+
+		pthread_mutex_destroy(&pstCounter->shards[i].lock);
+	}
+
+	pthread_mutex_destroy(&pstCounter->flush_lock);
+	free(pstCounter);
+
+	return ret;
+}
+
+// Write-behind commands
+/**
+ * @fn		int MCACHE_WriterCreate(MemCacheWriter **ppstWriter, MemCacheServer *pstMCServer, size_t nMaxItems, int nLinger, int nFlag)
+ *
+ * @param	ppstWriter	pointer to hold created writer.
+ * @param	pstMCServer	pointer of server receiving queued writes.
+ * @param	nMaxItems	maximum number of queued items.
+ * @param	nLinger		milliseconds flusher waits for more items before sending, 0 to send at once.
+ * @param	nFlag		MCACHE_WRITER_DROP_OLDEST and/or MCACHE_WRITER_NOREPLY.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	create write-behind queue whose items are stored by a background thread.
+ *
+ * @note	writes to the same key are coalesced in queue and the last one wins. items are sent by one pipelined bulk of
+ *       	sets ("noreply" with MCACHE_WRITER_NOREPLY). once queue is full, MCACHE_WriterSet waits for flusher
+ *       	unless MCACHE_WRITER_DROP_OLDEST is given, then the oldest item is dropped.
+ *       	pstMCServer must not be used by other threads while writer is alive, writer must be destroyed by
+ *       	MCACHE_WriterDestroy.
+ */
+int
+MCACHE_WriterCreate(MemCacheWriter **ppstWriter, MemCacheServer *pstMCServer, size_t nMaxItems, int nLinger, int nFlag)
+{
+	size_t buckets = WRITER_BUCKETS_MIN;
+	MemCacheWriter *writer = NULL;
+
+	if (NULL == ppstWriter || NULL == pstMCServer || 0 == nMaxItems || 0 > nLinger)
+		return MCACHE_ERR_INVAL;
+
+	while (buckets < nMaxItems)
+		buckets *= 2;
+
+	if (NULL == (writer = (MemCacheWriter *) calloc(1, sizeof(MemCacheWriter))))
+		return MCACHE_ERR_NOMEM;
+
+	if (NULL == (writer->buckets = (struct writeItem **) calloc(buckets, sizeof(struct writeItem *)))) {
+		free(writer);
+		return MCACHE_ERR_NOMEM;
+	}
+
+	writer->server = pstMCServer;
+	writer->mask = buckets - 1;
+	writer->max_items = nMaxItems;
+	writer->linger = (int64_t) nLinger * 1000;
+	writer->flag = nFlag;
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->wake, NULL);
+	pthread_cond_init(&writer->space, NULL);
+	pthread_cond_init(&writer->idle, NULL);
+
+	if (0 != pthread_create(&writer->thread, NULL, s_WriterThread, writer)) {
+		pthread_mutex_destroy(&writer->lock);
+		pthread_cond_destroy(&writer->wake);
+		pthread_cond_destroy(&writer->space);
+		pthread_cond_destroy(&writer->idle);
+		free(writer->buckets);
+		free(writer);
+		return MCACHE_ERR_NOMEM;
+	}
+
+	*ppstWriter = writer;
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_WriterSet(MemCacheWriter *pstWriter, MemCacheData *pstMCData)
+ *
+ * @param	pstWriter	pointer of writer.
+ * @param	pstMCData	pointer of data to store, key and value are copied.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_TIMEOUT if queue stays full for nTimeout of server, failure otherwise.
+ *
+ * @brief	queue data to be stored by flusher of writer and return without waiting for server, thread safe.
+ */
+int
+MCACHE_WriterSet(MemCacheWriter *pstWriter, MemCacheData *pstMCData)
+{
+	int ret = MCACHE_OK;
+	size_t key_len = 0;
+	uint32_t hash = 0;
+	void *value = NULL;
+	struct writeItem *item = NULL;
+	struct writeItem *old = NULL;
+	struct timespec ts;
+
+	if (NULL == pstWriter || NULL == pstMCData || MCACHE_OK != s_ChkKey(pstMCData, &key_len) ||
+		NULL == pstMCData->pDataValue || MCACHE_VALUE_MAX < pstMCData->nDataLen)
+		return MCACHE_ERR_INVAL;
+
+	if (s_TraceOn(pstWriter->server))
+		s_TraceEmit(pstWriter->server, MCACHE_TRACE_ENQUEUE, MCACHE_OP_SET, s_TraceHash(pstMCData), 1,
+			pstMCData->nDataLen, MCACHE_OK);
+
+	//copy outside of lock
+	if (NULL == (value = malloc(0 < pstMCData->nDataLen ? pstMCData->nDataLen : 1)))
+		return MCACHE_ERR_NOMEM;
+
+	memcpy(value, pstMCData->pDataValue, pstMCData->nDataLen);
+	hash = s_CounterHash(pstMCData->pszDataKey, key_len);
+
+	pthread_mutex_lock(&pstWriter->lock);
+
+	for (old = pstWriter->buckets[hash & pstWriter->mask]; NULL != old; old = old->hnext) {
+		if (hash == old->hash && s_KeyEqual(old->key, pstMCData->pszDataKey, key_len))
+			break;
+	}
+
+	if (NULL != old) {
+		free(old->value);
+		old->value = value;
+		old->len = pstMCData->nDataLen;
+		old->flags = pstMCData->nFlags;
+		old->expiration = pstMCData->nExpiration;
+		pthread_mutex_unlock(&pstWriter->lock);
+
+		return MCACHE_OK;
+	}
+
+	pthread_mutex_unlock(&pstWriter->lock);
+
+	if (NULL == (item = (struct writeItem *) malloc(sizeof(struct writeItem) + key_len + 1))) {
+		free(value);
+		return MCACHE_ERR_NOMEM;
+	}
+
+	item->key = (char *) (item + 1);
+	memcpy(item->key, pstMCData->pszDataKey, key_len);
+	item->key[key_len] = '\0';
+	item->hash = hash;
+	item->value = value;
+	item->len = pstMCData->nDataLen;
+	item->flags = pstMCData->nFlags;
+	item->expiration = pstMCData->nExpiration;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += pstWriter->server->nTimeout;
+
+	pthread_mutex_lock(&pstWriter->lock);
+
+	//key might be queued by others whenever lock was released, before relocking and while waiting for space
+	while (MCACHE_OK == ret) {
+		for (old = pstWriter->buckets[hash & pstWriter->mask]; NULL != old; old = old->hnext) {
+			if (hash == old->hash && 0 == strcmp(old->key, item->key)) {
+				s_WriterDrop(pstWriter, old);
+				break;
+			}
+		}
+
+		if (pstWriter->max_items > pstWriter->count)
+			break;
+
+		if (MCACHE_WRITER_DROP_OLDEST == (pstWriter->flag & MCACHE_WRITER_DROP_OLDEST)) {
+			s_WriterDrop(pstWriter, pstWriter->head);
+			pstWriter->dropped++;
+		}
+		else if (ETIMEDOUT == pthread_cond_timedwait(&pstWriter->space, &pstWriter->lock, &ts)) {
+			ret = MCACHE_ERR_TIMEOUT;
+		}
+	}
+
+	if (MCACHE_OK == ret) {
+		item->hnext = pstWriter->buckets[hash & pstWriter->mask];
+		pstWriter->buckets[hash & pstWriter->mask] = item;
+		item->prev = pstWriter->tail;
+		item->next = NULL;
+
+		if (NULL != pstWriter->tail)
+			pstWriter->tail->next = item;
+		else
+			pstWriter->head = item;
+
+		pstWriter->tail = item;
+		pstWriter->count++;
+		pthread_cond_signal(&pstWriter->wake);
+	}
+
+	pthread_mutex_unlock(&pstWriter->lock);
+
+	if (MCACHE_OK != ret) {
+		free(item->value);
+		free(item);
+	}
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_WriterFlush(MemCacheWriter *pstWriter, size_t *pnDropped)
+ *
+ * @param	pstWriter	pointer of writer.
+ * @param	pnDropped	pointer to hold number of items dropped for full queue since last call, could be NULL.
+ *
+ * @return	MCACHE_OK if all items are sent, otherwise first failure since last call.
+ *
+ * @brief	wait until all queued items are sent.
+ */
+int
+MCACHE_WriterFlush(MemCacheWriter *pstWriter, size_t *pnDropped)
+{
+	int ret = MCACHE_OK;
+
+	if (NULL == pstWriter)
+		return MCACHE_ERR_INVAL;
+
+	pthread_mutex_lock(&pstWriter->lock);
+	pthread_cond_signal(&pstWriter->wake);
+
+	while (0 < pstWriter->count || pstWriter->busy)
+		pthread_cond_wait(&pstWriter->idle, &pstWriter->lock);
+
+	ret = pstWriter->result;
+	pstWriter->result = MCACHE_OK;
+
+	if (NULL != pnDropped)
+		*pnDropped = pstWriter->dropped;
+
+	pstWriter->dropped = 0;
+	pthread_mutex_unlock(&pstWriter->lock);
+
+	return ret;
+}
+
+/**
+ * @fn		int MCACHE_WriterDestroy(MemCacheWriter *pstWriter)
+ *
+ * @param	pstWriter	pointer of writer.
+ *
+ * @return	MCACHE_OK if all items are sent, otherwise first failure since last MCACHE_WriterFlush.
+ *
+ * @brief	send queued items, stop flusher and free writer.
+ */
+int
+MCACHE_WriterDestroy(MemCacheWriter *pstWriter)
+{
+	int ret = MCACHE_OK;
+
+	if (NULL == pstWriter)
+		return MCACHE_ERR_INVAL;
+
+	pthread_mutex_lock(&pstWriter->lock);
+	pstWriter->stop = 1;
+	pthread_cond_signal(&pstWriter->wake);
+	pthread_mutex_unlock(&pstWriter->lock);
+
+	pthread_join(pstWriter->thread, NULL);
+	ret = pstWriter->result;
+
+	pthread_mutex_destroy(&pstWriter->lock);
+	pthread_cond_destroy(&pstWriter->wake);
+	pthread_cond_destroy(&pstWriter->space);
+	pthread_cond_destroy(&pstWriter->idle);
+	free(pstWriter->buckets);
+	free(pstWriter);
+
+	return ret;
+}
+
+// Replica commands
+/**
+ * @fn		int MCACHE_ReplicaInit(MemCacheReplicaSet *pstReplicaSet, MemCacheServer **ppstServers, size_t nServerCount, int nAck)
+ *
+ * @param	pstReplicaSet	pointer of replica set for initialization.
+ * @param	ppstServers	servers holding the same data, initialized by MCACHE_ServerInit.
+ * @param	nServerCount	number of servers, at most MCACHE_REPLICA_MAX.
+ * @param	nAck		MCACHE_ACK_ONE or MCACHE_ACK_ALL.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	initialize replica set over given servers.
+ *
+ * @note	servers are not owned by replica set, and must not be used elsewhere while replica set is in use.
+ *       	reads go to the better of two random replicas (MCACHE_SELECT_P2C), set nSelect to MCACHE_SELECT_LEAST
+ *       	to always pick the least loaded one.
+ *       	a server failing for network is disconnected and skipped for MCACHE_REPLICA_RETRY seconds, then it is
+ *       	reconnected.
+ */
+int
+MCACHE_ReplicaInit(MemCacheReplicaSet *pstReplicaSet, MemCacheServer **ppstServers, size_t nServerCount, int nAck)
+{
+	size_t i = 0;
+
+	if (NULL == pstReplicaSet || NULL == ppstServers || 0 == nServerCount || MCACHE_REPLICA_MAX < nServerCount ||
+		(MCACHE_ACK_ONE != nAck && MCACHE_ACK_ALL != nAck))
+		return MCACHE_ERR_INVAL;
+
+	memset(pstReplicaSet, 0, sizeof(MemCacheReplicaSet));
+
+	for (i = 0; i < nServerCount; i++) {
+		if (NULL == ppstServers[i] || NULL == ppstServers[i]->pszServerAddr)
+			return MCACHE_ERR_INVAL;
+
+		pstReplicaSet->apstServers[i] = ppstServers[i];
+	}
+
+	pstReplicaSet->nServerCount = nServerCount;
+	pstReplicaSet->nAck = nAck;
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_ReplicaDataSet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData)
+ *
+ * @param	pstReplicaSet	pointer of replica set.
+ * @param	pstMCData	pointer of data to set.
+ *
+ * @return	MCACHE_OK if acknowledged as required by nAck, failure otherwise.
+ *
+ * @brief	store data on all replicas in parallel.
+ *
+ * @note	with MCACHE_ACK_ONE, only the least loaded usable replica replies, others are sent "noreply" commands.
+ *       	with MCACHE_ACK_ALL, every replica of set must store data, including replicas currently down.
+ *       	replies of gets lost by hedging are read off replicas first, waiting for them up to nTimeout.
+ */
+int
+MCACHE_ReplicaDataSet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData)
+{
+	if (NULL == pstReplicaSet)
+		return MCACHE_ERR_INVAL;
+
+	return s_ReplicaWrite(pstReplicaSet, pstMCData, MCACHE_OP_SET, 0);
+}
+
+/**
+ * @fn		int MCACHE_ReplicaDataDelete(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData)
+ *
+ * @param	pstReplicaSet	pointer of replica set.
+ * @param	pstMCData	pointer of data holding key to delete.
+ *
+ * @return	MCACHE_OK if acknowledged as required by nAck, failure otherwise.
+ *
+ * @brief	delete data from all replicas in parallel, acknowledged as MCACHE_ReplicaDataSet.
+ */
+int
+MCACHE_ReplicaDataDelete(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData)
+{
+	if (NULL == pstReplicaSet)
+		return MCACHE_ERR_INVAL;
+
+	return s_ReplicaWrite(pstReplicaSet, pstMCData, MCACHE_OP_DELETE, 0);
+}
+
+/**
+ * @fn		int MCACHE_ReplicaDataGet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	pstReplicaSet	pointer of replica set.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ *
+ * @return	same as MCACHE_DataGet, MCACHE_ERR_NET if no replica is usable.
+ *
+ * @brief	fetch data from a replica chosen by nSelect of replica set, failing over to the least loaded remaining
+ *       	one for network failures.
+ *
+ * @note	if nHedgeDelay or nHedgePercentile of replica set is given, a get not answered within the delay is sent to
+ *       	a second replica as well and the first reply wins (up to nHedgeBudget percent of gets).
+ */
+int
+MCACHE_ReplicaDataGet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCDataList, size_t nListSize)
+{
+	int ret = MCACHE_ERR_NET;
+	size_t i = 0;
+	size_t count = 0;
+	size_t order[MCACHE_REPLICA_MAX];
+	int64_t begin = s_NowUSec();
+	int64_t delay = 0;
+
+	if (NULL == pstReplicaSet)
+		return MCACHE_ERR_INVAL;
+
+	count = s_ReplicaOrder(pstReplicaSet, order, 0);
+	delay = s_HedgeDelay(pstReplicaSet);
+	pstReplicaSet->nGets++;
+
+	//hedge within budget, failover to remaining replicas still applies
+	if (0 < count && 0 < delay && (0 >= pstReplicaSet->nHedgeBudget ||
+		pstReplicaSet->nHedges * 100 < pstReplicaSet->nGets * pstReplicaSet->nHedgeBudget)) {
+		if (!s_IsConnError(ret = s_HedgeGet(pstReplicaSet, pstMCDataList, nListSize, order, count, delay))) {
+			s_HedgeRecord(pstReplicaSet, s_NowUSec() - begin);
+			return ret;
+		}
+
+		count = s_ReplicaOrder(pstReplicaSet, order, 0);
+	}
+
+	for (i = 0; i < count; i++) {
+		ret = s_DataRetrieval(pstReplicaSet->apstServers[order[i]], pstMCDataList, nListSize, MCACHE_OP_GET, 0);
+
+		if (!s_IsConnError(ret)) {
+			s_HedgeRecord(pstReplicaSet, s_NowUSec() - begin);
+			break;
+		}
+
+		s_ReplicaFail(pstReplicaSet, order[i]);
+	}
+
+	return ret;
+}
+
+// Pool commands
+/**
+ * @fn		int MCACHE_PoolCreate(MemCachePool **ppstPool, size_t nMaxCached)
+ *
+ * @param	ppstPool	pointer to hold created pool.
+ * @param	nMaxCached	free blocks kept for reuse per size class.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	create pool of blocks in power of two size classes from 32 bytes to 64KB, larger blocks are malloced.
+ *
+ * @note	plug pool into server by setting stAllocator to { MCACHE_PoolAlloc, MCACHE_PoolFree, pool }, so values
+ *       	and reply buffers are recycled instead of going through malloc. pool is thread safe, and must outlive
+ *       	every block allocated from it before destroyed by MCACHE_PoolDestroy.
+ */
+int
+MCACHE_PoolCreate(MemCachePool **ppstPool, size_t nMaxCached)
+{
+	size_t i = 0;
+	MemCachePool *pool = NULL;
+
+	if (NULL == ppstPool || 0 == nMaxCached)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL == (pool = (MemCachePool *) calloc(1, sizeof(MemCachePool))))
+		return MCACHE_ERR_NOMEM;
+
+	for (i = 0; i < POOL_CLASS_COUNT; i++)
+		pthread_mutex_init(&pool->classes[i].lock, NULL);
+
+	pool->max_cached = nMaxCached;
+	*ppstPool = pool;
+
+	return MCACHE_OK;
+}
+
+/**
+ * size class of nSize bytes, POOL_CLASS_COUNT if too large for any.
+ */
+static size_t
+s_PoolClass(size_t nSize)
+{
+	size_t idx = 0;
+
+	if (((size_t) 1 << POOL_CLASS_MIN) >= nSize)
+		return 0;
+
+	idx = sizeof(unsigned long) * CHAR_BIT - __builtin_clzl(nSize - 1) - POOL_CLASS_MIN;
+
+	return POOL_CLASS_COUNT < idx ? POOL_CLASS_COUNT : idx;
+}
+
+/**
+ * @fn		void *MCACHE_PoolAlloc(size_t nSize, void *pContext)
+ *
+ * @param	nSize		bytes to allocate.
+ * @param	pContext	pointer of pool.
+ *
+ * @return	pointer of allocated block, NULL for failure.
+ *
+ * @brief	allocate block from pool, allocator function of MemCacheAllocator.
+ */
+void *
+MCACHE_PoolAlloc(size_t nSize, void *pContext)
+{
+	MemCachePool *pool = (MemCachePool *) pContext;
+	size_t idx = s_PoolClass(nSize);
+	char *block = NULL;
+
+	if (POOL_CLASS_COUNT > idx) {
+		pthread_mutex_lock(&pool->classes[idx].lock);
+
+		if (NULL != (block = (char *) pool->classes[idx].free_list)) {
+			pool->classes[idx].free_list = *(void **) block;
+			pool->classes[idx].cached--;
+		}
+
+		pthread_mutex_unlock(&pool->classes[idx].lock);
+		nSize = (size_t) 1 << (idx + POOL_CLASS_MIN);
+	}
+
+	if (NULL == block && NULL == (block = (char *) malloc(POOL_HEADER_SIZE + nSize)))
+		return NULL;
+
+	*(size_t *) block = idx;
+
+	return block + POOL_HEADER_SIZE;
+}
+
+/**
+ * @fn		void MCACHE_PoolFree(void *pPtr, void *pContext)
+ *
+ * @param	pPtr		pointer of block allocated by MCACHE_PoolAlloc, or NULL.
+ * @param	pContext	pointer of pool.
+ *
+ * @brief	return block to pool, free function of MemCacheAllocator.
+ */
+void
+MCACHE_PoolFree(void *pPtr, void *pContext)
+{
+	MemCachePool *pool = (MemCachePool *) pContext;
+	char *block = (char *) pPtr - POOL_HEADER_SIZE;
+	size_t idx = 0;
+
+	if (NULL == pPtr)
+		return;
+
+	if (POOL_CLASS_COUNT > (idx = *(size_t *) block)) {
+		pthread_mutex_lock(&pool->classes[idx].lock);
+
+		if (pool->classes[idx].cached < pool->max_cached) {
+			*(void **) block = pool->classes[idx].free_list;
+			pool->classes[idx].free_list = block;
+			pool->classes[idx].cached++;
+			block = NULL;
+		}
+
+		pthread_mutex_unlock(&pool->classes[idx].lock);
+	}
+
+	free(block);
+}
+
+/**
+ * @fn		int MCACHE_PoolDestroy(MemCachePool *pstPool)
+ *
+ * @param	pstPool		pointer of pool.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ */
+int
+MCACHE_PoolDestroy(MemCachePool *pstPool)
+{
+	size_t i = 0;
+	void *block = NULL;
+
+	if (NULL == pstPool)
+		return MCACHE_ERR_INVAL;
+
+	for (i = 0; i < POOL_CLASS_COUNT; i++) {
+		while (NULL != (block = pstPool->classes[i].free_list)) {
+			pstPool->classes[i].free_list = *(void **) block;
+			free(block);
+		}
+
+		pthread_mutex_destroy(&pstPool->classes[i].lock);
+	}
+
+	free(pstPool);
+
+	return MCACHE_OK;
+}
+
+// Hot key commands
+/**
+ * @fn		int MCACHE_HotKeyCreate(MemCacheHotKey **ppstHotKey, size_t nCapacity, size_t nThreshold, int nTTL)
+ *
+ * @param	ppstHotKey	pointer to hold created tracker.
+ * @param	nCapacity	number of keys monitored, also number of local copies kept.
+ * @param	nThreshold	gets per second making a key hot.
+ * @param	nTTL		milliseconds local copy of hot data is served, 0 to only detect hot keys.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	create tracker spotting hot keys on get path with a Space-Saving sketch of nCapacity counters.
+ *
+ * @note	data of hot keys fetched by MCACHE_HotKeyGet is pinned locally for nTTL and served without contacting
+ *       	server, so a viral key costs its server at most one get per nTTL. to spread hot keys over servers
+ *       	instead, store copies under keys given by MCACHE_HotKeyDerive and read a random one of them.
+ *       	tracker is thread safe, and must be destroyed by MCACHE_HotKeyDestroy.
+ *       	a get of a tracked key costs O(1) under tracker lock, but an untracked key scans all nCapacity
+ *       	counters to evict the least counted one, so keep nCapacity to a few hundred keys.
+ */
+int
+MCACHE_HotKeyCreate(MemCacheHotKey **ppstHotKey, size_t nCapacity, size_t nThreshold, int nTTL)
+{
+	MemCacheHotKey *hot = NULL;
+	size_t slots = 2;
 
-		if (0 == strcmp(pstDataList[i].pszDataKey, pszKey)) {
-			idx = i;
-			break;
-		}
+	if (NULL == ppstHotKey || 0 == nCapacity || UINT32_MAX / 2 < nCapacity || 0 == nThreshold || 0 > nTTL)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL == (hot = (MemCacheHotKey *) calloc(1, sizeof(MemCacheHotKey))))
+		return MCACHE_ERR_NOMEM;
+
+	while (slots < 2 * nCapacity)
+		slots <<= 1;
+
+	hot->counters = (struct hotCounter *) calloc(nCapacity, sizeof(struct hotCounter));
+	hot->index = (uint32_t *) calloc(slots, sizeof(uint32_t));
+	hot->pins = (struct hotPin *) calloc(nCapacity, sizeof(struct hotPin));
+
+	if (NULL == hot->counters || NULL == hot->index || NULL == hot->pins) {
+		free(hot->counters);
+		free(hot->index);
+		free(hot->pins);
+		free(hot);
+		return MCACHE_ERR_NOMEM;
 	}
 
-	return idx;
+	pthread_mutex_init(&hot->lock, NULL);
+	hot->mask = slots - 1;
+	hot->capacity = nCapacity;
+	hot->threshold = nThreshold;
+	hot->ttl = (int64_t) nTTL * 1000;
+	hot->last_decay = s_NowUSec();
+	*ppstHotKey = hot;
+
+	return MCACHE_OK;
 }
 
-static int
-s_DataRetrieval(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int nOpFlag)
+/**
+ * @fn		int MCACHE_HotKeyGet(MemCacheHotKey *pstHotKey, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	pstHotKey	pointer of tracker.
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ *
+ * @return	same as MCACHE_DataGet.
+ *
+ * @brief	same as MCACHE_DataGet, hits are counted by tracker and pinned data of hot keys is served locally.
+ */
+int
+MCACHE_HotKeyGet(MemCacheHotKey *pstHotKey, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
 {
-	int i = 0;
 	int ret = MCACHE_OK;
-	int timeout = 0;
-	int read_count = 0;
-	int data_size = 0;
-	size_t buffer_size = 6;/// 4 + 2 (i.e., gets + \r\n)
-	size_t fetched_count = 0;
-	char *buffer = NULL;
-	char *cursor = NULL;
-	time_t check_time = 0;
-
-	if (NULL == pstMCServer || NULL == pstMCDataList || MCACHE_MULTIGET_MAX < nListSize)
+	size_t i = 0;
+	size_t count = 0;
+	size_t *map = NULL;
+	char *flag = NULL;
+	char *hit = NULL;
+	uint32_t *hash = NULL;
+	MemCacheData *list = NULL;
+
+	if (NULL == pstHotKey || NULL == pstMCServer || NULL == pstMCDataList)
 		return MCACHE_ERR_INVAL;
 
-	///Maximum memory usage will be (MCACHE_MULTIGET_MAX * (250 + 1) + 6)
+	if (0 == nListSize)
+		return MCACHE_OK;
 
-	for (i = 0; i < nListSize; i++) {
-		if (MCACHE_OK != s_ChkInput(pstMCServer, pstMCDataList + i, nOpFlag))
-			continue;
+	map = (size_t *) malloc(nListSize * sizeof(size_t));
+	flag = (char *) calloc(nListSize, 2);
+	hash = (uint32_t *) malloc(nListSize * sizeof(uint32_t));
+	list = (MemCacheData *) malloc(nListSize * sizeof(MemCacheData));
 
-		buffer_size += strlen(pstMCDataList[i].pszDataKey) + 1; // key + space
+	if (NULL == map || NULL == flag || NULL == hash || NULL == list) {
+		ret = MCACHE_ERR_NOMEM;
+		goto end;
 	}
 
-	if (NULL == (buffer = (char *) malloc(buffer_size + 1)))
-		return MCACHE_ERR_NOMEM;
+	hit = flag + nListSize;
 
-	memset(buffer, 0, buffer_size + 1);
+	pthread_mutex_lock(&pstHotKey->lock);
 
-	if (MCACHE_OP_GET == nOpFlag) {
-		snprintf(buffer, buffer_size, "get");
-	}
-	else {
-		snprintf(buffer, buffer_size, "gets");
-	}
+	for (i = 0; i < nListSize; i++) {
+		struct hotPin *pin = NULL;
+		MemCacheData *data = pstMCDataList + i;
+		void *value = NULL;
+		size_t key_len = 0;
+
+		//invalid keys are left to s_DataRetrievalRun
+		if (MCACHE_OK != s_ChkKey(data, &key_len)) {
+			map[count] = i;
+			list[count++] = *data;
+			continue;
+		}
 
-	cursor = buffer + strlen(buffer);
+		hash[i] = s_CounterHash(data->pszDataKey, key_len);
+		flag[i] = s_HotKeyObserve(pstHotKey, data->pszDataKey, key_len, hash[i]);
 
-	for (i = 0; i < nListSize; i++) {
-		if (MCACHE_OK != s_ChkInput(pstMCServer, pstMCDataList + i, nOpFlag))
+		//pinned copy is handed out like s_RetrieveCopy does
+		if (flag[i] && NULL != (pin = s_HotKeyPin(pstHotKey, data->pszDataKey, key_len, hash[i])) &&
+			NULL != (value = s_Alloc(pstMCServer, pin->len + 1))) {
+			memcpy(value, pin->value, pin->len + 1);
+
+			if (MCACHE_FLAG_FREE_VALUE == (pstMCServer->nFlag & MCACHE_FLAG_FREE_VALUE) && NULL != data->pDataValue)
+				s_Free(pstMCServer, data->pDataValue);
+
+			data->pDataValue = value;
+			data->nDataLen = pin->len;
+			data->nFlags = pin->flags;
+			flag[i] = 0;
 			continue;
+		}
 
-		*cursor = ' ';
-		cursor++;
-		data_size = strlen(pstMCDataList[i].pszDataKey);
-		
-		memcpy(cursor, pstMCDataList[i].pszDataKey, data_size);
-		cursor += data_size;
+		map[count] = i;
+		list[count++] = *data;
 	}
 
-	*cursor = '\r';
-	cursor++;
-	*cursor = '\n';
-
-	timeout = pstMCServer->nTimeout;
-	check_time = time(NULL);
+	pthread_mutex_unlock(&pstHotKey->lock);
 
-	if (MCACHE_OK == (ret = s_SockWrite(pstMCServer->nSockFD, buffer, strlen(buffer), timeout))) {
-		timeout -= time(NULL) - check_time;
+	if (0 == count)
+		goto end;
 
-		//use large buffer for safety
-		if (buffer_size < (MCACHE_VALUE_MAX  * 2)) {
-			free(buffer);
-			buffer_size = MCACHE_VALUE_MAX * 2;
-			if (NULL == (buffer = (char *) malloc(buffer_size)))
-				return MCACHE_ERR_NOMEM;
-		}
+	ret = s_DataRetrievalRun(pstMCServer, list, count, MCACHE_OP_GET, 0, s_RetrieveCopy, pstMCServer, hit);
 
-		memset(buffer, 0, buffer_size);
-		data_size = 0;
-		while (1) {
+	for (i = 0; i < count; i++)
+		pstMCDataList[map[i]] = list[i];
 
-			timeout -= time(NULL) - check_time;
-			ret = s_SockRead(pstMCServer->nSockFD, buffer + data_size, buffer_size - data_size - 1, &read_count, timeout);
+	if (0 == pstHotKey->ttl)
+		goto end;
 
-			if (nListSize == fetched_count)
-				break;
+	pthread_mutex_lock(&pstHotKey->lock);
 
-			if (MCACHE_OK == ret) {
-				cursor = buffer;
-				
-				*(buffer + data_size + read_count) = '\0';	
-				int valid_data_size = data_size + read_count;
-
-				if (0 == strcmp(buffer, "END\r\n") || 0 == strcmp(buffer, "\r\nEND\r\n"))
-					goto done;
-
-				while (1) {
-					char *key = NULL;
-					char *flags = NULL;
-					char *size = NULL;
-					char *cas_unique = NULL;
-					char *data = NULL;
-					int  size_num = 0;
-					int  break_outer = 0;
-					int  idx = 0;
-					MemCacheData *tmp_data = NULL;
-					
-					while (1) {
-						if (0 == strcmp(cursor, "END\r\n") || 0 == strcmp(cursor, "\r\nEND\r\n"))
-							goto done;
-
-						if (NULL == (key = strstr(cursor, "VALUE ")))
-							break;
-
-						if (NULL == (data = strstr(key, "\r\n")))
-							break;
-
-						if (MCACHE_OP_GETS == nOpFlag) {
-							cas_unique = data;
-							while (' ' != *cas_unique)
-								cas_unique--;
-
-							size = cas_unique - 1;
-							while ( ' ' != *size)
-								size--;
-
-							size++;
-							*cas_unique = '\0';
-							size_num = strtol(size, NULL, 10);
-							*cas_unique = ' ';
-						}
-						else {
-							size = data;
-							while (' ' != *size)
-								size--;
-
-							*data = '\0';
-							size++;
-							size_num = strtol(size, NULL, 10);
-							*data = '\r';
-						}
-
-						if (size_num > (valid_data_size - ((data - cursor) + 2))) {
-							key = NULL;
-							break_outer = 1;
-							break;
-						}
-
-						key += 6;
-						flags = strchr(key, ' ');
-						*flags = '\0';
-						flags++;
-						*data = '\0';
-						data += 2;
-
-						if (-1 == (idx = s_GetDataByKey(pstMCDataList, nListSize, key))) {
-							ret = MCACHE_ERR_DATA;
-							goto end;
-						}
-
-						pstMCDataList[idx].nFlags = strtol(flags, NULL, 10);
-						pstMCDataList[idx].nDataLen = size_num;
-
-						if (MCACHE_OP_GETS == nOpFlag) {
-							pstMCDataList[idx].nCASUnique = strtoll(cas_unique, NULL, 10);
-						}
-						
-						if (MCACHE_FLAG_FREE_VALUE == (pstMCServer->nFlag & MCACHE_FLAG_FREE_VALUE) &&
-							NULL != pstMCDataList[idx].pDataValue)
-							free(pstMCDataList[idx].pDataValue);
-
-						pstMCDataList[idx].pDataValue = malloc(size_num);
-
-						if (NULL != pstMCDataList[idx].pDataValue) {
-							memcpy(pstMCDataList[idx].pDataValue, data, size_num);
-						}
-
-						valid_data_size = valid_data_size - (data - cursor) - size_num;
-						cursor = data + size_num;
-						fetched_count++;
-					}
-
-					if (NULL == key) {
-						data_size = valid_data_size;
-						memmove(buffer, cursor, data_size);
-						*(buffer + data_size) = '\0';
-						break;
-					}
-					
-					if (NULL == data) {
-						data_size = strlen(key);
-						memmove(buffer, key, data_size);
-						*(buffer + data_size) = '\0';
-						break;
-					}
-				}
-			}
-			else {
-				//error
-				break;
-			}
-		}
+	for (i = 0; i < count; i++) {
+		if (hit[i] && flag[map[i]])
+			s_HotKeyStore(pstHotKey, pstMCDataList + map[i], hash[map[i]]);
 	}
 
-done:
-
-	if (MCACHE_OK == ret && nListSize != fetched_count)
-		ret = MCACHE_ERR_PARTIAL;
+	pthread_mutex_unlock(&pstHotKey->lock);
 
 end:
 
-	if (NULL != buffer)
-		free(buffer);
+	if (NULL != map)
+		free(map);
+
+	if (NULL != flag)
+		free(flag);
+
+	if (NULL != hash)
+		free(hash);
+
+	if (NULL != list)
+		free(list);
 
 	return ret;
 }
 
-// Context Functions
 /**
- * @fn 		int MCACHE_ServerInit(MemCacheServer *pstMCServer, const char *pszHost, int nPort, int nTimeout)
+ * @fn		int MCACHE_HotKeyIsHot(MemCacheHotKey *pstHotKey, const char *pszKey)
  *
- * @param 	pszMCServer 	pointer of server for intialization.
- * @param 	pszHost 	the hostname/address of server running memcached.
- * @param 	nPort		the port which memcached server serving.
- * @param 	nTimeout	maximum timeout in seconds while communicating with memcached server.
- *
- * @return	MCACHE_OK for success, failure otherwise.
- *
- * @brief	initialize MemCacheServer with given host, port and timeout.
+ * @param	pstHotKey	pointer of tracker.
+ * @param	pszKey		key to check.
  *
- * @note	upon success. socket descriptor will be available. pszServerAddr must be freed by MCACHE_ServerDestroy.
+ * @return	1 if key is hot, 0 otherwise.
  *
- * @see		MCACHE_ServerDisconnect, MCACHE_ServerDestroy
+ * @brief	tell whether recent gets of key exceed threshold of tracker, without counting a hit.
  */
 int
-MCACHE_ServerInit(MemCacheServer *pstMCServer, const char *pszHost, int nPort, int nTimeout, int nFlag)
+MCACHE_HotKeyIsHot(MemCacheHotKey *pstHotKey, const char *pszKey)
 {
-	if (NULL == pstMCServer || NULL == pszHost || 0 >= nPort || 65535 < nPort ||
-		0 >= nTimeout || MCACHE_TIMEOUT_MAX < nTimeout)
-		return MCACHE_ERR_INVAL;
+	int hot = 0;
+	size_t pos = 0;
+	size_t len = 0;
 
-	memset(pstMCServer, 0, sizeof(MemCacheServer));
+	if (NULL == pstHotKey || NULL == pszKey || MCACHE_KEY_MAX < (len = strlen(pszKey)))
+		return 0;
 
-	if (0 > (pstMCServer->nSockFD = s_ConnectTCP(pszHost, nPort, nTimeout, nFlag)))
-		return MCACHE_ERR_NET;
+	pthread_mutex_lock(&pstHotKey->lock);
 
-	if (NULL == (pstMCServer->pszServerAddr = strdup(pszHost))) {
-		return MCACHE_ERR_NOMEM;
+	pos = s_HotKeySlot(pstHotKey, pszKey, len, s_CounterHash(pszKey, len));
+
+	if (0 != pstHotKey->index[pos]) {
+		struct hotCounter *counter = pstHotKey->counters + pstHotKey->index[pos] - 1;
+
+		hot = counter->count - counter->error >= pstHotKey->threshold;
 	}
 
-	pstMCServer->nPort = nPort;
-	pstMCServer->nTimeout = nTimeout;
-	pstMCServer->nFlag = nFlag;
+	pthread_mutex_unlock(&pstHotKey->lock);
 
-	return MCACHE_OK;
+	return hot;
 }
 
 /**
- * @fn		int MCACHE_ServerDisconnect(MemCacheServer *pstMCServer)
+ * @fn		int MCACHE_HotKeyInvalidate(MemCacheHotKey *pstHotKey, const char *pszKey)
  *
- * @param	pstMCServer	pointer of server for socket disconnection.
+ * @param	pstHotKey	pointer of tracker.
+ * @param	pszKey		key whose local copy is dropped.
  *
  * @return	MCACHE_OK for success, failure otherwise.
  *
- * @brief	disconnect socket connection between client and server.
+ * @brief	drop local copy of key, e.g., after storing new data for it.
+ */
+int
+MCACHE_HotKeyInvalidate(MemCacheHotKey *pstHotKey, const char *pszKey)
+{
+	struct hotPin *pin = NULL;
+
+	if (NULL == pstHotKey || NULL == pszKey)
+		return MCACHE_ERR_INVAL;
+
+	pthread_mutex_lock(&pstHotKey->lock);
+
+	if (NULL != (pin = s_HotKeyPin(pstHotKey, pszKey, strlen(pszKey), s_CounterHash(pszKey, strlen(pszKey))))) {
+		free(pin->key);
+		free(pin->value);
+		pin->key = NULL;
+		pin->value = NULL;
+	}
+
+	pthread_mutex_unlock(&pstHotKey->lock);
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		int MCACHE_HotKeyDerive(const char *pszKey, size_t nIndex, char *pszBuffer, size_t nBufferSize)
  *
- * @note	upon success. socket descriptor will be unavailable, and socket descriptor will be reset to -1.
+ * @param	pszKey		key of hot data.
+ * @param	nIndex		index of copy, 0 for key itself.
+ * @param	pszBuffer	buffer to hold derived key.
+ * @param	nBufferSize	size of buffer.
  *
- * @see		MCACHE_ServerInit
+ * @return	MCACHE_OK for success, MCACHE_ERR_INVAL if derived key does not fit in buffer or exceeds MCACHE_KEY_MAX.
+ *
+ * @brief	derive key of nIndex-th copy of hot data ("key#index"), copies land on different servers when keys are
+ *       	distributed by hash.
  */
 int
-MCACHE_ServerDisconnect(MemCacheServer *pstMCServer)
+MCACHE_HotKeyDerive(const char *pszKey, size_t nIndex, char *pszBuffer, size_t nBufferSize)
 {
-	if (NULL == pstMCServer || 0 > pstMCServer->nSockFD)
+	int len = 0;
+
+	if (NULL == pszKey || NULL == pszBuffer)
 		return MCACHE_ERR_INVAL;
 
-	close(pstMCServer->nSockFD);
-	pstMCServer->nSockFD = -1;
+	if (0 == nIndex)
+		len = snprintf(pszBuffer, nBufferSize, "%s", pszKey);
+	else
+		len = snprintf(pszBuffer, nBufferSize, "%s#%zu", pszKey, nIndex);
+
+	if (0 > len || nBufferSize <= (size_t) len || MCACHE_KEY_MAX < len)
+		return MCACHE_ERR_INVAL;
 
 	return MCACHE_OK;
 }
 
 /**
- * @fn		int MCACHE_ServerDestroy(MemCacheServer *pstMCServer)
+ * @fn		int MCACHE_HotKeyDestroy(MemCacheHotKey *pstHotKey)
  *
- * @param	pstMCServer	pointer of server for destroy.
+ * @param	pstHotKey	pointer of tracker.
  *
- * @return	MCACHE_OK for success, failure othwise.
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	free tracker and local copies.
  */
 int
-MCACHE_ServerDestroy(MemCacheServer *pstMCServer)
+MCACHE_HotKeyDestroy(MemCacheHotKey *pstHotKey)
 {
-	if (NULL == pstMCServer)
+	size_t i = 0;
+
+	if (NULL == pstHotKey)
 		return MCACHE_ERR_INVAL;
 
-	if (NULL != pstMCServer->pszServerAddr) {
-		free(pstMCServer->pszServerAddr);
-		pstMCServer->pszServerAddr = NULL;
+	for (i = 0; i < pstHotKey->capacity; i++) {
+		if (NULL != pstHotKey->pins[i].key) {
+			free(pstHotKey->pins[i].key);
+			free(pstHotKey->pins[i].value);
+		}
 	}
 
+	pthread_mutex_destroy(&pstHotKey->lock);
+	free(pstHotKey->counters);
+	free(pstHotKey->index);
+	free(pstHotKey->pins);
+	free(pstHotKey);
+
 	return MCACHE_OK;
 }
 
-// Storage Commands
+// Hash commands
 /**
- * @fn		int MCACHE_DataSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ * @fn		uint32_t MCACHE_HashCRC32C(const char *pKey, size_t nKeyLen)
  *
- * @param	pstMCServer	pointer of server for setting data.
- * @param	pstMCData	pointer of data to set.
+ * @param	pKey		key to hash.
+ * @param	nKeyLen		length of key.
  *
- * @return	MCACHE_OK for success, failure otherwise.
+ * @return	CRC32C (Castagnoli) of key.
  *
- * @brief	set (add if key not exists, update if key exists)  given value with key on specified cache server.
+ * @brief	hash key by CRC32C, computed by crc32 instruction of SSE4.2 when running cpu has it.
+ */
+uint32_t
+MCACHE_HashCRC32C(const char *pKey, size_t nKeyLen)
+{
+	if (NULL == pKey)
+		return 0;
+
+	return ~__atomic_load_n(&s_pfnCRC, __ATOMIC_RELAXED)(0xffffffffu, (const unsigned char *) pKey, nKeyLen);
+}
+
+/**
+ * @fn		uint64_t MCACHE_HashXXH3(const char *pKey, size_t nKeyLen)
+ *
+ * @param	pKey		key to hash.
+ * @param	nKeyLen		length of key.
  *
+ * @return	64-bit xxh3 of key, same as XXH3_64bits() of xxHash.
  */
-int
-MCACHE_DataSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+uint64_t
+MCACHE_HashXXH3(const char *pKey, size_t nKeyLen)
 {
-	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_SET);
+	if (NULL == pKey)
+		return 0;
+
+	return s_XXH3((const unsigned char *) pKey, nKeyLen);
 }
 
+/**
+ * @fn		uint32_t MCACHE_HashXXH3Low(const char *pKey, size_t nKeyLen)
+ *
+ * @param	pKey		key to hash.
+ * @param	nKeyLen		length of key.
+ *
+ * @return	low 32 bits of MCACHE_HashXXH3, for use as MemCacheHashFunc.
+ */
+uint32_t
+MCACHE_HashXXH3Low(const char *pKey, size_t nKeyLen)
+{
+	return (uint32_t) MCACHE_HashXXH3(pKey, nKeyLen);
+}
 
 /**
- * @fn		int MCACHE_DataAdd(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ * @fn		int MCACHE_HashKetamaPoints(const char *pKey, size_t nKeyLen, uint32_t *pnPoints)
  *
- * @param	pstMCServer	pointer of server for adding data.
- * @param	pstMCData	pointer of data to add.
+ * @param	pKey		key or server name (e.g., "10.0.0.1:11211-0") to hash.
+ * @param	nKeyLen		length of key.
+ * @param	pnPoints	array to hold 4 points.
  *
  * @return	MCACHE_OK for success, failure otherwise.
  *
- * @brief	add given value associated with key on specified cache server.
+ * @brief	split MD5 digest of key into 4 continuum points the way ketama does, point i is made of bytes
+ *       	4 * i to 4 * i + 3 of digest in little endian order.
  *
+ * @note	ketama places each server at 40 digests of "<host>:<port>-<n>", n in [0, 40) scaled by weight,
+ *       	and a key is served by first point not smaller than MCACHE_HashMD5 of key.
  */
 int
-MCACHE_DataAdd(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+MCACHE_HashKetamaPoints(const char *pKey, size_t nKeyLen, uint32_t *pnPoints)
 {
-	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_ADD);
+	int i = 0;
+	unsigned char digest[16];
+
+	if (NULL == pKey || NULL == pnPoints)
+		return MCACHE_ERR_INVAL;
+
+	s_MD5((const unsigned char *) pKey, nKeyLen, digest);
+
+	for (i = 0; i < 4; i++)
+		pnPoints[i] = ((uint32_t) digest[3 + i * 4] << 24) | ((uint32_t) digest[2 + i * 4] << 16) |
+			((uint32_t) digest[1 + i * 4] << 8) | digest[i * 4];
+
+	return MCACHE_OK;
 }
 
 /**
- * @fn		int MCACHE_DataReplace(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ * @fn		uint32_t MCACHE_HashMD5(const char *pKey, size_t nKeyLen)
  *
- * @param	pstMCServer	pointer of server for replacing data.
- * @param	pstMCData	pointer of data to replace.
+ * @param	pKey		key to hash.
+ * @param	nKeyLen		length of key.
  *
- * @return	MCACHE_OK for success, failure otherwise.
+ * @return	first ketama point of key, same as MD5 hash of libmemcached.
+ */
+uint32_t
+MCACHE_HashMD5(const char *pKey, size_t nKeyLen)
+{
+	uint32_t points[4];
+
+	if (MCACHE_OK != MCACHE_HashKetamaPoints(pKey, nKeyLen, points))
+		return 0;
+
+	return points[0];
+}
+
+/**
+ * @fn		MemCacheHashFunc MCACHE_HashFunction(int nAlgorithm)
  *
- * @brief	replace value associated with given key on server by given value.
+ * @param	nAlgorithm	MCACHE_HASH_CRC32C, MCACHE_HASH_XXH3 or MCACHE_HASH_MD5.
+ *
+ * @return	hash function of algorithm, NULL if unknown.
+ */
+MemCacheHashFunc
+MCACHE_HashFunction(int nAlgorithm)
+{
+	switch (nAlgorithm) {
+		case MCACHE_HASH_CRC32C:
+			return MCACHE_HashCRC32C;
+		case MCACHE_HASH_XXH3:
+			return MCACHE_HashXXH3Low;
+		case MCACHE_HASH_MD5:
+			return MCACHE_HashMD5;
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * @fn		int MCACHE_HashBatch(int nAlgorithm, MemCacheData *pstMCDataList, size_t nListSize, uint32_t *pnHashList)
+ *
+ * @param	nAlgorithm	MCACHE_HASH_CRC32C, MCACHE_HASH_XXH3 or MCACHE_HASH_MD5.
+ * @param	pstMCDataList	pointer of data list whose keys are hashed.
+ * @param	nListSize	number of data in data list.
+ * @param	pnHashList	array to hold hash of each key.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
  *
+ * @brief	hash keys of whole data list, e.g., to route a multiget to servers.
  */
 int
-MCACHE_DataReplace(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+MCACHE_HashBatch(int nAlgorithm, MemCacheData *pstMCDataList, size_t nListSize, uint32_t *pnHashList)
 {
-	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_REPLACE);
+	size_t i = 0;
+	crcFunc crc = NULL;
+	MemCacheHashFunc func = NULL;
+
+	if (NULL == pstMCDataList || NULL == pnHashList || NULL == (func = MCACHE_HashFunction(nAlgorithm)))
+		return MCACHE_ERR_INVAL;
+
+	for (i = 0; i < nListSize; i++) {
+		if (NULL == pstMCDataList[i].pszDataKey)
+			return MCACHE_ERR_INVAL;
+	}
+
+	//resolve kernel once instead of per key
+	if (MCACHE_HASH_CRC32C == nAlgorithm) {
+		MCACHE_HashCRC32C("", 0);
+		crc = __atomic_load_n(&s_pfnCRC, __ATOMIC_RELAXED);
+
+		for (i = 0; i < nListSize; i++) {
+			pnHashList[i] = ~crc(0xffffffffu, (const unsigned char *) pstMCDataList[i].pszDataKey,
+				s_KeyLen(pstMCDataList + i));
+		}
+
+		return MCACHE_OK;
+	}
+
+	for (i = 0; i < nListSize; i++)
+		pnHashList[i] = func(pstMCDataList[i].pszDataKey, s_KeyLen(pstMCDataList + i));
+
+	return MCACHE_OK;
+}
+
+// Metrics commands
+static const char *s_apszOpName[MCACHE_METRIC_OPS] = {
+	NULL, "set", "add", "append", "prepend", "replace", "cas", "get", "gets", "delete", "incr", "decr", "stats",
+	"touch", "gat", "gats"
+};
+
+static const char *s_apszResultName[MCACHE_RESULT_COUNT] = {
+	"ok", "partial", "net", "io", "timeout", "nomem", "inval", "exists", "not_stored", "not_found", "error", "data"
+};
+
+/**
+ * add counter of shard to snapshot, counter is taken atomically and zeroed if nReset is set.
+ */
+static void
+s_MetricsTake(uint64_t *pnTotal, uint64_t *pnCounter, int nReset)
+{
+	*pnTotal += nReset ? __atomic_exchange_n(pnCounter, 0, __ATOMIC_RELAXED) : __atomic_load_n(pnCounter, __ATOMIC_RELAXED);
 }
 
 /**
- * @fn		int MCACHE_DataAppend(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ * @fn		int MCACHE_ServerMetrics(MemCacheServer *pstMCServer, MemCacheMetrics *pstMetrics, int nReset)
  *
- * @param	pstMCServer	pointer of server for append data.
- * @param	pstMCData	pointer of data to append.
+ * @param	pstMCServer	pointer of server whose metrics are enabled by MCACHE_ServerMetricsEnable.
+ * @param	pstMetrics	pointer to hold snapshot of metrics.
+ * @param	nReset		non zero to zero counters taken into snapshot.
  *
  * @return	MCACHE_OK for success, failure otherwise.
  *
- * @brief	add given value to an existing key after existing value
+ * @brief	sum metrics of all shards into pstMetrics, astOps is indexed by command as MCACHE_MetricsOpName tells.
  *
+ * @note	each counter is read (and reset) atomically, so no request is lost or counted twice between snapshots,
+ *       	though counters of one request may land in different snapshots.
  */
 int
-MCACHE_DataAppend(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+MCACHE_ServerMetrics(MemCacheServer *pstMCServer, MemCacheMetrics *pstMetrics, int nReset)
 {
-	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_APPEND);
+	size_t i = 0;
+	size_t k = 0;
+	size_t op = 0;
+	struct memCacheMeter *meter = NULL;
+
+	if (NULL == pstMCServer || NULL == pstMetrics || NULL == (meter = pstMCServer->pstMeter))
+		return MCACHE_ERR_INVAL;
+
+	memset(pstMetrics, 0, sizeof(MemCacheMetrics));
+
+	for (i = 0; i < METER_SHARDS; i++) {
+		MemCacheMetrics *shard = &meter->shards[i].metrics;
+
+		s_MetricsTake(&pstMetrics->nBytesReceived, &shard->nBytesReceived, nReset);
+
+		for (op = 0; op < MCACHE_METRIC_OPS; op++) {
+			MemCacheOpMetrics *dst = pstMetrics->astOps + op;
+			MemCacheOpMetrics *src = shard->astOps + op;
+
+			s_MetricsTake(&dst->nRequests, &src->nRequests, nReset);
+			s_MetricsTake(&dst->nKeys, &src->nKeys, nReset);
+			s_MetricsTake(&dst->nBytesSent, &src->nBytesSent, nReset);
+			s_MetricsTake(&dst->nLatencySum, &src->nLatencySum, nReset);
+
+			for (k = 0; k < MCACHE_RESULT_COUNT; k++)
+				s_MetricsTake(dst->anResults + k, src->anResults + k, nReset);
+
+			for (k = 0; k < MCACHE_METRIC_BUCKETS; k++)
+				s_MetricsTake(dst->anLatencyHist + k, src->anLatencyHist + k, nReset);
+		}
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * @fn		uint64_t MCACHE_MetricsBucketBound(size_t nBucket)
+ *
+ * @param	nBucket		index of bucket of anLatencyHist.
+ *
+ * @return	exclusive upper bound of latency in microseconds counted by bucket, UINT64_MAX for last bucket.
+ *
+ * @brief	buckets 0-3 count 0-3 microseconds, later ones split every power of two into 4 equal buckets.
+ */
+uint64_t
+MCACHE_MetricsBucketBound(size_t nBucket)
+{
+	if (MCACHE_METRIC_BUCKETS - 1 <= nBucket)
+		return UINT64_MAX;
+
+	if (4 > nBucket)
+		return nBucket + 1;
+
+	return (uint64_t) (5 + nBucket % 4) << (nBucket / 4 - 1);
 }
 
 /**
- * @fn		int MCACHE_DataPrepend(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
- *
- * @param	pstMCServer	pointer of server for prepend data.
- * @param	pstMCData	pointer of data to prepend.
+ * @fn		const char *MCACHE_MetricsOpName(size_t nOp)
  *
- * @return	MCACHE_OK for success, failure otherwise.
+ * @param	nOp		index of astOps.
  *
- * @brief	add given value to an existing key before existing data
- * 
+ * @return	protocol name of command counted by astOps[nOp], NULL for unused index.
  */
-int
-MCACHE_DataPrepend(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+const char *
+MCACHE_MetricsOpName(size_t nOp)
 {
-	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_PREPEND);
+	return MCACHE_METRIC_OPS > nOp ? s_apszOpName[nOp] : NULL;
 }
 
 /**
- * @fn		int MCACHE_DataCheckAndSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
- *
- * @param	pstMCServer	pointer of server for setting data.
- * @param	pstMCData	pointer of data to check and set.
- *
- * @return	MCACHE_OK for success, failure otherwise.
- *
- * @brief	store given value but only if no one else has updated since last fetched it (by checking pstMCData->nCASUnique).
+ * append printf formatted text to pszBuffer at *pnLength, *pnLength grows by full length even if it does not fit.
  */
-int
-MCACHE_DataCheckAndSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+static void
+s_MetricsPrint(char *pszBuffer, size_t nBufferSize, size_t *pnLength, const char *pszFormat, ...)
 {
-	return s_DataManipulate(pstMCServer, pstMCData, MCACHE_OP_CAS);
+	int len = 0;
+	va_list args;
+
+	va_start(args, pszFormat);
+
+	if (*pnLength < nBufferSize)
+		len = vsnprintf(pszBuffer + *pnLength, nBufferSize - *pnLength, pszFormat, args);
+	else
+		len = vsnprintf(NULL, 0, pszFormat, args);
+
+	va_end(args);
+
+	if (0 < len)
+		*pnLength += len;
 }
 
 /**
- * @fn		int MCACHE_DataFree(MemCacheData *pstMCData)
+ * @fn		int MCACHE_ServerMetricsFormat(MemCacheServer *pstMCServer, const MemCacheMetrics *pstMetrics, char *pszBuffer, size_t nBufferSize, size_t *pnLength)
  *
- * @param	pstMCData	pointer of data to free.
+ * @param	pstMCServer	pointer of server labeling metrics.
+ * @param	pstMetrics	pointer of snapshot taken by MCACHE_ServerMetrics.
+ * @param	pszBuffer	buffer to hold text.
+ * @param	nBufferSize	size of buffer.
+ * @param	pnLength	pointer to hold length of text, without terminating '\0'.
  *
- * @brief	free pstMCData.pszDataValue if it's not NULL.
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOMEM if buffer is too small (*pnLength tells size needed less one),
+ *        	failure otherwise.
  *
- * @note	MCACHE_DataFree will be used for those data fetched by MCACHE_DataGet.
+ * @brief	write snapshot in Prometheus text exposition format, labeled by server "host:port", command and result.
  *
+ * @note	commands never sent are left out, and only non empty latency buckets are listed besides "+Inf".
  */
 int
-MCACHE_DataFree(MemCacheData *pstMCData)
+MCACHE_ServerMetricsFormat(MemCacheServer *pstMCServer, const MemCacheMetrics *pstMetrics, char *pszBuffer,
+	size_t nBufferSize, size_t *pnLength)
 {
-	if (NULL == pstMCData || NULL == pstMCData->pDataValue)
+	size_t i = 0;
+	size_t op = 0;
+	size_t len = 0;
+	uint64_t sum = 0;
+	char label[128];
+	const MemCacheOpMetrics *ops = NULL;
+
+	if (NULL == pstMCServer || NULL == pstMetrics || NULL == pnLength || (NULL == pszBuffer && 0 < nBufferSize))
 		return MCACHE_ERR_INVAL;
 
-	free(pstMCData->pDataValue);
-	pstMCData->pDataValue = NULL;
+	snprintf(label, sizeof(label), "server=\"%s:%zu\"",
+		NULL != pstMCServer->pszServerAddr ? pstMCServer->pszServerAddr : "", pstMCServer->nPort);
+	ops = pstMetrics->astOps;
+
+	s_MetricsPrint(pszBuffer, nBufferSize, &len, "# TYPE mcache_bytes_received_total counter\n"
+		"mcache_bytes_received_total{%s} %llu\n", label, (unsigned long long) pstMetrics->nBytesReceived);
+
+	s_MetricsPrint(pszBuffer, nBufferSize, &len, "# TYPE mcache_requests_total counter\n");
+
+	for (op = 1; op < MCACHE_METRIC_OPS; op++) {
+		if (0 < ops[op].nRequests)
+			s_MetricsPrint(pszBuffer, nBufferSize, &len, "mcache_requests_total{%s,op=\"%s\"} %llu\n", label,
+				s_apszOpName[op], (unsigned long long) ops[op].nRequests);
+	}
+
+	s_MetricsPrint(pszBuffer, nBufferSize, &len, "# TYPE mcache_keys_total counter\n");
+
+	for (op = 1; op < MCACHE_METRIC_OPS; op++) {
+		if (0 < ops[op].nRequests)
+			s_MetricsPrint(pszBuffer, nBufferSize, &len, "mcache_keys_total{%s,op=\"%s\"} %llu\n", label,
+				s_apszOpName[op], (unsigned long long) ops[op].nKeys);
+	}
+
+	s_MetricsPrint(pszBuffer, nBufferSize, &len, "# TYPE mcache_bytes_sent_total counter\n");
+
+	for (op = 1; op < MCACHE_METRIC_OPS; op++) {
+		if (0 < ops[op].nRequests)
+			s_MetricsPrint(pszBuffer, nBufferSize, &len, "mcache_bytes_sent_total{%s,op=\"%s\"} %llu\n", label,
+				s_apszOpName[op], (unsigned long long) ops[op].nBytesSent);
+	}
+
+	s_MetricsPrint(pszBuffer, nBufferSize, &len, "# TYPE mcache_results_total counter\n");
+
+	for (op = 1; op < MCACHE_METRIC_OPS; op++) {
+		for (i = 0; i < MCACHE_RESULT_COUNT; i++) {
+			if (0 < ops[op].anResults[i])
+				s_MetricsPrint(pszBuffer, nBufferSize, &len, "mcache_results_total{%s,op=\"%s\",result=\"%s\"} %llu\n",
+					label, s_apszOpName[op], s_apszResultName[i], (unsigned long long) ops[op].anResults[i]);
+		}
+	}
+
+	s_MetricsPrint(pszBuffer, nBufferSize, &len, "# TYPE mcache_latency_usec histogram\n");
+
+	for (op = 1; op < MCACHE_METRIC_OPS; op++) {
+		if (0 == ops[op].nRequests)
+			continue;
+
+		for (i = 0, sum = 0; i < MCACHE_METRIC_BUCKETS - 1; i++) {
+			if (0 == ops[op].anLatencyHist[i])
+				continue;
+
+			sum += ops[op].anLatencyHist[i];
+			s_MetricsPrint(pszBuffer, nBufferSize, &len, "mcache_latency_usec_bucket{%s,op=\"%s\",le=\"%llu\"} %llu\n",
+				label, s_apszOpName[op], (unsigned long long) MCACHE_MetricsBucketBound(i), (unsigned long long) sum);
+		}
+
+		sum += ops[op].anLatencyHist[MCACHE_METRIC_BUCKETS - 1];
+		s_MetricsPrint(pszBuffer, nBufferSize, &len, "mcache_latency_usec_bucket{%s,op=\"%s\",le=\"+Inf\"} %llu\n"
+			"mcache_latency_usec_sum{%s,op=\"%s\"} %llu\n"
+			"mcache_latency_usec_count{%s,op=\"%s\"} %llu\n",
+			label, s_apszOpName[op], (unsigned long long) sum,
+			label, s_apszOpName[op], (unsigned long long) ops[op].nLatencySum,
+			label, s_apszOpName[op], (unsigned long long) sum);
+	}
+
+	*pnLength = len;
+
+	return len < nBufferSize ? MCACHE_OK : MCACHE_ERR_NOMEM;
+}
+
+// Stats commands
+//sorted by name for bsearch
+static const struct statField s_astStatFields[] = {
+	{"bytes", offsetof(MemCacheStats, nBytes), STAT_TYPE_INT64},
+	{"bytes_read", offsetof(MemCacheStats, nBytesRead), STAT_TYPE_INT64},
+	{"bytes_written", offsetof(MemCacheStats, nBytesWritten), STAT_TYPE_INT64},
+	{"cas_badval", offsetof(MemCacheStats, nCasBadval), STAT_TYPE_INT64},
+	{"cas_hits", offsetof(MemCacheStats, nCasHits), STAT_TYPE_INT64},
+	{"cas_misses", offsetof(MemCacheStats, nCasMisses), STAT_TYPE_INT64},
+	{"cmd_flush", offsetof(MemCacheStats, nCmdFlush), STAT_TYPE_INT64},
+	{"cmd_get", offsetof(MemCacheStats, nCmdGet), STAT_TYPE_INT64},
+	{"cmd_set", offsetof(MemCacheStats, nCmdSet), STAT_TYPE_INT64},
+	{"conn_yields", offsetof(MemCacheStats, nConnYields), STAT_TYPE_INT64},
+	{"connection_structures", offsetof(MemCacheStats, nConnectionStructures), STAT_TYPE_SIZE},
+	{"curr_connections", offsetof(MemCacheStats, nCurrentConnections), STAT_TYPE_SIZE},
+	{"curr_items", offsetof(MemCacheStats, nCurrentItems), STAT_TYPE_SIZE},
+	{"decr_hits", offsetof(MemCacheStats, nDecrHits), STAT_TYPE_INT64},
+	{"decr_misses", offsetof(MemCacheStats, nDecrMisses), STAT_TYPE_INT64},
+	{"delete_hits", offsetof(MemCacheStats, nDeleteHits), STAT_TYPE_INT64},
+	{"delete_misses", offsetof(MemCacheStats, nDeleteMisses), STAT_TYPE_INT64},
+	{"evictions", offsetof(MemCacheStats, nEvictions), STAT_TYPE_INT64},
+	{"get_hits", offsetof(MemCacheStats, nGetHits), STAT_TYPE_INT64},
+	{"get_misses", offsetof(MemCacheStats, nGetMisses), STAT_TYPE_INT64},
+	{"incr_hits", offsetof(MemCacheStats, nIncrHits), STAT_TYPE_INT64},
+	{"incr_misses", offsetof(MemCacheStats, nIncrMisses), STAT_TYPE_INT64},
+	{"limit_maxbytes", offsetof(MemCacheStats, nLimitMaxbytes), STAT_TYPE_SIZE},
+	{"listen_disabled_num", offsetof(MemCacheStats, nListenDisabledNum), STAT_TYPE_INT64},
+	{"pid", offsetof(MemCacheStats, nPid), STAT_TYPE_SIZE},
+	{"pointer_size", offsetof(MemCacheStats, nPointerSize), STAT_TYPE_SIZE},
+	{"reclaimed", offsetof(MemCacheStats, nReclaimed), STAT_TYPE_INT64},
+	{"rusage_system", offsetof(MemCacheStats, pszRUsageSystem), STAT_TYPE_STRING},
+	{"rusage_user", offsetof(MemCacheStats, pszRUsageUser), STAT_TYPE_STRING},
+	{"threads", offsetof(MemCacheStats, nThreads), STAT_TYPE_SIZE},
+	{"time", offsetof(MemCacheStats, tTime), STAT_TYPE_TIME},
+	{"total_connections", offsetof(MemCacheStats, nTotalConnections), STAT_TYPE_SIZE},
+	{"total_items", offsetof(MemCacheStats, nTotalItems), STAT_TYPE_SIZE},
+	{"uptime", offsetof(MemCacheStats, nUptime), STAT_TYPE_SIZE},
+	{"version", offsetof(MemCacheStats, pszVersion), STAT_TYPE_STRING}
+};
+
+/**
+ * send "stats" (or "stats <pszGroup>") and hand every statistic to pfnStat in one pass over reply.
+ * once pfnStat fails, rest of reply is still read up to "END" and its failure is returned. connection is closed if
+ * reply could not be read up to its end.
+ */
+static int
+s_StatsRun(MemCacheServer *pstMCServer, const char *pszGroup, statFunc pfnStat, void *pArg)
+{
+	int ret = MCACHE_OK;
+	int status = MCACHE_OK;
+	int len = 0;
+	size_t i = 0;
+	size_t line_len = 0;
+	char *line = NULL;
+	char *bgn = NULL;
+	int64_t begin = 0;
+	char cmd[64];
+	struct sockReader reader;
+
+	if (NULL == pstMCServer || 0 > pstMCServer->nSockFD || 0 == pstMCServer->nTimeout)
+		return MCACHE_ERR_INVAL;
+
+	for (i = 0; NULL != pszGroup && '\0' != pszGroup[i]; i++) {
+		if (' ' >= (unsigned char) pszGroup[i] || 0x7f == pszGroup[i])
+			return MCACHE_ERR_INVAL;
+	}
+
+	if (NULL == pszGroup || 0 == i)
+		len = snprintf(cmd, sizeof(cmd), "stats\r\n");
+	else
+		len = snprintf(cmd, sizeof(cmd), "stats %s\r\n", pszGroup);
+
+	if (0 >= len || sizeof(cmd) <= (size_t) len)
+		return MCACHE_ERR_INVAL;
+
+	if (MCACHE_OK != (ret = s_ReaderInit(&reader, pstMCServer, pstMCServer->nTimeout, NULL, 0)))
+		return ret;
+
+	begin = s_ServerEnter(pstMCServer, MCACHE_OP_STATS, NULL, 0);
+	s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_START, 0);
+
+	if (MCACHE_OK != (ret = s_SockWrite(pstMCServer->nSockFD, cmd, len, pstMCServer->nTimeout))) {
+		len = 0;
+		goto end;
+	}
+
+	s_TraceWrite(pstMCServer, MCACHE_TRACE_WRITE_END, len);
+
+	//one pass over "STAT <name> <value>" lines up to "END"
+	while (MCACHE_OK == (ret = s_ReaderLine(&reader, &line, &line_len))) {
+		if (0 == strcmp(line, "END"))
+			break;
+
+		if (0 != strncmp(line, "STAT ", 5) || NULL == (bgn = s_Scan(line + 5, line + line_len, ' ', ' '))) {
+			ret = s_IsErrorLine(line) ? MCACHE_ERR_ERROR : MCACHE_ERR_DATA;
+			break;
+		}
+
+		*bgn++ = '\0';
+
+		if (MCACHE_OK == status)
+			status = pfnStat(line + 5, bgn - 1 - (line + 5), bgn, line + line_len - bgn, pArg);
+	}
+
+end:
+	//rest of a malformed or partly read reply would be taken for reply of next command
+	if (MCACHE_OK != ret && MCACHE_ERR_ERROR != ret)
+		MCACHE_ServerDisconnect(pstMCServer);
+
+	if (MCACHE_OK == ret)
+		ret = status;
+
+	s_ReaderFree(&reader);
+	s_ServerLeave(pstMCServer, begin, MCACHE_OP_STATS, ret, 0, len);
+
+	return ret;
+}
+
+static int
+s_StatFieldCompare(const void *pKey, const void *pField)
+{
+	return strcmp((const char *) pKey, ((const struct statField *) pField)->name);
+}
+
+/**
+ * store statistic into its field of MemCacheStats if it has one.
+ */
+static int
+s_StatsStore(const char *pszName, size_t nNameLen, const char *pszValue, size_t nValueLen, void *pArg)
+{
+	char *field = NULL;
+	const struct statField *info = NULL;
+
+	(void) nNameLen;
+	(void) nValueLen;
+
+	info = (const struct statField *) bsearch(pszName, s_astStatFields,
+		sizeof(s_astStatFields) / sizeof(s_astStatFields[0]), sizeof(s_astStatFields[0]), s_StatFieldCompare);
+
+	if (NULL == info)
+		return MCACHE_OK;
+
+	field = (char *) pArg + info->offset;
+
+	switch (info->type) {
+		case STAT_TYPE_SIZE:
+			*(size_t *) field = strtoull(pszValue, NULL, 10);
+			break;
+		case STAT_TYPE_INT64:
+			*(int64_t *) field = strtoll(pszValue, NULL, 10);
+			break;
+		case STAT_TYPE_TIME:
+			*(time_t *) field = strtol(pszValue, NULL, 10);
+			break;
+		case STAT_TYPE_STRING:
+			if (NULL != *(char **) field)
+				free(*(char **) field);
+
+			if (NULL == (*(char **) field = strdup(pszValue)))
+				return MCACHE_ERR_NOMEM;
+			break;
+	}
 
 	return MCACHE_OK;
 }
 
-// Retrival commands
 /**
- * @fn		int MCACHE_DataGet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ * @fn		int MCACHE_ServerStats(MemCacheServer *pstMCServer, MemCacheStats *pstMCStats)
  *
- * @param	pstMCServer	pointer of server for getting data.
- * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
- * @param	nListSize	number of data in data list
+ * @param	pstMCServer	pointer of server.
+ * @param	pstMCStats	pointer of status.
  *
- * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched correctly, failure otherwise.
+ * @return	MCACHE_OK for success, fail otherwise.
  *
- * @brief	fetch data associted with given key and store pstMCData.
- *       	fetched value will be stored in malloced memory, and caller must invoked MCACHE_DataFree to free it.
+ * @brief	get the status of server.
  *
+ * @note	pszVersion, pszRUsageUser and pszRUsageSystem are duplicated by strdup and must be freed by caller.
+ *       	statistics without field in MemCacheStats are skipped, see MCACHE_ServerStatList for all of them.
  */
 int
-MCACHE_DataGet(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+MCACHE_ServerStats(MemCacheServer *pstMCServer, MemCacheStats *pstMCStats)
 {
-	return s_DataRetrieval(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GET);
+	if (NULL == pstMCStats)
+		return MCACHE_ERR_INVAL;
+
+	return s_StatsRun(pstMCServer, NULL, s_StatsStore, pstMCStats);
 }
 
 /**
- * @fn		int MCACHE_DataGets(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
- *
- * @param	pstMCServer	pointer of server for getting data.
- * @param	pstMCData	pointer of data to hold key and stored fetched value.
- * @param	nListSize	number of data in data list.
- *
- * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched correctly, failure otherwise.
- *
- * @brief	fetched data associted with given key to pst
- *
+ * append "name\0value\0" of statistic to arena.
  */
-int
-MCACHE_DataGets(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+static int
+s_StatListAdd(const char *pszName, size_t nNameLen, const char *pszValue, size_t nValueLen, void *pArg)
 {
-	return s_DataRetrieval(pstMCServer, pstMCDataList, nListSize, MCACHE_OP_GETS);
+	char *tmp = NULL;
+	size_t size = 0;
+	struct statArena *arena = (struct statArena *) pArg;
+
+	if (arena->size < arena->len + nNameLen + nValueLen + 2) {
+		for (size = 0 < arena->size ? arena->size : 4096; size < arena->len + nNameLen + nValueLen + 2; size *= 2)
+			;
+
+		if (NULL == (tmp = (char *) realloc(arena->buffer, size)))
+			return MCACHE_ERR_NOMEM;
+
+		arena->buffer = tmp;
+		arena->size = size;
+	}
+
+	memcpy(arena->buffer + arena->len, pszName, nNameLen + 1);
+	arena->len += nNameLen + 1;
+	memcpy(arena->buffer + arena->len, pszValue, nValueLen + 1);
+	arena->len += nValueLen + 1;
+	arena->count++;
+
+	return MCACHE_OK;
 }
 
-// Delete commands
 /**
- * @fn		int MCACHE_DataDelete(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nTime)
+ * @fn		int MCACHE_ServerStatList(MemCacheServer *pstMCServer, const char *pszGroup, MemCacheStatList *pstList)
  *
- * @param	pstMCServer	pointer of server for deleting data.
- * @param	pstMCData	pointer of data to hold key and stored fetched value.
- * @param	nTime		seconds for server to refuse "add" and "replace" commands with this key.
+ * @param	pstMCServer	pointer of server.
+ * @param	pszGroup	NULL for general statistics, otherwise argument of "stats" command, e.g. "slabs", "items"
+ *        			or "settings".
+ * @param	pstList		pointer to hold statistics, must be released by MCACHE_StatListFree.
  *
- * @return	MCACHE_OK for success, failure otherwise.
+ * @return	MCACHE_OK for success, MCACHE_ERR_ERROR if server does not know pszGroup, failure otherwise.
  *
- * @brief	delete data on cache server associated with given key.
+ * @brief	fetch all statistics of pszGroup as name/value pairs in order of server.
+ *
+ * @note	reply is parsed in one pass, and array and all strings end up in one allocation.
+ *       	slab and item statistics are per class, named as "<class>:<field>" and "items:<class>:<field>",
+ *       	see MCACHE_StatListClassInt.
  */
 int
-MCACHE_DataDelete(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nTime)
+MCACHE_ServerStatList(MemCacheServer *pstMCServer, const char *pszGroup, MemCacheStatList *pstList)
 {
 	int ret = MCACHE_OK;
-	int read_count = 0;
-	char buffer[MCACHE_VALUE_MAX];
-	size_t timeout = 0;
-	time_t check_time = 0;
+	size_t i = 0;
+	char *cursor = NULL;
+	MemCacheStat *stats = NULL;
+	struct statArena arena;
 
-	if (MCACHE_OK != (ret = s_ChkInput(pstMCServer, pstMCData, MCACHE_OP_DELETE)))
-		return ret;
+	if (NULL == pstList)
+		return MCACHE_ERR_INVAL;
 
-	memset(buffer, 0, MCACHE_VALUE_MAX);
+	memset(pstList, 0, sizeof(MemCacheStatList));
+	memset(&arena, 0, sizeof(arena));
 
-	if (0 != nTime) {
-		snprintf(buffer, MCACHE_VALUE_MAX - 1, "delete %s %d\r\n", pstMCData->pszDataKey,
-			 nTime);
+	if (MCACHE_OK != (ret = s_StatsRun(pstMCServer, pszGroup, s_StatListAdd, &arena)) || 0 == arena.count) {
+		free(arena.buffer);
+		return ret;
 	}
-	else {
-		snprintf(buffer, MCACHE_VALUE_MAX - 1, "delete %s\r\n", pstMCData->pszDataKey);
+
+	if (NULL == (stats = (MemCacheStat *) malloc(arena.count * sizeof(MemCacheStat) + arena.len))) {
+		free(arena.buffer);
+		return MCACHE_ERR_NOMEM;
 	}
 
-	timeout = pstMCServer->nTimeout;
-	check_time = time(NULL);
-	if (MCACHE_OK != (ret = s_SockWrite(pstMCServer->nSockFD, buffer, strlen(buffer), timeout))) {
-		timeout -= time(NULL) - check_time;
-		memset(buffer, 0, MCACHE_VALUE_MAX);
+	cursor = (char *) (stats + arena.count);
+	memcpy(cursor, arena.buffer, arena.len);
+	free(arena.buffer);
 
-		if (MCACHE_OK == (ret = s_SockRead(pstMCServer->nSockFD, buffer, MCACHE_VALUE_MAX - 1, &read_count, timeout))) {
-			if (0 == strncmp(buffer, "DELETED\r\n", 9))
-				ret = MCACHE_OK;
-			else if (0 == strncmp(buffer, "NOT_FOUND\r\n", 11))
-				ret = MCACHE_ERR_NOT_FOUND;
-			else
-				ret = MCACHE_ERR_DATA;
-		}
+	for (i = 0; i < arena.count; i++) {
+		stats[i].pszName = cursor;
+		cursor += strlen(cursor) + 1;
+		stats[i].pszValue = cursor;
+		cursor += strlen(cursor) + 1;
 	}
 
-end:
+	pstList->astStats = stats;
+	pstList->nCount = arena.count;
 
-	return ret;
+	return MCACHE_OK;
 }
 
-// Increment/Decrement commands
 /**
- * @fn		int MCACHE_DataIncrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ * @fn		const char *MCACHE_StatListFind(const MemCacheStatList *pstList, const char *pszName)
  *
- * @param	pstMCServer	pointer of server for addition.
- * @param	pstMCData	pointer of data to add.
+ * @param	pstList		pointer of statistics.
+ * @param	pszName		name of statistic.
  *
- * @return	MCACHE_OK for success, failure otherwise.
+ * @return	value of statistic, NULL if not found.
+ */
+const char *
+MCACHE_StatListFind(const MemCacheStatList *pstList, const char *pszName)
+{
+	size_t i = 0;
+
+	if (NULL == pstList || NULL == pszName)
+		return NULL;
+
+	for (i = 0; i < pstList->nCount; i++) {
+		if (0 == strcmp(pstList->astStats[i].pszName, pszName))
+			return pstList->astStats[i].pszValue;
+	}
+
+	return NULL;
+}
+
+/**
+ * @fn		int MCACHE_StatListInt(const MemCacheStatList *pstList, const char *pszName, int64_t *pnValue)
  *
- * @brief	take the data associated with given key on server as 64-bit unsigned integer, and add given data and original data together on server.
+ * @param	pstList		pointer of statistics.
+ * @param	pszName		name of statistic.
+ * @param	pnValue		pointer to hold value.
  *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND if there is no such statistic, MCACHE_ERR_DATA if value is
+ *        	not an integer, failure otherwise.
  */
 int
-MCACHE_DataIncrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum)
+MCACHE_StatListInt(const MemCacheStatList *pstList, const char *pszName, int64_t *pnValue)
 {
-	return s_DataCalculate(pstMCServer, pstMCData, nNum, MCACHE_OP_INCREMENT);
+	char *end = NULL;
+	const char *value = NULL;
+	long long num = 0;
+
+	if (NULL == pstList || NULL == pszName || NULL == pnValue)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL == (value = MCACHE_StatListFind(pstList, pszName)))
+		return MCACHE_ERR_NOT_FOUND;
+
+	errno = 0;
+	num = strtoll(value, &end, 10);
+
+	if (end == value || '\0' != *end || 0 != errno)
+		return MCACHE_ERR_DATA;
+
+	*pnValue = num;
+
+	return MCACHE_OK;
 }
 
 /**
- * @fn		int MCACHE_DataDecrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
- *
- * @param	pstMCServer	pointer of server for substraction.
- * @param	pstMCData	pointer of data to substract.
+ * @fn		int MCACHE_StatListDouble(const MemCacheStatList *pstList, const char *pszName, double *pdValue)
  *
- * @return	MCACHE_OK for success, failure otherwise.
+ * @param	pstList		pointer of statistics.
+ * @param	pszName		name of statistic, e.g. "rusage_user".
+ * @param	pdValue		pointer to hold value.
  *
- * @brief	take the data associated with given key on server as 64-bit unsigned integer, and substract given dat from original data on server.
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND if there is no such statistic, MCACHE_ERR_DATA if value is
+ *        	not a number, failure otherwise.
  */
 int
-MCACHE_DataDecrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum)
+MCACHE_StatListDouble(const MemCacheStatList *pstList, const char *pszName, double *pdValue)
 {
-	return s_DataCalculate(pstMCServer, pstMCData, nNum, MCACHE_OP_DECREMENT);
+	char *end = NULL;
+	const char *value = NULL;
+	double num = 0;
+
+	if (NULL == pstList || NULL == pszName || NULL == pdValue)
+		return MCACHE_ERR_INVAL;
+
+	if (NULL == (value = MCACHE_StatListFind(pstList, pszName)))
+		return MCACHE_ERR_NOT_FOUND;
+
+	num = strtod(value, &end);
+
+	if (end == value || '\0' != *end)
+		return MCACHE_ERR_DATA;
+
+	*pdValue = num;
+
+	return MCACHE_OK;
 }
 
-// Stats commands
 /**
- * @fn		int MCACHE_ServerStats(MemCacheServer *pstMCServer, MemCacheStats *pstMCStats)
+ * @fn		int MCACHE_StatListClassInt(const MemCacheStatList *pstList, const char *pszPrefix, size_t nClass, const char *pszField, int64_t *pnValue)
  *
- * @param	pstMCServer	pointer of server for fetching status.
- * @param	pstMCStats	pointer of status.
+ * @param	pstList		pointer of statistics.
+ * @param	pszPrefix	prefix of per class statistics, NULL for "stats slabs" and "items" for "stats items".
+ * @param	nClass		slab class.
+ * @param	pszField	field of class, e.g. "chunk_size" or "evicted".
+ * @param	pnValue		pointer to hold value.
  *
- * @return	MCACHE_OK for success, fail otherwise.
+ * @return	same as MCACHE_StatListInt.
  *
- * @brief	get the status of server.
+ * @brief	get integer statistic of slab class, named "<nClass>:<pszField>" or "<pszPrefix>:<nClass>:<pszField>".
  */
 int
-MCACHE_ServerStats(MemCacheServer *pstMCServer, MemCacheStats *pstMCStats)
+MCACHE_StatListClassInt(const MemCacheStatList *pstList, const char *pszPrefix, size_t nClass, const char *pszField,
+	int64_t *pnValue)
 {
-	int ret = MCACHE_OK;
-	char buffer[MCACHE_VALUE_MAX * 2];
-	int timeout = 0;
-	int read_count = 0;
-	time_t check_time = 0;
-	int buffer_size = MCACHE_VALUE_MAX  * 2;
-	char i = 0;
-
-	enum {
-		STAT_PID = 0,
-		STAT_UPTIME,
-		STAT_TIME,
-		STAT_VERSION,
-		STAT_POINTER_SIZE,
-		STAT_RUSAGE_USER,
-		STAT_RUSAGE_SYSTEM,
-		STAT_CURR_CONNS,
-		STAT_TOTAL_CONNS,
-		STAT_CONN_STRUCTURES,
-		STAT_CMD_GET,
-		STAT_CMD_SET,
-		STAT_CMD_FLUSH,
-		STAT_GET_HITS,
-		STAT_GET_MISSES,
-		STAT_DELETE_MISSES,
-		STAT_DELETE_HITS,
-		STAT_INCR_MISSES,
-		STAT_INCR_HITS,
-		STAT_DECR_MISSES,
-		STAT_DECR_HITS,
-		STAT_CAS_MISSES,
-		STAT_CAS_HITS,
-		STAT_BADVAL,
-		STAT_AUTH_CMDS,
-		STAT_AUTH_ERROS,
-		STAT_BYTES_READ,
-		STAT_BYTES_WRITTEN,
-		STAT_LIMIT_MAXBYTES,
-		STAT_ACCEPTING_CONNS,
-		STAT_LISTEN_DISABLED_NUM,
-		STAT_THREADS,
-		STAT_CONN_YIELDS,
-		STAT_BYTES,
-		STAT_CURR_ITEMS,
-		STAT_TOTAL_ITEMS,
-		STAT_EVICTIONS,
-		STAT_RECLAIMED
-	};
-
-	struct statInfo stat_list[] = {
-		{STAT_PID, "STAT pid "},
-		{STAT_UPTIME, "STAT uptime"},
-		{STAT_TIME, "STAT time"},
-		{STAT_VERSION, "STAT version"},
-		{STAT_POINTER_SIZE, "STAT pointer_size"},
-		{STAT_RUSAGE_USER, "STAT rusage_user"},
-		{STAT_RUSAGE_SYSTEM, "STAT rusage_system"},
-		{STAT_CURR_CONNS, "STAT curr_connections"},
-		{STAT_TOTAL_CONNS, "STAT total_connections"},
-		{STAT_CONN_STRUCTURES, "STAT connection_structures"},
-		{STAT_CMD_GET, "STAT cmd_get"}, 
-		{STAT_CMD_SET, "STAT cmd_set"},
-		{STAT_CMD_FLUSH, "STAT cmd_flush"},
-		{STAT_GET_HITS, "STAT get_hits"},
-		{STAT_GET_MISSES, "STAT get_misses"},
-		{STAT_DELETE_MISSES, "STAT delete_misses"},
-		{STAT_DELETE_HITS, "STAT delete_hits"},
-		{STAT_INCR_MISSES, "STAT incr_misses"},
-		{STAT_INCR_HITS, "STAT incr_hits"},
-		{STAT_DECR_MISSES, "STAT decr_misses"},
-		{STAT_DECR_HITS, "STAT decr_hits"},
-		{STAT_CAS_MISSES, "STAT cas_misses"},
-		{STAT_CAS_HITS, "STAT cas_hits"},
-		{STAT_BYTES_READ, "STAT bytes_read"},
-		{STAT_BYTES_WRITTEN, "STAT bytes_written"},
-		{STAT_LIMIT_MAXBYTES, "STAT limit_maxbytes"},
-		{STAT_LISTEN_DISABLED_NUM, "STAT listen_disabled_num"},
-		{STAT_THREADS, "STAT threads"},
-		{STAT_CONN_YIELDS, "STAT conn_yields"},
-		{STAT_BYTES, "STAT bytes"},
-		{STAT_CURR_ITEMS, "STAT curr_items"},
-		{STAT_TOTAL_ITEMS, "STAT total_items"},
-		{STAT_EVICTIONS, "STAT evictions"},
-		{STAT_RECLAIMED, "STAT reclaimed"},
-		{-1, NULL}
-	};
+	int len = 0;
+	char name[128];
 
-	if (NULL == pstMCServer || NULL == pstMCStats || 0 > pstMCServer->nSockFD || 0 == pstMCServer->nTimeout)
+	if (NULL == pszField)
 		return MCACHE_ERR_INVAL;
 
-	memset(buffer, 0, buffer_size);
-	memcpy(buffer, "stats\r\n", 7);
-
-	timeout = pstMCServer->nTimeout;
-	check_time = time(NULL);
-
-	if (MCACHE_OK == (ret = s_SockWrite(pstMCServer->nSockFD, buffer, strlen(buffer), timeout))) {
-		timeout -= time(NULL) - check_time;
-		memset(buffer, 0, buffer_size);
+	if (NULL == pszPrefix)
+		len = snprintf(name, sizeof(name), "%zu:%s", nClass, pszField);
+	else
+		len = snprintf(name, sizeof(name), "%s:%zu:%s", pszPrefix, nClass, pszField);
 
-		if (MCACHE_OK == (ret = s_SockRead(pstMCServer->nSockFD, buffer, MCACHE_VALUE_MAX - 1, &read_count, timeout))) {
-			char *bgn = NULL;
-			char *end = NULL;
+	if (0 >= len || sizeof(name) <= (size_t) len)
+		return MCACHE_ERR_INVAL;
 
-			while (1) {
-				if (-1 == stat_list[i].idx || NULL == stat_list[i].value)
-					break;
+	return MCACHE_StatListInt(pstList, name, pnValue);
+}
 
-				if (NULL == (bgn = strstr(buffer, stat_list[i].value)) || NULL == (end = strstr(bgn, "\r\n"))) {
-					i++;
-					continue;
-				}
+/**
+ * @fn		void MCACHE_StatListFree(MemCacheStatList *pstList)
+ *
+ * @param	pstList		pointer of statistics filled by MCACHE_ServerStatList.
+ *
+ * @brief	release statistics, pstList is left empty.
+ */
+void
+MCACHE_StatListFree(MemCacheStatList *pstList)
+{
+	if (NULL == pstList)
+		return;
 
-				bgn += strlen(stat_list[i].value);
-				*end = '\0';
-
-				switch (stat_list[i].idx) {
-					case STAT_PID:
-						pstMCStats->nPid = strtol(bgn, NULL, 10);
-						break;
-					case STAT_UPTIME:
-						pstMCStats->nUptime = strtol(bgn, NULL, 10);
-						break;
-					case STAT_TIME:
-						pstMCStats->tTime = strtol(bgn, NULL, 10);
-						break;
-					case STAT_VERSION:
-						if (NULL != pstMCStats->pszVersion)
-							free(pstMCStats->pszVersion);
-
-						pstMCStats->pszVersion = strdup(bgn);
-						break;
-					case STAT_POINTER_SIZE:
-						pstMCStats->nPointerSize = strtol(bgn, NULL, 10);
-						break;
-					case STAT_RUSAGE_USER:
-						if (NULL != pstMCStats->pszRUsageUser)
-							free(pstMCStats->pszRUsageUser);
-
-						pstMCStats->pszRUsageUser = strdup(bgn);
-						break;
-					case STAT_RUSAGE_SYSTEM:
-						if (NULL != pstMCStats->pszRUsageSystem)
-							free(pstMCStats->pszRUsageSystem);
-
-						pstMCStats->pszRUsageSystem = strdup(bgn);
-						break;
-					case STAT_CURR_CONNS:
-						pstMCStats->nCurrentConnections = strtol(bgn, NULL, 10);
-						break;
-					case STAT_TOTAL_CONNS:
-						pstMCStats->nTotalConnections = strtol(bgn, NULL, 10);
-						break;
-					case STAT_CONN_STRUCTURES:
-						pstMCStats->nConnectionStructures = strtol(bgn, NULL, 10);
-						break;
-					case STAT_CMD_GET:
-						pstMCStats->nCmdGet = strtoll(bgn, NULL, 10);
-						break;
-					case STAT_CMD_SET:
-						pstMCStats->nCmdSet = strtoll(bgn, NULL, 10);
-						break;
-					case STAT_GET_HITS:
-						pstMCStats->nGetHits = strtoll(bgn, NULL, 10);
-						break;
-					case STAT_GET_MISSES:
-						pstMCStats->nGetMisses = strtoll(bgn, NULL, 10);
-						break;
-					case STAT_BYTES_READ:
-						pstMCStats->nBytesRead = strtoll(bgn, NULL, 10);
-						break;
-					case STAT_BYTES_WRITTEN:
-						pstMCStats->nBytesWritten = strtoll(bgn, NULL, 10);
-						break;
-					case STAT_LIMIT_MAXBYTES:
-						pstMCStats->nLimitMaxbytes = strtol(bgn, NULL, 10);
-						break;
-					case STAT_THREADS:
-						pstMCStats->nThreads = strtol(bgn, NULL, 10);
-						break;
-					case STAT_BYTES:
-						pstMCStats->nBytes = strtoll(bgn, NULL, 10);
-						break;
-					case STAT_CURR_ITEMS:
-						pstMCStats->nCurrentItems = strtol(bgn, NULL, 10);
-						break;
-					case STAT_TOTAL_ITEMS:
-						pstMCStats->nTotalItems = strtol(bgn, NULL, 10);
-						break;
-					case STAT_EVICTIONS:
-						pstMCStats->nEvictions = strtoll(bgn, NULL, 10);
-						break;
-				}				
-
-				*end = '\r';
-				i++;
-			}
-			
-		}
-	}
-end:
-	return ret;
+	free(pstList->astStats);
+	pstList->astStats = NULL;
+	pstList->nCount = 0;
 }
@@ -8,6 +8,12 @@
 #ifndef __MEMCACHE_CLIENT_
 #define __MEMCACHE_CLIENT_
 
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * @def MEMCACHE_KEY_MAX
  * Maximum length of key for caching.
@@ -28,7 +34,23 @@
 
 #define MCACHE_TIMEOUT_MAX	300		///< 300 seconds
 
-#define MCACHE_MULTIGET_MAX	1000		///< 1000 data for multiget maximum
+#define MCACHE_MULTIGET_MAX	1000		///< default number of keys per multiget command, larger lists are split
+
+#define MCACHE_BATCH_BYTES	64 * 1024	///< default maximum length of multiget command line
+
+#define MCACHE_BATCH_DEPTH	4		///< default number of multiget commands kept in flight
+
+#define MCACHE_REPLICA_MAX	8		///< maximum number of servers in MemCacheReplicaSet
+
+#define MCACHE_REPLICA_RETRY	3		///< seconds a failed replica is skipped before reconnecting
+
+#define MCACHE_LATENCY_BUCKETS	40		///< buckets of latency histogram, bucket i counts [2^i, 2^(i+1)) microseconds
+
+#define MCACHE_METRIC_BUCKETS	112		///< buckets of MemCacheOpMetrics latency histogram, see MCACHE_MetricsBucketBound
+
+#define MCACHE_METRIC_OPS	16		///< commands counted by MemCacheMetrics, see MCACHE_MetricsOpName
+
+#define MCACHE_RESULT_COUNT	12		///< number of MCACHE_OK and MCACHE_ERR_* codes
 
 enum
 {
@@ -54,6 +76,68 @@ enum
 	MCACHE_FLAG_IPv6	= 1 << 2
 };
 
+/**
+ * acknowledgement required by writes of MemCacheReplicaSet.
+ */
+enum
+{
+	MCACHE_ACK_ONE = 0,	///< least loaded usable replica stores data
+	MCACHE_ACK_ALL		///< every replica stores data
+};
+
+/**
+ * policy of MemCacheReplicaSet choosing replica for reads, load of replica is its average latency scaled by
+ * requests in progress.
+ */
+enum
+{
+	MCACHE_SELECT_P2C = 0,	///< less loaded of two random replicas
+	MCACHE_SELECT_LEAST	///< least loaded replica
+};
+
+/**
+ * flags of MCACHE_WriterCreate.
+ */
+enum
+{
+	MCACHE_WRITER_BLOCK		= 0,		///< MCACHE_WriterSet waits while queue is full
+	MCACHE_WRITER_DROP_OLDEST	= 1 << 0,	///< drop oldest item instead of waiting while queue is full
+	MCACHE_WRITER_NOREPLY		= 1 << 1	///< send "noreply" sets, failures of server are not reported
+};
+
+/**
+ * lifecycle points of a request reported to MemCacheTraceFunc, and to USDT probes of provider "mcache" (named
+ * enqueue, write__start, write__end, first__byte, parse__done and callback) if library is built with -DMCACHE_USDT.
+ */
+enum
+{
+	MCACHE_TRACE_ENQUEUE = 0,	///< call is queued by group commit or write-behind queue
+	MCACHE_TRACE_WRITE_START,	///< request is about to be written to socket
+	MCACHE_TRACE_WRITE_END,		///< request is written, nBytes tells bytes written by request so far
+	MCACHE_TRACE_FIRST_BYTE,	///< first bytes of reply are read, nBytes tells how many
+	MCACHE_TRACE_PARSE_DONE,	///< reply is parsed, nBytes tells bytes read and nResult result of request
+	MCACHE_TRACE_CALLBACK,		///< fetched value is about to be handed to callback of caller, nBytes tells its length
+	MCACHE_TRACE_EVENTS
+};
+
+/**
+ * key hash algorithms of MCACHE_HashFunction.
+ */
+enum
+{
+	MCACHE_HASH_CRC32C = 1,	///< CRC32C (Castagnoli), hardware accelerated
+	MCACHE_HASH_XXH3,	///< low 32 bits of 64-bit xxh3
+	MCACHE_HASH_MD5		///< ketama compatible MD5
+};
+
+/**
+ * hash function of key of nKeyLen bytes, see MCACHE_HashFunction.
+ */
+typedef uint32_t (*MemCacheHashFunc)(const char *pKey, size_t nKeyLen);
+
+/**
+ * general statistics of server filled by MCACHE_ServerStats, one field per statistic of "stats" command.
+ */
 typedef struct
 {
 	size_t	nPid;
@@ -78,8 +162,73 @@ typedef struct
 	int64_t	nBytesWritten;
 	size_t	nLimitMaxbytes;
 	size_t	nThreads;
+	int64_t	nCmdFlush;
+	int64_t	nDeleteHits;
+	int64_t	nDeleteMisses;
+	int64_t	nIncrHits;
+	int64_t	nIncrMisses;
+	int64_t	nDecrHits;
+	int64_t	nDecrMisses;
+	int64_t	nCasHits;
+	int64_t	nCasMisses;
+	int64_t	nCasBadval;
+	int64_t	nReclaimed;
+	int64_t	nConnYields;
+	int64_t	nListenDisabledNum;
 } MemCacheStats;
 
+/**
+ * one statistic of server, see MCACHE_ServerStatList.
+ */
+typedef struct
+{
+	const char	*pszName;
+	const char	*pszValue;
+} MemCacheStat;
+
+/**
+ * statistics of one "stats" command in order of server, filled by MCACHE_ServerStatList.
+ */
+typedef struct
+{
+	MemCacheStat	*astStats;	///< names and values are kept in the same allocation
+	size_t	nCount;
+} MemCacheStatList;
+
+/**
+ * allocator of values handed to caller and of reply buffers of a server, see MemCacheServer.stAllocator.
+ * pfnFree must accept any block of pfnAlloc with same context, from any thread. MCACHE_PoolAlloc and
+ * MCACHE_PoolFree make one of MemCachePool.
+ */
+typedef struct
+{
+	void	*(*pfnAlloc)(size_t nSize, void *pContext);
+	void	(*pfnFree)(void *pPtr, void *pContext);
+	void	*pContext;
+} MemCacheAllocator;
+
+/**
+ * request metrics of one command on a server, see MCACHE_ServerMetrics.
+ */
+typedef struct
+{
+	uint64_t	nRequests;	///< round trips
+	uint64_t	nKeys;		///< data carried by requests
+	uint64_t	nBytesSent;
+	uint64_t	nLatencySum;	///< microseconds
+	uint64_t	anResults[MCACHE_RESULT_COUNT];	///< requests by returned MCACHE_OK or MCACHE_ERR_* code
+	uint64_t	anLatencyHist[MCACHE_METRIC_BUCKETS];	///< requests by latency, see MCACHE_MetricsBucketBound
+} MemCacheOpMetrics;
+
+/**
+ * snapshot of request metrics of a server, taken by MCACHE_ServerMetrics.
+ */
+typedef struct
+{
+	uint64_t	nBytesReceived;
+	MemCacheOpMetrics	astOps[MCACHE_METRIC_OPS];	///< indexed by command, see MCACHE_MetricsOpName
+} MemCacheMetrics;
+
 typedef struct
 {
 	char	*pszServerAddr;
@@ -87,8 +236,36 @@ typedef struct
 	int	nSockFD;
 	size_t	nTimeout;
 	int	nFlag;
+	size_t	nBatchKeys;	///< keys per multiget command, MCACHE_MULTIGET_MAX if 0
+	size_t	nBatchBytes;	///< maximum length of multiget command line, MCACHE_BATCH_BYTES if 0
+	size_t	nBatchDepth;	///< multiget commands kept in flight on connection, MCACHE_BATCH_DEPTH if 0 (at most 16)
+	struct memCacheGroup	*pstGroup;	///< group commit state, see MCACHE_ServerGroupEnable
+	struct memCacheNegative	*pstNegative;	///< recently missing keys, see MCACHE_ServerNegativeEnable
+	struct memCacheMeter	*pstMeter;	///< request metrics, see MCACHE_ServerMetricsEnable
+	struct memCacheTracer	*pstTracer;	///< trace callback, see MCACHE_ServerTraceEnable
+	int64_t	nLatency;	///< moving average of request latency in microseconds
+	int64_t	nLatencyTime;	///< time of last request in microseconds
+	int	nInflight;	///< requests in progress
+	int	nDiscard;	///< responses of abandoned gets still to be skipped on connection
+	MemCacheAllocator	stAllocator;	///< allocator of fetched values and reply buffers, malloc/free if pfnAlloc is NULL
 } MemCacheServer;
 
+typedef struct
+{
+	MemCacheServer	*apstServers[MCACHE_REPLICA_MAX];
+	size_t	nServerCount;
+	int	nAck;					///< MCACHE_ACK_ONE or MCACHE_ACK_ALL
+	int	nSelect;				///< MCACHE_SELECT_P2C or MCACHE_SELECT_LEAST
+	int64_t	anDownUntil[MCACHE_REPLICA_MAX];	///< failed replica is skipped until this time (microseconds)
+	int64_t	nHedgeDelay;				///< microseconds before a get is sent to a second replica, 0 to derive from nHedgePercentile
+	int	nHedgePercentile;			///< percentile of get latency used as hedge delay (e.g., 95), 0 disables hedging if nHedgeDelay is 0 too
+	int	nHedgeBudget;				///< maximum percentage of gets which may be hedged, 0 for no limit
+	uint64_t	nGets;				///< gets served by replica set
+	uint64_t	nHedges;			///< gets sent to a second replica
+	uint64_t	nHedgeWins;			///< hedged gets answered by second replica first
+	uint64_t	anLatencyHist[MCACHE_LATENCY_BUCKETS];	///< histogram of get latency
+} MemCacheReplicaSet;
+
 typedef struct
 {
 	char	*pszDataKey;
@@ -97,8 +274,84 @@ typedef struct
 	size_t	nFlags;
 	size_t	nExpiration;
 	int64_t	nCASUnique;
+	size_t	nKeyLen;	///< length of pszDataKey, which then needs no '\0' terminator. strlen(pszDataKey) is used if 0
 } MemCacheData;
 
+/**
+ * @brief	callback receiving value chunks fetched by MCACHE_DataGetStream.
+ *
+ * @param	pstMCData	data in list whose value is being delivered, nFlags and nDataLen (total length of value) are filled.
+ * @param	nOffset		offset of chunk within value.
+ * @param	pChunk		chunk of value, valid until callback returns.
+ * @param	nChunkLen	length of chunk.
+ * @param	pArg		argument given to MCACHE_DataGetStream.
+ *
+ * @return	MCACHE_OK to continue, otherwise remaining chunks are discarded and the code is returned by MCACHE_DataGetStream.
+ */
+typedef int (*MemCacheStreamFunc)(MemCacheData *pstMCData, size_t nOffset, const void *pChunk, size_t nChunkLen, void *pArg);
+
+/**
+ * @brief	callback receiving data fetched by MCACHE_DataGetEach or MCACHE_DataGetsEach.
+ *
+ * @param	pstMCData	data in list, nFlags, nDataLen and nCASUnique (for gets) are filled for fetched data.
+ * @param	pValue		value of fetched data, valid until callback returns. NULL for data not found.
+ * @param	pArg		argument given to MCACHE_DataGetEach or MCACHE_DataGetsEach.
+ *
+ * @return	MCACHE_OK to continue, otherwise no more callbacks are invoked and the code is returned.
+ */
+typedef int (*MemCacheItemFunc)(MemCacheData *pstMCData, const void *pValue, void *pArg);
+
+/**
+ * event passed to MemCacheTraceFunc.
+ */
+typedef struct
+{
+	int	nEvent;		///< MCACHE_TRACE_*
+	int	nOp;		///< command of request, see MCACHE_MetricsOpName
+	int	nResult;	///< result of request for MCACHE_TRACE_PARSE_DONE, MCACHE_OK otherwise
+	uint64_t	nKeyHash;	///< FNV-1a hash of key (first key of multi-key request), 0 if unknown
+	size_t	nKeys;		///< data carried by request
+	size_t	nBytes;		///< see MCACHE_TRACE_*, value length for MCACHE_TRACE_ENQUEUE
+	int64_t	nTime;		///< microseconds since epoch
+} MemCacheTraceEvent;
+
+/**
+ * @brief	callback receiving lifecycle events of requests on server, see MCACHE_ServerTraceEnable.
+ *
+ * @param	pstMCServer	server of request.
+ * @param	pstEvent	event, valid until callback returns.
+ * @param	pContext	context given to MCACHE_ServerTraceEnable.
+ *
+ * @note	callback runs on thread making the request (or on flusher of write-behind queue) in the middle of it, and
+ *       	must not send requests on pstMCServer.
+ */
+typedef void (*MemCacheTraceFunc)(MemCacheServer *pstMCServer, const MemCacheTraceEvent *pstEvent, void *pContext);
+
+/**
+ * @brief	client side aggregator of incr/decr deltas, created by MCACHE_CounterCreate.
+ */
+typedef struct memCacheCounter MemCacheCounter;
+
+/**
+ * @brief	write-behind queue with background flusher, created by MCACHE_WriterCreate.
+ */
+typedef struct memCacheWriter MemCacheWriter;
+
+/**
+ * @brief	hot key tracker with local copies of hot data, created by MCACHE_HotKeyCreate.
+ */
+typedef struct memCacheHotKey MemCacheHotKey;
+
+/**
+ * @brief	serialized retrieval commands of a key list, created by MCACHE_DataPrepareGet.
+ */
+typedef struct memCachePrepared MemCachePrepared;
+
+/**
+ * @brief	size-class pool of value buffers, created by MCACHE_PoolCreate.
+ */
+typedef struct memCachePool MemCachePool;
+
 // Context Functions
 /**
  * @fn 		int MCACHE_ServerInit(MemCacheServer *pstMCServer, const char *pszHost, int nPort, int nTimeout, int nFlag)
@@ -146,6 +399,77 @@ MCACHE_ServerDisconnect(MemCacheServer *pstMCServer);
 int
 MCACHE_ServerDestroy(MemCacheServer *pstMCServer);
 
+/**
+ * @fn		int MCACHE_ServerGroupEnable(MemCacheServer *pstMCServer, int nWindow)
+ *
+ * @param	pstMCServer	pointer of server.
+ * @param	nWindow		microseconds a caller waits for other callers before sending, 0 to gather only callers
+ *        			arriving while previous calls are being sent.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	let concurrent synchronous calls on server share one pipelined write (group commit).
+ *
+ * @note	once enabled, storage commands, MCACHE_DataDelete, MCACHE_DataTouch and single-key MCACHE_DataGet and
+ *       	MCACHE_DataGets are thread safe on server, callers block until their own reply is parsed.
+ *       	the window is skipped while calls arrive alone, so latency of a lonely caller is unchanged.
+ *       	other commands must not run concurrently with them. group is released by MCACHE_ServerDestroy.
+ */
+int
+MCACHE_ServerGroupEnable(MemCacheServer *pstMCServer, int nWindow);
+
+/**
+ * @fn		int MCACHE_ServerNegativeEnable(MemCacheServer *pstMCServer, size_t nMaxKeys, int nTTL)
+ *
+ * @param	pstMCServer	pointer of server.
+ * @param	nMaxKeys	number of missing keys remembered.
+ * @param	nTTL		milliseconds a missing key is answered locally.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	remember keys MCACHE_DataGet and MCACHE_DataGets found missing, so repeated gets of them are answered as
+ *       	misses without a round trip for nTTL.
+ *
+ * @note	keys are kept as 32-bit fingerprints (8 bytes each), a false hit is possible but very unlikely.
+ *       	storage commands of this client forget the key stored, other clients storing it are seen after nTTL.
+ *       	calling again clears cache and changes nTTL. cache is released by MCACHE_ServerDestroy.
+ */
+int
+MCACHE_ServerNegativeEnable(MemCacheServer *pstMCServer, size_t nMaxKeys, int nTTL);
+
+/**
+ * @fn		int MCACHE_ServerMetricsEnable(MemCacheServer *pstMCServer)
+ *
+ * @param	pstMCServer	pointer of server.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	count requests, keys, bytes, results and latency of every command sent to server, see MCACHE_ServerMetrics.
+ *
+ * @note	counters are sharded by calling thread and updated by relaxed atomics, no lock is taken on request path.
+ *       	metrics take about 128KB, and are released by MCACHE_ServerDestroy. calling again keeps current counters.
+ */
+int
+MCACHE_ServerMetricsEnable(MemCacheServer *pstMCServer);
+
+/**
+ * @fn		int MCACHE_ServerTraceEnable(MemCacheServer *pstMCServer, MemCacheTraceFunc pfnTrace, void *pContext)
+ *
+ * @param	pstMCServer	pointer of server.
+ * @param	pfnTrace	callback receiving events of requests on server, NULL to stop tracing.
+ * @param	pContext	argument passed to pfnTrace.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	report lifecycle points of requests on server (see MCACHE_TRACE_*) to pfnTrace.
+ *
+ * @note	must not be called while server is in use. an untraced server pays one pointer test per event, if
+ *       	library is built with -DMCACHE_USDT events also fire USDT probes while any of them is attached.
+ *       	tracer is released by MCACHE_ServerDestroy.
+ */
+int
+MCACHE_ServerTraceEnable(MemCacheServer *pstMCServer, MemCacheTraceFunc pfnTrace, void *pContext);
+
 // Storage Commands
 /**
  * @fn		int MCACHE_DataSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
@@ -230,6 +554,42 @@ MCACHE_DataPrepend(MemCacheServer *pstMCServer, MemCacheData *pstMCData);
 int
 MCACHE_DataCheckAndSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData);
 
+/**
+ * @fn		int MCACHE_DataSetMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for setting data.
+ * @param	pstMCDataList	pointer of data list to set.
+ * @param	nListSize	number of data in data list.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are stored, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	set all data of list, commands are sent in one write and replies are parsed in one pass.
+ *
+ * @note	commands are sent nBatchKeys data at a time, values are never copied.
+ */
+int
+MCACHE_DataSetMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus);
+
+/**
+ * @fn		int MCACHE_DataSetFromFD(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nFD, int64_t nOffset)
+ *
+ * @param	pstMCServer	pointer of server for setting data.
+ * @param	pstMCData	pointer of data to set, pDataValue is ignored and nDataLen bytes are taken from nFD.
+ * @param	nFD		descriptor to read value from.
+ * @param	nOffset		offset of value within nFD.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_IO for failure of nFD, failure otherwise.
+ *
+ * @brief	set given key with value stored in nFD.
+ *
+ * @note	value is sent by sendfile(2) without copying into user space, and command line, value and trailing
+ *       	"\r\n" are flushed together. for memory mapped regions, pass mapped address as pDataValue to MCACHE_DataSet.
+ *       	connection is closed if nDataLen bytes could not be read from nFD, since command is left incomplete.
+ */
+int
+MCACHE_DataSetFromFD(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nFD, int64_t nOffset);
+
 /**
  * @fn		int MCACHE_DataFree(MemCacheData *pstMCData)
  *
@@ -238,11 +598,25 @@ MCACHE_DataCheckAndSet(MemCacheServer *pstMCServer, MemCacheData *pstMCData);
  * @brief	free pstMCData.pszDataValue if it's not NULL.
  *
  * @note	MCACHE_DataFree will be used for those data fetched by MCACHE_DataGet.
+ *       	data fetched by server with stAllocator set is freed by MCACHE_ServerDataFree instead.
  *
  */
 int
 MCACHE_DataFree(MemCacheData *pstMCData);
 
+/**
+ * @fn		int MCACHE_ServerDataFree(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server which fetched data.
+ * @param	pstMCData	pointer of data to free.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataFree, but value is released by allocator of pstMCServer.
+ */
+int
+MCACHE_ServerDataFree(MemCacheServer *pstMCServer, MemCacheData *pstMCData);
+
 // Retrival commands
 /**
  * @fn		int MCACHE_DataGet(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
@@ -256,6 +630,8 @@ MCACHE_DataFree(MemCacheData *pstMCData);
  * @brief	fetch data associted with given key and store pstMCData.
  *       	fetched value will be stored in malloced memory, and caller must invoked MCACHE_DataFree to free it.
  *
+ * @note	list of any size is accepted, it is split into commands of nBatchKeys keys (or nBatchBytes bytes) and
+ *       	up to nBatchDepth of them are pipelined on connection.
  */
 int
 MCACHE_DataGet(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize);
@@ -275,62 +651,968 @@ MCACHE_DataGet(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t
 int
 MCACHE_DataGets(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize);
 
-// Delete commands
 /**
- * @fn		int MCACHE_DataDelete(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nTime)
+ * @fn		int MCACHE_DataGetAndTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nExpiration)
  *
- * @param	pstMCServer	pointer of server for deleting data.
- * @param	pstMCData	pointer of data to hold key and stored fetched value.
- * @param	nTime		seconds for server to refuse "add" and "replace" commands with this key.
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ * @param	nExpiration	new expiration time of fetched data.
  *
- * @return	MCACHE_OK for success, failure otherwise.
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched correctly, failure otherwise.
  *
- * @brief	delete data on cache server associated with given key.
+ * @brief	same as MCACHE_DataGet, and expiration time of fetched data is updated in the same round trip ("gat").
  */
 int
-MCACHE_DataDelete(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nTime);
+MCACHE_DataGetAndTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nExpiration);
 
-// Increment/Decrement commands
 /**
- * @fn		int MCACHE_DataIncrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ * @fn		int MCACHE_DataGetsAndTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nExpiration)
  *
- * @param	pstMCServer	pointer of server for addition.
- * @param	pstMCData	pointer of data to add.
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ * @param	nExpiration	new expiration time of fetched data.
  *
- * @return	MCACHE_OK for success, failure otherwise.
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched correctly, failure otherwise.
  *
- * @brief	take the data associated with given key on server as 64-bit unsigned integer, and add given data and original data together on server.
+ * @brief	same as MCACHE_DataGets, and expiration time of fetched data is updated in the same round trip ("gats").
+ */
+int
+MCACHE_DataGetsAndTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nExpiration);
+
+/**
+ * @fn		int MCACHE_DataGetEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key, fetched flags and length.
+ * @param	nListSize	number of data in data list.
+ * @param	pfnHit		callback invoked for each fetched data as soon as its value is received.
+ * @param	pfnMiss		callback invoked for each data not found after whole response is received, could be NULL.
+ * @param	pArg		argument passed to pfnHit and pfnMiss.
  *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched, error returned by callbacks, failure otherwise.
+ *
+ * @brief	fetch data associated with given keys and hand each of them to pfnHit while response is still being parsed.
+ *
+ * @note	value passed to pfnHit points into receive buffer and is valid until callback returns, pDataValue is left untouched.
+ *       	once a callback fails, no more callbacks are invoked.
  */
 int
-MCACHE_DataIncrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum);
+MCACHE_DataGetEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg);
 
 /**
- * @fn		int MCACHE_DataDecrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ * @fn		int MCACHE_DataGetsEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg)
  *
- * @param	pstMCServer	pointer of server for substraction.
- * @param	pstMCData	pointer of data to substract.
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key, fetched flags, length and cas unique.
+ * @param	nListSize	number of data in data list.
+ * @param	pfnHit		callback invoked for each fetched data as soon as its value is received.
+ * @param	pfnMiss		callback invoked for each data not found after whole response is received, could be NULL.
+ * @param	pArg		argument passed to pfnHit and pfnMiss.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched, error returned by callbacks, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataGetEach, but nCASUnique is fetched as well.
+ */
+int
+MCACHE_DataGetsEach(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheItemFunc pfnHit, MemCacheItemFunc pfnMiss, void *pArg);
+
+/**
+ * @fn		int MCACHE_DataGetStream(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, MemCacheStreamFunc pfnStream, void *pArg)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key, fetched flags and length.
+ * @param	nListSize	number of data in data list.
+ * @param	pfnStream	callback receiving value chunks.
+ * @param	pArg		argument passed to pfnStream.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for some data could not be fetched, error returned by pfnStream, failure otherwise.
+ *
+ * @brief	fetch data associated with given keys and deliver values to pfnStream in chunks as they are received.
+ *
+ * @note	pDataValue is left untouched, values are never buffered as a whole.
+ */
+int
+MCACHE_DataGetStream(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheStreamFunc pfnStream, void *pArg);
+
+/**
+ * @fn		int MCACHE_DataGetToFD(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nFD)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCData	pointer of data to hold key, fetched flags and length.
+ * @param	nFD		descriptor to write value into.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_PARTIAL for data not found, MCACHE_ERR_IO for failure of nFD, failure otherwise.
+ *
+ * @brief	fetch data associated with given key and write value into nFD.
+ *
+ * @note	value is spliced from socket into nFD without copying into user space where splice(2) is supported.
+ */
+int
+MCACHE_DataGetToFD(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nFD);
+
+/**
+ * @fn		int MCACHE_DataPrepareGet(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	ppstPrepared	pointer to hold prepared commands.
+ * @param	pstMCServer	pointer of server whose batch settings split commands.
+ * @param	pstMCDataList	pointer of data list holding keys.
+ * @param	nListSize	number of data in data list.
  *
  * @return	MCACHE_OK for success, failure otherwise.
  *
- * @brief	take the data associated with given key on server as 64-bit unsigned integer, and substract given dat from original data on server.
+ * @brief	validate keys of data list and serialize its "get" commands once, for lists fetched again and again.
+ *
+ * @note	invalid keys are left out and reported as not fetched by MCACHE_DataGetPrepared. prepared commands
+ *       	must be freed by MCACHE_PreparedFree.
  */
 int
-MCACHE_DataDecrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum);
+MCACHE_DataPrepareGet(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList,
+	size_t nListSize);
 
-// Stats commands
 /**
- * @fn		int MCACHE_ServerStats(MemCacheServer *pstMCServer, MemCacheStats *pstMCStats)
+ * @fn		int MCACHE_DataPrepareGets(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
  *
- * @param	pstMCServer	pointer of server for fetching status.
- * @param	pstMCStats	pointer of status data.
+ * @param	ppstPrepared	pointer to hold prepared commands.
+ * @param	pstMCServer	pointer of server whose batch settings split commands.
+ * @param	pstMCDataList	pointer of data list holding keys.
+ * @param	nListSize	number of data in data list.
  *
  * @return	MCACHE_OK for success, failure otherwise.
- * 
- * @brief	get server status and store status data in pstMCStats.
+ *
+ * @brief	same as MCACHE_DataPrepareGet, but prepare "gets" commands fetching CAS unique too.
  */
 int
-MCACHE_ServerStats(MemCacheServer *pstMCServer, MemCacheStats *pstMCStats);
+MCACHE_DataPrepareGets(MemCachePrepared **ppstPrepared, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList,
+	size_t nListSize);
+
+/**
+ * @fn		int MCACHE_DataGetPrepared(MemCacheServer *pstMCServer, MemCachePrepared *pstPrepared, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstPrepared	pointer of prepared commands.
+ * @param	pstMCDataList	pointer of data list to store fetched value, keys must be those given to prepare, in same order.
+ * @param	nListSize	number of data in data list, same as given to prepare.
+ *
+ * @return	same as MCACHE_DataGet.
+ *
+ * @brief	send prepared commands and parse replies, keys are neither validated nor serialized again and reply keys
+ *       	are found through precomputed hash index.
+ *
+ * @note	negative cache and group commit of server are bypassed. reply keys are matched against keys kept in
+ *       	prepared commands, so keys of list changed after prepare are not read.
+ */
+int
+MCACHE_DataGetPrepared(MemCacheServer *pstMCServer, MemCachePrepared *pstPrepared, MemCacheData *pstMCDataList,
+	size_t nListSize);
 
+/**
+ * @fn		int MCACHE_PreparedFree(MemCachePrepared *pstPrepared)
+ *
+ * @param	pstPrepared	pointer of prepared commands.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ */
+int
+MCACHE_PreparedFree(MemCachePrepared *pstPrepared);
+
+// Update commands
+/**
+ * @fn		int MCACHE_DataUpdate(MemCacheServer *pstMCServer, MemCacheData *pstMCData, MemCacheItemFunc pfnUpdate, void *pArg, int nRetry)
+ *
+ * @param	pstMCServer	pointer of server for updating data.
+ * @param	pstMCData	pointer of data holding key, expiration time, and new value after success.
+ * @param	pfnUpdate	callback computing new value from current one.
+ * @param	pArg		argument passed to pfnUpdate.
+ * @param	nRetry		maximum number of retries after losing a race with other clients.
+ *
+ * @return	MCACHE_OK for success, error returned by pfnUpdate, failure otherwise. once retries are exhausted the last
+ *       	race lost is returned: MCACHE_ERR_EXISTS if data was modified, MCACHE_ERR_NOT_FOUND if it was deleted, or
+ *       	MCACHE_ERR_NOT_STORED if it was created by others.
+ *
+ * @brief	atomically replace value of data with the one computed by pfnUpdate, by running "gets" and "cas" until
+ *       	no one else updates data in between. "gets" is pipelined behind every "cas", so a retry costs no extra
+ *       	round trip.
+ *
+ * @note	pfnUpdate receives current value (NULL if data does not exist, then it is created by "add") and must store
+ *       	new value into pDataValue and nDataLen (nFlags and nExpiration could be changed too), returning other than
+ *       	MCACHE_OK gives up the update. pfnUpdate may be invoked once per attempt, on retry pDataValue holds value
+ *       	it computed on previous attempt, which it may reuse or release before storing new one. values are owned
+ *       	by caller and never freed by library, once pfnUpdate has run pDataValue is left holding the last value it
+ *       	computed whether stored or not.
+ */
+int
+MCACHE_DataUpdate(MemCacheServer *pstMCServer, MemCacheData *pstMCData, MemCacheItemFunc pfnUpdate, void *pArg, int nRetry);
+
+/**
+ * @fn		int MCACHE_DataUpdateMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, MemCacheItemFunc pfnUpdate, void *pArg, int nRetry, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for updating data.
+ * @param	pstMCDataList	pointer of data list holding keys, expiration time, and new values after success.
+ * @param	nListSize	number of data in data list.
+ * @param	pfnUpdate	callback computing new value from current one.
+ * @param	pArg		argument passed to pfnUpdate.
+ * @param	nRetry		maximum number of retries after losing a race with other clients.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are updated, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataUpdate for each data, pending data are fetched and stored in one pipeline per attempt,
+ *       	so only data losing a race cost extra round trips.
+ */
+int
+MCACHE_DataUpdateMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize,
+	MemCacheItemFunc pfnUpdate, void *pArg, int nRetry, int *pnStatus);
+
+// Delete commands
+/**
+ * @fn		int MCACHE_DataDelete(MemCacheServer *pstMCServer, MemCacheData *pstMCData, int nTime)
+ *
+ * @param	pstMCServer	pointer of server for deleting data.
+ * @param	pstMCData	pointer of data to hold key and stored fetched value.
+ * @param	nTime		seconds for server to refuse "add" and "replace" commands with this key.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	delete data on cache server associated with given key.
+ */
+int
+MCACHE_DataDelete(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nTime);
+
+/**
+ * @fn		int MCACHE_DataDeleteMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for deleting data.
+ * @param	pstMCDataList	pointer of data list holding keys to delete.
+ * @param	nListSize	number of data in data list.
+ * @param	pnStatus	array of nListSize to hold result of each data (e.g., MCACHE_ERR_NOT_FOUND), could be NULL.
+ *
+ * @return	MCACHE_OK if all data are deleted, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	delete data associated with given keys, commands are sent in one write and replies are parsed in one pass.
+ */
+int
+MCACHE_DataDeleteMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus);
+
+// Touch commands
+/**
+ * @fn		int MCACHE_DataTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for touching data.
+ * @param	pstMCData	pointer of data holding key and new expiration time (nExpiration).
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND for data not found, failure otherwise.
+ *
+ * @brief	update expiration time of data associated with given key without transferring its value.
+ */
+int
+MCACHE_DataTouch(MemCacheServer *pstMCServer, MemCacheData *pstMCData);
+
+/**
+ * @fn		int MCACHE_DataTouchMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for touching data.
+ * @param	pstMCDataList	pointer of data list holding keys and new expiration time (nExpiration).
+ * @param	nListSize	number of data in data list.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are touched, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataTouch for each data, commands are sent in one write and replies are parsed in one pass.
+ */
+int
+MCACHE_DataTouchMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, int *pnStatus);
+
+// Increment/Decrement commands
+/**
+ * @fn		int MCACHE_DataIncrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for addition.
+ * @param	pstMCData	pointer of data to add.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	take the data associated with given key on server as 64-bit unsigned integer, and add given data and original data together on server.
+ *
+ */
+int
+MCACHE_DataIncrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum);
+
+/**
+ * @fn		int MCACHE_DataDecrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData)
+ *
+ * @param	pstMCServer	pointer of server for substraction.
+ * @param	pstMCData	pointer of data to substract.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	take the data associated with given key on server as 64-bit unsigned integer, and substract given dat from original data on server.
+ */
+int
+MCACHE_DataDecrement(MemCacheServer *pstMCServer, MemCacheData *pstMCData, size_t nNum);
+
+/**
+ * @fn		int MCACHE_DataIncrementMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nNum, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for addition.
+ * @param	pstMCDataList	pointer of data list holding keys to add.
+ * @param	nListSize	number of data in data list.
+ * @param	nNum		number to add to each data.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are incremented, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataIncrement for each data, commands are sent in one write and replies are parsed in one pass.
+ */
+int
+MCACHE_DataIncrementMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nNum, int *pnStatus);
+
+/**
+ * @fn		int MCACHE_DataDecrementMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nNum, int *pnStatus)
+ *
+ * @param	pstMCServer	pointer of server for substraction.
+ * @param	pstMCDataList	pointer of data list holding keys to substract.
+ * @param	nListSize	number of data in data list.
+ * @param	nNum		number to substract from each data.
+ * @param	pnStatus	array of nListSize to hold result of each data, could be NULL.
+ *
+ * @return	MCACHE_OK if all data are decremented, MCACHE_ERR_PARTIAL if some of them fail, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataDecrement for each data, commands are sent in one write and replies are parsed in one pass.
+ */
+int
+MCACHE_DataDecrementMulti(MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize, size_t nNum, int *pnStatus);
+
+// Counter commands
+/**
+ * @fn		int MCACHE_DataIncrementNum(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, uint64_t *pnValue)
+ *
+ * @param	pstMCServer	pointer of server for addition.
+ * @param	pstMCData	pointer of data holding key.
+ * @param	nNum		number to add.
+ * @param	pnValue		pointer to hold new value, could be NULL.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND for data not found, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataIncrement, but new value is returned as integer and pDataValue is left untouched.
+ *
+ * @note	no memory is allocated.
+ */
+int
+MCACHE_DataIncrementNum(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, uint64_t *pnValue);
+
+/**
+ * @fn		int MCACHE_DataDecrementNum(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, uint64_t *pnValue)
+ *
+ * @param	pstMCServer	pointer of server for substraction.
+ * @param	pstMCData	pointer of data holding key.
+ * @param	nNum		number to substract.
+ * @param	pnValue		pointer to hold new value, could be NULL.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND for data not found, failure otherwise.
+ *
+ * @brief	same as MCACHE_DataDecrement, but new value is returned as integer and pDataValue is left untouched.
+ *
+ * @note	no memory is allocated.
+ */
+int
+MCACHE_DataDecrementNum(MemCacheServer *pstMCServer, MemCacheData *pstMCData, uint64_t nNum, uint64_t *pnValue);
+
+/**
+ * @fn		int MCACHE_CounterCreate(MemCacheCounter **ppstCounter, MemCacheServer *pstMCServer, size_t nMaxKeys, int nInterval)
+ *
+ * @param	ppstCounter	pointer to hold created counter.
+ * @param	pstMCServer	pointer of server receiving aggregated deltas.
+ * @param	nMaxKeys	pending keys triggering a flush, 0 for no limit.
+ * @param	nInterval	milliseconds after last flush triggering a flush, 0 for no limit.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	create counter aggregating deltas of incr/decr on client side.
+ *
+ * @note	deltas added by MCACHE_CounterAdd are kept in tables sharded by thread and sent by one bulk of incr/decr
+ *       	when a trigger fires (checked by MCACHE_CounterAdd) or MCACHE_CounterFlush is invoked.
+ *       	counters not existing on server are created by "add".
+ *       	pstMCServer must not be used by other threads while counter is alive, counter must be destroyed by
+ *       	MCACHE_CounterDestroy.
+ */
+int
+MCACHE_CounterCreate(MemCacheCounter **ppstCounter, MemCacheServer *pstMCServer, size_t nMaxKeys, int nInterval);
+
+/**
+ * @fn		int MCACHE_CounterAdd(MemCacheCounter *pstCounter, const char *pszKey, int64_t nDelta)
+ *
+ * @param	pstCounter	pointer of counter.
+ * @param	pszKey		key of counter on server.
+ * @param	nDelta		number to add, negative for substraction.
+ *
+ * @return	MCACHE_OK for success, result of flush if it is triggered, failure otherwise.
+ *
+ * @brief	aggregate delta of key on client side, thread safe.
+ *
+ * @note	deltas of a key are summed before sent, so decrements saturating at 0 on server may differ from
+ *       	sending them one by one.
+ */
+int
+MCACHE_CounterAdd(MemCacheCounter *pstCounter, const char *pszKey, int64_t nDelta);
+
+/**
+ * @fn		int MCACHE_CounterFlush(MemCacheCounter *pstCounter)
+ *
+ * @param	pstCounter	pointer of counter.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	send all pending deltas in one bulk of incr/decr.
+ *
+ * @note	deltas failed for connection are kept and sent by next flush.
+ */
+int
+MCACHE_CounterFlush(MemCacheCounter *pstCounter);
+
+/**
+ * @fn		int MCACHE_CounterDestroy(MemCacheCounter *pstCounter)
+ *
+ * @param	pstCounter	pointer of counter.
+ *
+ * @return	result of final flush.
+ *
+ * @brief	flush pending deltas and free counter, deltas failed to be sent are dropped.
+ */
+int
+MCACHE_CounterDestroy(MemCacheCounter *pstCounter);
+
+// Write-behind commands
+/**
+ * @fn		int MCACHE_WriterCreate(MemCacheWriter **ppstWriter, MemCacheServer *pstMCServer, size_t nMaxItems, int nLinger, int nFlag)
+ *
+ * @param	ppstWriter	pointer to hold created writer.
+ * @param	pstMCServer	pointer of server receiving queued writes.
+ * @param	nMaxItems	maximum number of queued items.
+ * @param	nLinger		milliseconds flusher waits for more items before sending, 0 to send at once.
+ * @param	nFlag		MCACHE_WRITER_DROP_OLDEST and/or MCACHE_WRITER_NOREPLY.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	create write-behind queue whose items are stored by a background thread.
+ *
+ * @note	writes to the same key are coalesced in queue and the last one wins. items are sent by one pipelined bulk of
+ *       	sets ("noreply" with MCACHE_WRITER_NOREPLY). once queue is full, MCACHE_WriterSet waits for flusher
+ *       	unless MCACHE_WRITER_DROP_OLDEST is given, then the oldest item is dropped.
+ *       	pstMCServer must not be used by other threads while writer is alive, writer must be destroyed by
+ *       	MCACHE_WriterDestroy.
+ */
+int
+MCACHE_WriterCreate(MemCacheWriter **ppstWriter, MemCacheServer *pstMCServer, size_t nMaxItems, int nLinger, int nFlag);
+
+/**
+ * @fn		int MCACHE_WriterSet(MemCacheWriter *pstWriter, MemCacheData *pstMCData)
+ *
+ * @param	pstWriter	pointer of writer.
+ * @param	pstMCData	pointer of data to store, key and value are copied.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_TIMEOUT if queue stays full for nTimeout of server, failure otherwise.
+ *
+ * @brief	queue data to be stored by flusher of writer and return without waiting for server, thread safe.
+ */
+int
+MCACHE_WriterSet(MemCacheWriter *pstWriter, MemCacheData *pstMCData);
+
+/**
+ * @fn		int MCACHE_WriterFlush(MemCacheWriter *pstWriter, size_t *pnDropped)
+ *
+ * @param	pstWriter	pointer of writer.
+ * @param	pnDropped	pointer to hold number of items dropped for full queue since last call, could be NULL.
+ *
+ * @return	MCACHE_OK if all items are sent, otherwise first failure since last call.
+ *
+ * @brief	wait until all queued items are sent.
+ */
+int
+MCACHE_WriterFlush(MemCacheWriter *pstWriter, size_t *pnDropped);
+
+/**
+ * @fn		int MCACHE_WriterDestroy(MemCacheWriter *pstWriter)
+ *
+ * @param	pstWriter	pointer of writer.
+ *
+ * @return	MCACHE_OK if all items are sent, otherwise first failure since last MCACHE_WriterFlush.
+ *
+ * @brief	send queued items, stop flusher and free writer.
+ */
+int
+MCACHE_WriterDestroy(MemCacheWriter *pstWriter);
+
+// Replica commands
+/**
+ * @fn		int MCACHE_ReplicaInit(MemCacheReplicaSet *pstReplicaSet, MemCacheServer **ppstServers, size_t nServerCount, int nAck)
+ *
+ * @param	pstReplicaSet	pointer of replica set for initialization.
+ * @param	ppstServers	servers holding the same data, initialized by MCACHE_ServerInit.
+ * @param	nServerCount	number of servers, at most MCACHE_REPLICA_MAX.
+ * @param	nAck		MCACHE_ACK_ONE or MCACHE_ACK_ALL.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	initialize replica set over given servers.
+ *
+ * @note	servers are not owned by replica set, and must not be used elsewhere while replica set is in use.
+ *       	reads go to the better of two random replicas (MCACHE_SELECT_P2C), set nSelect to MCACHE_SELECT_LEAST
+ *       	to always pick the least loaded one.
+ *       	a server failing for network is disconnected and skipped for MCACHE_REPLICA_RETRY seconds, then it is
+ *       	reconnected.
+ */
+int
+MCACHE_ReplicaInit(MemCacheReplicaSet *pstReplicaSet, MemCacheServer **ppstServers, size_t nServerCount, int nAck);
+
+/**
+ * @fn		int MCACHE_ReplicaDataSet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData)
+ *
+ * @param	pstReplicaSet	pointer of replica set.
+ * @param	pstMCData	pointer of data to set.
+ *
+ * @return	MCACHE_OK if acknowledged as required by nAck, failure otherwise.
+ *
+ * @brief	store data on all replicas in parallel.
+ *
+ * @note	with MCACHE_ACK_ONE, only the least loaded usable replica replies, others are sent "noreply" commands.
+ *       	with MCACHE_ACK_ALL, every replica of set must store data, including replicas currently down.
+ *       	replies of gets lost by hedging are read off replicas first, waiting for them up to nTimeout.
+ */
+int
+MCACHE_ReplicaDataSet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData);
+
+/**
+ * @fn		int MCACHE_ReplicaDataDelete(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData)
+ *
+ * @param	pstReplicaSet	pointer of replica set.
+ * @param	pstMCData	pointer of data holding key to delete.
+ *
+ * @return	MCACHE_OK if acknowledged as required by nAck, failure otherwise.
+ *
+ * @brief	delete data from all replicas in parallel, acknowledged as MCACHE_ReplicaDataSet.
+ */
+int
+MCACHE_ReplicaDataDelete(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCData);
+
+/**
+ * @fn		int MCACHE_ReplicaDataGet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	pstReplicaSet	pointer of replica set.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ *
+ * @return	same as MCACHE_DataGet, MCACHE_ERR_NET if no replica is usable.
+ *
+ * @brief	fetch data from a replica chosen by nSelect of replica set, failing over to the least loaded remaining
+ *       	one for network failures.
+ *
+ * @note	if nHedgeDelay or nHedgePercentile of replica set is given, a get not answered within the delay is sent to
+ *       	a second replica as well and the first reply wins (up to nHedgeBudget percent of gets).
+ */
+int
+MCACHE_ReplicaDataGet(MemCacheReplicaSet *pstReplicaSet, MemCacheData *pstMCDataList, size_t nListSize);
+
+// Pool commands
+/**
+ * @fn		int MCACHE_PoolCreate(MemCachePool **ppstPool, size_t nMaxCached)
+ *
+ * @param	ppstPool	pointer to hold created pool.
+ * @param	nMaxCached	free blocks kept for reuse per size class.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	create pool of blocks in power of two size classes from 32 bytes to 64KB, larger blocks are malloced.
+ *
+ * @note	plug pool into server by setting stAllocator to { MCACHE_PoolAlloc, MCACHE_PoolFree, pool }, so values
+ *       	and reply buffers are recycled instead of going through malloc. pool is thread safe, and must outlive
+ *       	every block allocated from it before destroyed by MCACHE_PoolDestroy.
+ */
+int
+MCACHE_PoolCreate(MemCachePool **ppstPool, size_t nMaxCached);
+
+/**
+ * @fn		void *MCACHE_PoolAlloc(size_t nSize, void *pContext)
+ *
+ * @param	nSize		bytes to allocate.
+ * @param	pContext	pointer of pool.
+ *
+ * @return	pointer of allocated block, NULL for failure.
+ *
+ * @brief	allocate block from pool, allocator function of MemCacheAllocator.
+ */
+void *
+MCACHE_PoolAlloc(size_t nSize, void *pContext);
+
+/**
+ * @fn		void MCACHE_PoolFree(void *pPtr, void *pContext)
+ *
+ * @param	pPtr		pointer of block allocated by MCACHE_PoolAlloc, or NULL.
+ * @param	pContext	pointer of pool.
+ *
+ * @brief	return block to pool, free function of MemCacheAllocator.
+ */
+void
+MCACHE_PoolFree(void *pPtr, void *pContext);
+
+/**
+ * @fn		int MCACHE_PoolDestroy(MemCachePool *pstPool)
+ *
+ * @param	pstPool		pointer of pool.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ */
+int
+MCACHE_PoolDestroy(MemCachePool *pstPool);
+
+// Hot key commands
+/**
+ * @fn		int MCACHE_HotKeyCreate(MemCacheHotKey **ppstHotKey, size_t nCapacity, size_t nThreshold, int nTTL)
+ *
+ * @param	ppstHotKey	pointer to hold created tracker.
+ * @param	nCapacity	number of keys monitored, also number of local copies kept.
+ * @param	nThreshold	gets per second making a key hot.
+ * @param	nTTL		milliseconds local copy of hot data is served, 0 to only detect hot keys.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	create tracker spotting hot keys on get path with a Space-Saving sketch of nCapacity counters.
+ *
+ * @note	data of hot keys fetched by MCACHE_HotKeyGet is pinned locally for nTTL and served without contacting
+ *       	server, so a viral key costs its server at most one get per nTTL. to spread hot keys over servers
+ *       	instead, store copies under keys given by MCACHE_HotKeyDerive and read a random one of them.
+ *       	tracker is thread safe, and must be destroyed by MCACHE_HotKeyDestroy.
+ *       	a get of a tracked key costs O(1) under tracker lock, but an untracked key scans all nCapacity
+ *       	counters to evict the least counted one, so keep nCapacity to a few hundred keys.
+ */
+int
+MCACHE_HotKeyCreate(MemCacheHotKey **ppstHotKey, size_t nCapacity, size_t nThreshold, int nTTL);
+
+/**
+ * @fn		int MCACHE_HotKeyGet(MemCacheHotKey *pstHotKey, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize)
+ *
+ * @param	pstHotKey	pointer of tracker.
+ * @param	pstMCServer	pointer of server for getting data.
+ * @param	pstMCDataList	pointer of data list to hold key and stored fetched value.
+ * @param	nListSize	number of data in data list.
+ *
+ * @return	same as MCACHE_DataGet.
+ *
+ * @brief	same as MCACHE_DataGet, hits are counted by tracker and pinned data of hot keys is served locally.
+ */
+int
+MCACHE_HotKeyGet(MemCacheHotKey *pstHotKey, MemCacheServer *pstMCServer, MemCacheData *pstMCDataList, size_t nListSize);
+
+/**
+ * @fn		int MCACHE_HotKeyIsHot(MemCacheHotKey *pstHotKey, const char *pszKey)
+ *
+ * @param	pstHotKey	pointer of tracker.
+ * @param	pszKey		key to check.
+ *
+ * @return	1 if key is hot, 0 otherwise.
+ *
+ * @brief	tell whether recent gets of key exceed threshold of tracker, without counting a hit.
+ */
+int
+MCACHE_HotKeyIsHot(MemCacheHotKey *pstHotKey, const char *pszKey);
+
+/**
+ * @fn		int MCACHE_HotKeyInvalidate(MemCacheHotKey *pstHotKey, const char *pszKey)
+ *
+ * @param	pstHotKey	pointer of tracker.
+ * @param	pszKey		key whose local copy is dropped.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	drop local copy of key, e.g., after storing new data for it.
+ */
+int
+MCACHE_HotKeyInvalidate(MemCacheHotKey *pstHotKey, const char *pszKey);
+
+/**
+ * @fn		int MCACHE_HotKeyDerive(const char *pszKey, size_t nIndex, char *pszBuffer, size_t nBufferSize)
+ *
+ * @param	pszKey		key of hot data.
+ * @param	nIndex		index of copy, 0 for key itself.
+ * @param	pszBuffer	buffer to hold derived key.
+ * @param	nBufferSize	size of buffer.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_INVAL if derived key does not fit in buffer or exceeds MCACHE_KEY_MAX.
+ *
+ * @brief	derive key of nIndex-th copy of hot data ("key#index"), copies land on different servers when keys are
+ *       	distributed by hash.
+ */
+int
+MCACHE_HotKeyDerive(const char *pszKey, size_t nIndex, char *pszBuffer, size_t nBufferSize);
+
+/**
+ * @fn		int MCACHE_HotKeyDestroy(MemCacheHotKey *pstHotKey)
+ *
+ * @param	pstHotKey	pointer of tracker.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	free tracker and local copies.
+ */
+int
+MCACHE_HotKeyDestroy(MemCacheHotKey *pstHotKey);
+
+// Hash commands
+/**
+ * @fn		uint32_t MCACHE_HashCRC32C(const char *pKey, size_t nKeyLen)
+ *
+ * @param	pKey		key to hash.
+ * @param	nKeyLen		length of key.
+ *
+ * @return	CRC32C (Castagnoli) of key.
+ *
+ * @brief	hash key by CRC32C, computed by crc32 instruction of SSE4.2 when running cpu has it.
+ */
+uint32_t
+MCACHE_HashCRC32C(const char *pKey, size_t nKeyLen);
+
+/**
+ * @fn		uint64_t MCACHE_HashXXH3(const char *pKey, size_t nKeyLen)
+ *
+ * @param	pKey		key to hash.
+ * @param	nKeyLen		length of key.
+ *
+ * @return	64-bit xxh3 of key, same as XXH3_64bits() of xxHash.
+ */
+uint64_t
+MCACHE_HashXXH3(const char *pKey, size_t nKeyLen);
+
+/**
+ * @fn		uint32_t MCACHE_HashXXH3Low(const char *pKey, size_t nKeyLen)
+ *
+ * @param	pKey		key to hash.
+ * @param	nKeyLen		length of key.
+ *
+ * @return	low 32 bits of MCACHE_HashXXH3, for use as MemCacheHashFunc.
+ */
+uint32_t
+MCACHE_HashXXH3Low(const char *pKey, size_t nKeyLen);
+
+/**
+ * @fn		int MCACHE_HashKetamaPoints(const char *pKey, size_t nKeyLen, uint32_t *pnPoints)
+ *
+ * @param	pKey		key or server name (e.g., "10.0.0.1:11211-0") to hash.
+ * @param	nKeyLen		length of key.
+ * @param	pnPoints	array to hold 4 points.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	split MD5 digest of key into 4 continuum points the way ketama does, point i is made of bytes
+ *       	4 * i to 4 * i + 3 of digest in little endian order.
+ *
+ * @note	ketama places each server at 40 digests of "<host>:<port>-<n>", n in [0, 40) scaled by weight,
+ *       	and a key is served by first point not smaller than MCACHE_HashMD5 of key.
+ */
+int
+MCACHE_HashKetamaPoints(const char *pKey, size_t nKeyLen, uint32_t *pnPoints);
+
+/**
+ * @fn		uint32_t MCACHE_HashMD5(const char *pKey, size_t nKeyLen)
+ *
+ * @param	pKey		key to hash.
+ * @param	nKeyLen		length of key.
+ *
+ * @return	first ketama point of key, same as MD5 hash of libmemcached.
+ */
+uint32_t
+MCACHE_HashMD5(const char *pKey, size_t nKeyLen);
+
+/**
+ * @fn		MemCacheHashFunc MCACHE_HashFunction(int nAlgorithm)
+ *
+ * @param	nAlgorithm	MCACHE_HASH_CRC32C, MCACHE_HASH_XXH3 or MCACHE_HASH_MD5.
+ *
+ * @return	hash function of algorithm, NULL if unknown.
+ */
+MemCacheHashFunc
+MCACHE_HashFunction(int nAlgorithm);
+
+/**
+ * @fn		int MCACHE_HashBatch(int nAlgorithm, MemCacheData *pstMCDataList, size_t nListSize, uint32_t *pnHashList)
+ *
+ * @param	nAlgorithm	MCACHE_HASH_CRC32C, MCACHE_HASH_XXH3 or MCACHE_HASH_MD5.
+ * @param	pstMCDataList	pointer of data list whose keys are hashed.
+ * @param	nListSize	number of data in data list.
+ * @param	pnHashList	array to hold hash of each key.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	hash keys of whole data list, e.g., to route a multiget to servers.
+ */
+int
+MCACHE_HashBatch(int nAlgorithm, MemCacheData *pstMCDataList, size_t nListSize, uint32_t *pnHashList);
+
+// Metrics commands
+/**
+ * @fn		int MCACHE_ServerMetrics(MemCacheServer *pstMCServer, MemCacheMetrics *pstMetrics, int nReset)
+ *
+ * @param	pstMCServer	pointer of server whose metrics are enabled by MCACHE_ServerMetricsEnable.
+ * @param	pstMetrics	pointer to hold snapshot of metrics.
+ * @param	nReset		non zero to zero counters taken into snapshot.
+ *
+ * @return	MCACHE_OK for success, failure otherwise.
+ *
+ * @brief	sum metrics of all shards into pstMetrics, astOps is indexed by command as MCACHE_MetricsOpName tells.
+ *
+ * @note	each counter is read (and reset) atomically, so no request is lost or counted twice between snapshots,
+ *       	though counters of one request may land in different snapshots.
+ */
+int
+MCACHE_ServerMetrics(MemCacheServer *pstMCServer, MemCacheMetrics *pstMetrics, int nReset);
+
+/**
+ * @fn		uint64_t MCACHE_MetricsBucketBound(size_t nBucket)
+ *
+ * @param	nBucket		index of bucket of anLatencyHist.
+ *
+ * @return	exclusive upper bound of latency in microseconds counted by bucket, UINT64_MAX for last bucket.
+ *
+ * @brief	buckets 0-3 count 0-3 microseconds, later ones split every power of two into 4 equal buckets.
+ */
+uint64_t
+MCACHE_MetricsBucketBound(size_t nBucket);
+
+/**
+ * @fn		const char *MCACHE_MetricsOpName(size_t nOp)
+ *
+ * @param	nOp		index of astOps.
+ *
+ * @return	protocol name of command counted by astOps[nOp], NULL for unused index.
+ */
+const char *
+MCACHE_MetricsOpName(size_t nOp);
+
+/**
+ * @fn		int MCACHE_ServerMetricsFormat(MemCacheServer *pstMCServer, const MemCacheMetrics *pstMetrics, char *pszBuffer, size_t nBufferSize, size_t *pnLength)
+ *
+ * @param	pstMCServer	pointer of server labeling metrics.
+ * @param	pstMetrics	pointer of snapshot taken by MCACHE_ServerMetrics.
+ * @param	pszBuffer	buffer to hold text.
+ * @param	nBufferSize	size of buffer.
+ * @param	pnLength	pointer to hold length of text, without terminating '\0'.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOMEM if buffer is too small (*pnLength tells size needed less one),
+ *        	failure otherwise.
+ *
+ * @brief	write snapshot in Prometheus text exposition format, labeled by server "host:port", command and result.
+ *
+ * @note	commands never sent are left out, and only non empty latency buckets are listed besides "+Inf".
+ */
+int
+MCACHE_ServerMetricsFormat(MemCacheServer *pstMCServer, const MemCacheMetrics *pstMetrics, char *pszBuffer,
+	size_t nBufferSize, size_t *pnLength);
+
+// Stats commands
+/**
+ * @fn		int MCACHE_ServerStats(MemCacheServer *pstMCServer, MemCacheStats *pstMCStats)
+ *
+ * @param	pstMCServer	pointer of server.
+ * @param	pstMCStats	pointer of status.
+ *
+ * @return	MCACHE_OK for success, fail otherwise.
+ *
+ * @brief	get the status of server.
+ *
+ * @note	pszVersion, pszRUsageUser and pszRUsageSystem are duplicated by strdup and must be freed by caller.
+ *       	statistics without field in MemCacheStats are skipped, see MCACHE_ServerStatList for all of them.
+ */
+int
+MCACHE_ServerStats(MemCacheServer *pstMCServer, MemCacheStats *pstMCStats);
+
+/**
+ * @fn		int MCACHE_ServerStatList(MemCacheServer *pstMCServer, const char *pszGroup, MemCacheStatList *pstList)
+ *
+ * @param	pstMCServer	pointer of server.
+ * @param	pszGroup	NULL for general statistics, otherwise argument of "stats" command, e.g. "slabs", "items"
+ *        			or "settings".
+ * @param	pstList		pointer to hold statistics, must be released by MCACHE_StatListFree.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_ERROR if server does not know pszGroup, failure otherwise.
+ *
+ * @brief	fetch all statistics of pszGroup as name/value pairs in order of server.
+ *
+ * @note	reply is parsed in one pass, and array and all strings end up in one allocation.
+ *       	slab and item statistics are per class, named as "<class>:<field>" and "items:<class>:<field>",
+ *       	see MCACHE_StatListClassInt.
+ */
+int
+MCACHE_ServerStatList(MemCacheServer *pstMCServer, const char *pszGroup, MemCacheStatList *pstList);
+
+/**
+ * @fn		const char *MCACHE_StatListFind(const MemCacheStatList *pstList, const char *pszName)
+ *
+ * @param	pstList		pointer of statistics.
+ * @param	pszName		name of statistic.
+ *
+ * @return	value of statistic, NULL if not found.
+ */
+const char *
+MCACHE_StatListFind(const MemCacheStatList *pstList, const char *pszName);
+
+/**
+ * @fn		int MCACHE_StatListInt(const MemCacheStatList *pstList, const char *pszName, int64_t *pnValue)
+ *
+ * @param	pstList		pointer of statistics.
+ * @param	pszName		name of statistic.
+ * @param	pnValue		pointer to hold value.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND if there is no such statistic, MCACHE_ERR_DATA if value is
+ *        	not an integer, failure otherwise.
+ */
+int
+MCACHE_StatListInt(const MemCacheStatList *pstList, const char *pszName, int64_t *pnValue);
+
+/**
+ * @fn		int MCACHE_StatListDouble(const MemCacheStatList *pstList, const char *pszName, double *pdValue)
+ *
+ * @param	pstList		pointer of statistics.
+ * @param	pszName		name of statistic, e.g. "rusage_user".
+ * @param	pdValue		pointer to hold value.
+ *
+ * @return	MCACHE_OK for success, MCACHE_ERR_NOT_FOUND if there is no such statistic, MCACHE_ERR_DATA if value is
+ *        	not a number, failure otherwise.
+ */
+int
+MCACHE_StatListDouble(const MemCacheStatList *pstList, const char *pszName, double *pdValue);
+
+/**
+ * @fn		int MCACHE_StatListClassInt(const MemCacheStatList *pstList, const char *pszPrefix, size_t nClass, const char *pszField, int64_t *pnValue)
+ *
+ * @param	pstList		pointer of statistics.
+ * @param	pszPrefix	prefix of per class statistics, NULL for "stats slabs" and "items" for "stats items".
+ * @param	nClass		slab class.
+ * @param	pszField	field of class, e.g. "chunk_size" or "evicted".
+ * @param	pnValue		pointer to hold value.
+ *
+ * @return	same as MCACHE_StatListInt.
+ *
+ * @brief	get integer statistic of slab class, named "<nClass>:<pszField>" or "<pszPrefix>:<nClass>:<pszField>".
+ */
+int
+MCACHE_StatListClassInt(const MemCacheStatList *pstList, const char *pszPrefix, size_t nClass, const char *pszField,
+	int64_t *pnValue);
+
+/**
+ * @fn		void MCACHE_StatListFree(MemCacheStatList *pstList)
+ *
+ * @param	pstList		pointer of statistics filled by MCACHE_ServerStatList.
+ *
+ * @brief	release statistics, pstList is left empty.
+ */
+void
+MCACHE_StatListFree(MemCacheStatList *pstList);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,869 @@
+/**
+ * @file memcacheclient.hpp
+ *
+ * @brief header only C++17 wrapper of memcacheclient.h, servers, fetched values and stats are released by RAII.
+ *
+ */
+
+#ifndef __MEMCACHE_CLIENT_HPP_
+#define __MEMCACHE_CLIENT_HPP_
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "memcacheclient/memcacheclient.h"
+
+namespace mcache {
+
+template <typename T, typename C>
+class TypedCache;
+
+/**
+ * @brief	read only view of value bytes, like std::span<const char> of C++20.
+ *
+ * @note	built from pointer and length, C string, or any contiguous container of trivially copyable elements.
+ */
+class Bytes
+{
+public:
+	constexpr Bytes() noexcept = default;
+
+	constexpr Bytes(const void *pData, size_t nSize) noexcept
+		: data_(static_cast<const char *>(pData)), size_(nSize) {}
+
+	Bytes(const char *pszData) noexcept
+		: data_(pszData), size_(NULL == pszData ? 0 : std::strlen(pszData)) {}
+
+	template <typename C, typename T = std::remove_cv_t<std::remove_pointer_t<decltype(std::data(std::declval<const C &>()))>>,
+		typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
+	constexpr Bytes(const C &container) noexcept
+		: data_(reinterpret_cast<const char *>(std::data(container))), size_(std::size(container) * sizeof(T)) {}
+
+	constexpr const char *data() const noexcept { return data_; }
+	constexpr size_t size() const noexcept { return size_; }
+	constexpr bool empty() const noexcept { return 0 == size_; }
+	constexpr const char *begin() const noexcept { return data_; }
+	constexpr const char *end() const noexcept { return data_ + size_; }
+	constexpr operator std::string_view() const noexcept { return std::string_view(data_, size_); }
+
+private:
+	const char *data_ = nullptr;
+	size_t size_ = 0;
+};
+
+/**
+ * @brief	value fetched by Connection, owns buffer allocated by library and releases it by allocator of its server.
+ */
+class Value
+{
+public:
+	Value() noexcept = default;
+	Value(const Value &) = delete;
+	Value &operator=(const Value &) = delete;
+
+	Value(Value &&other) noexcept { *this = std::move(other); }
+
+	Value &operator=(Value &&other) noexcept
+	{
+		if (this != &other) {
+			Reset();
+			data_ = std::exchange(other.data_, nullptr);
+			size_ = std::exchange(other.size_, 0);
+			flags_ = other.flags_;
+			cas_ = other.cas_;
+			alloc_ = other.alloc_;
+		}
+
+		return *this;
+	}
+
+	~Value() { Reset(); }
+
+	/**
+	 * take over pDataValue of pstMCData, which was allocated by stAllocator of pstMCServer.
+	 */
+	void Adopt(MemCacheServer *pstMCServer, MemCacheData *pstMCData) noexcept
+	{
+		Reset();
+		data_ = std::exchange(pstMCData->pDataValue, nullptr);
+		size_ = pstMCData->nDataLen;
+		flags_ = pstMCData->nFlags;
+		cas_ = pstMCData->nCASUnique;
+		alloc_ = pstMCServer->stAllocator;
+	}
+
+	void Reset() noexcept
+	{
+		if (nullptr == data_)
+			return;
+
+		if (nullptr != alloc_.pfnFree)
+			alloc_.pfnFree(data_, alloc_.pContext);
+		else
+			std::free(data_);
+
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+	const char *data() const noexcept { return static_cast<const char *>(data_); }
+	size_t size() const noexcept { return size_; }
+	size_t flags() const noexcept { return flags_; }
+	int64_t cas() const noexcept { return cas_; }
+	std::string_view view() const noexcept { return std::string_view(data(), size_); }
+	Bytes bytes() const noexcept { return Bytes(data_, size_); }
+	explicit operator bool() const noexcept { return nullptr != data_; }
+
+private:
+	void *data_ = nullptr;		///< '\0' terminated by library
+	size_t size_ = 0;
+	size_t flags_ = 0;
+	int64_t cas_ = 0;
+	MemCacheAllocator alloc_ = {};
+};
+
+/**
+ * @brief	values of one multiget in order of requested keys, keys and values share one buffer.
+ *
+ * @note	reusing result across multigets keeps its buffers, so steady state gets allocate nothing per item.
+ */
+class MultiResult
+{
+public:
+	/**
+	 * @brief	view of one requested key, valid until result is reused or destroyed.
+	 */
+	struct Item
+	{
+		std::string_view key;
+		std::string_view value;
+		size_t flags;
+		int64_t cas;
+		bool found;
+	};
+
+	size_t size() const noexcept { return slots_.size(); }
+	bool empty() const noexcept { return slots_.empty(); }
+
+	Item operator[](size_t nIndex) const noexcept
+	{
+		const Slot &slot = slots_[nIndex];
+
+		return Item{ std::string_view(arena_.data() + slot.key_offset, slot.key_len),
+			std::string_view(arena_.data() + slot.value_offset, slot.value_len), slot.flags, slot.cas, slot.found };
+	}
+
+	/**
+	 * find item of key by scanning keys in request order, empty Item (found false) if key was not requested.
+	 */
+	Item Find(std::string_view key) const noexcept
+	{
+		for (size_t i = 0; i < slots_.size(); i++) {
+			if (key == std::string_view(arena_.data() + slots_[i].key_offset, slots_[i].key_len))
+				return (*this)[i];
+		}
+
+		return Item{ std::string_view(), std::string_view(), 0, 0, false };
+	}
+
+	size_t Found() const noexcept { return found_; }
+
+	void Clear() noexcept
+	{
+		slots_.clear();
+		arena_.clear();
+		list_.clear();
+		found_ = 0;
+	}
+
+private:
+	friend class Connection;
+
+	struct Slot
+	{
+		size_t key_offset;
+		size_t key_len;
+		size_t value_offset;
+		size_t value_len;
+		size_t flags;
+		int64_t cas;
+		bool found;
+	};
+
+	template <typename It>
+	int Prepare(It first, It last)
+	{
+		Clear();
+
+		try {
+			size_t count = std::distance(first, last);
+
+			list_.resize(count);
+			slots_.resize(count);
+
+			for (size_t i = 0; first != last; ++first, i++) {
+				std::string_view key(*first);
+
+				if (key.empty())
+					return MCACHE_ERR_INVAL;
+
+				std::memset(&list_[i], 0, sizeof(MemCacheData));
+				list_[i].pszDataKey = const_cast<char *>(key.data());
+				list_[i].nKeyLen = key.size();
+				slots_[i] = Slot{ 0, key.size(), 0, 0, 0, 0, false };
+			}
+		}
+		catch (const std::bad_alloc &) {
+			return MCACHE_ERR_NOMEM;
+		}
+
+		return MCACHE_OK;
+	}
+
+	/**
+	 * copy requested keys into arena once values are in, so list keeps pointing at caller keys while parsing.
+	 */
+	int Finish() noexcept
+	{
+		try {
+			for (size_t i = 0; i < list_.size(); i++) {
+				slots_[i].key_offset = arena_.size();
+				arena_.insert(arena_.end(), list_[i].pszDataKey, list_[i].pszDataKey + list_[i].nKeyLen);
+			}
+		}
+		catch (const std::bad_alloc &) {
+			return MCACHE_ERR_NOMEM;
+		}
+
+		return MCACHE_OK;
+	}
+
+	static int Hit(MemCacheData *pstMCData, const void *pValue, void *pArg) noexcept
+	{
+		MultiResult *result = static_cast<MultiResult *>(pArg);
+		Slot &slot = result->slots_[pstMCData - result->list_.data()];
+		const char *value = static_cast<const char *>(pValue);
+
+		try {
+			slot.value_offset = result->arena_.size();
+			result->arena_.insert(result->arena_.end(), value, value + pstMCData->nDataLen);
+		}
+		catch (const std::bad_alloc &) {
+			return MCACHE_ERR_NOMEM;
+		}
+
+		slot.value_len = pstMCData->nDataLen;
+		slot.flags = pstMCData->nFlags;
+		slot.cas = pstMCData->nCASUnique;
+		slot.found = true;
+		result->found_++;
+
+		return MCACHE_OK;
+	}
+
+	std::vector<MemCacheData> list_;
+	std::vector<Slot> slots_;
+	std::vector<char> arena_;
+	size_t found_ = 0;
+};
+
+/**
+ * @brief	server statistics, strings duplicated by MCACHE_ServerStats are freed on destruction.
+ */
+class Stats
+{
+public:
+	Stats() noexcept { std::memset(&stats_, 0, sizeof(stats_)); }
+	Stats(const Stats &) = delete;
+	Stats &operator=(const Stats &) = delete;
+
+	Stats(Stats &&other) noexcept : Stats() { *this = std::move(other); }
+
+	Stats &operator=(Stats &&other) noexcept
+	{
+		if (this != &other) {
+			Reset();
+			stats_ = other.stats_;
+			std::memset(&other.stats_, 0, sizeof(other.stats_));
+		}
+
+		return *this;
+	}
+
+	~Stats() { Reset(); }
+
+	void Reset() noexcept
+	{
+		std::free(stats_.pszVersion);
+		std::free(stats_.pszRUsageUser);
+		std::free(stats_.pszRUsageSystem);
+		std::memset(&stats_, 0, sizeof(stats_));
+	}
+
+	const MemCacheStats *operator->() const noexcept { return &stats_; }
+	const MemCacheStats &get() const noexcept { return stats_; }
+	MemCacheStats *raw() noexcept { return &stats_; }
+
+	std::string_view Version() const noexcept
+	{
+		return nullptr == stats_.pszVersion ? std::string_view() : std::string_view(stats_.pszVersion);
+	}
+
+private:
+	MemCacheStats stats_;
+};
+
+/**
+ * @brief	all statistics of one "stats" command as name/value pairs, released on destruction.
+ */
+class StatList
+{
+public:
+	StatList() noexcept { std::memset(&list_, 0, sizeof(list_)); }
+	StatList(const StatList &) = delete;
+	StatList &operator=(const StatList &) = delete;
+
+	StatList(StatList &&other) noexcept : StatList() { *this = std::move(other); }
+
+	StatList &operator=(StatList &&other) noexcept
+	{
+		if (this != &other) {
+			Reset();
+			list_ = other.list_;
+			std::memset(&other.list_, 0, sizeof(other.list_));
+		}
+
+		return *this;
+	}
+
+	~StatList() { Reset(); }
+
+	void Reset() noexcept { MCACHE_StatListFree(&list_); }
+
+	const MemCacheStat *begin() const noexcept { return list_.astStats; }
+	const MemCacheStat *end() const noexcept { return list_.astStats + list_.nCount; }
+	size_t size() const noexcept { return list_.nCount; }
+	MemCacheStatList *raw() noexcept { return &list_; }
+
+	std::string_view Find(const char *pszName) const noexcept
+	{
+		const char *value = MCACHE_StatListFind(&list_, pszName);
+
+		return nullptr == value ? std::string_view() : std::string_view(value);
+	}
+
+	int Int(const char *pszName, int64_t &nValue) const noexcept
+	{
+		return MCACHE_StatListInt(&list_, pszName, &nValue);
+	}
+
+	int Double(const char *pszName, double &dValue) const noexcept
+	{
+		return MCACHE_StatListDouble(&list_, pszName, &dValue);
+	}
+
+	int ClassInt(const char *pszPrefix, size_t nClass, const char *pszField, int64_t &nValue) const noexcept
+	{
+		return MCACHE_StatListClassInt(&list_, pszPrefix, nClass, pszField, &nValue);
+	}
+
+private:
+	MemCacheStatList list_;
+};
+
+/**
+ * @brief	move only connection to one memcached server, MemCacheServer is kept at a stable address so that
+ *       	counters, writers and replica sets may refer to it.
+ *
+ * @note	every call returns MCACHE_OK or MCACHE_ERR_* code of the underlying C function.
+ */
+class Connection
+{
+public:
+	Connection() noexcept = default;
+	Connection(const Connection &) = delete;
+	Connection &operator=(const Connection &) = delete;
+	Connection(Connection &&) noexcept = default;
+
+	Connection &operator=(Connection &&other) noexcept
+	{
+		if (this != &other) {
+			Close();
+			server_ = std::move(other.server_);
+		}
+
+		return *this;
+	}
+
+	~Connection() { Close(); }
+
+	int Open(const std::string &host, int nPort, int nTimeout, int nFlag = 0)
+	{
+		int ret = MCACHE_OK;
+
+		Close();
+
+		server_.reset(new (std::nothrow) MemCacheServer());
+
+		if (nullptr == server_)
+			return MCACHE_ERR_NOMEM;
+
+		if (MCACHE_OK != (ret = MCACHE_ServerInit(server_.get(), host.c_str(), nPort, nTimeout, nFlag)))
+			server_.reset();
+
+		return ret;
+	}
+
+	void Close() noexcept
+	{
+		if (nullptr == server_)
+			return;
+
+		if (0 <= server_->nSockFD)
+			MCACHE_ServerDisconnect(server_.get());
+
+		MCACHE_ServerDestroy(server_.get());
+		server_.reset();
+	}
+
+	bool IsOpen() const noexcept { return nullptr != server_; }
+	MemCacheServer *get() noexcept { return server_.get(); }
+
+	/**
+	 * allocator of fetched values and reply buffers, values already fetched keep the allocator they came from.
+	 */
+	int SetAllocator(const MemCacheAllocator &stAllocator) noexcept
+	{
+		if (nullptr == server_)
+			return MCACHE_ERR_INVAL;
+
+		server_->stAllocator = stAllocator;
+
+		return MCACHE_OK;
+	}
+
+	int Get(std::string_view key, Value &value) { return Fetch(key, value, MCACHE_DataGet); }
+	int Gets(std::string_view key, Value &value) { return Fetch(key, value, MCACHE_DataGets); }
+
+	/**
+	 * fetch keys of [first, last), anything convertible to std::string_view, into result in request order.
+	 */
+	template <typename It>
+	int Get(It first, It last, MultiResult &result) { return FetchMulti(first, last, result, MCACHE_DataGetEach); }
+
+	template <typename It>
+	int Gets(It first, It last, MultiResult &result) { return FetchMulti(first, last, result, MCACHE_DataGetsEach); }
+
+	int Get(std::initializer_list<std::string_view> keys, MultiResult &result)
+	{
+		return Get(keys.begin(), keys.end(), result);
+	}
+
+	int Gets(std::initializer_list<std::string_view> keys, MultiResult &result)
+	{
+		return Gets(keys.begin(), keys.end(), result);
+	}
+
+	int Set(std::string_view key, Bytes value, size_t nFlags = 0, size_t nExpiration = 0)
+	{
+		return Store(key, value, nFlags, nExpiration, 0, MCACHE_DataSet);
+	}
+
+	int Add(std::string_view key, Bytes value, size_t nFlags = 0, size_t nExpiration = 0)
+	{
+		return Store(key, value, nFlags, nExpiration, 0, MCACHE_DataAdd);
+	}
+
+	int Replace(std::string_view key, Bytes value, size_t nFlags = 0, size_t nExpiration = 0)
+	{
+		return Store(key, value, nFlags, nExpiration, 0, MCACHE_DataReplace);
+	}
+
+	int Append(std::string_view key, Bytes value)
+	{
+		return Store(key, value, 0, 0, 0, MCACHE_DataAppend);
+	}
+
+	int Prepend(std::string_view key, Bytes value)
+	{
+		return Store(key, value, 0, 0, 0, MCACHE_DataPrepend);
+	}
+
+	int CheckAndSet(std::string_view key, Bytes value, int64_t nCASUnique, size_t nFlags = 0, size_t nExpiration = 0)
+	{
+		return Store(key, value, nFlags, nExpiration, nCASUnique, MCACHE_DataCheckAndSet);
+	}
+
+	int Delete(std::string_view key, size_t nTime = 0)
+	{
+		MemCacheData data;
+
+		if (!Key(key, data))
+			return MCACHE_ERR_INVAL;
+
+		return MCACHE_DataDelete(server_.get(), &data, nTime);
+	}
+
+	int Touch(std::string_view key, size_t nExpiration)
+	{
+		MemCacheData data;
+
+		if (!Key(key, data))
+			return MCACHE_ERR_INVAL;
+
+		data.nExpiration = nExpiration;
+
+		return MCACHE_DataTouch(server_.get(), &data);
+	}
+
+	int Increment(std::string_view key, uint64_t nNum, uint64_t *pnValue = nullptr)
+	{
+		MemCacheData data;
+
+		if (!Key(key, data))
+			return MCACHE_ERR_INVAL;
+
+		return MCACHE_DataIncrementNum(server_.get(), &data, nNum, pnValue);
+	}
+
+	int Decrement(std::string_view key, uint64_t nNum, uint64_t *pnValue = nullptr)
+	{
+		MemCacheData data;
+
+		if (!Key(key, data))
+			return MCACHE_ERR_INVAL;
+
+		return MCACHE_DataDecrementNum(server_.get(), &data, nNum, pnValue);
+	}
+
+	int ServerStats(Stats &stats)
+	{
+		if (nullptr == server_)
+			return MCACHE_ERR_INVAL;
+
+		stats.Reset();
+
+		return MCACHE_ServerStats(server_.get(), stats.raw());
+	}
+
+	/**
+	 * @param	pszGroup	nullptr for general statistics, or "slabs", "items", "settings" and so on.
+	 */
+	int ServerStats(StatList &stats, const char *pszGroup = nullptr)
+	{
+		if (nullptr == server_)
+			return MCACHE_ERR_INVAL;
+
+		stats.Reset();
+
+		return MCACHE_ServerStatList(server_.get(), pszGroup, stats.raw());
+	}
+
+private:
+	template <typename T, typename C>
+	friend class TypedCache;
+
+	/**
+	 * point data at key, which needs no '\0' terminator.
+	 */
+	bool Key(std::string_view key, MemCacheData &data) const noexcept
+	{
+		std::memset(&data, 0, sizeof(data));
+
+		if (nullptr == server_ || key.empty())
+			return false;
+
+		data.pszDataKey = const_cast<char *>(key.data());
+		data.nKeyLen = key.size();
+
+		return true;
+	}
+
+	int Fetch(std::string_view key, Value &value, int (*pfnGet)(MemCacheServer *, MemCacheData *, size_t))
+	{
+		int ret = MCACHE_OK;
+		MemCacheData data;
+
+		value.Reset();
+
+		if (!Key(key, data))
+			return MCACHE_ERR_INVAL;
+
+		ret = pfnGet(server_.get(), &data, 1);
+
+		if (nullptr != data.pDataValue)
+			value.Adopt(server_.get(), &data);
+
+		return ret;
+	}
+
+	template <typename It>
+	int FetchMulti(It first, It last, MultiResult &result,
+		int (*pfnGet)(MemCacheServer *, MemCacheData *, size_t, MemCacheItemFunc, MemCacheItemFunc, void *))
+	{
+		int ret = MCACHE_OK;
+
+		if (nullptr == server_)
+			return MCACHE_ERR_INVAL;
+
+		if (MCACHE_OK != (ret = result.Prepare(first, last)) || result.list_.empty())
+			return ret;
+
+		ret = pfnGet(server_.get(), result.list_.data(), result.list_.size(), MultiResult::Hit, nullptr, &result);
+
+		if (MCACHE_OK != result.Finish())
+			return MCACHE_ERR_NOMEM;
+
+		return ret;
+	}
+
+	int Store(std::string_view key, Bytes value, size_t nFlags, size_t nExpiration, int64_t nCASUnique,
+		int (*pfnStore)(MemCacheServer *, MemCacheData *))
+	{
+		MemCacheData data;
+
+		if (!Key(key, data))
+			return MCACHE_ERR_INVAL;
+
+		data.pDataValue = const_cast<char *>(value.data());
+		data.nDataLen = value.size();
+		data.nFlags = nFlags;
+		data.nExpiration = nExpiration;
+		data.nCASUnique = nCASUnique;
+
+		return pfnStore(server_.get(), &data);
+	}
+
+	std::unique_ptr<MemCacheServer> server_;
+};
+
+template <typename T>
+inline constexpr bool kAlwaysFalse = false;
+
+/**
+ * @brief	type id and version of values of T, written into nFlags of stored data and checked on read.
+ *
+ * @note	must be specialized for every T stored through TypedCache other than arithmetic types, with kType unique
+ *       	among types sharing the same keys (below 0xff00, reserved for arithmetic types), and kVersion bumped
+ *       	whenever layout of T changes. there is no default, so that two types can not end up with one tag.
+ */
+template <typename T, typename Enable = void>
+struct TypeTag
+{
+	static_assert(kAlwaysFalse<T>, "specialize mcache::TypeTag<T> with kType and kVersion of T");
+};
+
+/**
+ * @brief	tag of arithmetic types, made of kind and size so that e.g. long and long long of one size match.
+ */
+template <typename T>
+struct TypeTag<T, std::enable_if_t<std::is_arithmetic_v<T>>>
+{
+	static constexpr uint16_t kType = 0xff00 | (std::is_same_v<T, bool> ? 0x80 : 0) |
+		(std::is_floating_point_v<T> ? 0x40 : 0) | (std::is_signed_v<T> ? 0x20 : 0) | sizeof(T);
+	static constexpr uint8_t kVersion = 0;
+};
+
+/**
+ * @brief	codec of T picked at compile time, raw copy of object for trivially copyable T.
+ *
+ * @note	specialize for other types with the same members, kRaw false:
+ *       	Size(value) bytes encoded value takes, Encode(value, pBuffer) writing exactly that many bytes, and
+ *       	Decode(pData, nSize, value) returning false for malformed data.
+ */
+template <typename T, typename Enable = void>
+struct Codec
+{
+	static_assert(std::is_trivially_copyable_v<T>, "specialize mcache::Codec for types not trivially copyable");
+
+	static constexpr bool kRaw = true;	///< encoded value is object representation, stored without copying
+
+	static size_t Size(const T &) noexcept { return sizeof(T); }
+	static void Encode(const T &value, char *pBuffer) noexcept { std::memcpy(pBuffer, &value, sizeof(T)); }
+
+	static bool Decode(const char *pData, size_t nSize, T &value) noexcept
+	{
+		if (sizeof(T) != nSize)
+			return false;
+
+		std::memcpy(&value, pData, sizeof(T));
+
+		return true;
+	}
+};
+
+/**
+ * @brief	values of T stored through Connection by codec C, tagged by TypeTag<T> in nFlags.
+ *
+ * @note	gets decode straight from receive buffer into destination objects, data of other type, version or size
+ *       	is reported as MCACHE_ERR_DATA rather than reinterpreted.
+ */
+template <typename T, typename C = Codec<T>>
+class TypedCache
+{
+public:
+	static constexpr size_t kMagic = 0xA5;	///< marks nFlags written by TypedCache
+	static constexpr size_t kFlags = kMagic << 24 | (size_t) TypeTag<T>::kType << 8 | TypeTag<T>::kVersion;
+	static constexpr size_t kStackSize = 256;	///< encoded values up to this size are built on stack
+
+	explicit TypedCache(Connection &conn) noexcept : conn_(conn) {}
+
+	int Set(std::string_view key, const T &value, size_t nExpiration = 0)
+	{
+		return Store(key, value, nExpiration, MCACHE_DataSet);
+	}
+
+	int Add(std::string_view key, const T &value, size_t nExpiration = 0)
+	{
+		return Store(key, value, nExpiration, MCACHE_DataAdd);
+	}
+
+	int Replace(std::string_view key, const T &value, size_t nExpiration = 0)
+	{
+		return Store(key, value, nExpiration, MCACHE_DataReplace);
+	}
+
+	/**
+	 * @return	MCACHE_OK, MCACHE_ERR_NOT_FOUND for data not found, MCACHE_ERR_DATA for data of other type, or
+	 *        	failure of underlying get.
+	 */
+	int Get(std::string_view key, T &value)
+	{
+		int ret = MCACHE_OK;
+		int status = MCACHE_ERR_NOT_FOUND;
+		MemCacheData data;
+		Batch batch = { &data, &value, &status };
+
+		if (!conn_.Key(key, data))
+			return MCACHE_ERR_INVAL;
+
+		ret = MCACHE_DataGetEach(conn_.get(), &data, 1, Hit, nullptr, &batch);
+
+		if (MCACHE_OK != ret && MCACHE_ERR_PARTIAL != ret)
+			return ret;
+
+		return status;
+	}
+
+	/**
+	 * fetch keys of [first, last) into pValues by one multiget, pnStatus (optional) holds result of each key as
+	 * Get returns it.
+	 *
+	 * @return	MCACHE_OK if all keys are decoded, MCACHE_ERR_PARTIAL if some are not, failure otherwise.
+	 */
+	template <typename It>
+	int Get(It first, It last, T *pValues, int *pnStatus = nullptr)
+	{
+		int ret = MCACHE_OK;
+		size_t i = 0;
+		size_t decoded = 0;
+		std::vector<MemCacheData> list;
+		std::vector<int> status;
+		Batch batch;
+
+		try {
+			list.resize(std::distance(first, last));
+			status.assign(list.size(), MCACHE_ERR_NOT_FOUND);
+		}
+		catch (const std::bad_alloc &) {
+			return MCACHE_ERR_NOMEM;
+		}
+
+		for (i = 0; first != last; ++first, i++) {
+			if (!conn_.Key(std::string_view(*first), list[i]))
+				return MCACHE_ERR_INVAL;
+		}
+
+		if (list.empty())
+			return MCACHE_OK;
+
+		batch = Batch{ list.data(), pValues, status.data() };
+		ret = MCACHE_DataGetEach(conn_.get(), list.data(), list.size(), Hit, nullptr, &batch);
+
+		for (i = 0; i < list.size(); i++) {
+			if (nullptr != pnStatus)
+				pnStatus[i] = status[i];
+
+			decoded += MCACHE_OK == status[i];
+		}
+
+		if (MCACHE_OK != ret && MCACHE_ERR_PARTIAL != ret)
+			return ret;
+
+		return list.size() == decoded ? MCACHE_OK : MCACHE_ERR_PARTIAL;
+	}
+
+private:
+	/**
+	 * data list with destination objects and status parallel to it.
+	 */
+	struct Batch
+	{
+		MemCacheData *list;
+		T *values;
+		int *status;
+	};
+
+	static int Hit(MemCacheData *pstMCData, const void *pValue, void *pArg) noexcept
+	{
+		Batch *batch = static_cast<Batch *>(pArg);
+		size_t idx = pstMCData - batch->list;
+
+		if (kFlags != pstMCData->nFlags ||
+			!C::Decode(static_cast<const char *>(pValue), pstMCData->nDataLen, batch->values[idx]))
+			batch->status[idx] = MCACHE_ERR_DATA;
+		else
+			batch->status[idx] = MCACHE_OK;
+
+		return MCACHE_OK;
+	}
+
+	int Store(std::string_view key, const T &value, size_t nExpiration,
+		int (*pfnStore)(MemCacheServer *, MemCacheData *))
+	{
+		MemCacheData data;
+		char stack[kStackSize];
+		std::vector<char> heap;
+
+		if (!conn_.Key(key, data))
+			return MCACHE_ERR_INVAL;
+
+		data.nFlags = kFlags;
+		data.nExpiration = nExpiration;
+		data.nDataLen = C::Size(value);
+
+		if constexpr (C::kRaw) {
+			data.pDataValue = const_cast<T *>(&value);
+		}
+		else {
+			if (kStackSize < data.nDataLen) {
+				try {
+					heap.resize(data.nDataLen);
+				}
+				catch (const std::bad_alloc &) {
+					return MCACHE_ERR_NOMEM;
+				}
+			}
+
+			data.pDataValue = kStackSize < data.nDataLen ? heap.data() : stack;
+			C::Encode(value, static_cast<char *>(data.pDataValue));
+		}
+
+		return pfnStore(conn_.get(), &data);
+	}
+
+	Connection &conn_;
+};
+
+} // namespace mcache
+
+#endif
@@ -1,7 +1,13 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
 
 #include "memcacheclient/memcacheclient.h"
 
@@ -11,6 +17,1805 @@ struct test
 	char name[20];
 };
 
+static int s_failed = 0;
+
+#define CHECK(expr)	s_Check((expr), #expr, __LINE__)
+
+static void
+s_Check(int nResult, const char *pszExpr, int nLine)
+{
+	if (!nResult) {
+		printf("FAIL (line %d): %s\n", nLine, pszExpr);
+		s_failed++;
+	}
+}
+
+/**
+ * known answers of CRC32C (RFC 3720), XXH3_64bits() of xxHash and MD5 digest split into ketama points.
+ */
+static void
+s_TestHash(void)
+{
+	char buf[512];
+	uint32_t points[4];
+	MemCacheData list[2];
+	uint32_t hashes[2];
+	int i = 0;
+
+	CHECK(0xe3069283 == MCACHE_HashCRC32C("123456789", 9));
+
+	memset(buf, 0, 32);
+	CHECK(0x8a9136aa == MCACHE_HashCRC32C(buf, 32));
+
+	memset(buf, 0xff, 32);
+	CHECK(0x62a8ab43 == MCACHE_HashCRC32C(buf, 32));
+
+	CHECK(0x2d06800538d394c2ULL == MCACHE_HashXXH3("", 0));
+	CHECK(0xe6c632b61e964e1fULL == MCACHE_HashXXH3("a", 1));
+	CHECK(0x78af5f94892f3950ULL == MCACHE_HashXXH3("abc", 3));
+	CHECK(0x62e29b4cad9e2ef6ULL == MCACHE_HashXXH3("12345678", 8));
+	CHECK(0x72dcb18b67a17dffULL == MCACHE_HashXXH3("123456789", 9));
+
+	for (i = 0; i < 100; i++)
+		buf[i] = "0123456789abcdef"[i % 16];
+	CHECK(0x8ab7dbd99e15c48fULL == MCACHE_HashXXH3(buf, 100));
+
+	memset(buf, 'a', 200);
+	CHECK(0xac2bd404bce6c995ULL == MCACHE_HashXXH3(buf, 200));
+
+	for (i = 0; i < 512; i++)
+		buf[i] = (char) i;
+	CHECK(0x1059105ad19bfa09ULL == MCACHE_HashXXH3(buf, 512));
+	CHECK((uint32_t) MCACHE_HashXXH3(buf, 512) == MCACHE_HashXXH3Low(buf, 512));
+
+	CHECK(MCACHE_OK == MCACHE_HashKetamaPoints("10.0.0.1:11211-0", 16, points));
+	CHECK(0x62092476 == points[0] && 0x0fe39fe2 == points[1] && 0x5c597f40 == points[2] && 0x77757e51 == points[3]);
+	CHECK(0x62092476 == MCACHE_HashMD5("10.0.0.1:11211-0", 16));
+
+	CHECK(MCACHE_OK == MCACHE_HashKetamaPoints("", 0, points));
+	CHECK(0xd98c1dd4 == points[0] && 0x04b2008f == points[1] && 0x980980e9 == points[2] && 0x7e42f8ec == points[3]);
+
+	memset(list, 0, sizeof(list));
+	list[0].pszDataKey = "123456789";
+	list[1].pszDataKey = "10.0.0.1:11211-0";
+
+	CHECK(MCACHE_OK == MCACHE_HashBatch(MCACHE_HASH_CRC32C, list, 2, hashes));
+	CHECK(0xe3069283 == hashes[0] && MCACHE_HashCRC32C(list[1].pszDataKey, 16) == hashes[1]);
+
+	CHECK(MCACHE_OK == MCACHE_HashBatch(MCACHE_HASH_MD5, list, 2, hashes));
+	CHECK(0x62092476 == hashes[1]);
+
+	CHECK(MCACHE_HashXXH3Low == MCACHE_HashFunction(MCACHE_HASH_XXH3));
+}
+
+/**
+ * size classes of MemCachePool are powers of two from 32 bytes to 64KB, freed blocks are reused by any size of
+ * their class and larger sizes bypass the pool.
+ */
+static void
+s_TestPool(void)
+{
+	MemCachePool *pool = NULL;
+	char *a = NULL;
+	char *b = NULL;
+	char *c = NULL;
+
+	CHECK(MCACHE_OK == MCACHE_PoolCreate(&pool, 1));
+	if (NULL == pool)
+		return;
+
+	a = MCACHE_PoolAlloc(1, pool);
+	CHECK(NULL != a && 0 == (uintptr_t) a % 16);
+	MCACHE_PoolFree(a, pool);
+	CHECK(a == (b = MCACHE_PoolAlloc(32, pool)));
+	MCACHE_PoolFree(b, pool);
+
+	a = MCACHE_PoolAlloc(33, pool);
+	memset(a, 'x', 64);
+	MCACHE_PoolFree(a, pool);
+	CHECK(a != (b = MCACHE_PoolAlloc(32, pool)));
+	CHECK(a != (c = MCACHE_PoolAlloc(65, pool)));
+	CHECK(a == MCACHE_PoolAlloc(64, pool));
+	MCACHE_PoolFree(a, pool);
+	MCACHE_PoolFree(b, pool);
+	MCACHE_PoolFree(c, pool);
+
+	a = MCACHE_PoolAlloc(65536, pool);
+	MCACHE_PoolFree(a, pool);
+	CHECK(a != (b = MCACHE_PoolAlloc(65537, pool)));
+	CHECK(a == (c = MCACHE_PoolAlloc(32769, pool)));
+	MCACHE_PoolFree(b, pool);
+	MCACHE_PoolFree(c, pool);
+
+	//only nMaxCached blocks are kept per class
+	a = MCACHE_PoolAlloc(100, pool);
+	b = MCACHE_PoolAlloc(100, pool);
+	MCACHE_PoolFree(a, pool);
+	MCACHE_PoolFree(b, pool);
+	CHECK(a == (c = MCACHE_PoolAlloc(128, pool)));
+	MCACHE_PoolFree(c, pool);
+	MCACHE_PoolFree(NULL, pool);
+
+	CHECK(MCACHE_OK == MCACHE_PoolDestroy(pool));
+}
+
+/**
+ * bucket of latency as counted into anLatencyHist, same rule as library.
+ */
+static size_t
+s_LatencyBucket(uint64_t nLatency)
+{
+	int exp = 0;
+	size_t bucket = 0;
+
+	if (4 > nLatency)
+		return nLatency;
+
+	exp = 63 - __builtin_clzll(nLatency);
+	bucket = (exp - 1) * 4 + ((nLatency >> (exp - 2)) & 3);
+
+	return MCACHE_METRIC_BUCKETS > bucket ? bucket : MCACHE_METRIC_BUCKETS - 1;
+}
+
+/**
+ * bounds of latency buckets are contiguous, and every latency lies below bound of its bucket.
+ */
+static void
+s_TestMetricsBucket(void)
+{
+	size_t i = 0;
+	uint64_t lower = 0;
+	uint64_t upper = 0;
+
+	CHECK(1 == MCACHE_MetricsBucketBound(0) && 4 == MCACHE_MetricsBucketBound(3));
+	CHECK(5 == MCACHE_MetricsBucketBound(4) && 10 == MCACHE_MetricsBucketBound(8));
+	CHECK(UINT64_MAX == MCACHE_MetricsBucketBound(MCACHE_METRIC_BUCKETS - 1));
+
+	for (i = 0; i < MCACHE_METRIC_BUCKETS - 1; i++) {
+		upper = MCACHE_MetricsBucketBound(i);
+
+		if (lower >= upper || i != s_LatencyBucket(lower) || i != s_LatencyBucket(upper - 1) ||
+			i + 1 != s_LatencyBucket(upper)) {
+			printf("FAIL bucket %zu [%llu, %llu)\n", i, (unsigned long long) lower, (unsigned long long) upper);
+			s_failed++;
+		}
+
+		lower = upper;
+	}
+
+	CHECK(MCACHE_METRIC_BUCKETS - 1 == s_LatencyBucket(lower));
+	CHECK(MCACHE_METRIC_BUCKETS - 1 == s_LatencyBucket(UINT64_MAX >> 1));
+}
+
+static char s_fake_host[] = "fake";
+
+/**
+ * connect server to one end of a socket pair, pszReply is queued as whole reply of peer on the other end, which
+ * is returned by pnPeer to read requests.
+ */
+static int
+s_FakeServer(MemCacheServer *pstServer, const char *pszReply, int *pnPeer)
+{
+	int fd[2];
+
+	memset(pstServer, 0, sizeof(MemCacheServer));
+
+	if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fd))
+		return MCACHE_ERR_NET;
+
+	if (strlen(pszReply) != (size_t) write(fd[1], pszReply, strlen(pszReply)) || 0 != shutdown(fd[1], SHUT_WR)) {
+		close(fd[0]);
+		close(fd[1]);
+		return MCACHE_ERR_NET;
+	}
+
+	pstServer->nSockFD = fd[0];
+	pstServer->pszServerAddr = s_fake_host;
+	pstServer->nPort = 11211;
+	pstServer->nTimeout = 1;
+	*pnPeer = fd[1];
+
+	return MCACHE_OK;
+}
+
+/**
+ * read requests already sent to fake server.
+ */
+static const char *
+s_FakeRequest(int nPeer)
+{
+	static char buf[1024];
+	ssize_t len = recv(nPeer, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+
+	buf[0 < len ? len : 0] = '\0';
+
+	return buf;
+}
+
+static void
+s_FakeClose(MemCacheServer *pstServer, int nPeer)
+{
+	if (0 <= pstServer->nSockFD)
+		close(pstServer->nSockFD);
+
+	close(nPeer);
+}
+
+#define FAKE_ITEMS	4096
+
+struct fakeItem
+{
+	char key[MCACHE_KEY_MAX + 1];
+	char *value;
+	size_t len;
+	size_t flags;
+	uint64_t cas;
+};
+
+struct fakeBuffer
+{
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+/**
+ * memcached serving text protocol on one end of a socket pair by its own thread, so requests of several rounds
+ * are answered as a server would. counters and items are guarded by lock.
+ */
+struct fakeServer
+{
+	int fd;
+	int delay;		///< microseconds before replies to one read are written
+	int reads;		///< reads returning requests
+	int commands;		///< commands served
+	int repeats;		///< keys stored twice by requests of one read
+	uint64_t cas;
+	uint64_t read_cas;	///< cas before requests of current read
+	const char *fail;	///< retrieval of this key is answered by SERVER_ERROR, NULL for none
+	size_t count;
+	struct fakeItem *items;
+	int (*hook)(struct fakeServer *fake, const char *line, void *arg);	///< called before each command, non-zero closes connection
+	void *arg;
+	pthread_t thread;
+	pthread_mutex_t lock;
+};
+
+static void
+s_FakeReserve(struct fakeBuffer *pstBuffer, size_t nLen)
+{
+	char *data = NULL;
+
+	if (pstBuffer->len + nLen > pstBuffer->size) {
+		if (NULL == (data = realloc(pstBuffer->data, 2 * (pstBuffer->len + nLen))))
+			abort();
+
+		pstBuffer->data = data;
+		pstBuffer->size = 2 * (pstBuffer->len + nLen);
+	}
+}
+
+static void
+s_FakeAppend(struct fakeBuffer *pstBuffer, const void *pData, size_t nLen)
+{
+	s_FakeReserve(pstBuffer, nLen);
+	memcpy(pstBuffer->data + pstBuffer->len, pData, nLen);
+	pstBuffer->len += nLen;
+}
+
+static void
+s_FakePrint(struct fakeBuffer *pstBuffer, const char *pszFormat, ...)
+{
+	char line[512];
+	int len = 0;
+	va_list args;
+
+	va_start(args, pszFormat);
+	len = vsnprintf(line, sizeof(line), pszFormat, args);
+	va_end(args);
+
+	s_FakeAppend(pstBuffer, line, len);
+}
+
+/**
+ * copy next word of line, 0 at end of line.
+ */
+static int
+s_FakeWord(const char **ppszLine, char *pszWord, size_t nSize)
+{
+	size_t len = 0;
+	const char *p = *ppszLine;
+
+	while (' ' == *p)
+		p++;
+
+	for (; '\0' != *p && ' ' != *p; p++) {
+		if (len + 1 < nSize)
+			pszWord[len++] = *p;
+	}
+
+	pszWord[len] = '\0';
+	*ppszLine = p;
+
+	return 0 < len;
+}
+
+static struct fakeItem *
+s_FakeFind(struct fakeServer *pstFake, const char *pszKey)
+{
+	size_t i = 0;
+
+	for (i = 0; i < pstFake->count; i++) {
+		if (0 == strcmp(pstFake->items[i].key, pszKey))
+			return pstFake->items + i;
+	}
+
+	return NULL;
+}
+
+/**
+ * store value of key as server does, lock must be held.
+ */
+static struct fakeItem *
+s_FakeStore(struct fakeServer *pstFake, const char *pszKey, const void *pValue, size_t nLen, size_t nFlags)
+{
+	char *value = NULL;
+	struct fakeItem *item = s_FakeFind(pstFake, pszKey);
+
+	if (NULL == item) {
+		if (FAKE_ITEMS == pstFake->count)
+			return NULL;
+
+		item = pstFake->items + pstFake->count++;
+		snprintf(item->key, sizeof(item->key), "%s", pszKey);
+		item->value = NULL;
+	}
+
+	if (NULL == (value = malloc(nLen + 1)))
+		abort();
+
+	memcpy(value, pValue, nLen);
+	value[nLen] = '\0';
+	free(item->value);
+	item->value = value;
+	item->len = nLen;
+	item->flags = nFlags;
+	item->cas = ++pstFake->cas;
+
+	return item;
+}
+
+static void
+s_FakeRemove(struct fakeServer *pstFake, struct fakeItem *pstItem)
+{
+	free(pstItem->value);
+	*pstItem = pstFake->items[--pstFake->count];
+}
+
+/**
+ * serve one command whose data block (for storage commands) follows, lock must be held.
+ */
+static void
+s_FakeCommand(struct fakeServer *pstFake, const char *pszLine, const char *pData, size_t nBytes, struct fakeBuffer *pstOut)
+{
+	char cmd[16];
+	char key[MCACHE_KEY_MAX + 1];
+	char word[32];
+	char num[32];
+	const char *p = pszLine;
+	int noreply = NULL != strstr(pszLine, " noreply");
+	size_t flags = 0;
+	uint64_t value = 0;
+	uint64_t delta = 0;
+	unsigned long long cas = 0;
+	struct fakeItem *item = NULL;
+	struct fakeBuffer reply = { NULL, 0, 0 };
+
+	s_FakeWord(&p, cmd, sizeof(cmd));
+
+	if (0 == strcmp("get", cmd) || 0 == strcmp("gets", cmd) || 0 == strcmp("gat", cmd) || 0 == strcmp("gats", cmd)) {
+		size_t start = pstOut->len;
+
+		if ('a' == cmd[1])
+			s_FakeWord(&p, word, sizeof(word));
+
+		while (s_FakeWord(&p, key, sizeof(key))) {
+			if (NULL != pstFake->fail && 0 == strcmp(pstFake->fail, key)) {
+				pstOut->len = start;
+				s_FakeAppend(pstOut, "SERVER_ERROR out of memory\r\n", 28);
+				return;
+			}
+
+			if (NULL == (item = s_FakeFind(pstFake, key)))
+				continue;
+
+			if ('s' == cmd[strlen(cmd) - 1])
+				s_FakePrint(pstOut, "VALUE %s %zu %zu %llu\r\n", key, item->flags, item->len, (unsigned long long) item->cas);
+			else
+				s_FakePrint(pstOut, "VALUE %s %zu %zu\r\n", key, item->flags, item->len);
+
+			s_FakeAppend(pstOut, item->value, item->len);
+			s_FakeAppend(pstOut, "\r\n", 2);
+		}
+
+		s_FakeAppend(pstOut, "END\r\n", 5);
+		return;
+	}
+
+	s_FakeWord(&p, key, sizeof(key));
+	item = s_FakeFind(pstFake, key);
+
+	if (NULL != pData) {
+		s_FakeWord(&p, word, sizeof(word));
+		flags = strtoul(word, NULL, 10);
+		s_FakeWord(&p, word, sizeof(word));
+		s_FakeWord(&p, word, sizeof(word));
+
+		if (0 == strcmp("cas", cmd)) {
+			s_FakeWord(&p, word, sizeof(word));
+			cas = strtoull(word, NULL, 10);
+		}
+
+		if ((0 == strcmp("add", cmd) && NULL != item) ||
+			(0 != strcmp("set", cmd) && 0 != strcmp("add", cmd) && 0 != strcmp("cas", cmd) && NULL == item)) {
+			s_FakePrint(&reply, "NOT_STORED\r\n");
+		}
+		else if (0 == strcmp("cas", cmd) && NULL == item) {
+			s_FakePrint(&reply, "NOT_FOUND\r\n");
+		}
+		else if (0 == strcmp("cas", cmd) && cas != item->cas) {
+			s_FakePrint(&reply, "EXISTS\r\n");
+		}
+		else if (0 == strcmp("append", cmd) || 0 == strcmp("prepend", cmd)) {
+			s_FakeAppend(&reply, 'a' == cmd[0] ? item->value : pData, 'a' == cmd[0] ? item->len : nBytes);
+			s_FakeAppend(&reply, 'a' == cmd[0] ? pData : item->value, 'a' == cmd[0] ? nBytes : item->len);
+			s_FakeStore(pstFake, key, reply.data, reply.len, item->flags);
+			reply.len = 0;
+			s_FakePrint(&reply, "STORED\r\n");
+		}
+		else {
+			if (NULL != item && item->cas > pstFake->read_cas)
+				pstFake->repeats++;
+
+			s_FakeStore(pstFake, key, pData, nBytes, flags);
+			s_FakePrint(&reply, "STORED\r\n");
+		}
+	}
+	else if (0 == strcmp("incr", cmd) || 0 == strcmp("decr", cmd)) {
+		s_FakeWord(&p, word, sizeof(word));
+		delta = strtoull(word, NULL, 10);
+
+		if (NULL == item) {
+			s_FakePrint(&reply, "NOT_FOUND\r\n");
+		}
+		else {
+			value = strtoull(item->value, NULL, 10);
+			value = 'i' == cmd[0] ? value + delta : (value > delta ? value - delta : 0);
+			snprintf(num, sizeof(num), "%llu", (unsigned long long) value);
+			s_FakeStore(pstFake, key, num, strlen(num), item->flags);
+			s_FakePrint(&reply, "%s\r\n", num);
+		}
+	}
+	else if (0 == strcmp("delete", cmd)) {
+		if (NULL != item)
+			s_FakeRemove(pstFake, item);
+
+		s_FakePrint(&reply, NULL != item ? "DELETED\r\n" : "NOT_FOUND\r\n");
+	}
+	else if (0 == strcmp("touch", cmd)) {
+		s_FakePrint(&reply, NULL != item ? "TOUCHED\r\n" : "NOT_FOUND\r\n");
+	}
+	else if (0 == strcmp("stats", cmd)) {
+		s_FakePrint(&reply, "STAT pid 1\r\nEND\r\n");
+	}
+	else {
+		s_FakePrint(&reply, "ERROR\r\n");
+	}
+
+	if (!noreply)
+		s_FakeAppend(pstOut, reply.data, reply.len);
+
+	free(reply.data);
+}
+
+static void *
+s_FakeThread(void *pArg)
+{
+	char cmd[16];
+	char *eol = NULL;
+	char *line = NULL;
+	int closed = 0;
+	int storage = 0;
+	size_t pos = 0;
+	size_t line_len = 0;
+	size_t bytes = 0;
+	ssize_t len = 0;
+	struct fakeServer *fake = (struct fakeServer *) pArg;
+	struct fakeBuffer in = { NULL, 0, 0 };
+	struct fakeBuffer out = { NULL, 0, 0 };
+
+	while (!closed) {
+		s_FakeReserve(&in, 65536);
+
+		if (0 >= (len = read(fake->fd, in.data + in.len, in.size - in.len)))
+			break;
+
+		in.len += len;
+		pos = 0;
+		pthread_mutex_lock(&fake->lock);
+		fake->reads++;
+		fake->read_cas = fake->cas;
+
+		while (!closed && NULL != (eol = memmem(in.data + pos, in.len - pos, "\r\n", 2))) {
+			line_len = eol - (in.data + pos);
+			bytes = 0;
+
+			if (NULL == (line = strndup(in.data + pos, line_len)))
+				abort();
+
+			//storage command waits for its whole data block
+			cmd[0] = '\0';
+			sscanf(line, "%15s", cmd);
+			storage = 0 == strcmp("set", cmd) || 0 == strcmp("add", cmd) || 0 == strcmp("replace", cmd) ||
+				0 == strcmp("append", cmd) || 0 == strcmp("prepend", cmd) || 0 == strcmp("cas", cmd);
+
+			if (storage && (1 != sscanf(line, "%*s %*s %*s %*s %zu", &bytes) ||
+				in.len - pos < line_len + 2 + bytes + 2)) {
+				free(line);
+				break;
+			}
+
+			if (NULL != fake->hook && 0 != fake->hook(fake, line, fake->arg)) {
+				closed = 1;
+			}
+			else {
+				s_FakeCommand(fake, line, storage ? eol + 2 : NULL, bytes, &out);
+				fake->commands++;
+			}
+
+			pos += line_len + 2 + (storage ? bytes + 2 : 0);
+			free(line);
+		}
+
+		pthread_mutex_unlock(&fake->lock);
+
+		memmove(in.data, in.data + pos, in.len - pos);
+		in.len -= pos;
+
+		if (0 < out.len) {
+			if (0 < fake->delay)
+				usleep(fake->delay);
+
+			if (out.len != (size_t) write(fake->fd, out.data, out.len))
+				break;
+
+			out.len = 0;
+		}
+	}
+
+	shutdown(fake->fd, SHUT_RDWR);
+	free(in.data);
+	free(out.data);
+
+	return NULL;
+}
+
+/**
+ * start fake server and connect server to it. server points to unreachable 127.0.0.1:1, so it cannot reconnect.
+ */
+static int
+s_FakeStart(struct fakeServer *pstFake, MemCacheServer *pstServer)
+{
+	int fd[2];
+
+	memset(pstFake, 0, sizeof(struct fakeServer));
+	memset(pstServer, 0, sizeof(MemCacheServer));
+
+	if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fd))
+		return MCACHE_ERR_NET;
+
+	if (NULL == (pstFake->items = calloc(FAKE_ITEMS, sizeof(struct fakeItem)))) {
+		close(fd[0]);
+		close(fd[1]);
+		return MCACHE_ERR_NOMEM;
+	}
+
+	pstFake->fd = fd[1];
+	pthread_mutex_init(&pstFake->lock, NULL);
+
+	if (0 != pthread_create(&pstFake->thread, NULL, s_FakeThread, pstFake)) {
+		pthread_mutex_destroy(&pstFake->lock);
+		free(pstFake->items);
+		close(fd[0]);
+		close(fd[1]);
+		return MCACHE_ERR_NOMEM;
+	}
+
+	pstServer->nSockFD = fd[0];
+	pstServer->pszServerAddr = strdup("127.0.0.1");
+	pstServer->nPort = 1;
+	pstServer->nTimeout = 1;
+
+	return MCACHE_OK;
+}
+
+/**
+ * destroy server and stop fake server.
+ */
+static void
+s_FakeStop(struct fakeServer *pstFake, MemCacheServer *pstServer)
+{
+	size_t i = 0;
+
+	MCACHE_ServerDisconnect(pstServer);
+	MCACHE_ServerDestroy(pstServer);
+	shutdown(pstFake->fd, SHUT_RDWR);
+	pthread_join(pstFake->thread, NULL);
+	close(pstFake->fd);
+
+	for (i = 0; i < pstFake->count; i++)
+		free(pstFake->items[i].value);
+
+	free(pstFake->items);
+	pthread_mutex_destroy(&pstFake->lock);
+}
+
+/**
+ * value of key held by fake server, NULL if missing.
+ */
+static const char *
+s_FakeValue(struct fakeServer *pstFake, const char *pszKey)
+{
+	const char *value = NULL;
+	struct fakeItem *item = NULL;
+
+	pthread_mutex_lock(&pstFake->lock);
+	if (NULL != (item = s_FakeFind(pstFake, pszKey)))
+		value = item->value;
+	pthread_mutex_unlock(&pstFake->lock);
+
+	return value;
+}
+
+/**
+ * statistics are parsed into list and typed fields, malformed reply closes connection.
+ */
+static void
+s_TestStats(void)
+{
+	int peer = -1;
+	int64_t num = 0;
+	double real = 0;
+	MemCacheServer server;
+	MemCacheStats stats;
+	MemCacheStatList list;
+
+	if (MCACHE_OK != s_FakeServer(&server, "STAT pid 42\r\nSTAT rusage_user 0.500000\r\nSTAT version 1.6.21\r\n"
+		"STAT 1:chunk_size 96\r\nSTAT items:1:evicted 7\r\nSTAT name two words\r\nEND\r\n", &peer))
+		return;
+
+	CHECK(MCACHE_OK == MCACHE_ServerStatList(&server, "slabs", &list));
+	CHECK(0 == strcmp("stats slabs\r\n", s_FakeRequest(peer)));
+	CHECK(6 == list.nCount && 0 == strcmp("pid", list.astStats[0].pszName));
+	CHECK(0 == strcmp("1.6.21", MCACHE_StatListFind(&list, "version")));
+	CHECK(0 == strcmp("two words", MCACHE_StatListFind(&list, "name")));
+	CHECK(NULL == MCACHE_StatListFind(&list, "missing"));
+	CHECK(MCACHE_OK == MCACHE_StatListInt(&list, "pid", &num) && 42 == num);
+	CHECK(MCACHE_OK == MCACHE_StatListDouble(&list, "rusage_user", &real) && 0.5 == real);
+	CHECK(MCACHE_OK == MCACHE_StatListClassInt(&list, NULL, 1, "chunk_size", &num) && 96 == num);
+	CHECK(MCACHE_OK == MCACHE_StatListClassInt(&list, "items", 1, "evicted", &num) && 7 == num);
+	CHECK(MCACHE_ERR_NOT_FOUND == MCACHE_StatListClassInt(&list, "items", 2, "evicted", &num));
+	CHECK(MCACHE_ERR_DATA == MCACHE_StatListInt(&list, "version", &num));
+	CHECK(MCACHE_ERR_NOT_FOUND == MCACHE_StatListInt(&list, "missing", &num));
+	MCACHE_StatListFree(&list);
+	s_FakeClose(&server, peer);
+
+	if (MCACHE_OK != s_FakeServer(&server, "STAT pid 42\r\nSTAT curr_items 3\r\nSTAT version 1.6.21\r\nEND\r\n", &peer))
+		return;
+
+	memset(&stats, 0, sizeof(MemCacheStats));
+	CHECK(MCACHE_OK == MCACHE_ServerStats(&server, &stats));
+	CHECK(42 == stats.nPid && 3 == stats.nCurrentItems);
+	CHECK(NULL != stats.pszVersion && 0 == strcmp("1.6.21", stats.pszVersion));
+	free(stats.pszVersion);
+	s_FakeClose(&server, peer);
+
+	//server rejecting group keeps connection, malformed line closes it
+	if (MCACHE_OK != s_FakeServer(&server, "ERROR\r\n", &peer))
+		return;
+
+	CHECK(MCACHE_ERR_ERROR == MCACHE_ServerStatList(&server, "bogus", &list));
+	CHECK(0 <= server.nSockFD);
+	s_FakeClose(&server, peer);
+
+	if (MCACHE_OK != s_FakeServer(&server, "STAT pid 42\r\nJUNK\r\nSTAT uptime 1\r\nEND\r\n", &peer))
+		return;
+
+	CHECK(MCACHE_ERR_DATA == MCACHE_ServerStatList(&server, NULL, &list));
+	CHECK(0 > server.nSockFD);
+	s_FakeClose(&server, peer);
+}
+
+/**
+ * deltas of counter are sent by one flush, those not acknowledged for connection failure are sent by next one.
+ */
+static void
+s_TestCounter(void)
+{
+	int peer = -1;
+	const char *request = NULL;
+	MemCacheServer server;
+	MemCacheCounter *counter = NULL;
+
+	if (MCACHE_OK != s_FakeServer(&server, "11\r\n", &peer))
+		return;
+
+	CHECK(MCACHE_OK == MCACHE_CounterCreate(&counter, &server, 0, 0));
+	if (NULL == counter) {
+		s_FakeClose(&server, peer);
+		return;
+	}
+
+	CHECK(MCACHE_OK == MCACHE_CounterAdd(counter, "ka", 1));
+	CHECK(MCACHE_OK == MCACHE_CounterAdd(counter, "kb", 2));
+	CHECK(MCACHE_OK == MCACHE_CounterAdd(counter, "ka", 9));
+
+	//reply of "ka" is read before connection drops, only "kb" is left
+	CHECK(MCACHE_OK != MCACHE_CounterFlush(counter));
+	request = s_FakeRequest(peer);
+	CHECK(NULL != strstr(request, "incr ka 10\r\n") && NULL != strstr(request, "incr kb 2\r\n"));
+	s_FakeClose(&server, peer);
+
+	if (MCACHE_OK != s_FakeServer(&server, "12\r\n", &peer))
+		return;
+
+	CHECK(MCACHE_OK == MCACHE_CounterFlush(counter));
+	CHECK(0 == strcmp("incr kb 2\r\n", s_FakeRequest(peer)));
+
+	CHECK(MCACHE_OK == MCACHE_CounterDestroy(counter));
+	s_FakeClose(&server, peer);
+}
+
+/**
+ * fake server hook holding command starting with command until gate is opened.
+ */
+struct fakeGate
+{
+	const char *command;
+	int arrived;
+	int open;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void
+s_GateInit(struct fakeGate *pstGate, const char *pszCommand)
+{
+	memset(pstGate, 0, sizeof(struct fakeGate));
+	pstGate->command = pszCommand;
+	pthread_mutex_init(&pstGate->lock, NULL);
+	pthread_cond_init(&pstGate->cond, NULL);
+}
+
+static int
+s_GateHook(struct fakeServer *pstFake, const char *pszLine, void *pArg)
+{
+	struct fakeGate *gate = (struct fakeGate *) pArg;
+
+	if (0 == strncmp(gate->command, pszLine, strlen(gate->command))) {
+		pthread_mutex_lock(&gate->lock);
+		gate->arrived = 1;
+		pthread_cond_broadcast(&gate->cond);
+
+		while (!gate->open)
+			pthread_cond_wait(&gate->cond, &gate->lock);
+
+		pthread_mutex_unlock(&gate->lock);
+	}
+
+	return 0;
+}
+
+/**
+ * wait until command has reached gate.
+ */
+static void
+s_GateWait(struct fakeGate *pstGate)
+{
+	pthread_mutex_lock(&pstGate->lock);
+	while (!pstGate->arrived)
+		pthread_cond_wait(&pstGate->cond, &pstGate->lock);
+	pthread_mutex_unlock(&pstGate->lock);
+}
+
+static void *
+s_GateOpen(void *pArg)
+{
+	struct fakeGate *gate = (struct fakeGate *) pArg;
+
+	pthread_mutex_lock(&gate->lock);
+	gate->open = 1;
+	pthread_cond_broadcast(&gate->cond);
+	pthread_mutex_unlock(&gate->lock);
+
+	return NULL;
+}
+
+static void
+s_GateDestroy(struct fakeGate *pstGate)
+{
+	pthread_mutex_destroy(&pstGate->lock);
+	pthread_cond_destroy(&pstGate->cond);
+}
+
+/**
+ * "add" of key created by another client in between, so that counter falls back to "incr".
+ */
+static int
+s_CounterRace(struct fakeServer *pstFake, const char *pszLine, void *pArg)
+{
+	if (0 == strncmp("add cb ", pszLine, 7) && NULL == s_FakeFind(pstFake, "cb"))
+		s_FakeStore(pstFake, "cb", "10", 2, 0);
+
+	return 0;
+}
+
+/**
+ * flush of existing and missing keys allocates nothing for replies, missing keys are added and a raced add is
+ * retried by incr.
+ */
+static void
+s_TestCounterFlush(void)
+{
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCacheCounter *counter = NULL;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	server.nFlag = MCACHE_FLAG_FREE_VALUE;
+	fake.hook = s_CounterRace;
+	pthread_mutex_lock(&fake.lock);
+	s_FakeStore(&fake, "ca", "5", 1, 0);
+	pthread_mutex_unlock(&fake.lock);
+
+	CHECK(MCACHE_OK == MCACHE_CounterCreate(&counter, &server, 0, 0));
+	if (NULL == counter) {
+		s_FakeStop(&fake, &server);
+		return;
+	}
+
+	CHECK(MCACHE_OK == MCACHE_CounterAdd(counter, "ca", 3));
+	CHECK(MCACHE_OK == MCACHE_CounterAdd(counter, "cb", 4));
+	CHECK(MCACHE_OK == MCACHE_CounterAdd(counter, "cc", -2));
+	CHECK(MCACHE_OK == MCACHE_CounterFlush(counter));
+	CHECK(0 == strcmp("8", s_FakeValue(&fake, "ca")));
+	CHECK(0 == strcmp("14", s_FakeValue(&fake, "cb")));
+	CHECK(0 == strcmp("0", s_FakeValue(&fake, "cc")));
+
+	//incr of ca and cb, add of cb and cc, incr of cb
+	CHECK(6 == fake.commands);
+
+	CHECK(MCACHE_OK == MCACHE_CounterAdd(counter, "ca", 1));
+	CHECK(MCACHE_OK == MCACHE_CounterDestroy(counter));
+	CHECK(0 == strcmp("9", s_FakeValue(&fake, "ca")));
+
+	s_FakeStop(&fake, &server);
+}
+
+/**
+ * start fake servers of replica set, each holding pszKey with value "v1".
+ */
+static int
+s_FakeReplicas(struct fakeServer *pstFakes, MemCacheServer *pstServers, size_t nCount, const char *pszKey)
+{
+	size_t i = 0;
+
+	for (i = 0; i < nCount; i++) {
+		if (MCACHE_OK != s_FakeStart(pstFakes + i, pstServers + i)) {
+			while (0 < i--)
+				s_FakeStop(pstFakes + i, pstServers + i);
+
+			return MCACHE_ERR_NET;
+		}
+
+		pthread_mutex_lock(&pstFakes[i].lock);
+		s_FakeStore(pstFakes + i, pszKey, "v1", 2, 0);
+		pthread_mutex_unlock(&pstFakes[i].lock);
+	}
+
+	return MCACHE_OK;
+}
+
+/**
+ * value of key fetched from one server of replica set, so that "noreply" writes sent before are served first.
+ */
+static int
+s_ServerHolds(MemCacheServer *pstServer, const char *pszKey, const char *pszValue)
+{
+	int found = 0;
+	MemCacheData data;
+
+	memset(&data, 0, sizeof(MemCacheData));
+	data.pszDataKey = (char *) pszKey;
+
+	if (MCACHE_OK == MCACHE_DataGet(pstServer, &data, 1)) {
+		found = strlen(pszValue) == data.nDataLen && 0 == memcmp(pszValue, data.pDataValue, data.nDataLen);
+		MCACHE_DataFree(&data);
+	}
+
+	return found;
+}
+
+/**
+ * write right after a hedged get still reaches replica whose reply of lost get is pending.
+ */
+static void
+s_TestReplicaHedge(int nAck)
+{
+	size_t i = 0;
+	struct fakeServer fakes[2];
+	MemCacheServer servers[2];
+	MemCacheServer *list[2] = { servers, servers + 1 };
+	MemCacheReplicaSet set;
+	MemCacheData data;
+
+	if (MCACHE_OK != s_FakeReplicas(fakes, servers, 2, "rk"))
+		return;
+
+	//first replica is slow, so hedge to second one wins
+	fakes[0].delay = 200000;
+	CHECK(MCACHE_OK == MCACHE_ReplicaInit(&set, list, 2, nAck));
+	set.nSelect = MCACHE_SELECT_LEAST;
+	set.nHedgeDelay = 20000;
+
+	memset(&data, 0, sizeof(MemCacheData));
+	data.pszDataKey = "rk";
+	CHECK(MCACHE_OK == MCACHE_ReplicaDataGet(&set, &data, 1));
+	CHECK(1 == set.nHedgeWins && 1 == servers[0].nDiscard);
+	MCACHE_DataFree(&data);
+
+	data.pDataValue = "v2";
+	data.nDataLen = 2;
+	CHECK(MCACHE_OK == MCACHE_ReplicaDataSet(&set, &data));
+	CHECK(0 == servers[0].nDiscard);
+	CHECK(s_ServerHolds(servers, "rk", "v2"));
+	CHECK(s_ServerHolds(servers + 1, "rk", "v2"));
+
+	for (i = 0; i < 2; i++)
+		s_FakeStop(fakes + i, servers + i);
+}
+
+/**
+ * command of key "uk" seen by fake server before which another client stores value (or deletes key if NULL).
+ */
+struct updateRace
+{
+	const char *command;
+	int remaining;
+	const char *value;
+};
+
+static int
+s_UpdateRace(struct fakeServer *pstFake, const char *pszLine, void *pArg)
+{
+	struct updateRace *race = (struct updateRace *) pArg;
+	struct fakeItem *item = NULL;
+
+	if (0 < race->remaining && 0 == strncmp(race->command, pszLine, strlen(race->command))) {
+		race->remaining--;
+
+		if (NULL != race->value)
+			s_FakeStore(pstFake, "uk", race->value, strlen(race->value), 0);
+		else if (NULL != (item = s_FakeFind(pstFake, "uk")))
+			s_FakeRemove(pstFake, item);
+	}
+
+	return 0;
+}
+
+/**
+ * append "+" to current value into buffer of pArg.
+ */
+static int
+s_UpdateAppend(MemCacheData *pstMCData, const void *pValue, void *pArg)
+{
+	char *buffer = (char *) pArg;
+	size_t len = NULL != pValue ? pstMCData->nDataLen : 0;
+
+	if (30 < len)
+		return MCACHE_ERR_INVAL;
+
+	memcpy(buffer, pValue, len);
+	buffer[len] = '+';
+	pstMCData->pDataValue = buffer;
+	pstMCData->nDataLen = len + 1;
+
+	return MCACHE_OK;
+}
+
+/**
+ * update losing a race retries with value fetched behind its "cas", and reports the last race lost once retries
+ * are exhausted.
+ */
+static void
+s_TestUpdate(void)
+{
+	char buffer[32];
+	struct updateRace race = { "cas uk ", 1, "x" };
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCacheData data;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	fake.hook = s_UpdateRace;
+	fake.arg = &race;
+	pthread_mutex_lock(&fake.lock);
+	s_FakeStore(&fake, "uk", "a", 1, 0);
+	pthread_mutex_unlock(&fake.lock);
+
+	//gets, cas losing with current value, cas
+	memset(&data, 0, sizeof(MemCacheData));
+	data.pszDataKey = "uk";
+	CHECK(MCACHE_OK == MCACHE_DataUpdate(&server, &data, s_UpdateAppend, buffer, 3));
+	CHECK(0 == strcmp("x+", s_FakeValue(&fake, "uk")) && 2 == data.nDataLen && buffer == data.pDataValue);
+	CHECK(3 == fake.reads);
+
+	race.remaining = 5;
+	race.value = "y";
+	CHECK(MCACHE_ERR_EXISTS == MCACHE_DataUpdate(&server, &data, s_UpdateAppend, buffer, 2));
+	CHECK(0 == strcmp("y", s_FakeValue(&fake, "uk")));
+
+	race.value = NULL;
+	CHECK(MCACHE_ERR_NOT_FOUND == MCACHE_DataUpdate(&server, &data, s_UpdateAppend, buffer, 0));
+	CHECK(NULL == s_FakeValue(&fake, "uk"));
+
+	race.command = "add uk ";
+	race.value = "z";
+	CHECK(MCACHE_ERR_NOT_STORED == MCACHE_DataUpdate(&server, &data, s_UpdateAppend, buffer, 0));
+
+	//deleted data is created by "add"
+	race.command = "cas uk ";
+	race.remaining = 1;
+	race.value = NULL;
+	CHECK(MCACHE_OK == MCACHE_DataUpdate(&server, &data, s_UpdateAppend, buffer, 1));
+	CHECK(0 == strcmp("+", s_FakeValue(&fake, "uk")));
+
+	s_FakeStop(&fake, &server);
+}
+
+#define GROUP_CALLERS	8
+
+struct groupCaller
+{
+	MemCacheServer *server;
+	pthread_barrier_t *barrier;
+	int index;
+	int status;
+	char key[16];
+	char value[16];
+	MemCacheData data;
+};
+
+/**
+ * even callers set their own key, odd ones get theirs, the last one gets a missing key.
+ */
+static void *
+s_GroupCaller(void *pArg)
+{
+	struct groupCaller *caller = (struct groupCaller *) pArg;
+
+	memset(&caller->data, 0, sizeof(MemCacheData));
+	caller->data.pszDataKey = caller->key;
+	snprintf(caller->key, sizeof(caller->key), GROUP_CALLERS - 1 == caller->index ? "gmiss" : "gk%d", caller->index);
+	snprintf(caller->value, sizeof(caller->value), "v%d", caller->index);
+
+	pthread_barrier_wait(caller->barrier);
+
+	if (0 == caller->index % 2) {
+		caller->data.pDataValue = caller->value;
+		caller->data.nDataLen = strlen(caller->value);
+		caller->status = MCACHE_DataSet(caller->server, &caller->data);
+	}
+	else {
+		caller->status = MCACHE_DataGet(caller->server, &caller->data, 1);
+	}
+
+	return NULL;
+}
+
+/**
+ * concurrent sets and gets wait behind one slow call and are then sent by one write, each caller gets its own
+ * status and value back.
+ */
+static void
+s_TestGroup(void)
+{
+	int i = 0;
+	char value[16];
+	pthread_t threads[GROUP_CALLERS];
+	pthread_barrier_t barrier;
+	struct groupCaller callers[GROUP_CALLERS];
+	struct fakeServer fake;
+	MemCacheServer server;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	pthread_mutex_lock(&fake.lock);
+	for (i = 1; i < GROUP_CALLERS - 1; i += 2) {
+		snprintf(value, sizeof(value), "w%d", i);
+		snprintf(callers[i].key, sizeof(callers[i].key), "gk%d", i);
+		s_FakeStore(&fake, callers[i].key, value, strlen(value), i);
+	}
+	pthread_mutex_unlock(&fake.lock);
+
+	fake.delay = 100000;
+	CHECK(MCACHE_OK == MCACHE_ServerGroupEnable(&server, 0));
+	pthread_barrier_init(&barrier, NULL, GROUP_CALLERS);
+
+	for (i = 0; i < GROUP_CALLERS; i++) {
+		callers[i].server = &server;
+		callers[i].barrier = &barrier;
+		callers[i].index = i;
+		pthread_create(threads + i, NULL, s_GroupCaller, callers + i);
+	}
+
+	for (i = 0; i < GROUP_CALLERS; i++)
+		pthread_join(threads[i], NULL);
+
+	//the first caller is sent alone, the rest queue up behind it
+	CHECK(GROUP_CALLERS == fake.commands && 2 == fake.reads);
+
+	for (i = 0; i < GROUP_CALLERS; i++) {
+		snprintf(value, sizeof(value), "%c%d", 0 == i % 2 ? 'v' : 'w', i);
+
+		if (GROUP_CALLERS - 1 == i) {
+			CHECK(MCACHE_ERR_PARTIAL == callers[i].status && NULL == callers[i].data.pDataValue);
+		}
+		else if (0 == i % 2) {
+			CHECK(MCACHE_OK == callers[i].status && 0 == strcmp(value, s_FakeValue(&fake, callers[i].key)));
+		}
+		else {
+			CHECK(MCACHE_OK == callers[i].status && (size_t) i == callers[i].data.nFlags);
+			CHECK(strlen(value) == callers[i].data.nDataLen && 0 == strcmp(value, callers[i].data.pDataValue));
+			MCACHE_DataFree(&callers[i].data);
+		}
+	}
+
+	pthread_barrier_destroy(&barrier);
+	s_FakeStop(&fake, &server);
+}
+
+static int
+s_WriterPut(MemCacheWriter *pstWriter, const char *pszKey, const char *pszValue)
+{
+	MemCacheData data;
+
+	memset(&data, 0, sizeof(MemCacheData));
+	data.pszDataKey = (char *) pszKey;
+	data.pDataValue = (void *) pszValue;
+	data.nDataLen = strlen(pszValue);
+
+	return MCACHE_WriterSet(pstWriter, &data);
+}
+
+static int64_t
+s_NowMSec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *
+s_GateOpenLater(void *pArg)
+{
+	usleep(200000);
+
+	return s_GateOpen(pArg);
+}
+
+/**
+ * writes of one key queued while flusher lingers are sent once with the last value.
+ */
+static void
+s_TestWriterCoalesce(void)
+{
+	size_t dropped = 1;
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCacheWriter *writer = NULL;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	CHECK(MCACHE_OK == MCACHE_WriterCreate(&writer, &server, 16, 200, 0));
+	if (NULL != writer) {
+		CHECK(MCACHE_OK == s_WriterPut(writer, "wk", "1"));
+		CHECK(MCACHE_OK == s_WriterPut(writer, "wk", "2"));
+		CHECK(MCACHE_OK == s_WriterPut(writer, "wj", "1"));
+		CHECK(MCACHE_OK == s_WriterPut(writer, "wk", "3"));
+		CHECK(MCACHE_OK == MCACHE_WriterFlush(writer, &dropped) && 0 == dropped);
+		CHECK(2 == fake.commands && 0 == strcmp("3", s_FakeValue(&fake, "wk")));
+		CHECK(MCACHE_OK == MCACHE_WriterDestroy(writer));
+	}
+
+	s_FakeStop(&fake, &server);
+}
+
+/**
+ * full queue drops its oldest item with MCACHE_WRITER_DROP_OLDEST, otherwise writers wait for flusher up to
+ * nTimeout of server.
+ */
+static void
+s_TestWriterFull(int nFlag)
+{
+	int64_t begin = 0;
+	size_t dropped = 0;
+	pthread_t opener;
+	struct fakeGate gate;
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCacheWriter *writer = NULL;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	//flusher is held on "d0" by fake server, its read is armed with timeout of 5 seconds
+	s_GateInit(&gate, "set d0 ");
+	fake.hook = s_GateHook;
+	fake.arg = &gate;
+	server.nTimeout = 5;
+
+	CHECK(MCACHE_OK == MCACHE_WriterCreate(&writer, &server, 2, 0, nFlag));
+	if (NULL == writer) {
+		s_GateOpen(&gate);
+		s_FakeStop(&fake, &server);
+		s_GateDestroy(&gate);
+		return;
+	}
+
+	CHECK(MCACHE_OK == s_WriterPut(writer, "d0", "0"));
+	s_GateWait(&gate);
+	CHECK(MCACHE_OK == s_WriterPut(writer, "da", "a"));
+	CHECK(MCACHE_OK == s_WriterPut(writer, "db", "b"));
+
+	if (MCACHE_WRITER_DROP_OLDEST == nFlag) {
+		CHECK(MCACHE_OK == s_WriterPut(writer, "dc", "c"));
+		s_GateOpen(&gate);
+	}
+	else {
+		//writer waits only 1 second for space
+		server.nTimeout = 1;
+		begin = s_NowMSec();
+		CHECK(MCACHE_ERR_TIMEOUT == s_WriterPut(writer, "dc", "c"));
+		CHECK(900 <= s_NowMSec() - begin);
+
+		//space made by flusher wakes waiting writer
+		pthread_create(&opener, NULL, s_GateOpenLater, &gate);
+		begin = s_NowMSec();
+		CHECK(MCACHE_OK == s_WriterPut(writer, "dd", "d"));
+		CHECK(150 <= s_NowMSec() - begin);
+		pthread_join(opener, NULL);
+	}
+
+	CHECK(MCACHE_OK == MCACHE_WriterFlush(writer, &dropped));
+	CHECK((MCACHE_WRITER_DROP_OLDEST == nFlag ? 1 : 0) == dropped);
+	CHECK(NULL != s_FakeValue(&fake, "d0") && NULL != s_FakeValue(&fake, "db"));
+
+	if (MCACHE_WRITER_DROP_OLDEST == nFlag)
+		CHECK(NULL == s_FakeValue(&fake, "da") && NULL != s_FakeValue(&fake, "dc"));
+	else
+		CHECK(NULL != s_FakeValue(&fake, "da") && NULL == s_FakeValue(&fake, "dc") && NULL != s_FakeValue(&fake, "dd"));
+
+	CHECK(MCACHE_OK == MCACHE_WriterDestroy(writer));
+	s_FakeStop(&fake, &server);
+	s_GateDestroy(&gate);
+}
+
+static void *
+s_WriterWaiter(void *pArg)
+{
+	void **args = (void **) pArg;
+
+	args[2] = (void *) (intptr_t) s_WriterPut((MemCacheWriter *) args[0], "dx", (const char *) args[1]);
+
+	return NULL;
+}
+
+/**
+ * writers of one key waiting for space queue it once, whoever gets lock later replaces the earlier one.
+ */
+static void
+s_TestWriterRace(void)
+{
+	int i = 0;
+	size_t dropped = 1;
+	const char *value = NULL;
+	void *args[2][3];
+	pthread_t threads[2];
+	struct fakeGate gate;
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCacheWriter *writer = NULL;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	s_GateInit(&gate, "set d0 ");
+	fake.hook = s_GateHook;
+	fake.arg = &gate;
+	server.nTimeout = 5;
+
+	CHECK(MCACHE_OK == MCACHE_WriterCreate(&writer, &server, 4, 100, 0));
+	if (NULL == writer) {
+		s_GateOpen(&gate);
+		s_FakeStop(&fake, &server);
+		s_GateDestroy(&gate);
+		return;
+	}
+
+	//"d0" is sent alone once linger is over and held, then queue is filled
+	CHECK(MCACHE_OK == s_WriterPut(writer, "d0", "0"));
+	s_GateWait(&gate);
+	CHECK(MCACHE_OK == s_WriterPut(writer, "da", "a"));
+	CHECK(MCACHE_OK == s_WriterPut(writer, "db", "b"));
+	CHECK(MCACHE_OK == s_WriterPut(writer, "dc", "c"));
+	CHECK(MCACHE_OK == s_WriterPut(writer, "dd", "d"));
+
+	for (i = 0; i < 2; i++) {
+		args[i][0] = writer;
+		args[i][1] = 0 == i ? "1" : "2";
+		args[i][2] = (void *) (intptr_t) MCACHE_ERR_NET;
+		pthread_create(threads + i, NULL, s_WriterWaiter, args[i]);
+	}
+
+	usleep(100000);
+	s_GateOpen(&gate);
+
+	for (i = 0; i < 2; i++) {
+		pthread_join(threads[i], NULL);
+		CHECK(MCACHE_OK == (intptr_t) args[i][2]);
+	}
+
+	CHECK(MCACHE_OK == MCACHE_WriterFlush(writer, &dropped) && 0 == dropped);
+	CHECK(6 == fake.commands && 0 == fake.repeats);
+	CHECK(NULL != (value = s_FakeValue(&fake, "dx")) && (0 == strcmp("1", value) || 0 == strcmp("2", value)));
+
+	CHECK(MCACHE_OK == MCACHE_WriterDestroy(writer));
+	s_FakeStop(&fake, &server);
+	s_GateDestroy(&gate);
+}
+
+/**
+ * fake server hook closing connection on command starting with pArg.
+ */
+static int
+s_CloseHook(struct fakeServer *pstFake, const char *pszLine, void *pArg)
+{
+	(void) pstFake;
+
+	return 0 == strncmp((const char *) pArg, pszLine, strlen((const char *) pArg));
+}
+
+/**
+ * replica failing to acknowledge a write (MCACHE_ACK_ONE) or a get hands it to the next one and is marked down,
+ * unreachable replica fails a write of MCACHE_ACK_ALL even though others store it.
+ */
+static void
+s_TestReplicaFailover(void)
+{
+	size_t i = 0;
+	struct fakeServer fakes[2];
+	MemCacheServer servers[2];
+	MemCacheServer *list[2] = { servers, servers + 1 };
+	MemCacheReplicaSet set;
+	MemCacheData data;
+
+	memset(&data, 0, sizeof(MemCacheData));
+	data.pszDataKey = "rk";
+	data.pDataValue = "v2";
+	data.nDataLen = 2;
+
+	//first replica drops connection instead of acknowledging
+	if (MCACHE_OK != s_FakeReplicas(fakes, servers, 2, "rk"))
+		return;
+
+	fakes[0].hook = s_CloseHook;
+	fakes[0].arg = "set ";
+	CHECK(MCACHE_OK == MCACHE_ReplicaInit(&set, list, 2, MCACHE_ACK_ONE));
+	set.nSelect = MCACHE_SELECT_LEAST;
+	CHECK(MCACHE_OK == MCACHE_ReplicaDataSet(&set, &data));
+	CHECK(0 > servers[0].nSockFD && 0 < set.anDownUntil[0]);
+	CHECK(s_ServerHolds(servers + 1, "rk", "v2"));
+
+	//replica marked down is skipped by gets until its retry time
+	data.pDataValue = NULL;
+	CHECK(MCACHE_OK == MCACHE_ReplicaDataGet(&set, &data, 1));
+	CHECK(2 == data.nDataLen && 0 == memcmp("v2", data.pDataValue, 2));
+	MCACHE_DataFree(&data);
+
+	for (i = 0; i < 2; i++)
+		s_FakeStop(fakes + i, servers + i);
+
+	//get fails over to next replica
+	if (MCACHE_OK != s_FakeReplicas(fakes, servers, 2, "rk"))
+		return;
+
+	pthread_mutex_lock(&fakes[1].lock);
+	s_FakeStore(fakes + 1, "rk", "v3", 2, 0);
+	pthread_mutex_unlock(&fakes[1].lock);
+
+	fakes[0].hook = s_CloseHook;
+	fakes[0].arg = "get ";
+	CHECK(MCACHE_OK == MCACHE_ReplicaInit(&set, list, 2, MCACHE_ACK_ONE));
+	set.nSelect = MCACHE_SELECT_LEAST;
+	CHECK(MCACHE_OK == MCACHE_ReplicaDataGet(&set, &data, 1));
+	CHECK(2 == data.nDataLen && 0 == memcmp("v3", data.pDataValue, 2));
+	CHECK(0 > servers[0].nSockFD && 0 < set.anDownUntil[0]);
+	MCACHE_DataFree(&data);
+
+	for (i = 0; i < 2; i++)
+		s_FakeStop(fakes + i, servers + i);
+
+	//second replica is unreachable, it cannot reconnect to 127.0.0.1:1
+	if (MCACHE_OK != s_FakeReplicas(fakes, servers, 2, "rk"))
+		return;
+
+	MCACHE_ServerDisconnect(servers + 1);
+	CHECK(MCACHE_OK == MCACHE_ReplicaInit(&set, list, 2, MCACHE_ACK_ALL));
+	data.pDataValue = "v2";
+	data.nDataLen = 2;
+	CHECK(MCACHE_ERR_NET == MCACHE_ReplicaDataSet(&set, &data));
+	CHECK(0 < set.anDownUntil[1] && 0 == set.anDownUntil[0]);
+	CHECK(s_ServerHolds(servers, "rk", "v2"));
+
+	//one usable replica is enough for MCACHE_ACK_ONE
+	set.nAck = MCACHE_ACK_ONE;
+	CHECK(MCACHE_OK == MCACHE_ReplicaDataDelete(&set, &data));
+	CHECK(NULL == s_FakeValue(fakes, "rk"));
+
+	for (i = 0; i < 2; i++)
+		s_FakeStop(fakes + i, servers + i);
+}
+
+/**
+ * fake server hook clearing negative cache of server in pArg while "get ne" is in flight.
+ */
+static int
+s_NegativeReset(struct fakeServer *pstFake, const char *pszLine, void *pArg)
+{
+	(void) pstFake;
+
+	if (0 == strcmp("get ne", pszLine))
+		MCACHE_ServerNegativeEnable((MemCacheServer *) pArg, 100, 500);
+
+	return 0;
+}
+
+/**
+ * get of missing key answered as miss and how many commands server has served since.
+ */
+static int
+s_NegativeMiss(MemCacheServer *pstServer, struct fakeServer *pstFake, const char *pszKey)
+{
+	int commands = pstFake->commands;
+	MemCacheData data;
+
+	memset(&data, 0, sizeof(MemCacheData));
+	data.pszDataKey = (char *) pszKey;
+
+	if (MCACHE_ERR_PARTIAL != MCACHE_DataGet(pstServer, &data, 1) || NULL != data.pDataValue) {
+		MCACHE_DataFree(&data);
+		return -1;
+	}
+
+	return pstFake->commands - commands;
+}
+
+/**
+ * misses are answered locally within TTL, stores of this client through single, bulk and replica commands forget
+ * them, and a miss whose get overlaps clearing of cache is not remembered.
+ */
+static void
+s_TestNegative(void)
+{
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCacheServer *list[1] = { &server };
+	MemCacheReplicaSet set;
+	MemCacheData data[2];
+	int status[2];
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	fake.hook = s_NegativeReset;
+	fake.arg = &server;
+	CHECK(MCACHE_OK == MCACHE_ServerNegativeEnable(&server, 100, 500));
+	CHECK(1 == s_NegativeMiss(&server, &fake, "nk"));
+	CHECK(0 == s_NegativeMiss(&server, &fake, "nk"));
+
+	memset(data, 0, sizeof(data));
+	data[0].pszDataKey = "nk";
+	data[0].pDataValue = "v";
+	data[0].nDataLen = 1;
+	CHECK(MCACHE_OK == MCACHE_DataSet(&server, data));
+	CHECK(s_ServerHolds(&server, "nk", "v"));
+
+	//bulk store
+	CHECK(1 == s_NegativeMiss(&server, &fake, "nm"));
+	data[1] = data[0];
+	data[1].pszDataKey = "nm";
+	CHECK(MCACHE_OK == MCACHE_DataSetMulti(&server, data, 2, status));
+	CHECK(s_ServerHolds(&server, "nm", "v"));
+
+	//replica store
+	CHECK(1 == s_NegativeMiss(&server, &fake, "nr"));
+	CHECK(MCACHE_OK == MCACHE_ReplicaInit(&set, list, 1, MCACHE_ACK_ONE));
+	data[0].pszDataKey = "nr";
+	CHECK(MCACHE_OK == MCACHE_ReplicaDataSet(&set, data));
+	CHECK(s_ServerHolds(&server, "nr", "v"));
+
+	//miss is asked again once TTL is over
+	CHECK(1 == s_NegativeMiss(&server, &fake, "nk2"));
+	usleep(600000);
+	CHECK(1 == s_NegativeMiss(&server, &fake, "nk2"));
+
+	//cache cleared while get is in flight
+	CHECK(1 == s_NegativeMiss(&server, &fake, "ne"));
+	CHECK(1 == s_NegativeMiss(&server, &fake, "ne"));
+
+	s_FakeStop(&fake, &server);
+}
+
+/**
+ * get of one key through hot key tracker, copies value into pszValue ("" for miss) and returns how many commands
+ * server has served since.
+ */
+static int
+s_HotGet(MemCacheHotKey *pstHotKey, MemCacheServer *pstServer, struct fakeServer *pstFake, const char *pszKey,
+	char *pszValue)
+{
+	int ret = 0;
+	int commands = pstFake->commands;
+	MemCacheData data;
+
+	memset(&data, 0, sizeof(MemCacheData));
+	data.pszDataKey = (char *) pszKey;
+	pszValue[0] = '\0';
+
+	ret = MCACHE_HotKeyGet(pstHotKey, pstServer, &data, 1);
+
+	if (MCACHE_OK == ret && NULL != data.pDataValue && 16 > data.nDataLen) {
+		memcpy(pszValue, data.pDataValue, data.nDataLen);
+		pszValue[data.nDataLen] = '\0';
+	}
+	else if (MCACHE_ERR_PARTIAL != ret) {
+		MCACHE_DataFree(&data);
+		return -1;
+	}
+
+	MCACHE_DataFree(&data);
+
+	return pstFake->commands - commands;
+}
+
+/**
+ * sketch evicts least counted key and charges its count to newcomer, counts decay per second, and data of hot
+ * keys is served from pinned copy until invalidated.
+ */
+static void
+s_TestHotKey(void)
+{
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCacheHotKey *hot = NULL;
+	char key[16];
+	char value[16];
+	int i = 0;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	//eviction
+	CHECK(MCACHE_OK == MCACHE_HotKeyCreate(&hot, 2, 3, 0));
+	for (i = 0; i < 3; i++)
+		s_HotGet(hot, &server, &fake, "ha", value);
+	s_HotGet(hot, &server, &fake, "hb", value);
+	CHECK(MCACHE_HotKeyIsHot(hot, "ha") && !MCACHE_HotKeyIsHot(hot, "hb"));
+
+	//hc takes slot of hb with count 2 and error 1
+	s_HotGet(hot, &server, &fake, "hc", value);
+	CHECK(!MCACHE_HotKeyIsHot(hot, "hc"));
+	s_HotGet(hot, &server, &fake, "hc", value);
+	s_HotGet(hot, &server, &fake, "hc", value);
+	CHECK(MCACHE_HotKeyIsHot(hot, "hc"));
+
+	//ha is least counted now, hb comes back with error 3
+	s_HotGet(hot, &server, &fake, "hb", value);
+	CHECK(!MCACHE_HotKeyIsHot(hot, "ha") && !MCACHE_HotKeyIsHot(hot, "hb") && MCACHE_HotKeyIsHot(hot, "hc"));
+	MCACHE_HotKeyDestroy(hot);
+
+	//hot key survives a stream of keys passing through, which keeps evicting from index
+	CHECK(MCACHE_OK == MCACHE_HotKeyCreate(&hot, 8, 10, 0));
+	for (i = 0; i < 20; i++)
+		s_HotGet(hot, &server, &fake, "hh", value);
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "hs%d", i);
+		s_HotGet(hot, &server, &fake, key, value);
+	}
+	CHECK(MCACHE_HotKeyIsHot(hot, "hh") && !MCACHE_HotKeyIsHot(hot, "hs99") && !MCACHE_HotKeyIsHot(hot, "hs0"));
+
+	//decay
+	usleep(1100000);
+	s_HotGet(hot, &server, &fake, "hs0", value);
+	CHECK(!MCACHE_HotKeyIsHot(hot, "hh"));
+	MCACHE_HotKeyDestroy(hot);
+
+	//pinned copy
+	pthread_mutex_lock(&fake.lock);
+	s_FakeStore(&fake, "hp", "p1", 2, 0);
+	pthread_mutex_unlock(&fake.lock);
+
+	CHECK(MCACHE_OK == MCACHE_HotKeyCreate(&hot, 4, 2, 5000));
+	CHECK(1 == s_HotGet(hot, &server, &fake, "hp", value) && 0 == strcmp("p1", value));
+	CHECK(1 == s_HotGet(hot, &server, &fake, "hp", value) && 0 == strcmp("p1", value));
+	CHECK(0 == s_HotGet(hot, &server, &fake, "hp", value) && 0 == strcmp("p1", value));
+
+	pthread_mutex_lock(&fake.lock);
+	s_FakeStore(&fake, "hp", "p2", 2, 0);
+	pthread_mutex_unlock(&fake.lock);
+
+	CHECK(0 == s_HotGet(hot, &server, &fake, "hp", value) && 0 == strcmp("p1", value));
+	CHECK(MCACHE_OK == MCACHE_HotKeyInvalidate(hot, "hp"));
+	CHECK(1 == s_HotGet(hot, &server, &fake, "hp", value) && 0 == strcmp("p2", value));
+	CHECK(0 == s_HotGet(hot, &server, &fake, "hp", value) && 0 == strcmp("p2", value));
+	MCACHE_HotKeyDestroy(hot);
+
+	s_FakeStop(&fake, &server);
+}
+
+/**
+ * prepared commands split by nBatchKeys fetch values into list positions of keys given to prepare, also after
+ * caller freed or shortened those keys, and gets commands fetch CAS unique.
+ */
+static void
+s_TestPrepared(void)
+{
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCachePrepared *prepared = NULL;
+	MemCacheData data[5];
+	char *keys[5] = { NULL };
+	const char *names[5] = { "prepared_a", "prepared_bb", "bad key", "prepared_none", "prepared_cccc" };
+	size_t i = 0;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	pthread_mutex_lock(&fake.lock);
+	s_FakeStore(&fake, "prepared_a", "1", 1, 0);
+	s_FakeStore(&fake, "prepared_bb", "22", 2, 0);
+	s_FakeStore(&fake, "prepared_cccc", "4444", 4, 0);
+	pthread_mutex_unlock(&fake.lock);
+
+	server.nBatchKeys = 2;
+	memset(data, 0, sizeof(data));
+
+	for (i = 0; i < 5; i++)
+		data[i].pszDataKey = keys[i] = strdup(names[i]);
+
+	CHECK(MCACHE_OK == MCACHE_DataPrepareGet(&prepared, &server, data, 5));
+
+	//keys are reused for something shorter
+	for (i = 0; i < 5; i++) {
+		free(keys[i]);
+		data[i].pszDataKey = keys[i] = strdup("p");
+	}
+
+	CHECK(MCACHE_ERR_PARTIAL == MCACHE_DataGetPrepared(&server, prepared, data, 5));
+	CHECK(NULL != data[0].pDataValue && 1 == data[0].nDataLen && 0 == memcmp("1", data[0].pDataValue, 1));
+	CHECK(NULL != data[1].pDataValue && 2 == data[1].nDataLen && 0 == memcmp("22", data[1].pDataValue, 2));
+	CHECK(NULL == data[2].pDataValue && NULL == data[3].pDataValue);
+	CHECK(NULL != data[4].pDataValue && 4 == data[4].nDataLen && 0 == memcmp("4444", data[4].pDataValue, 4));
+	CHECK(2 == fake.commands);
+
+	for (i = 0; i < 5; i++)
+		MCACHE_DataFree(data + i);
+	CHECK(MCACHE_OK == MCACHE_PreparedFree(prepared));
+
+	//gets
+	for (i = 0; i < 5; i++) {
+		free(keys[i]);
+		data[i].pszDataKey = keys[i] = strdup(names[i]);
+	}
+
+	CHECK(MCACHE_OK == MCACHE_DataPrepareGets(&prepared, &server, data + 4, 1));
+	CHECK(MCACHE_OK == MCACHE_DataGetPrepared(&server, prepared, data + 4, 1));
+	CHECK(NULL != data[4].pDataValue && 0 < data[4].nCASUnique);
+	MCACHE_DataFree(data + 4);
+	CHECK(MCACHE_OK == MCACHE_PreparedFree(prepared));
+
+	for (i = 0; i < 5; i++)
+		free(keys[i]);
+
+	s_FakeStop(&fake, &server);
+}
+
+/**
+ * list of more keys than one command holds is split by nBatchKeys, and values are merged into list in place.
+ * error reply with later commands in flight closes connection, their replies would be taken for those of next
+ * request.
+ */
+static void
+s_TestMultiGet(void)
+{
+	struct fakeServer fake;
+	MemCacheServer server;
+	MemCacheData *data = NULL;
+	char (*keys)[16] = NULL;
+	char value[16];
+	int fetched = 1;
+	size_t i = 0;
+	size_t count = MCACHE_MULTIGET_MAX + 500;
+
+	if (MCACHE_OK != s_FakeStart(&fake, &server))
+		return;
+
+	data = (MemCacheData *) calloc(count, sizeof(MemCacheData));
+	keys = (char (*)[16]) calloc(count, sizeof(*keys));
+
+	pthread_mutex_lock(&fake.lock);
+	for (i = 0; i < count; i++) {
+		snprintf(keys[i], sizeof(keys[i]), "mg%zu", i);
+		data[i].pszDataKey = keys[i];
+
+		if (0 == i % 2) {
+			snprintf(value, sizeof(value), "v%zu", i);
+			s_FakeStore(&fake, keys[i], value, strlen(value), i);
+		}
+	}
+	pthread_mutex_unlock(&fake.lock);
+
+	server.nBatchKeys = 100;
+	CHECK(MCACHE_ERR_PARTIAL == MCACHE_DataGet(&server, data, count));
+	CHECK((int) (count / 100) == fake.commands);
+
+	for (i = 0; i < count; i++) {
+		snprintf(value, sizeof(value), "v%zu", i);
+
+		if (0 == i % 2)
+			fetched &= NULL != data[i].pDataValue && strlen(value) == data[i].nDataLen && i == data[i].nFlags &&
+				0 == memcmp(value, data[i].pDataValue, data[i].nDataLen);
+		else
+			fetched &= NULL == data[i].pDataValue;
+
+		MCACHE_DataFree(data + i);
+	}
+	CHECK(fetched);
+	CHECK(0 <= server.nSockFD);
+
+	//second command fails while third and later ones are in flight
+	fake.fail = "mg150";
+	CHECK(MCACHE_ERR_ERROR == MCACHE_DataGet(&server, data, count));
+	CHECK(0 > server.nSockFD);
+	CHECK(NULL != data[0].pDataValue && NULL == data[150].pDataValue);
+
+	for (i = 0; i < count; i++)
+		MCACHE_DataFree(data + i);
+
+	free(keys);
+	free(data);
+	s_FakeStop(&fake, &server);
+}
+
 int
 main(void)
 {
@@ -18,6 +1823,29 @@ main(void)
 	MemCacheServer server;
 	MemCacheData data;
 
+	//writes to connections closed by fake servers fail instead of killing test
+	signal(SIGPIPE, SIG_IGN);
+
+	s_TestHash();
+	s_TestPool();
+	s_TestMetricsBucket();
+	s_TestStats();
+	s_TestCounter();
+	s_TestCounterFlush();
+	s_TestReplicaHedge(MCACHE_ACK_ONE);
+	s_TestReplicaHedge(MCACHE_ACK_ALL);
+	s_TestReplicaFailover();
+	s_TestNegative();
+	s_TestHotKey();
+	s_TestPrepared();
+	s_TestMultiGet();
+	s_TestUpdate();
+	s_TestGroup();
+	s_TestWriterCoalesce();
+	s_TestWriterFull(MCACHE_WRITER_DROP_OLDEST);
+	s_TestWriterFull(0);
+	s_TestWriterRace();
+
 	memset(&server, 0, sizeof(MemCacheServer));
 	memset(&data, 0, sizeof(MemCacheData));
 
@@ -113,5 +1941,7 @@ main(void)
 
 
 end:
-	exit(0);
+	printf("%d check(s) failed\n", s_failed);
+
+	exit(0 < s_failed ? 1 : 0);
 }
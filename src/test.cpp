@@ -0,0 +1,185 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "memcacheclient/memcacheclient.hpp"
+
+struct Point
+{
+	int x;
+	int y;
+};
+
+struct Size
+{
+	int width;
+	int height;
+};
+
+struct Name
+{
+	std::string text;
+};
+
+namespace mcache {
+
+template <>
+struct TypeTag<Point>
+{
+	static constexpr uint16_t kType = 1;
+	static constexpr uint8_t kVersion = 1;
+};
+
+template <>
+struct TypeTag<Size>
+{
+	static constexpr uint16_t kType = 2;
+	static constexpr uint8_t kVersion = 1;
+};
+
+template <>
+struct TypeTag<Name>
+{
+	static constexpr uint16_t kType = 3;
+	static constexpr uint8_t kVersion = 1;
+};
+
+template <>
+struct Codec<Name>
+{
+	static constexpr bool kRaw = false;
+
+	static size_t Size(const Name &value) noexcept { return value.text.size(); }
+	static void Encode(const Name &value, char *pBuffer) noexcept { memcpy(pBuffer, value.text.data(), value.text.size()); }
+
+	static bool Decode(const char *pData, size_t nSize, Name &value)
+	{
+		value.text.assign(pData, nSize);
+
+		return true;
+	}
+};
+
+}
+
+static_assert(mcache::TypedCache<Point>::kFlags != mcache::TypedCache<Size>::kFlags, "types of one size share tag");
+static_assert(mcache::TypedCache<bool>::kFlags != mcache::TypedCache<unsigned char>::kFlags, "bool is tagged as byte");
+static_assert(mcache::TypedCache<int32_t>::kFlags != mcache::TypedCache<uint32_t>::kFlags, "signedness is not tagged");
+static_assert(mcache::TypedCache<int32_t>::kFlags != mcache::TypedCache<float>::kFlags, "float is tagged as int");
+static_assert(sizeof(long) != sizeof(long long) ||
+	mcache::TypedCache<long>::kFlags == mcache::TypedCache<long long>::kFlags, "integers of one size differ");
+
+static int s_failed = 0;
+
+#define CHECK(expr)	s_Check((expr), #expr, __LINE__)
+
+static void
+s_Check(bool bResult, const char *pszExpr, int nLine)
+{
+	if (!bResult) {
+		printf("FAIL (line %d): %s\n", nLine, pszExpr);
+		s_failed++;
+	}
+}
+
+/**
+ * wrappers refuse work without connection and hold nothing when empty.
+ */
+static void
+s_TestClosed(void)
+{
+	mcache::Connection conn;
+	mcache::Value value;
+	mcache::MultiResult result;
+	mcache::TypedCache<Point> points(conn);
+	Point point = { 0, 0 };
+	std::vector<int> ints = { 1, 2, 3 };
+
+	CHECK(!conn.IsOpen());
+	CHECK(MCACHE_ERR_INVAL == conn.Get("key", value) && !value);
+	CHECK(MCACHE_ERR_INVAL == conn.Set("key", "value"));
+	CHECK(MCACHE_ERR_INVAL == points.Get("key", point));
+	CHECK(0 == result.size() && 0 == result.Found());
+
+	CHECK(3 * sizeof(int) == mcache::Bytes(ints).size());
+	CHECK("abc" == std::string_view(mcache::Bytes(std::string("abc"))));
+}
+
+/**
+ * values, multigets, typed values and statistics through server.
+ */
+static void
+s_TestServer(mcache::Connection &conn)
+{
+	int status[3];
+	uint64_t num = 0;
+	Point points[3] = {};
+	Point point = { 0, 0 };
+	Size size = { 0, 0 };
+	Name name;
+	mcache::Value value;
+	mcache::MultiResult result;
+	mcache::StatList stats;
+	mcache::TypedCache<Point> point_cache(conn);
+	mcache::TypedCache<Size> size_cache(conn);
+	mcache::TypedCache<Name> name_cache(conn);
+	mcache::TypedCache<uint64_t> num_cache(conn);
+	std::vector<std::string> keys = { "hpp_p1", "hpp_none", "hpp_p2" };
+
+	CHECK(MCACHE_OK == conn.Set("hpp_key", "hello", 7));
+	CHECK(MCACHE_OK == conn.Gets("hpp_key", value));
+	CHECK("hello" == value.view() && 7 == value.flags() && 0 < value.cas());
+
+	mcache::Value moved = std::move(value);
+	CHECK(!value && moved);
+
+	conn.Delete("hpp_none");
+	CHECK(MCACHE_ERR_PARTIAL == conn.Get("hpp_none", value) && !value);
+
+	CHECK(MCACHE_OK == point_cache.Set("hpp_p1", Point{ 1, 2 }));
+	CHECK(MCACHE_OK == point_cache.Set("hpp_p2", Point{ 3, 4 }));
+	CHECK(MCACHE_OK == point_cache.Get("hpp_p1", point) && 1 == point.x && 2 == point.y);
+
+	//types of one size are told apart by their tags
+	CHECK(MCACHE_ERR_DATA == size_cache.Get("hpp_p1", size));
+	CHECK(MCACHE_ERR_DATA == point_cache.Get("hpp_key", point));
+
+	CHECK(MCACHE_ERR_PARTIAL == point_cache.Get(keys.begin(), keys.end(), points, status));
+	CHECK(MCACHE_OK == status[0] && MCACHE_ERR_NOT_FOUND == status[1] && MCACHE_OK == status[2]);
+	CHECK(3 == points[2].x && 4 == points[2].y);
+
+	CHECK(MCACHE_OK == name_cache.Set("hpp_name", Name{ std::string(1000, 'n') }));
+	CHECK(MCACHE_OK == name_cache.Get("hpp_name", name) && 1000 == name.text.size());
+
+	CHECK(MCACHE_OK == num_cache.Set("hpp_num", 42));
+	CHECK(MCACHE_OK == num_cache.Get("hpp_num", num) && 42 == num);
+
+	CHECK(MCACHE_ERR_PARTIAL == conn.Get(keys.begin(), keys.end(), result));
+	CHECK(3 == result.size() && 2 == result.Found() && !result[1].found);
+	CHECK(result.Find("hpp_p2").found && sizeof(Point) == result.Find("hpp_p2").value.size());
+
+	CHECK(MCACHE_OK == conn.Set("hpp_count", "5"));
+	CHECK(MCACHE_OK == conn.Increment("hpp_count", 3, &num) && 8 == num);
+	CHECK(MCACHE_OK == conn.Delete("hpp_count"));
+	CHECK(MCACHE_ERR_NOT_FOUND == conn.Delete("hpp_count"));
+
+	CHECK(MCACHE_OK == conn.ServerStats(stats) && 0 < stats.size());
+	CHECK(!stats.Find("version").empty());
+}
+
+int
+main(void)
+{
+	mcache::Connection conn;
+
+	s_TestClosed();
+
+	if (MCACHE_OK == conn.Open("127.0.0.1", 11211, 2))
+		s_TestServer(conn);
+	else
+		printf("no server on 127.0.0.1:11211, server tests skipped\n");
+
+	printf("%d check(s) failed\n", s_failed);
+
+	return 0 < s_failed ? 1 : 0;
+}